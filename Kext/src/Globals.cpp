@@ -1,8 +1,12 @@
 #include "Globals.h"
 
 static PandoraRuntimeState g_runtime_state = {};
+static KernelUtilities g_kernel_utilities;
 
 PandoraRuntimeState &pandora_runtime_state() {
   return g_runtime_state;
 }
 
+KernelUtilities &pandora_kernel_utilities() {
+  return g_kernel_utilities;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Utils/KernelUtilities.h"
 #include "Utils/TimeUtilities.h"
 
 #include <stdint.h>
@@ -16,6 +17,8 @@ struct PandoraTelemetryState {
 
   bool pid1Exists = false;
   bool workloopSawZero = false;
+
+  uint64_t kernelBaseScanNanos = 0;
 };
 
 struct PandoraDebugState {
@@ -31,3 +34,6 @@ struct PandoraRuntimeState {
 
 PandoraRuntimeState &pandora_runtime_state();
 
+// Kernel base/slide context shared by the service, every module and the kpi
+// shims, so the kernel base is located once per load.
+KernelUtilities &pandora_kernel_utilities();
@@ -7,11 +7,13 @@
 #include "../Utils/KernelUtilities.h"
 #include "../Utils/PandoraLog.h"
 #include "../Utils/TimeUtilities.h"
+#include "calypso/pattern_match.h"
 
 #include <IOKit/IOLib.h>
 #include <IOKit/IOReturn.h>
 #include <kern/task.h>
 #include <libkern/copyio.h>
+#include <ptrauth.h>
 #include <sys/proc.h>
 #include <string.h>
 
@@ -30,8 +32,262 @@ enum HwAccessMethod : uint16_t {
   kMethodPWritePid = 5,
   kMethodKCall = 7,
   kMethodRunArbFuncWithTaskArgPid = 8,
+  kMethodKReadV = 9,
+  kMethodKWriteV = 10,
+  kMethodKReadWindow = 11,
+  kMethodKReadAsync = 12,
+  kMethodKWriteAsync = 13,
+  kMethodKCallAsync = 14,
+  kMethodWalkList = 15,
+  kMethodSearchPattern = 16,
+  kMethodAccessPathStats = 17,
+  kMethodProcOpen = 18,
+  kMethodProcClose = 19,
+  kMethodProcRead = 20,
+  kMethodProcWrite = 21,
+  kMethodPReadV = 22,
+  kMethodKCallBatch = 23,
+  kMethodQueryRun = 24,
+  kMethodHashRanges = 25,
+  kMethodKAtomic = 26,
+  kMethodKMemmove = 27,
+  kMethodKMemset = 28,
+  kMethodPhysRead = 29,
+  kMethodPhysInfo = 30,
+  kMethodVToPBatch = 31,
+  kMethodTranslationRegs = 32,
+  kMethodPhysRanges = 33,
 };
 
+// Copies the structure input into a fresh IOMalloc'd buffer. Inputs larger
+// than the inband limit arrive as a memory descriptor instead of a pointer.
+IOReturn copyStructureInput(IOExternalMethodArguments *args, size_t maxSize,
+                            void **out, size_t *outSize) {
+  if (!args || !out || !outSize) {
+    return kIOReturnBadArgument;
+  }
+
+  IOMemoryDescriptor *desc = args->structureInputDescriptor;
+  size_t size = desc ? static_cast<size_t>(desc->getLength())
+                     : static_cast<size_t>(args->structureInputSize);
+  if (size == 0 || size > maxSize || (!desc && !args->structureInput)) {
+    return kIOReturnBadArgument;
+  }
+
+  void *buffer = IOMalloc(size);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  if (!desc) {
+    memcpy(buffer, args->structureInput, size);
+  } else {
+    IOReturn ret = desc->prepare();
+    if (ret != kIOReturnSuccess) {
+      IOFree(buffer, size);
+      return ret;
+    }
+    IOByteCount copied = desc->readBytes(0, buffer, size);
+    desc->complete();
+    if (copied != size) {
+      IOFree(buffer, size);
+      return kIOReturnVMError;
+    }
+  }
+
+  *out = buffer;
+  *outSize = size;
+  return kIOReturnSuccess;
+}
+
+inline uint64_t stripPointer(uint64_t ptr) {
+  return reinterpret_cast<uint64_t>(
+      ptrauth_strip(reinterpret_cast<void *>(ptr), ptrauth_key_asda));
+}
+
+inline bool isKernelPointer(uint64_t ptr) {
+  return (ptr & 0xFF00000000000000ULL) == 0xFF00000000000000ULL;
+}
+
+// Memory source for in-kernel query programs. Only kernel addresses are
+// readable.
+bool queryRead(void *ctx, uint64_t addr, void *out, size_t len) {
+  (void)ctx;
+  return isKernelPointer(addr) && isKernelPointer(addr + len - 1) &&
+         KernelUtilities::kread(addr, out, len) == KUErrorSuccess;
+}
+
+// Reads every requested field of `node` into `record` (after the node
+// address). Indirect fields whose pointer is NULL are zero-filled.
+bool readWalkRecord(const PandoraWalkListRequest &req, uint64_t node,
+                    uint8_t *record) {
+  memcpy(record, &node, sizeof(node));
+  uint8_t *cursor = record + sizeof(node);
+
+  for (uint32_t i = 0; i < req.fieldCount; ++i) {
+    const PandoraWalkField &f = req.fields[i];
+    uint64_t addr = node + static_cast<int64_t>(f.offset);
+
+    if (f.flags & kPandoraWalkFieldIndirect) {
+      uint64_t ptr = 0;
+      if (KernelUtilities::kread(addr, &ptr, sizeof(ptr)) != KUErrorSuccess) {
+        return false;
+      }
+      ptr = stripPointer(ptr);
+      if (!ptr) {
+        bzero(cursor, f.size);
+        cursor += f.size;
+        continue;
+      }
+      addr = ptr + static_cast<int64_t>(f.indirectOffset);
+    }
+
+    if (KernelUtilities::kread(addr, cursor, f.size) != KUErrorSuccess) {
+      return false;
+    }
+    cursor += f.size;
+  }
+
+  return true;
+}
+
+enum HwAccessAsyncKind : uint32_t {
+  kAsyncKRead = 0,
+  kAsyncKWrite = 1,
+  kAsyncKCall = 2,
+};
+
+} // namespace
+
+struct HwAccessAsyncRequest {
+  HwAccessAsyncRequest *next;
+  PandoraUserClient *client;
+  OSAsyncReference64 reference;
+  HwAccessAsyncKind kind;
+  uint64_t kaddr;
+  size_t len;
+  void *buffer;                   // kwrite payload, copied in at submit time
+  IOMemoryDescriptor *userMemory; // kread destination, wired by the worker
+  bool userMemoryPrepared;
+  PandoraKCallRequest kcall;
+};
+
+namespace {
+
+// Counts against the client's in-flight limit until freeAsyncRequest().
+IOReturn allocAsyncRequest(PandoraUserClient *client,
+                           IOExternalMethodArguments *args,
+                           HwAccessAsyncKind kind,
+                           HwAccessAsyncRequest **out) {
+  *out = nullptr;
+  if (!client || !args || !args->asyncWakePort || !args->asyncReference) {
+    return kIOReturnBadArgument;
+  }
+
+  if (!client->reserveAsyncRequest()) {
+    return kIOReturnBusy;
+  }
+
+  auto *request =
+      static_cast<HwAccessAsyncRequest *>(IOMallocZero(sizeof(HwAccessAsyncRequest)));
+  if (!request) {
+    client->releaseAsyncRequest();
+    return kIOReturnNoMemory;
+  }
+
+  // asyncReference[0] already carries the wake port installed by IOKit.
+  bcopy(args->asyncReference, request->reference, sizeof(OSAsyncReference64));
+  request->kind = kind;
+  request->client = client;
+  client->retain();
+  *out = request;
+  return kIOReturnSuccess;
+}
+
+void freeAsyncRequest(HwAccessAsyncRequest *request) {
+  if (!request) {
+    return;
+  }
+
+  if (request->userMemory) {
+    if (request->userMemoryPrepared) {
+      request->userMemory->complete();
+    }
+    request->userMemory->release();
+  }
+  if (request->buffer) {
+    IOFree(request->buffer, request->len);
+  }
+  if (request->client) {
+    request->client->releaseAsyncRequest();
+    request->client->release();
+  }
+  IOFree(request, sizeof(HwAccessAsyncRequest));
+}
+
+void completeAsyncRequest(HwAccessAsyncRequest *request, IOReturn status,
+                          uint64_t value) {
+  io_user_reference_t result[1] = {value};
+  PandoraUserClient::sendAsyncResult64(request->reference, status, result, 1);
+  freeAsyncRequest(request);
+}
+
+void runAsyncRequest(HwAccessAsyncRequest *request) {
+  switch (request->kind) {
+  case kAsyncKRead: {
+    void *buffer = IOMalloc(request->len);
+    if (!buffer) {
+      completeAsyncRequest(request, kIOReturnNoMemory, 0);
+      return;
+    }
+
+    IOReturn status = kIOReturnSuccess;
+    KUError err = KernelUtilities::kread(request->kaddr, buffer, request->len);
+    if (err != KUErrorSuccess) {
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kread_async failed size=%zu addr=0x%llx err=%s(%d)",
+          request->len, request->kaddr, get_error_name(err), err);
+      status = kIOReturnVMError;
+    } else if (request->userMemory->prepare() != kIOReturnSuccess) {
+      // Wired only while its request runs, so queued reads pin no memory.
+      status = kIOReturnVMError;
+    } else {
+      request->userMemoryPrepared = true;
+      if (request->userMemory->writeBytes(0, buffer, request->len) !=
+          request->len) {
+        status = kIOReturnVMError;
+      }
+    }
+
+    IOFree(buffer, request->len);
+    completeAsyncRequest(request, status,
+                         status == kIOReturnSuccess ? request->len : 0);
+    return;
+  }
+  case kAsyncKWrite: {
+    KUError err =
+        KernelUtilities::kwrite(request->kaddr, request->buffer, request->len);
+    if (err != KUErrorSuccess) {
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kwrite_async failed size=%zu addr=0x%llx err=%s(%d)",
+          request->len, request->kaddr, get_error_name(err), err);
+      completeAsyncRequest(request, kIOReturnVMError, 0);
+      return;
+    }
+    completeAsyncRequest(request, kIOReturnSuccess, request->len);
+    return;
+  }
+  case kAsyncKCall: {
+    PandoraKCallResult res = pandora_kcall(
+        request->kcall.fn, request->kcall.args, request->kcall.argCount);
+    completeAsyncRequest(request, res.status, res.ret0);
+    return;
+  }
+  }
+
+  completeAsyncRequest(request, kIOReturnUnsupported, 0);
+}
+
 } // namespace
 
 const PandoraModuleDescriptor &HwAccessModule::descriptor() const {
@@ -62,6 +318,20 @@ IOReturn HwAccessModule::onStart(Pandora &service) {
     return kIOReturnError;
   }
 
+  if (!bouncePool_.init()) {
+    PANDORA_LOG_DEFAULT("hw_access: bounce pool setup failed");
+    service_ = nullptr;
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn asyncRc = startAsync();
+  if (asyncRc != kIOReturnSuccess) {
+    PANDORA_LOG_DEFAULT("hw_access: async queue setup failed: 0x%x", asyncRc);
+    bouncePool_.drain();
+    service_ = nullptr;
+    return asyncRc;
+  }
+
   active_ = true;
   PANDORA_LOG_DEFAULT("hw_access: started");
   return kIOReturnSuccess;
@@ -70,6 +340,10 @@ IOReturn HwAccessModule::onStart(Pandora &service) {
 void HwAccessModule::onStop(Pandora &service) {
   (void)service;
   active_ = false;
+  stopAsync();
+  // Selectors that raced with the stop may still hold pool buffers; keep the
+  // pool usable and only drop its cache. The lock goes in onShutdown().
+  bouncePool_.drain();
   service_ = nullptr;
   PANDORA_LOG_DEFAULT("hw_access: stopped");
 }
@@ -81,6 +355,14 @@ void HwAccessModule::onError(Pandora &service, IOReturn error) {
 
 void HwAccessModule::onShutdown() {
   active_ = false;
+  stopAsync();
+  // Selectors check asyncCall_ under the lock, so the lock outlives every
+  // stop and is only released here, like the bounce pool's.
+  if (asyncLock_) {
+    IOLockFree(asyncLock_);
+    asyncLock_ = nullptr;
+  }
+  bouncePool_.free();
   service_ = nullptr;
 }
 
@@ -124,25 +406,92 @@ bool HwAccessModule::authorizeUserClient(task_t owningTask, void *securityID,
 
 void HwAccessModule::registerUserClientMethods(
     PandoraUserClientMethodRegistrar &registrar) {
+  // The trailing argument names the scalar that carries the transfer length,
+  // for the per-selector byte counters.
   (void)registrar.addMethod(kMethodKRead, &HwAccessModule::methodKRead, 3, 0, 0,
-                            0);
+                            0, 2);
   (void)registrar.addMethod(kMethodKWrite, &HwAccessModule::methodKWrite, 3, 0,
-                            0, 0);
+                            0, 0, 2);
   (void)registrar.addMethod(kMethodGetKernelBase,
                             &HwAccessModule::methodGetKernelBase, 0, 0, 1, 0);
   (void)registrar.addMethod(kMethodGetPandoraLoadMetadata,
                             &HwAccessModule::methodGetPandoraLoadMetadata, 0, 0,
                             0, sizeof(PandoraMetadata));
   (void)registrar.addMethod(kMethodPReadPid, &HwAccessModule::methodPReadPid, 4,
-                            0, 0, 0);
+                            0, 0, 0, 3);
   (void)registrar.addMethod(kMethodPWritePid, &HwAccessModule::methodPWritePid,
-                            4, 0, 0, 0);
+                            4, 0, 0, 0, 3);
   (void)registrar.addMethod(kMethodKCall, &HwAccessModule::methodKCall, 0,
-                            sizeof(PandoraKCallRequest), 0,
+                            kIOUCVariableStructureSize, 0,
                             sizeof(PandoraKCallResponse));
   (void)registrar.addMethod(kMethodRunArbFuncWithTaskArgPid,
                             &HwAccessModule::methodRunArbFuncWithTaskArgPid, 2,
                             0, 1, 0);
+  (void)registrar.addMethod(kMethodKReadV, &HwAccessModule::methodKReadV, 2,
+                            kIOUCVariableStructureSize, 1,
+                            kIOUCVariableStructureSize, 1);
+  (void)registrar.addMethod(kMethodKWriteV, &HwAccessModule::methodKWriteV, 0,
+                            kIOUCVariableStructureSize, 1, 0);
+  (void)registrar.addMethod(kMethodKReadWindow,
+                            &HwAccessModule::methodKReadWindow, 3, 0, 0, 0, 2);
+  (void)registrar.addMethod(kMethodKReadAsync,
+                            &HwAccessModule::methodKReadAsync, 3, 0, 0, 0, 2);
+  (void)registrar.addMethod(kMethodKWriteAsync,
+                            &HwAccessModule::methodKWriteAsync, 3, 0, 0, 0,
+                            2);
+  (void)registrar.addMethod(kMethodKCallAsync,
+                            &HwAccessModule::methodKCallAsync, 0,
+                            sizeof(PandoraKCallRequest), 0, 0);
+  (void)registrar.addMethod(kMethodWalkList, &HwAccessModule::methodWalkList,
+                            2, sizeof(PandoraWalkListRequest), 2, 0);
+  (void)registrar.addMethod(kMethodSearchPattern,
+                            &HwAccessModule::methodSearchPattern, 2,
+                            sizeof(PandoraSearchRequest), 2, 0);
+  (void)registrar.addMethod(kMethodAccessPathStats,
+                            &HwAccessModule::methodAccessPathStats, 1, 0, 0,
+                            sizeof(KUAccessPathStats));
+  (void)registrar.addMethod(kMethodProcOpen, &HwAccessModule::methodProcOpen,
+                            1, 0, 1, 0);
+  (void)registrar.addMethod(kMethodProcClose, &HwAccessModule::methodProcClose,
+                            1, 0, 0, 0);
+  (void)registrar.addMethod(kMethodProcRead, &HwAccessModule::methodProcRead,
+                            4, 0, 0, 0, 3);
+  (void)registrar.addMethod(kMethodProcWrite, &HwAccessModule::methodProcWrite,
+                            4, 0, 0, 0, 3);
+  (void)registrar.addMethod(kMethodPReadV, &HwAccessModule::methodPReadV, 4,
+                            kIOUCVariableStructureSize, 1,
+                            kIOUCVariableStructureSize, 3);
+  (void)registrar.addMethod(kMethodKCallBatch,
+                            &HwAccessModule::methodKCallBatch, 1,
+                            kIOUCVariableStructureSize, 1,
+                            kIOUCVariableStructureSize);
+  (void)registrar.addMethod(kMethodQueryRun, &HwAccessModule::methodQueryRun,
+                            2, sizeof(PandoraQueryRequest), 4, 0);
+  (void)registrar.addMethod(kMethodHashRanges,
+                            &HwAccessModule::methodHashRanges, 1,
+                            kIOUCVariableStructureSize, 0,
+                            kIOUCVariableStructureSize);
+  (void)registrar.addMethod(kMethodKAtomic, &HwAccessModule::methodKAtomic, 1,
+                            kIOUCVariableStructureSize, 1,
+                            kIOUCVariableStructureSize);
+  (void)registrar.addMethod(kMethodKMemmove, &HwAccessModule::methodKMemmove,
+                            3, 0, 0, 0, 2);
+  (void)registrar.addMethod(kMethodKMemset, &HwAccessModule::methodKMemset, 3,
+                            0, 0, 0, 2);
+  (void)registrar.addMethod(kMethodPhysRead, &HwAccessModule::methodPhysRead,
+                            3, 0, 0, 0, 2);
+  (void)registrar.addMethod(kMethodPhysInfo, &HwAccessModule::methodPhysInfo,
+                            0, 0, 2, 0);
+  (void)registrar.addMethod(kMethodVToPBatch,
+                            &HwAccessModule::methodVToPBatch, 0,
+                            kIOUCVariableStructureSize, 1,
+                            kIOUCVariableStructureSize);
+  (void)registrar.addMethod(kMethodTranslationRegs,
+                            &HwAccessModule::methodTranslationRegs, 0, 0, 2,
+                            0);
+  (void)registrar.addMethod(kMethodPhysRanges,
+                            &HwAccessModule::methodPhysRanges, 0, 0, 1,
+                            kIOUCVariableStructureSize);
 }
 
 HwAccessModule *HwAccessModule::fromModule(PandoraModule *module) {
@@ -157,42 +506,116 @@ HwAccessModule *HwAccessModule::fromModule(PandoraModule *module) {
   return static_cast<HwAccessModule *>(module);
 }
 
-IOReturn HwAccessModule::methodKCall(PandoraUserClient *client,
-                                     PandoraModule *module,
-                                     IOExternalMethodArguments *args) {
-  (void)client;
-  (void)module;
+IOReturn HwAccessModule::startAsync() {
+  if (asyncCall_) {
+    return kIOReturnSuccess;
+  }
 
-  if (!args || !args->structureInput ||
-      args->structureInputSize < sizeof(PandoraKCallRequest) ||
-      !args->structureOutput ||
-      args->structureOutputSize < sizeof(PandoraKCallResponse)) {
-    return kIOReturnBadArgument;
+  if (!asyncLock_) {
+    asyncLock_ = IOLockAlloc();
+    if (!asyncLock_) {
+      return kIOReturnNoMemory;
+    }
   }
 
-  const auto *req = static_cast<const PandoraKCallRequest *>(args->structureInput);
-  if (req->argCount > 8) {
-    return kIOReturnBadArgument;
+  thread_call_t call = thread_call_allocate(&HwAccessModule::asyncWorker, this);
+  if (!call) {
+    return kIOReturnNoResources;
+  }
+
+  IOLockLock(asyncLock_);
+  asyncCall_ = call;
+  asyncHead_ = nullptr;
+  asyncTail_ = nullptr;
+  IOLockUnlock(asyncLock_);
+  return kIOReturnSuccess;
+}
+
+void HwAccessModule::stopAsync() {
+  if (!asyncLock_) {
+    return;
   }
 
-  PandoraKCallResult res = pandora_kcall(req->fn, req->args, req->argCount);
+  // Stop accepting work first, then wait out a running worker.
+  IOLockLock(asyncLock_);
+  thread_call_t call = asyncCall_;
+  asyncCall_ = nullptr;
+  IOLockUnlock(asyncLock_);
 
-  PandoraKCallResponse out = {};
-  out.status = res.status;
-  out.ret0 = res.ret0;
+  if (call) {
+    thread_call_cancel_wait(call);
+    thread_call_free(call);
+  }
 
-  memcpy(args->structureOutput, &out, sizeof(out));
-  args->structureOutputSize = sizeof(out);
+  IOLockLock(asyncLock_);
+  HwAccessAsyncRequest *pending = asyncHead_;
+  asyncHead_ = nullptr;
+  asyncTail_ = nullptr;
+  IOLockUnlock(asyncLock_);
+
+  while (pending) {
+    HwAccessAsyncRequest *next = pending->next;
+    completeAsyncRequest(pending, kIOReturnAborted, 0);
+    pending = next;
+  }
+}
+
+IOReturn HwAccessModule::enqueueAsync(HwAccessAsyncRequest *request) {
+  if (!request || !asyncLock_) {
+    return kIOReturnNotReady;
+  }
+
+  IOLockLock(asyncLock_);
+  if (!asyncCall_) {
+    IOLockUnlock(asyncLock_);
+    return kIOReturnNotReady;
+  }
+  request->next = nullptr;
+  if (asyncTail_) {
+    asyncTail_->next = request;
+  } else {
+    asyncHead_ = request;
+  }
+  asyncTail_ = request;
+
+  // Entering an already pending call is a no-op; the worker drains the queue.
+  thread_call_enter(asyncCall_);
+  IOLockUnlock(asyncLock_);
   return kIOReturnSuccess;
 }
 
-IOReturn HwAccessModule::methodKRead(PandoraUserClient *client,
-                                     PandoraModule *module,
-                                     IOExternalMethodArguments *args) {
-  (void)client;
-  (void)module;
+void HwAccessModule::asyncWorker(thread_call_param_t param0,
+                                 thread_call_param_t param1) {
+  (void)param1;
+  auto *self = static_cast<HwAccessModule *>(param0);
+  if (!self || !self->asyncLock_) {
+    return;
+  }
 
-  if (!args) {
+  for (;;) {
+    IOLockLock(self->asyncLock_);
+    HwAccessAsyncRequest *request = self->asyncHead_;
+    if (request) {
+      self->asyncHead_ = request->next;
+      if (!self->asyncHead_) {
+        self->asyncTail_ = nullptr;
+      }
+    }
+    IOLockUnlock(self->asyncLock_);
+
+    if (!request) {
+      return;
+    }
+
+    runAsyncRequest(request);
+  }
+}
+
+IOReturn HwAccessModule::methodKReadAsync(PandoraUserClient *client,
+                                          PandoraModule *module,
+                                          IOExternalMethodArguments *args) {
+  HwAccessModule *self = fromModule(module);
+  if (!self || !client || !args) {
     return kIOReturnBadArgument;
   }
 
@@ -200,43 +623,39 @@ IOReturn HwAccessModule::methodKRead(PandoraUserClient *client,
   user_addr_t uaddr = args->scalarInput[1];
   size_t len = args->scalarInput[2];
 
-  if (!kaddr || !uaddr || !len) {
+  if (!kaddr || !uaddr || !len || len > kPandoraAsyncMaxTransfer) {
     return kIOReturnBadArgument;
   }
 
-  void *buffer = IOMalloc(len);
-  if (!buffer) {
-    PANDORA_USERCLIENT_LOG_ERROR(
-        "HwAccessModule::kread: allocation failed size=%zu addr=0x%llx", len,
-        kaddr);
+  HwAccessAsyncRequest *request = nullptr;
+  IOReturn ret = allocAsyncRequest(client, args, kAsyncKRead, &request);
+  if (ret != kIOReturnSuccess) {
+    return ret;
+  }
+  request->kaddr = kaddr;
+
+  // The worker runs outside the client's address space, so the destination
+  // is described now and wired and written through the descriptor later.
+  request->userMemory = IOMemoryDescriptor::withAddressRange(
+      uaddr, len, kIODirectionIn, client->owningTask());
+  if (!request->userMemory) {
+    freeAsyncRequest(request);
     return kIOReturnNoMemory;
   }
+  request->len = len;
 
-  KUError err = KernelUtilities::kread(kaddr, buffer, len);
-  if (err != KUErrorSuccess) {
-    const PandoraRuntimeState &runtime = pandora_runtime_state();
-    PANDORA_USERCLIENT_LOG_ERROR(
-        "HwAccessModule::kread failed size=%zu addr=0x%llx err=%s(%d) extra=[%llu,%llu,%llu]",
-        len, kaddr, get_error_name(err), err,
-        runtime.debug.extraErrorData1,
-        runtime.debug.extraErrorData2,
-        runtime.debug.extraErrorData3);
-    IOFree(buffer, len);
-    return kIOReturnVMError;
+  ret = self->enqueueAsync(request);
+  if (ret != kIOReturnSuccess) {
+    freeAsyncRequest(request);
   }
-
-  int copyErr = copyout(buffer, uaddr, len);
-  IOFree(buffer, len);
-  return (copyErr == 0) ? kIOReturnSuccess : kIOReturnVMError;
+  return ret;
 }
 
-IOReturn HwAccessModule::methodKWrite(PandoraUserClient *client,
-                                      PandoraModule *module,
-                                      IOExternalMethodArguments *args) {
-  (void)client;
-  (void)module;
-
-  if (!args) {
+IOReturn HwAccessModule::methodKWriteAsync(PandoraUserClient *client,
+                                           PandoraModule *module,
+                                           IOExternalMethodArguments *args) {
+  HwAccessModule *self = fromModule(module);
+  if (!self || !client || !args) {
     return kIOReturnBadArgument;
   }
 
@@ -244,149 +663,1600 @@ IOReturn HwAccessModule::methodKWrite(PandoraUserClient *client,
   uint64_t kaddr = args->scalarInput[1];
   size_t len = args->scalarInput[2];
 
-  if (!kaddr || !uaddr || !len) {
+  if (!kaddr || !uaddr || !len || len > kPandoraAsyncMaxTransfer) {
     return kIOReturnBadArgument;
   }
 
-  void *buffer = IOMalloc(len);
-  if (!buffer) {
-    return kIOReturnNoMemory;
+  HwAccessAsyncRequest *request = nullptr;
+  IOReturn ret = allocAsyncRequest(client, args, kAsyncKWrite, &request);
+  if (ret != kIOReturnSuccess) {
+    return ret;
   }
+  request->kaddr = kaddr;
 
-  int copyErr = copyin(uaddr, buffer, len);
-  if (copyErr != 0) {
-    IOFree(buffer, len);
-    return kIOReturnVMError;
+  request->buffer = IOMalloc(len);
+  if (!request->buffer) {
+    freeAsyncRequest(request);
+    return kIOReturnNoMemory;
   }
+  request->len = len;
 
-  KUError err = KernelUtilities::kwrite(kaddr, buffer, len);
-  IOFree(buffer, len);
-
-  if (err != KUErrorSuccess) {
-    const PandoraRuntimeState &runtime = pandora_runtime_state();
-    PANDORA_USERCLIENT_LOG_ERROR(
-        "HwAccessModule::kwrite failed size=%zu addr=0x%llx err=%s(%d) extra=[%llu,%llu,%llu]",
-        len, kaddr, get_error_name(err), err,
-        runtime.debug.extraErrorData1,
-        runtime.debug.extraErrorData2,
-        runtime.debug.extraErrorData3);
+  if (copyin(uaddr, request->buffer, len) != 0) {
+    freeAsyncRequest(request);
     return kIOReturnVMError;
   }
 
-  return kIOReturnSuccess;
+  ret = self->enqueueAsync(request);
+  if (ret != kIOReturnSuccess) {
+    freeAsyncRequest(request);
+  }
+  return ret;
 }
 
-IOReturn HwAccessModule::methodPReadPid(PandoraUserClient *client,
-                                        PandoraModule *module,
-                                        IOExternalMethodArguments *args) {
-  (void)client;
-  (void)module;
-
-  if (!args) {
+IOReturn HwAccessModule::methodKCallAsync(PandoraUserClient *client,
+                                          PandoraModule *module,
+                                          IOExternalMethodArguments *args) {
+  HwAccessModule *self = fromModule(module);
+  if (!self || !client || !args || !args->structureInput ||
+      args->structureInputSize != sizeof(PandoraKCallRequest)) {
     return kIOReturnBadArgument;
   }
 
-  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
-  uint64_t paddr = args->scalarInput[1];
-  user_addr_t uaddr = args->scalarInput[2];
-  size_t len = args->scalarInput[3];
-
-  if (!pid || !paddr || !uaddr || !len) {
+  const auto *req = static_cast<const PandoraKCallRequest *>(args->structureInput);
+  // Chaining only means something inside a batch.
+  if (req->argCount > 8 || req->chainMask != 0) {
     return kIOReturnBadArgument;
   }
 
-  proc_t p = proc_find(pid);
-  if (!p) {
-    return kIOReturnNotFound;
+  HwAccessAsyncRequest *request = nullptr;
+  IOReturn ret = allocAsyncRequest(client, args, kAsyncKCall, &request);
+  if (ret != kIOReturnSuccess) {
+    return ret;
   }
+  memcpy(&request->kcall, req, sizeof(request->kcall));
 
-  task_t t = proc_task(p);
-  if (t == TASK_NULL) {
-    proc_rele(p);
-    return kIOReturnNotFound;
+  ret = self->enqueueAsync(request);
+  if (ret != kIOReturnSuccess) {
+    freeAsyncRequest(request);
   }
+  return ret;
+}
 
-  void *buffer = IOMalloc(len);
-  if (!buffer) {
-    proc_rele(p);
-    return kIOReturnNoMemory;
+// Scratch memory backing the buffers of one marshalled kcall.
+struct KCallScratch {
+  void *kbuf[kPandoraKCallMaxBuffers];
+  uint32_t count;
+};
+
+static void freeKCallScratch(const PandoraKCallMarshalledRequest &req,
+                             KCallScratch *scratch) {
+  for (uint32_t i = 0; i < scratch->count; ++i) {
+    if (scratch->kbuf[i]) {
+      IOFree(scratch->kbuf[i], req.buffers[i].size);
+      scratch->kbuf[i] = nullptr;
+    }
   }
+  scratch->count = 0;
+}
 
-  KUError err = KernelUtilities::pread(t, paddr, buffer, len);
-  if (err != KUErrorSuccess) {
-    IOFree(buffer, len);
-    proc_rele(p);
-    return kIOReturnVMError;
+// Allocates and fills the scratch buffers and rewrites the matching
+// arguments in `callArgs` to point at them.
+static IOReturn prepareKCallScratch(const PandoraKCallMarshalledRequest &req,
+                                    uint64_t *callArgs,
+                                    KCallScratch *scratch) {
+  *scratch = KCallScratch{};
+  if (req.bufferCount > kPandoraKCallMaxBuffers) {
+    return kIOReturnBadArgument;
   }
 
-  int copyErr = copyout(buffer, uaddr, len);
-  IOFree(buffer, len);
-  proc_rele(p);
+  uint32_t claimed = 0;
+  for (uint32_t i = 0; i < req.bufferCount; ++i) {
+    const PandoraKCallBuffer &b = req.buffers[i];
+    if (!b.uaddr || !b.size || b.size > kPandoraKCallMaxBufferSize ||
+        b.argIndex >= req.call.argCount || (claimed & (1u << b.argIndex)) ||
+        !(b.flags & (kPandoraKCallBufferIn | kPandoraKCallBufferOut))) {
+      freeKCallScratch(req, scratch);
+      return kIOReturnBadArgument;
+    }
+    claimed |= 1u << b.argIndex;
 
-  return (copyErr == 0) ? kIOReturnSuccess : kIOReturnVMError;
+    void *kbuf = IOMallocZero(b.size);
+    if (!kbuf) {
+      freeKCallScratch(req, scratch);
+      return kIOReturnNoMemory;
+    }
+    scratch->kbuf[i] = kbuf;
+    scratch->count = i + 1;
+
+    if ((b.flags & kPandoraKCallBufferIn) &&
+        copyin(b.uaddr, kbuf, b.size) != 0) {
+      freeKCallScratch(req, scratch);
+      return kIOReturnVMError;
+    }
+    callArgs[b.argIndex] = reinterpret_cast<uint64_t>(kbuf);
+  }
+  return kIOReturnSuccess;
 }
 
-IOReturn HwAccessModule::methodPWritePid(PandoraUserClient *client,
-                                         PandoraModule *module,
-                                         IOExternalMethodArguments *args) {
+IOReturn HwAccessModule::methodKCall(PandoraUserClient *client,
+                                     PandoraModule *module,
+                                     IOExternalMethodArguments *args) {
   (void)client;
   (void)module;
 
-  if (!args) {
+  if (!args || !args->structureInput || !args->structureOutput ||
+      args->structureOutputSize < sizeof(PandoraKCallResponse)) {
     return kIOReturnBadArgument;
   }
 
-  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
-  user_addr_t uaddr = args->scalarInput[1];
-  uint64_t paddr = args->scalarInput[2];
-  size_t len = args->scalarInput[3];
-
-  if (!pid || !paddr || !uaddr || !len) {
+  // A bare request is a marshalled request with no buffers.
+  PandoraKCallMarshalledRequest req = {};
+  if (args->structureInputSize == sizeof(PandoraKCallRequest)) {
+    memcpy(&req.call, args->structureInput, sizeof(PandoraKCallRequest));
+  } else if (args->structureInputSize == sizeof(req)) {
+    memcpy(&req, args->structureInput, sizeof(req));
+  } else {
     return kIOReturnBadArgument;
   }
-
-  proc_t p = proc_find(pid);
-  if (!p) {
-    return kIOReturnNotFound;
+  // Chaining only means something inside a batch.
+  if (req.call.argCount > 8 || req.call.chainMask != 0) {
+    return kIOReturnBadArgument;
   }
 
-  task_t t = proc_task(p);
-  if (t == TASK_NULL) {
-    proc_rele(p);
-    return kIOReturnNotFound;
-  }
+  uint64_t callArgs[8] = {};
+  memcpy(callArgs, req.call.args, sizeof(callArgs));
 
-  void *buffer = IOMalloc(len);
-  if (!buffer) {
-    proc_rele(p);
-    return kIOReturnNoMemory;
+  KCallScratch scratch;
+  IOReturn ret = prepareKCallScratch(req, callArgs, &scratch);
+  if (ret != kIOReturnSuccess) {
+    return ret;
   }
 
-  int copyErr = copyin(uaddr, buffer, len);
-  if (copyErr != 0) {
-    IOFree(buffer, len);
-    proc_rele(p);
-    return kIOReturnVMError;
-  }
+  PandoraKCallResult res =
+      pandora_kcall(req.call.fn, callArgs, req.call.argCount);
 
-  KUError err = KernelUtilities::pwrite(t, paddr, buffer, len);
-  IOFree(buffer, len);
-  proc_rele(p);
+  PandoraKCallResponse out = {};
+  out.status = res.status;
+  out.ret0 = res.ret0;
+
+  if (res.status == kIOReturnSuccess) {
+    for (uint32_t i = 0; i < scratch.count; ++i) {
+      const PandoraKCallBuffer &b = req.buffers[i];
+      if ((b.flags & kPandoraKCallBufferOut) &&
+          copyout(scratch.kbuf[i], b.uaddr, b.size) != 0) {
+        out.status = kIOReturnVMError;
+      }
+    }
+  }
+  freeKCallScratch(req, &scratch);
 
-  return (err == KUErrorSuccess) ? kIOReturnSuccess : kIOReturnVMError;
+  memcpy(args->structureOutput, &out, sizeof(out));
+  args->structureOutputSize = sizeof(out);
+  return kIOReturnSuccess;
 }
 
-IOReturn HwAccessModule::methodGetKernelBase(PandoraUserClient *client,
-                                             PandoraModule *module,
-                                             IOExternalMethodArguments *args) {
+IOReturn HwAccessModule::methodPhysRead(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
   (void)client;
-  if (!args) {
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
     return kIOReturnBadArgument;
   }
 
-  HwAccessModule *self = fromModule(module);
-  if (!self || !self->service_) {
-    return kIOReturnNotReady;
+  user_addr_t uaddr = args->scalarInput[0];
+  uint64_t paddr = args->scalarInput[1];
+  size_t len = args->scalarInput[2];
+  if (!uaddr || !len || len > kPandoraPhysReadMaxLength) {
+    return kIOReturnBadArgument;
+  }
+
+  // Small reads use the pool; large ones stream through a bigger staging
+  // buffer so each descriptor covers up to kPandoraPhysReadChunk bytes.
+  const bool streaming = len > BouncePool::kMaxClassSize;
+  size_t capacity = 0;
+  void *buffer = nullptr;
+  if (streaming) {
+    capacity = (len < kPandoraPhysReadChunk) ? len : kPandoraPhysReadChunk;
+    buffer = IOMalloc(capacity);
+  } else {
+    buffer = self->bouncePool_.get(len, &capacity);
+  }
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn ret = kIOReturnSuccess;
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < capacity) ? (len - done) : capacity;
+    KUError err = KernelUtilities::physRead(paddr + done, buffer, chunk);
+    if (err != KUErrorSuccess) {
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::physread failed size=%zu paddr=0x%llx err=%s(%d)",
+          chunk, paddr + done, get_error_name(err), err);
+      ret = (err == KUErrorInvalidAddress) ? kIOReturnBadArgument
+                                           : kIOReturnVMError;
+      break;
+    }
+    if (copyout(buffer, uaddr + done, chunk) != 0) {
+      ret = kIOReturnVMError;
+      break;
+    }
+    done += chunk;
+  }
+
+  if (streaming) {
+    IOFree(buffer, capacity);
+  } else {
+    self->bouncePool_.put(buffer, capacity);
+  }
+  return ret;
+}
+
+IOReturn HwAccessModule::methodPhysInfo(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t base = 0;
+  uint64_t size = 0;
+  if (KernelUtilities::dramRange(&base, &size) != KUErrorSuccess) {
+    return kIOReturnNotFound;
+  }
+  args->scalarOutput[0] = base;
+  args->scalarOutput[1] = size;
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodPhysRanges(PandoraUserClient *client,
+                                          PandoraModule *module,
+                                          IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  uint32_t max = args->structureOutputSize / sizeof(phys_range);
+  if (max > kPandoraPhysMaxRanges) {
+    max = kPandoraPhysMaxRanges;
+  }
+  uint32_t count = 0;
+  KUError err = KernelUtilities::physSafeRanges(
+      static_cast<phys_range *>(args->structureOutput), max, &count);
+  if (err != KUErrorSuccess) {
+    return kIOReturnNotFound;
+  }
+
+  // scalarOutput[0] is the total, which may exceed what fit.
+  args->structureOutputSize = (count < max ? count : max) * sizeof(phys_range);
+  args->scalarOutput[0] = count;
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodVToPBatch(PandoraUserClient *client,
+                                         PandoraModule *module,
+                                         IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureInput || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t inSize = args->structureInputSize;
+  if (inSize == 0 || inSize % sizeof(uint64_t) != 0) {
+    return kIOReturnBadArgument;
+  }
+  const uint32_t count = inSize / sizeof(uint64_t);
+  if (count > kPandoraVToPMaxAddresses ||
+      args->structureOutputSize < count * sizeof(PandoraVToPResult)) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *vaddrs = static_cast<const uint64_t *>(args->structureInput);
+  auto *results = static_cast<PandoraVToPResult *>(args->structureOutput);
+
+  // Untranslatable addresses are reported per entry, not as a failure.
+  uint64_t valid = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    results[i] = PandoraVToPResult{};
+    KUTranslation t;
+    if (KernelUtilities::translate(vaddrs[i], &t) != KUErrorSuccess) {
+      continue;
+    }
+    results[i].paddr = t.paddr;
+    results[i].flags =
+        kPandoraVToPValid | (t.writable ? kPandoraVToPWritable : 0);
+    results[i].attr = t.attr;
+    results[i].shareability = t.shareability;
+    valid++;
+  }
+
+  args->structureOutputSize = count * sizeof(PandoraVToPResult);
+  args->scalarOutput[0] = valid;
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodTranslationRegs(PandoraUserClient *client,
+                                               PandoraModule *module,
+                                               IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t ttbr1 = 0;
+  uint64_t tcr = 0;
+  KernelUtilities::translationRegisters(&ttbr1, &tcr);
+  args->scalarOutput[0] = ttbr1;
+  args->scalarOutput[1] = tcr;
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodKMemmove(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t dst = args->scalarInput[0];
+  uint64_t src = args->scalarInput[1];
+  size_t len = args->scalarInput[2];
+  if (!dst || !src || !len || len > kPandoraKMemMaxLength) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t capacity = 0;
+  void *buffer = self->bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  KUError err = KernelUtilities::kmemmove(dst, src, len, buffer, capacity);
+  self->bouncePool_.put(buffer, capacity);
+  if (err != KUErrorSuccess) {
+    PANDORA_USERCLIENT_LOG_ERROR(
+        "HwAccessModule::kmemmove failed size=%zu dst=0x%llx src=0x%llx err=%s(%d)",
+        len, dst, src, get_error_name(err), err);
+    return kIOReturnVMError;
+  }
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodKMemset(PandoraUserClient *client,
+                                       PandoraModule *module,
+                                       IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t dst = args->scalarInput[0];
+  uint64_t value = args->scalarInput[1];
+  size_t len = args->scalarInput[2];
+  if (!dst || !len || value > 0xFF || len > kPandoraKMemMaxLength) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t capacity = 0;
+  void *buffer = self->bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  KUError err = KernelUtilities::kmemset(dst, static_cast<uint8_t>(value), len,
+                                         buffer, capacity);
+  self->bouncePool_.put(buffer, capacity);
+  if (err != KUErrorSuccess) {
+    PANDORA_USERCLIENT_LOG_ERROR(
+        "HwAccessModule::kmemset failed size=%zu dst=0x%llx err=%s(%d)", len,
+        dst, get_error_name(err), err);
+    return kIOReturnVMError;
+  }
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodKAtomic(PandoraUserClient *client,
+                                       PandoraModule *module,
+                                       IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureInput || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t inSize = args->structureInputSize;
+  if (inSize == 0 || inSize % sizeof(PandoraAtomicOp) != 0) {
+    return kIOReturnBadArgument;
+  }
+  const uint32_t count = inSize / sizeof(PandoraAtomicOp);
+  if (count > kPandoraAtomicMaxOps ||
+      args->structureOutputSize < count * sizeof(PandoraAtomicResult)) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *ops = static_cast<const PandoraAtomicOp *>(args->structureInput);
+  auto *results = static_cast<PandoraAtomicResult *>(args->structureOutput);
+  const bool stopOnFailure =
+      (args->scalarInput[0] & kPandoraAtomicStopOnFailure) != 0;
+
+  uint64_t applied = 0;
+  bool stopped = false;
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraAtomicOp &op = ops[i];
+    PandoraAtomicResult &res = results[i];
+    res = PandoraAtomicResult{};
+
+    if (stopped) {
+      res.status = kIOReturnAborted;
+      continue;
+    }
+
+    KUError err = KUErrorBadArgument;
+    if (op.op == kPandoraAtomicCompareSwap) {
+      err = KernelUtilities::kcas(op.kaddr, op.width, op.operand, op.value,
+                                  &res.previous);
+    } else if (op.op == kPandoraAtomicMaskedWrite) {
+      err = KernelUtilities::kwriteMasked(op.kaddr, op.width, op.value,
+                                          op.operand, &res.previous);
+    }
+
+    switch (err) {
+    case KUErrorSuccess:
+      applied++;
+      break;
+    case KUErrorCompareMismatch:
+      res.status = kIOReturnNotPermitted;
+      break;
+    case KUErrorBadArgument:
+      res.status = kIOReturnBadArgument;
+      break;
+    default:
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::katomic failed index=%u addr=0x%llx err=%s(%d)", i,
+          op.kaddr, get_error_name(err), err);
+      res.status = kIOReturnVMError;
+      break;
+    }
+    stopped = stopOnFailure && res.status != kIOReturnSuccess;
+  }
+
+  args->scalarOutput[0] = applied;
+  args->structureOutputSize = count * sizeof(PandoraAtomicResult);
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodHashRanges(PandoraUserClient *client,
+                                          PandoraModule *module,
+                                          IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args || !args->structureInput || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t inSize = args->structureInputSize;
+  if (inSize == 0 || inSize % sizeof(PandoraHashRange) != 0) {
+    return kIOReturnBadArgument;
+  }
+  const uint32_t count = inSize / sizeof(PandoraHashRange);
+  if (count > kPandoraHashMaxRanges ||
+      args->structureOutputSize < count * sizeof(PandoraHashResult)) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *ranges =
+      static_cast<const PandoraHashRange *>(args->structureInput);
+  auto *results = static_cast<PandoraHashResult *>(args->structureOutput);
+  const uint64_t seed = args->scalarInput[0];
+
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!ranges[i].kaddr || !ranges[i].len ||
+        ranges[i].len > kPandoraHashMaxTotalBytes - total) {
+      return kIOReturnBadArgument;
+    }
+    total += ranges[i].len;
+  }
+
+  size_t capacity = 0;
+  uint8_t *chunk = static_cast<uint8_t *>(
+      self->bouncePool_.get(BouncePool::kMaxClassSize, &capacity));
+  if (!chunk) {
+    return kIOReturnNoMemory;
+  }
+
+  // The data only ever lands in the bounce buffer; just the digests leave
+  // the kernel.
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraHashRange &r = ranges[i];
+    PandoraHashResult &res = results[i];
+    res = PandoraHashResult{};
+
+    xxh64_state st;
+    xxh64_reset(&st, seed);
+    uint64_t done = 0;
+    while (done < r.len) {
+      size_t len = (r.len - done < capacity) ? static_cast<size_t>(r.len - done)
+                                             : capacity;
+      if (KernelUtilities::kread(r.kaddr + done, chunk, len) !=
+          KUErrorSuccess) {
+        res.status = kIOReturnNotReadable;
+        break;
+      }
+      xxh64_update(&st, chunk, len);
+      done += len;
+    }
+    if (res.status == kIOReturnSuccess) {
+      res.hash = xxh64_digest(&st);
+    }
+  }
+
+  self->bouncePool_.put(chunk, capacity);
+  args->structureOutputSize = count * sizeof(PandoraHashResult);
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodQueryRun(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureInput ||
+      args->structureInputSize < sizeof(PandoraQueryRequest)) {
+    return kIOReturnBadArgument;
+  }
+
+  user_addr_t uaddr = args->scalarInput[0];
+  size_t ulen = args->scalarInput[1];
+  if ((ulen && !uaddr) || ulen > kPandoraQueryMaxOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *req =
+      static_cast<const PandoraQueryRequest *>(args->structureInput);
+  if (qvm_verify(req->insns, req->insnCount) != QVM_OK) {
+    return kIOReturnBadArgument;
+  }
+
+  uint8_t *out = nullptr;
+  if (ulen) {
+    out = static_cast<uint8_t *>(IOMalloc(ulen));
+    if (!out) {
+      return kIOReturnNoMemory;
+    }
+  }
+
+  qvm_state st = {};
+  st.read = queryRead;
+  st.out = out;
+  st.out_cap = ulen;
+  st.max_steps = req->maxSteps && req->maxSteps < kPandoraQueryMaxSteps
+                     ? req->maxSteps
+                     : kPandoraQueryMaxSteps;
+  st.max_read_bytes =
+      req->maxReadBytes && req->maxReadBytes < kPandoraQueryMaxReadBytes
+          ? req->maxReadBytes
+          : kPandoraQueryMaxReadBytes;
+  memcpy(st.regs, req->regs, sizeof(st.regs));
+
+  qvm_status status = qvm_run(req->insns, req->insnCount, &st);
+
+  IOReturn ret = kIOReturnSuccess;
+  if (st.out_len && copyout(out, uaddr, st.out_len) != 0) {
+    ret = kIOReturnVMError;
+  }
+  if (out) {
+    IOFree(out, ulen);
+  }
+
+  args->scalarOutput[0] = status;
+  args->scalarOutput[1] = st.out_len;
+  args->scalarOutput[2] = st.steps;
+  args->scalarOutput[3] = st.pc;
+  return ret;
+}
+
+IOReturn HwAccessModule::methodKCallBatch(PandoraUserClient *client,
+                                          PandoraModule *module,
+                                          IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  // A full batch (64 * 80 bytes) exceeds the inband limit and arrives as a
+  // descriptor, so the requests are always copied in.
+  void *input = nullptr;
+  size_t inSize = 0;
+  IOReturn ret = copyStructureInput(
+      args, kPandoraKCallBatchMax * sizeof(PandoraKCallRequest), &input,
+      &inSize);
+  if (ret != kIOReturnSuccess) {
+    return ret;
+  }
+  const uint32_t count =
+      static_cast<uint32_t>(inSize / sizeof(PandoraKCallRequest));
+  if (inSize % sizeof(PandoraKCallRequest) != 0 ||
+      args->structureOutputSize < count * sizeof(PandoraKCallTimedResponse)) {
+    IOFree(input, inSize);
+    return kIOReturnBadArgument;
+  }
+
+  const auto *reqs = static_cast<const PandoraKCallRequest *>(input);
+  auto *resps = static_cast<PandoraKCallTimedResponse *>(args->structureOutput);
+  uint32_t flags =
+      (args->scalarInput[0] & kPandoraKCallBatchLog) ? 0 : kPandoraKCallNoLog;
+
+  uint64_t executed = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKCallRequest &req = reqs[i];
+    PandoraKCallTimedResponse &resp = resps[i];
+    resp = PandoraKCallTimedResponse{};
+
+    // A call that depends on a failed call, or on one that returned NULL, is
+    // skipped rather than handed a NULL pointer.
+    uint64_t callArgs[8] = {};
+    resp.status = kcall_chain_resolve(&req, i, resps, callArgs);
+    if (resp.status != kIOReturnSuccess) {
+      continue;
+    }
+
+    PandoraKCallResult res =
+        pandora_kcall(req.fn, callArgs, req.argCount, flags);
+    resp.status = res.status;
+    resp.ret0 = res.ret0;
+    resp.elapsed = res.elapsed;
+    executed++;
+  }
+
+  IOFree(input, inSize);
+  args->scalarOutput[0] = executed;
+  args->structureOutputSize = count * sizeof(PandoraKCallTimedResponse);
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodKRead(PandoraUserClient *client,
+                                     PandoraModule *module,
+                                     IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t kaddr = args->scalarInput[0];
+  user_addr_t uaddr = args->scalarInput[1];
+  size_t len = args->scalarInput[2];
+
+  if (!kaddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t capacity = 0;
+  void *buffer = self->bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    PANDORA_USERCLIENT_LOG_ERROR(
+        "HwAccessModule::kread: allocation failed size=%zu addr=0x%llx", len,
+        kaddr);
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn ret = kIOReturnSuccess;
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < capacity) ? (len - done) : capacity;
+    KUError err = KernelUtilities::kread(kaddr + done, buffer, chunk);
+    if (err != KUErrorSuccess) {
+      const PandoraRuntimeState &runtime = pandora_runtime_state();
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kread failed size=%zu addr=0x%llx err=%s(%d) extra=[%llu,%llu,%llu]",
+          chunk, kaddr + done, get_error_name(err), err,
+          runtime.debug.extraErrorData1,
+          runtime.debug.extraErrorData2,
+          runtime.debug.extraErrorData3);
+      ret = kIOReturnVMError;
+      break;
+    }
+
+    if (copyout(buffer, uaddr + done, chunk) != 0) {
+      ret = kIOReturnVMError;
+      break;
+    }
+    done += chunk;
+  }
+
+  self->bouncePool_.put(buffer, capacity);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodKReadV(PandoraUserClient *client,
+                                      PandoraModule *module,
+                                      IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args || !args->structureInput || !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  user_addr_t uaddr = args->scalarInput[0];
+  uint64_t ulen = args->scalarInput[1];
+
+  const uint32_t inSize = args->structureInputSize;
+  if (!uaddr || !ulen || inSize == 0 ||
+      inSize % sizeof(PandoraKReadVDescriptor) != 0) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t count = inSize / sizeof(PandoraKReadVDescriptor);
+  if (count > kPandoraKReadVMaxDescriptors ||
+      args->structureOutputSize < count * sizeof(IOReturn)) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *descs =
+      static_cast<const PandoraKReadVDescriptor *>(args->structureInput);
+  auto *statuses = static_cast<IOReturn *>(args->structureOutput);
+
+  // Validate everything up front so a single pooled bounce buffer serves the
+  // whole batch. Descriptors larger than the buffer are streamed through it.
+  size_t maxLen = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKReadVDescriptor &d = descs[i];
+    if (!d.kaddr || !d.len || d.offset > ulen || d.len > ulen - d.offset) {
+      statuses[i] = kIOReturnBadArgument;
+      continue;
+    }
+    statuses[i] = kIOReturnSuccess;
+    if (d.len > maxLen) {
+      maxLen = d.len;
+    }
+  }
+
+  size_t capacity = 0;
+  void *buffer = nullptr;
+  if (maxLen) {
+    buffer = self->bouncePool_.get(maxLen, &capacity);
+    if (!buffer) {
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kreadv: allocation failed size=%zu count=%u",
+          maxLen, count);
+      return kIOReturnNoMemory;
+    }
+  }
+
+  uint64_t failed = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKReadVDescriptor &d = descs[i];
+    if (statuses[i] != kIOReturnSuccess) {
+      failed++;
+      continue;
+    }
+
+    for (size_t done = 0; done < d.len;) {
+      size_t chunk = (d.len - done < capacity) ? (d.len - done) : capacity;
+      KUError err = KernelUtilities::kread(d.kaddr + done, buffer, chunk);
+      if (err != KUErrorSuccess) {
+        PANDORA_USERCLIENT_LOG_ERROR(
+            "HwAccessModule::kreadv failed index=%u size=%zu addr=0x%llx err=%s(%d)",
+            i, chunk, d.kaddr + done, get_error_name(err), err);
+        statuses[i] = kIOReturnVMError;
+        break;
+      }
+
+      if (copyout(buffer, uaddr + d.offset + done, chunk) != 0) {
+        statuses[i] = kIOReturnVMError;
+        break;
+      }
+      done += chunk;
+    }
+    if (statuses[i] != kIOReturnSuccess) {
+      failed++;
+    }
+  }
+
+  if (buffer) {
+    self->bouncePool_.put(buffer, capacity);
+  }
+
+  args->scalarOutput[0] = failed;
+  args->structureOutputSize = count * sizeof(IOReturn);
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodWalkList(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args || !args->structureInput ||
+      args->structureInputSize < sizeof(PandoraWalkListRequest)) {
+    return kIOReturnBadArgument;
+  }
+
+  user_addr_t uaddr = args->scalarInput[0];
+  uint64_t ulen = args->scalarInput[1];
+
+  PandoraWalkListRequest req;
+  memcpy(&req, args->structureInput, sizeof(req));
+
+  if (!uaddr || !ulen || !req.head || !req.maxNodes ||
+      req.maxNodes > kPandoraWalkMaxNodes ||
+      req.fieldCount > kPandoraWalkMaxFields) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t recordSize = sizeof(uint64_t);
+  for (uint32_t i = 0; i < req.fieldCount; ++i) {
+    const PandoraWalkField &f = req.fields[i];
+    if (!f.size || f.size > kPandoraWalkMaxFieldSize ||
+        (f.flags & ~kPandoraWalkFieldIndirect) != 0) {
+      return kIOReturnBadArgument;
+    }
+    recordSize += f.size;
+  }
+  recordSize = (recordSize + 7) & ~static_cast<size_t>(7);
+
+  size_t capacity = 0;
+  uint8_t *record =
+      static_cast<uint8_t *>(self->bouncePool_.get(recordSize, &capacity));
+  if (!record) {
+    return kIOReturnNoMemory;
+  }
+  if (capacity < recordSize) {
+    self->bouncePool_.put(record, capacity);
+    return kIOReturnBadArgument;
+  }
+  bzero(record, recordSize);
+
+  // Brent's cycle detection: `saved` is re-anchored at powers of two, so a
+  // cycle of length L is caught within O(L) extra steps without a visited set.
+  uint64_t saved = req.head;
+  uint32_t power = 1;
+  uint32_t steps = 0;
+
+  uint64_t node = req.head;
+  uint64_t count = 0;
+  PandoraWalkEnd end = kPandoraWalkEndLimit;
+  IOReturn ret = kIOReturnSuccess;
+
+  while (count < req.maxNodes) {
+    if ((count + 1) * recordSize > ulen) {
+      end = kPandoraWalkEndLimit;
+      break;
+    }
+
+    if (!readWalkRecord(req, node, record)) {
+      end = kPandoraWalkEndFault;
+      break;
+    }
+    if (copyout(record, uaddr + count * recordSize, recordSize) != 0) {
+      ret = kIOReturnVMError;
+      break;
+    }
+    count++;
+
+    uint64_t next = 0;
+    if (KernelUtilities::kread(node + req.nextOffset, &next, sizeof(next)) !=
+        KUErrorSuccess) {
+      end = kPandoraWalkEndFault;
+      break;
+    }
+
+    next = stripPointer(next);
+    if (!next) {
+      end = kPandoraWalkEndNull;
+      break;
+    }
+    next -= static_cast<uint64_t>(req.nodeBias);
+    if (!isKernelPointer(next)) {
+      end = kPandoraWalkEndBadPointer;
+      break;
+    }
+    if (next == req.head) {
+      end = kPandoraWalkEndHead;
+      break;
+    }
+    if (next == saved) {
+      end = kPandoraWalkEndLoop;
+      break;
+    }
+    if (++steps == power) {
+      saved = next;
+      power <<= 1;
+      steps = 0;
+    }
+
+    node = next;
+  }
+
+  self->bouncePool_.put(record, capacity);
+
+  args->scalarOutput[0] = count;
+  args->scalarOutput[1] = end;
+  return ret;
+}
+
+IOReturn HwAccessModule::methodSearchPattern(PandoraUserClient *client,
+                                             PandoraModule *module,
+                                             IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args || !args->structureInput ||
+      args->structureInputSize < sizeof(PandoraSearchRequest)) {
+    return kIOReturnBadArgument;
+  }
+
+  user_addr_t uaddr = args->scalarInput[0];
+  uint64_t maxResults = args->scalarInput[1];
+
+  PandoraSearchRequest req;
+  memcpy(&req, args->structureInput, sizeof(req));
+
+  if (!uaddr || !maxResults || !req.size || !req.patternLen ||
+      req.patternLen > kPandoraSearchMaxPattern ||
+      req.start + req.size < req.start) {
+    return kIOReturnBadArgument;
+  }
+
+  // The wire mask is not NUL-terminated; the matcher expects a C string.
+  char mask[kPandoraSearchMaxPattern + 1];
+  memcpy(mask, req.mask, req.patternLen);
+  mask[req.patternLen] = '\0';
+
+  pattern_plan plan;
+  if (!pattern_plan_init(&plan, req.pattern, mask) ||
+      plan.len != req.patternLen) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t stride = req.stride ? static_cast<size_t>(req.stride) : plan.len;
+
+  size_t capacity = 0;
+  uint8_t *chunk = static_cast<uint8_t *>(
+      self->bouncePool_.get(BouncePool::kMaxClassSize, &capacity));
+  if (!chunk) {
+    return kIOReturnNoMemory;
+  }
+  if (capacity < plan.len) {
+    self->bouncePool_.put(chunk, capacity);
+    return kIOReturnNoMemory;
+  }
+
+  // Matches are staged and copied out in small batches.
+  uint64_t staged[32];
+  uint32_t stagedCount = 0;
+  uint64_t found = 0;
+  bool truncated = false;
+  IOReturn ret = kIOReturnSuccess;
+
+  // `off` is always a candidate offset, so each chunk starts on the stride
+  // grid and consecutive chunks overlap by less than one pattern.
+  uint64_t off = 0;
+  while (off + plan.len <= req.size && !truncated) {
+    size_t chunkLen = (req.size - off < capacity)
+                          ? static_cast<size_t>(req.size - off)
+                          : capacity;
+    if (KernelUtilities::kread(req.start + off, chunk, chunkLen) !=
+        KUErrorSuccess) {
+      ret = kIOReturnNotReadable;
+      break;
+    }
+
+    size_t rel = 0;
+    while ((rel = pattern_find(&plan, chunk, chunkLen, rel, stride)) !=
+           PATTERN_NOT_FOUND) {
+      if (found == maxResults) {
+        truncated = true;
+        break;
+      }
+      staged[stagedCount++] = req.start + off + rel;
+      found++;
+      if (stagedCount == sizeof(staged) / sizeof(staged[0])) {
+        if (copyout(staged, uaddr + (found - stagedCount) * sizeof(uint64_t),
+                    stagedCount * sizeof(uint64_t)) != 0) {
+          ret = kIOReturnVMError;
+          break;
+        }
+        stagedCount = 0;
+      }
+      rel = pattern_next_candidate(chunkLen, rel, stride);
+    }
+    if (ret != kIOReturnSuccess) {
+      break;
+    }
+
+    // A stride can be as large as the user likes; stop once the next chunk
+    // would start at or past the end rather than letting `off` wrap.
+    uint64_t advance = pattern_chunk_advance(&plan, chunkLen, stride);
+    if (advance >= req.size - off) {
+      break;
+    }
+    off += advance;
+  }
+
+  if (ret == kIOReturnSuccess && stagedCount &&
+      copyout(staged, uaddr + (found - stagedCount) * sizeof(uint64_t),
+              stagedCount * sizeof(uint64_t)) != 0) {
+    ret = kIOReturnVMError;
+  }
+
+  self->bouncePool_.put(chunk, capacity);
+
+  args->scalarOutput[0] = found;
+  args->scalarOutput[1] = truncated ? 1 : 0;
+  return ret;
+}
+
+IOReturn HwAccessModule::methodKReadWindow(PandoraUserClient *client,
+                                           PandoraModule *module,
+                                           IOExternalMethodArguments *args) {
+  (void)module;
+
+  if (!client || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t kaddr = args->scalarInput[0];
+  uint64_t offset = args->scalarInput[1];
+  uint64_t len = args->scalarInput[2];
+
+  size_t windowSize = 0;
+  uint8_t *window = client->readWindow(&windowSize);
+  if (!window) {
+    return kIOReturnNotReady;
+  }
+
+  if (!kaddr || !len || offset > windowSize || len > windowSize - offset) {
+    return kIOReturnBadArgument;
+  }
+
+  // The window is the destination: no bounce buffer and no copyout.
+  KUError err = KernelUtilities::kread(kaddr, window + offset, len);
+  if (err != KUErrorSuccess) {
+    PANDORA_USERCLIENT_LOG_ERROR(
+        "HwAccessModule::kread_window failed size=%llu addr=0x%llx err=%s(%d)",
+        len, kaddr, get_error_name(err), err);
+    return kIOReturnVMError;
+  }
+
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodKWrite(PandoraUserClient *client,
+                                      PandoraModule *module,
+                                      IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  user_addr_t uaddr = args->scalarInput[0];
+  uint64_t kaddr = args->scalarInput[1];
+  size_t len = args->scalarInput[2];
+
+  if (!kaddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t capacity = 0;
+  void *buffer = self->bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn ret = kIOReturnSuccess;
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < capacity) ? (len - done) : capacity;
+    if (copyin(uaddr + done, buffer, chunk) != 0) {
+      ret = kIOReturnVMError;
+      break;
+    }
+
+    KUError err = KernelUtilities::kwrite(kaddr + done, buffer, chunk);
+    if (err != KUErrorSuccess) {
+      const PandoraRuntimeState &runtime = pandora_runtime_state();
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kwrite failed size=%zu addr=0x%llx err=%s(%d) extra=[%llu,%llu,%llu]",
+          chunk, kaddr + done, get_error_name(err), err,
+          runtime.debug.extraErrorData1,
+          runtime.debug.extraErrorData2,
+          runtime.debug.extraErrorData3);
+      ret = kIOReturnVMError;
+      break;
+    }
+    done += chunk;
+  }
+
+  self->bouncePool_.put(buffer, capacity);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodKWriteV(PandoraUserClient *client,
+                                       PandoraModule *module,
+                                       IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  void *input = nullptr;
+  size_t inputSize = 0;
+  IOReturn ret = copyStructureInput(args, kPandoraKWriteVMaxInputSize, &input,
+                                    &inputSize);
+  if (ret != kIOReturnSuccess) {
+    return ret;
+  }
+
+  const auto *header = static_cast<const PandoraKWriteVHeader *>(input);
+  const size_t runsOffset = sizeof(PandoraKWriteVHeader);
+  if (inputSize < runsOffset || header->count == 0 ||
+      header->count > kPandoraKWriteVMaxRuns ||
+      inputSize - runsOffset <
+          header->count * sizeof(PandoraKWriteVRun)) {
+    IOFree(input, inputSize);
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t count = header->count;
+  const auto *runs = reinterpret_cast<const PandoraKWriteVRun *>(
+      static_cast<const uint8_t *>(input) + runsOffset);
+  const uint8_t *payload = reinterpret_cast<const uint8_t *>(runs + count);
+  const size_t payloadSize =
+      inputSize - runsOffset - count * sizeof(PandoraKWriteVRun);
+
+  // Reject the whole request before touching kernel memory if any run is
+  // malformed; a partially applied patch set is worse than none.
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKWriteVRun &run = runs[i];
+    if (!run.kaddr || !run.len || run.offset > payloadSize ||
+        run.len > payloadSize - run.offset) {
+      IOFree(input, inputSize);
+      return kIOReturnBadArgument;
+    }
+  }
+
+  uint64_t written = 0;
+  ret = kIOReturnSuccess;
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKWriteVRun &run = runs[i];
+    KUError err = KernelUtilities::kwrite(run.kaddr, payload + run.offset,
+                                          run.len);
+    if (err != KUErrorSuccess) {
+      const PandoraRuntimeState &runtime = pandora_runtime_state();
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "HwAccessModule::kwritev failed index=%u size=%u addr=0x%llx err=%s(%d) extra=[%llu,%llu,%llu]",
+          i, run.len, run.kaddr, get_error_name(err), err,
+          runtime.debug.extraErrorData1,
+          runtime.debug.extraErrorData2,
+          runtime.debug.extraErrorData3);
+      ret = kIOReturnVMError;
+      break;
+    }
+    written++;
+  }
+
+  IOFree(input, inputSize);
+  args->scalarOutput[0] = written;
+  return ret;
+}
+
+IOReturn HwAccessModule::readTask(task_t task, uint64_t paddr,
+                                  user_addr_t uaddr, size_t len) {
+  size_t capacity = 0;
+  void *buffer = bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn ret = kIOReturnSuccess;
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < capacity) ? (len - done) : capacity;
+    if (KernelUtilities::pread(task, paddr + done, buffer, chunk) !=
+            KUErrorSuccess ||
+        copyout(buffer, uaddr + done, chunk) != 0) {
+      ret = kIOReturnVMError;
+      break;
+    }
+    done += chunk;
+  }
+
+  bouncePool_.put(buffer, capacity);
+  return ret;
+}
+
+IOReturn HwAccessModule::writeTask(task_t task, user_addr_t uaddr,
+                                   uint64_t paddr, size_t len) {
+  size_t capacity = 0;
+  void *buffer = bouncePool_.get(len, &capacity);
+  if (!buffer) {
+    return kIOReturnNoMemory;
+  }
+
+  IOReturn ret = kIOReturnSuccess;
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < capacity) ? (len - done) : capacity;
+    if (copyin(uaddr + done, buffer, chunk) != 0 ||
+        KernelUtilities::pwrite(task, paddr + done, buffer, chunk) !=
+            KUErrorSuccess) {
+      ret = kIOReturnVMError;
+      break;
+    }
+    done += chunk;
+  }
+
+  bouncePool_.put(buffer, capacity);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodPReadPid(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
+  uint64_t paddr = args->scalarInput[1];
+  user_addr_t uaddr = args->scalarInput[2];
+  size_t len = args->scalarInput[3];
+
+  if (!pid || !paddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  proc_t p = proc_find(pid);
+  if (!p) {
+    return kIOReturnNotFound;
+  }
+
+  task_t t = proc_task(p);
+  if (t == TASK_NULL) {
+    proc_rele(p);
+    return kIOReturnNotFound;
+  }
+
+  IOReturn ret = self->readTask(t, paddr, uaddr, len);
+  proc_rele(p);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodPWritePid(PandoraUserClient *client,
+                                         PandoraModule *module,
+                                         IOExternalMethodArguments *args) {
+  (void)client;
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
+  user_addr_t uaddr = args->scalarInput[1];
+  uint64_t paddr = args->scalarInput[2];
+  size_t len = args->scalarInput[3];
+
+  if (!pid || !paddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  proc_t p = proc_find(pid);
+  if (!p) {
+    return kIOReturnNotFound;
+  }
+
+  task_t t = proc_task(p);
+  if (t == TASK_NULL) {
+    proc_rele(p);
+    return kIOReturnNotFound;
+  }
+
+  IOReturn ret = self->writeTask(t, uaddr, paddr, len);
+  proc_rele(p);
+  return ret;
+}
+
+// Reads `count` ranges of `task` into `staging` back to back with one
+// multi-range descriptor. Returns false if the descriptor cannot be prepared,
+// e.g. because one of the ranges is unmapped.
+static bool preadRangesGathered(task_t task, IOAddressRange *ranges,
+                                uint32_t count, uint8_t *staging,
+                                size_t total) {
+  IOMemoryDescriptor *memDesc =
+      IOMemoryDescriptor::withAddressRanges(ranges, count, kIODirectionIn, task);
+  if (!memDesc) {
+    return false;
+  }
+  if (memDesc->prepare() != kIOReturnSuccess) {
+    memDesc->release();
+    return false;
+  }
+
+  uint64_t bytesRead = memDesc->readBytes(0, staging, total);
+  memDesc->complete();
+  memDesc->release();
+  return bytesRead == total;
+}
+
+// Serves every descriptor whose status is still success, batching them into
+// multi-range descriptors, and counts the failures.
+static IOReturn preadvTask(task_t task, const PandoraKReadVDescriptor *descs,
+                           IOReturn *statuses, uint32_t count,
+                           user_addr_t uaddr, uint64_t *failed) {
+  IOAddressRange *ranges = static_cast<IOAddressRange *>(
+      IOMalloc(count * sizeof(IOAddressRange)));
+  uint32_t *indices =
+      static_cast<uint32_t *>(IOMalloc(count * sizeof(uint32_t)));
+  uint8_t *staging =
+      static_cast<uint8_t *>(IOMalloc(kPandoraPReadVMaxBatchBytes));
+  if (!ranges || !indices || !staging) {
+    if (ranges) {
+      IOFree(ranges, count * sizeof(IOAddressRange));
+    }
+    if (indices) {
+      IOFree(indices, count * sizeof(uint32_t));
+    }
+    if (staging) {
+      IOFree(staging, kPandoraPReadVMaxBatchBytes);
+    }
+    return kIOReturnNoMemory;
+  }
+
+  uint32_t next = 0;
+  while (next < count) {
+    // Gather valid descriptors until the staging buffer is full.
+    uint32_t batch = 0;
+    size_t total = 0;
+    for (; next < count; ++next) {
+      const PandoraKReadVDescriptor &d = descs[next];
+      if (statuses[next] != kIOReturnSuccess) {
+        continue;
+      }
+      if (total + d.len > kPandoraPReadVMaxBatchBytes) {
+        break;
+      }
+      ranges[batch].address = d.kaddr;
+      ranges[batch].length = d.len;
+      indices[batch++] = next;
+      total += d.len;
+    }
+    if (!batch) {
+      break;
+    }
+
+    if (preadRangesGathered(task, ranges, batch, staging, total)) {
+      size_t off = 0;
+      for (uint32_t b = 0; b < batch; ++b) {
+        const PandoraKReadVDescriptor &d = descs[indices[b]];
+        if (copyout(staging + off, uaddr + d.offset, d.len) != 0) {
+          statuses[indices[b]] = kIOReturnVMError;
+        }
+        off += d.len;
+      }
+      continue;
+    }
+
+    // Something in the batch is not readable; find out which range by
+    // reading them one at a time.
+    for (uint32_t b = 0; b < batch; ++b) {
+      const PandoraKReadVDescriptor &d = descs[indices[b]];
+      if (KernelUtilities::pread(task, d.kaddr, staging, d.len) !=
+              KUErrorSuccess ||
+          copyout(staging, uaddr + d.offset, d.len) != 0) {
+        statuses[indices[b]] = kIOReturnVMError;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (statuses[i] != kIOReturnSuccess) {
+      (*failed)++;
+    }
+  }
+
+  IOFree(staging, kPandoraPReadVMaxBatchBytes);
+  IOFree(indices, count * sizeof(uint32_t));
+  IOFree(ranges, count * sizeof(IOAddressRange));
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodPReadV(PandoraUserClient *client,
+                                      PandoraModule *module,
+                                      IOExternalMethodArguments *args) {
+  (void)module;
+
+  if (!client || !args || !args->structureInput ||
+      !args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  // Target is a handle from the open-process selector, or a pid when the
+  // handle is 0.
+  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
+  uint64_t handle = args->scalarInput[1];
+  user_addr_t uaddr = args->scalarInput[2];
+  uint64_t ulen = args->scalarInput[3];
+
+  const uint32_t inSize = args->structureInputSize;
+  if ((!pid && !handle) || !uaddr || !ulen || inSize == 0 ||
+      inSize % sizeof(PandoraKReadVDescriptor) != 0) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint32_t count = inSize / sizeof(PandoraKReadVDescriptor);
+  if (count > kPandoraKReadVMaxDescriptors ||
+      args->structureOutputSize < count * sizeof(IOReturn)) {
+    return kIOReturnBadArgument;
+  }
+
+  const auto *descs =
+      static_cast<const PandoraKReadVDescriptor *>(args->structureInput);
+  auto *statuses = static_cast<IOReturn *>(args->structureOutput);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    const PandoraKReadVDescriptor &d = descs[i];
+    bool valid = d.kaddr && d.len && d.len <= kPandoraPReadVMaxBatchBytes &&
+                 d.offset <= ulen && d.len <= ulen - d.offset;
+    statuses[i] = valid ? kIOReturnSuccess : kIOReturnBadArgument;
+  }
+
+  task_t task = TASK_NULL;
+  if (handle) {
+    task = client->copyProcessTask(handle);
+  } else {
+    proc_t p = proc_find(pid);
+    if (p) {
+      task = proc_task(p);
+      if (task != TASK_NULL) {
+        task_reference(task);
+      }
+      proc_rele(p);
+    }
+  }
+  if (task == TASK_NULL) {
+    return kIOReturnNotFound;
+  }
+
+  uint64_t failed = 0;
+  IOReturn ret = preadvTask(task, descs, statuses, count, uaddr, &failed);
+  task_deallocate(task);
+  if (ret != kIOReturnSuccess) {
+    return ret;
+  }
+
+  args->scalarOutput[0] = failed;
+  args->structureOutputSize = count * sizeof(IOReturn);
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodProcOpen(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)module;
+
+  if (!client || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  pid_t pid = static_cast<pid_t>(args->scalarInput[0]);
+  uint64_t handle = 0;
+  IOReturn ret = client->openProcess(pid, &handle);
+  if (ret != kIOReturnSuccess) {
+    return ret;
+  }
+
+  args->scalarOutput[0] = handle;
+  return kIOReturnSuccess;
+}
+
+IOReturn HwAccessModule::methodProcClose(PandoraUserClient *client,
+                                         PandoraModule *module,
+                                         IOExternalMethodArguments *args) {
+  (void)module;
+
+  if (!client || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  return client->closeProcess(args->scalarInput[0]);
+}
+
+IOReturn HwAccessModule::methodProcRead(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  HwAccessModule *self = fromModule(module);
+  if (!self || !client || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t handle = args->scalarInput[0];
+  uint64_t paddr = args->scalarInput[1];
+  user_addr_t uaddr = args->scalarInput[2];
+  size_t len = args->scalarInput[3];
+
+  if (!paddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  task_t t = client->copyProcessTask(handle);
+  if (t == TASK_NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  IOReturn ret = self->readTask(t, paddr, uaddr, len);
+  task_deallocate(t);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodProcWrite(PandoraUserClient *client,
+                                         PandoraModule *module,
+                                         IOExternalMethodArguments *args) {
+  HwAccessModule *self = fromModule(module);
+  if (!self || !client || !args) {
+    return kIOReturnBadArgument;
+  }
+
+  uint64_t handle = args->scalarInput[0];
+  user_addr_t uaddr = args->scalarInput[1];
+  uint64_t paddr = args->scalarInput[2];
+  size_t len = args->scalarInput[3];
+
+  if (!paddr || !uaddr || !len) {
+    return kIOReturnBadArgument;
+  }
+
+  task_t t = client->copyProcessTask(handle);
+  if (t == TASK_NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  IOReturn ret = self->writeTask(t, uaddr, paddr, len);
+  task_deallocate(t);
+  return ret;
+}
+
+IOReturn HwAccessModule::methodGetKernelBase(PandoraUserClient *client,
+                                             PandoraModule *module,
+                                             IOExternalMethodArguments *args) {
+  (void)client;
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  HwAccessModule *self = fromModule(module);
+  if (!self || !self->service_) {
+    return kIOReturnNotReady;
   }
 
   uint64_t kbase = self->service_->kernelUtilities().kernelBase();
@@ -402,9 +2272,9 @@ IOReturn HwAccessModule::methodGetPandoraLoadMetadata(
     PandoraUserClient *client, PandoraModule *module,
     IOExternalMethodArguments *args) {
   (void)client;
-  (void)module;
 
-  if (!args || !args->structureOutput ||
+  HwAccessModule *self = fromModule(module);
+  if (!self || !args || !args->structureOutput ||
       args->structureOutputSize < sizeof(PandoraMetadata)) {
     return kIOReturnBadArgument;
   }
@@ -424,12 +2294,37 @@ IOReturn HwAccessModule::methodGetPandoraLoadMetadata(
           ? runtime.telemetry.userClientInitTime
           : TimestampPair{0, 0, 0};
   metadata.pid1_exists = runtime.telemetry.pid1Exists;
+  metadata.bounce_pool_hits = self->bouncePool_.hits();
+  metadata.bounce_pool_misses = self->bouncePool_.misses();
+  metadata.kernel_base_scan_ns = runtime.telemetry.kernelBaseScanNanos;
 
   memcpy(args->structureOutput, &metadata, sizeof(metadata));
   args->structureOutputSize = sizeof(metadata);
   return kIOReturnSuccess;
 }
 
+IOReturn HwAccessModule::methodAccessPathStats(
+    PandoraUserClient *client, PandoraModule *module,
+    IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args || !args->structureOutput ||
+      args->structureOutputSize < sizeof(KUAccessPathStats)) {
+    return kIOReturnBadArgument;
+  }
+
+  KUAccessPathStats stats = {};
+  KernelUtilities::accessPathStats(&stats);
+  if (args->scalarInput[0] & 1) {
+    KernelUtilities::resetAccessPathCache();
+  }
+
+  memcpy(args->structureOutput, &stats, sizeof(stats));
+  args->structureOutputSize = sizeof(stats);
+  return kIOReturnSuccess;
+}
+
 IOReturn HwAccessModule::methodRunArbFuncWithTaskArgPid(
     PandoraUserClient *client, PandoraModule *module,
     IOExternalMethodArguments *args) {
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "ModuleSystem.h"
+#include "../Utils/BouncePool.h"
+
+#include <IOKit/IOLib.h>
+#include <kern/thread_call.h>
 
 class Pandora;
+struct HwAccessAsyncRequest;
 
 class HwAccessModule final : public PandoraModule {
 public:
@@ -24,13 +29,61 @@ public:
 private:
   Pandora *service_{nullptr};
   bool active_{false};
+  BouncePool bouncePool_;
+
+  // Async requests are queued here and completed by one thread call, so the
+  // calling thread returns as soon as its request is accepted. The lock lives
+  // from the first start until onShutdown(); asyncCall_ is null while stopped.
+  IOLock *asyncLock_{nullptr};
+  thread_call_t asyncCall_{nullptr};
+  HwAccessAsyncRequest *asyncHead_{nullptr};
+  HwAccessAsyncRequest *asyncTail_{nullptr};
 
   static HwAccessModule *fromModule(PandoraModule *module);
 
+  IOReturn startAsync();
+  void stopAsync();
+  IOReturn enqueueAsync(HwAccessAsyncRequest *request);
+  static void asyncWorker(thread_call_param_t param0,
+                          thread_call_param_t param1);
+
+  // Chunked process memory transfers through the bounce pool.
+  IOReturn readTask(task_t task, uint64_t paddr, user_addr_t uaddr,
+                    size_t len);
+  IOReturn writeTask(task_t task, user_addr_t uaddr, uint64_t paddr,
+                     size_t len);
+
   static IOReturn methodKRead(PandoraUserClient *client, PandoraModule *module,
                               IOExternalMethodArguments *args);
+  static IOReturn methodKReadV(PandoraUserClient *client,
+                               PandoraModule *module,
+                               IOExternalMethodArguments *args);
   static IOReturn methodKWrite(PandoraUserClient *client, PandoraModule *module,
                                IOExternalMethodArguments *args);
+  static IOReturn methodKWriteV(PandoraUserClient *client,
+                                PandoraModule *module,
+                                IOExternalMethodArguments *args);
+  static IOReturn methodKReadWindow(PandoraUserClient *client,
+                                    PandoraModule *module,
+                                    IOExternalMethodArguments *args);
+  static IOReturn methodKReadAsync(PandoraUserClient *client,
+                                   PandoraModule *module,
+                                   IOExternalMethodArguments *args);
+  static IOReturn methodKWriteAsync(PandoraUserClient *client,
+                                    PandoraModule *module,
+                                    IOExternalMethodArguments *args);
+  static IOReturn methodKCallAsync(PandoraUserClient *client,
+                                   PandoraModule *module,
+                                   IOExternalMethodArguments *args);
+  static IOReturn methodWalkList(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodSearchPattern(PandoraUserClient *client,
+                                      PandoraModule *module,
+                                      IOExternalMethodArguments *args);
+  static IOReturn methodAccessPathStats(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args);
   static IOReturn methodGetKernelBase(PandoraUserClient *client,
                                       PandoraModule *module,
                                       IOExternalMethodArguments *args);
@@ -43,8 +96,56 @@ private:
   static IOReturn methodPWritePid(PandoraUserClient *client,
                                   PandoraModule *module,
                                   IOExternalMethodArguments *args);
+  static IOReturn methodProcOpen(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodProcClose(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args);
+  static IOReturn methodProcRead(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodProcWrite(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args);
+  static IOReturn methodPReadV(PandoraUserClient *client,
+                               PandoraModule *module,
+                               IOExternalMethodArguments *args);
+  static IOReturn methodPhysRead(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodPhysInfo(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodVToPBatch(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args);
+  static IOReturn methodTranslationRegs(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args);
+  static IOReturn methodPhysRanges(PandoraUserClient *client,
+                                   PandoraModule *module,
+                                   IOExternalMethodArguments *args);
+  static IOReturn methodKMemmove(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodKMemset(PandoraUserClient *client,
+                                PandoraModule *module,
+                                IOExternalMethodArguments *args);
+  static IOReturn methodKAtomic(PandoraUserClient *client,
+                                PandoraModule *module,
+                                IOExternalMethodArguments *args);
+  static IOReturn methodHashRanges(PandoraUserClient *client,
+                                   PandoraModule *module,
+                                   IOExternalMethodArguments *args);
+  static IOReturn methodQueryRun(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
   static IOReturn methodKCall(PandoraUserClient *client, PandoraModule *module,
                               IOExternalMethodArguments *args);
+  static IOReturn methodKCallBatch(PandoraUserClient *client,
+                                   PandoraModule *module,
+                                   IOExternalMethodArguments *args);
   static IOReturn methodRunArbFuncWithTaskArgPid(
       PandoraUserClient *client, PandoraModule *module,
       IOExternalMethodArguments *args);
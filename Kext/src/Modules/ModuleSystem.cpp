@@ -4,7 +4,12 @@
 #include "PatchOSVariantModule.h"
 #include "../Pandora.h"
 #include "../Utils/PandoraLog.h"
+#include "../Utils/TimeUtilities.h"
 
+#include <IOKit/IOLib.h>
+#include <IOKit/IOMemoryDescriptor.h>
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
 #include <pexpert/pexpert.h>
 #include <string.h>
 
@@ -20,9 +25,20 @@ struct PandoraModuleRuntime {
   IOReturn startError;
 };
 
+struct PandoraUserClientMethodStatsRuntime {
+  volatile SInt64 calls;
+  volatile SInt64 errors;
+  volatile SInt64 bytes;
+  volatile SInt64 totalNanos;
+  volatile UInt64 maxNanos;
+  volatile SInt64 histogram[kPandoraLatencyBuckets];
+};
+
 struct PandoraUserClientMethodCookie {
   PandoraModule *module;
   PandoraUserClientMethodHandler handler;
+  uint8_t bytesScalarIndex;
+  PandoraUserClientMethodStatsRuntime stats;
 };
 
 struct PandoraUserClientMethodRuntime {
@@ -38,9 +54,118 @@ bool g_defaults_registered = false;
 PandoraUserClientMethodRuntime g_userclient_methods[kMaxUserClientMethods] = {};
 size_t g_userclient_method_count = 0;
 
+// Selector lookup: module id -> dispatch slot + 1, then slot and local
+// selector -> method index + 1. Zero means "not registered".
+static constexpr size_t kMaxDispatchSlots = kMaxModules + 1; // + core
+uint8_t g_userclient_module_slots[kPandoraMaxModuleId] = {};
+uint16_t g_userclient_index[kMaxDispatchSlots][kPandoraMaxLocalSelector] = {};
+size_t g_userclient_slot_count = 0;
+
 static HwAccessModule g_hw_access_module;
 static PatchOSVariantModule g_patch_osvariant_module;
 
+using CoreReplyBuilder = IOReturn (*)(void *out, size_t *size, bool reset);
+
+// Core replies can exceed the inband limit, in which case IOKit hands us the
+// caller's buffer as a descriptor instead.
+IOReturn core_write_reply(IOExternalMethodArguments *args, size_t needed,
+                          CoreReplyBuilder build, bool reset) {
+  if (args->structureOutputDescriptor) {
+    if (args->structureOutputDescriptor->getLength() < needed) {
+      return kIOReturnNoSpace;
+    }
+
+    void *buffer = IOMalloc(needed);
+    if (!buffer) {
+      return kIOReturnNoMemory;
+    }
+
+    size_t size = needed;
+    IOReturn rc = build(buffer, &size, reset);
+    if (rc == kIOReturnSuccess &&
+        args->structureOutputDescriptor->writeBytes(0, buffer, size) != size) {
+      rc = kIOReturnVMError;
+    }
+    IOFree(buffer, needed);
+    args->structureOutputDescriptorSize = static_cast<uint32_t>(size);
+    return rc;
+  }
+
+  if (!args->structureOutput) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t size = args->structureOutputSize;
+  IOReturn rc = build(args->structureOutput, &size, reset);
+  args->structureOutputSize = static_cast<uint32_t>(size);
+  return rc;
+}
+
+IOReturn core_method_capabilities(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  return core_write_reply(
+      args, pandora_modules_capabilities_size(),
+      [](void *out, size_t *size, bool) {
+        return pandora_modules_copy_capabilities(out, size);
+      },
+      false);
+}
+
+// scalarInput[0] bit 0 resets the counters after they are copied out.
+IOReturn core_method_method_stats(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args) {
+  (void)client;
+  (void)module;
+
+  if (!args) {
+    return kIOReturnBadArgument;
+  }
+
+  return core_write_reply(args, pandora_modules_method_stats_size(),
+                          &pandora_modules_copy_method_stats,
+                          (args->scalarInput[0] & 1u) != 0);
+}
+
+// Owns the selectors every client needs regardless of which modules are
+// enabled. It is never listed in g_modules.
+class PandoraCoreModule final : public PandoraModule {
+public:
+  const PandoraModuleDescriptor &descriptor() const override {
+    static const PandoraModuleDescriptor kDescriptor = {
+        kPandoraCoreModuleId, "core", nullptr, nullptr, true,
+    };
+    return kDescriptor;
+  }
+
+  IOReturn onStart(Pandora &service) override {
+    (void)service;
+    return kIOReturnSuccess;
+  }
+
+  void onStop(Pandora &service) override { (void)service; }
+
+  void registerUserClientMethods(
+      PandoraUserClientMethodRegistrar &registrar) override {
+    (void)registrar.addMethod(kPandoraCoreSelectorCapabilities,
+                              &core_method_capabilities, 0, 0, 0,
+                              kIOUCVariableStructureSize);
+    (void)registrar.addMethod(kPandoraCoreSelectorMethodStats,
+                              &core_method_method_stats, 1, 0, 0,
+                              kIOUCVariableStructureSize);
+  }
+};
+
+static PandoraCoreModule g_core_module;
+
 PandoraModuleRuntime *find_module_runtime(uint16_t moduleId) {
   for (size_t i = 0; i < g_module_count; ++i) {
     if (g_modules[i].module &&
@@ -105,6 +230,68 @@ bool module_enabled_from_boot_args(const PandoraModuleDescriptor &desc) {
 void clear_userclient_methods() {
   g_userclient_method_count = 0;
   bzero(g_userclient_methods, sizeof(g_userclient_methods));
+  g_userclient_slot_count = 0;
+  bzero(g_userclient_module_slots, sizeof(g_userclient_module_slots));
+  bzero(g_userclient_index, sizeof(g_userclient_index));
+}
+
+uint32_t latency_bucket(uint64_t nanos) {
+  if (nanos == 0) {
+    return 0;
+  }
+
+  uint32_t bucket = 63u - static_cast<uint32_t>(__builtin_clzll(nanos));
+  return bucket < kPandoraLatencyBuckets ? bucket : kPandoraLatencyBuckets - 1;
+}
+
+uint64_t method_bytes(const PandoraUserClientMethodCookie &cookie,
+                      const IOExternalMethodArguments *args) {
+  if (cookie.bytesScalarIndex != kPandoraNoBytesScalar) {
+    return cookie.bytesScalarIndex < args->scalarInputCount
+               ? args->scalarInput[cookie.bytesScalarIndex]
+               : 0;
+  }
+
+  uint64_t bytes = args->structureInputSize + args->structureOutputSize;
+  if (args->structureInputDescriptor) {
+    bytes += args->structureInputDescriptor->getLength();
+  }
+  if (args->structureOutputDescriptor) {
+    bytes += args->structureOutputDescriptorSize;
+  }
+  return bytes;
+}
+
+void record_method_call(PandoraUserClientMethodCookie &cookie,
+                        const IOExternalMethodArguments *args, IOReturn rc,
+                        uint64_t elapsed) {
+  PandoraUserClientMethodStatsRuntime &stats = cookie.stats;
+  const uint64_t nanos = TimeUtilities::machTimeToNanoseconds(elapsed);
+
+  OSIncrementAtomic64(&stats.calls);
+  OSAddAtomic64(static_cast<SInt64>(nanos), &stats.totalNanos);
+  OSIncrementAtomic64(&stats.histogram[latency_bucket(nanos)]);
+  if (rc == kIOReturnSuccess) {
+    OSAddAtomic64(static_cast<SInt64>(method_bytes(cookie, args)),
+                  &stats.bytes);
+  } else {
+    OSIncrementAtomic64(&stats.errors);
+  }
+
+  UInt64 seen = stats.maxNanos;
+  while (nanos > seen && !OSCompareAndSwap64(seen, nanos, &stats.maxNanos)) {
+    seen = stats.maxNanos;
+  }
+}
+
+// Returns the value read and subtracts it when `reset` is set, so calls that
+// land in between are kept for the next read.
+uint64_t take_counter(volatile SInt64 *counter, bool reset) {
+  SInt64 value = *counter;
+  if (reset && value) {
+    OSAddAtomic64(-value, counter);
+  }
+  return static_cast<uint64_t>(value);
 }
 
 IOReturn add_userclient_method(PandoraModule &module, uint16_t localSelector,
@@ -112,7 +299,8 @@ IOReturn add_userclient_method(PandoraModule &module, uint16_t localSelector,
                                uint32_t checkScalarInputCount,
                                uint32_t checkStructureInputSize,
                                uint32_t checkScalarOutputCount,
-                               uint32_t checkStructureOutputSize) {
+                               uint32_t checkStructureOutputSize,
+                               uint8_t bytesScalarIndex) {
   if (!handler) {
     return kIOReturnBadArgument;
   }
@@ -123,15 +311,30 @@ IOReturn add_userclient_method(PandoraModule &module, uint16_t localSelector,
     return kIOReturnNoResources;
   }
 
-  const uint32_t selector =
-      pandora_compose_selector(module.descriptor().identifier, localSelector);
+  const uint16_t moduleId = module.descriptor().identifier;
+  const uint32_t selector = pandora_compose_selector(moduleId, localSelector);
 
-  for (size_t i = 0; i < g_userclient_method_count; ++i) {
-    if (g_userclient_methods[i].selector == selector) {
-      PANDORA_LOG_DEFAULT("Duplicate userclient selector 0x%x from module %s",
-                          selector, module.descriptor().name);
-      return kIOReturnExclusiveAccess;
+  if (moduleId >= kPandoraMaxModuleId ||
+      localSelector >= kPandoraMaxLocalSelector) {
+    PANDORA_LOG_DEFAULT("Userclient selector 0x%x from module %s is out of "
+                        "dispatch table range",
+                        selector, module.descriptor().name);
+    return kIOReturnBadArgument;
+  }
+
+  uint8_t slot = g_userclient_module_slots[moduleId];
+  if (slot && g_userclient_index[slot - 1][localSelector]) {
+    PANDORA_LOG_DEFAULT("Duplicate userclient selector 0x%x from module %s",
+                        selector, module.descriptor().name);
+    return kIOReturnExclusiveAccess;
+  }
+
+  if (!slot) {
+    if (g_userclient_slot_count >= kMaxDispatchSlots) {
+      return kIOReturnNoResources;
     }
+    slot = static_cast<uint8_t>(++g_userclient_slot_count);
+    g_userclient_module_slots[moduleId] = slot;
   }
 
   PandoraUserClientMethodRuntime &entry =
@@ -146,6 +349,9 @@ IOReturn add_userclient_method(PandoraModule &module, uint16_t localSelector,
   };
   entry.cookie.module = &module;
   entry.cookie.handler = handler;
+  entry.cookie.bytesScalarIndex = bytesScalarIndex;
+  g_userclient_index[slot - 1][localSelector] =
+      static_cast<uint16_t>(g_userclient_method_count);
 
   PANDORA_LOG_DEFAULT("Registered userclient method module=%s id=0x%x local=%u",
                       module.descriptor().name, selector, localSelector);
@@ -155,6 +361,9 @@ IOReturn add_userclient_method(PandoraModule &module, uint16_t localSelector,
 IOReturn rebuild_userclient_dispatch_table() {
   clear_userclient_methods();
 
+  PandoraUserClientMethodRegistrar coreRegistrar(g_core_module);
+  g_core_module.registerUserClientMethods(coreRegistrar);
+
   for (size_t i = 0; i < g_module_count; ++i) {
     PandoraModuleRuntime &runtime = g_modules[i];
     if (!runtime.started || !runtime.module) {
@@ -199,12 +408,13 @@ void PandoraModule::registerUserClientMethods(
 IOReturn PandoraUserClientMethodRegistrar::addMethod(
     uint16_t localSelector, PandoraUserClientMethodHandler handler,
     uint32_t checkScalarInputCount, uint32_t checkStructureInputSize,
-    uint32_t checkScalarOutputCount, uint32_t checkStructureOutputSize) {
+    uint32_t checkScalarOutputCount, uint32_t checkStructureOutputSize,
+    uint8_t bytesScalarIndex) {
   return add_userclient_method(module_, localSelector, handler,
                                checkScalarInputCount,
                                checkStructureInputSize,
                                checkScalarOutputCount,
-                               checkStructureOutputSize);
+                               checkStructureOutputSize, bytesScalarIndex);
 }
 
 bool pandora_bootarg_enabled(const char *name, bool defaultEnabled) {
@@ -358,6 +568,117 @@ bool pandora_modules_is_started(uint16_t moduleId) {
   return runtime ? runtime->started : false;
 }
 
+size_t pandora_modules_capabilities_size() {
+  return sizeof(PandoraCapabilitiesHeader) +
+         g_module_count * sizeof(PandoraCapabilitiesModule) +
+         g_userclient_method_count * sizeof(PandoraCapabilitiesMethod);
+}
+
+IOReturn pandora_modules_copy_capabilities(void *out, size_t *size) {
+  if (!out || !size) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t needed = pandora_modules_capabilities_size();
+  if (*size < needed) {
+    *size = needed;
+    return kIOReturnNoSpace;
+  }
+
+  uint8_t *cursor = static_cast<uint8_t *>(out);
+
+  PandoraCapabilitiesHeader header = {};
+  header.version = kPandoraCapabilitiesVersion;
+  header.moduleCount = static_cast<uint32_t>(g_module_count);
+  header.methodCount = static_cast<uint32_t>(g_userclient_method_count);
+  memcpy(cursor, &header, sizeof(header));
+  cursor += sizeof(header);
+
+  for (size_t i = 0; i < g_module_count; ++i) {
+    const PandoraModuleRuntime &runtime = g_modules[i];
+    const PandoraModuleDescriptor &desc = runtime.module->descriptor();
+
+    PandoraCapabilitiesModule record = {};
+    record.identifier = desc.identifier;
+    record.enabled = runtime.enabled ? 1 : 0;
+    record.started = runtime.started ? 1 : 0;
+    record.startError = runtime.startError;
+    if (desc.name) {
+      strlcpy(record.name, desc.name, sizeof(record.name));
+    }
+    memcpy(cursor, &record, sizeof(record));
+    cursor += sizeof(record);
+  }
+
+  for (size_t i = 0; i < g_userclient_method_count; ++i) {
+    const PandoraUserClientMethodRuntime &entry = g_userclient_methods[i];
+
+    PandoraCapabilitiesMethod record = {};
+    record.selector = entry.selector;
+    record.scalarInputCount = entry.dispatch.checkScalarInputCount;
+    record.structureInputSize = entry.dispatch.checkStructureInputSize;
+    record.scalarOutputCount = entry.dispatch.checkScalarOutputCount;
+    record.structureOutputSize = entry.dispatch.checkStructureOutputSize;
+    memcpy(cursor, &record, sizeof(record));
+    cursor += sizeof(record);
+  }
+
+  *size = needed;
+  return kIOReturnSuccess;
+}
+
+size_t pandora_modules_method_stats_size() {
+  return sizeof(PandoraMethodStatsHeader) +
+         g_userclient_method_count * sizeof(PandoraMethodStats);
+}
+
+IOReturn pandora_modules_copy_method_stats(void *out, size_t *size,
+                                           bool reset) {
+  if (!out || !size) {
+    return kIOReturnBadArgument;
+  }
+
+  size_t needed = pandora_modules_method_stats_size();
+  if (*size < needed) {
+    *size = needed;
+    return kIOReturnNoSpace;
+  }
+
+  uint8_t *cursor = static_cast<uint8_t *>(out);
+
+  PandoraMethodStatsHeader header = {};
+  header.version = kPandoraMethodStatsVersion;
+  header.count = static_cast<uint32_t>(g_userclient_method_count);
+  header.bucketCount = kPandoraLatencyBuckets;
+  memcpy(cursor, &header, sizeof(header));
+  cursor += sizeof(header);
+
+  for (size_t i = 0; i < g_userclient_method_count; ++i) {
+    PandoraUserClientMethodRuntime &entry = g_userclient_methods[i];
+    PandoraUserClientMethodStatsRuntime &stats = entry.cookie.stats;
+
+    PandoraMethodStats record = {};
+    record.selector = entry.selector;
+    record.calls = take_counter(&stats.calls, reset);
+    record.errors = take_counter(&stats.errors, reset);
+    record.bytes = take_counter(&stats.bytes, reset);
+    record.totalNanos = take_counter(&stats.totalNanos, reset);
+    record.maxNanos = stats.maxNanos;
+    if (reset) {
+      OSCompareAndSwap64(record.maxNanos, 0, &stats.maxNanos);
+    }
+    for (uint32_t b = 0; b < kPandoraLatencyBuckets; ++b) {
+      record.histogram[b] = take_counter(&stats.histogram[b], reset);
+    }
+
+    memcpy(cursor, &record, sizeof(record));
+    cursor += sizeof(record);
+  }
+
+  *size = needed;
+  return kIOReturnSuccess;
+}
+
 bool pandora_modules_authorize_user_client(task_t owningTask, void *securityID,
                                            uint32_t type) {
   bool sawUserClientModule = false;
@@ -384,16 +705,27 @@ bool pandora_modules_lookup_userclient_method(uint32_t selector,
     return false;
   }
 
-  for (size_t i = 0; i < g_userclient_method_count; ++i) {
-    const PandoraUserClientMethodRuntime &entry = g_userclient_methods[i];
-    if (entry.selector == selector) {
-      out->dispatch = &entry.dispatch;
-      out->reference = const_cast<PandoraUserClientMethodCookie *>(&entry.cookie);
-      return true;
-    }
+  const uint32_t moduleId = selector >> kPandoraModuleSelectorShift;
+  const uint32_t localSelector = selector & 0xFFFFu;
+  if (moduleId >= kPandoraMaxModuleId ||
+      localSelector >= kPandoraMaxLocalSelector) {
+    return false;
   }
 
-  return false;
+  const uint8_t slot = g_userclient_module_slots[moduleId];
+  if (!slot) {
+    return false;
+  }
+
+  const uint16_t index = g_userclient_index[slot - 1][localSelector];
+  if (!index) {
+    return false;
+  }
+
+  PandoraUserClientMethodRuntime &entry = g_userclient_methods[index - 1];
+  out->dispatch = &entry.dispatch;
+  out->reference = &entry.cookie;
+  return true;
 }
 
 IOReturn pandora_modules_userclient_dispatch(PandoraUserClient *client,
@@ -408,5 +740,8 @@ IOReturn pandora_modules_userclient_dispatch(PandoraUserClient *client,
     return kIOReturnBadArgument;
   }
 
-  return cookie->handler(client, cookie->module, args);
+  const uint64_t start = mach_absolute_time();
+  IOReturn rc = cookie->handler(client, cookie->module, args);
+  record_method_call(*cookie, args, rc, mach_absolute_time() - start);
+  return rc;
 }
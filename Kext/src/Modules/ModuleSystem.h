@@ -20,6 +20,20 @@ static inline constexpr uint32_t pandora_compose_selector(uint16_t moduleId,
          static_cast<uint32_t>(local);
 }
 
+// Selectors owned by the module system itself rather than by a module.
+static constexpr uint16_t kPandoraCoreModuleId = 0x00FF;
+static constexpr uint16_t kPandoraCoreSelectorCapabilities = 0;
+static constexpr uint16_t kPandoraCoreSelectorMethodStats = 1;
+
+// Dispatch is a direct [module][local selector] table lookup, so module ids
+// and local selectors must stay below these bounds.
+static constexpr uint16_t kPandoraMaxModuleId = 0x0100;
+static constexpr uint16_t kPandoraMaxLocalSelector = 64;
+
+// Passed as addMethod's bytesScalarIndex when no scalar input holds the
+// transfer length; the structure sizes are counted instead.
+static constexpr uint8_t kPandoraNoBytesScalar = 0xFF;
+
 struct PandoraModuleDescriptor {
   uint16_t identifier;
   const char *name;
@@ -42,7 +56,8 @@ public:
                      uint32_t checkScalarInputCount,
                      uint32_t checkStructureInputSize,
                      uint32_t checkScalarOutputCount,
-                     uint32_t checkStructureOutputSize);
+                     uint32_t checkStructureOutputSize,
+                     uint8_t bytesScalarIndex = kPandoraNoBytesScalar);
 
 private:
   PandoraModule &module_;
@@ -74,6 +89,57 @@ struct PandoraModuleInfo {
   IOReturn startError;
 };
 
+// Reply of the capabilities selector: a header followed by `moduleCount`
+// module records and `methodCount` method records.
+static constexpr uint32_t kPandoraCapabilitiesVersion = 1;
+static constexpr size_t kPandoraCapabilitiesNameSize = 32;
+
+struct PandoraCapabilitiesHeader {
+  uint32_t version;
+  uint32_t moduleCount;
+  uint32_t methodCount;
+  uint32_t reserved;
+};
+
+struct PandoraCapabilitiesModule {
+  uint16_t identifier;
+  uint8_t enabled;
+  uint8_t started;
+  IOReturn startError;
+  char name[kPandoraCapabilitiesNameSize];
+};
+
+struct PandoraCapabilitiesMethod {
+  uint32_t selector;
+  uint32_t scalarInputCount;
+  uint32_t structureInputSize;
+  uint32_t scalarOutputCount;
+  uint32_t structureOutputSize;
+};
+
+// Reply of the method statistics selector: a header followed by `count`
+// records. Bucket i of the histogram counts calls that took [2^i, 2^(i+1)) ns.
+static constexpr uint32_t kPandoraMethodStatsVersion = 1;
+static constexpr uint32_t kPandoraLatencyBuckets = 32;
+
+struct PandoraMethodStatsHeader {
+  uint32_t version;
+  uint32_t count;
+  uint32_t bucketCount;
+  uint32_t reserved;
+};
+
+struct PandoraMethodStats {
+  uint32_t selector;
+  uint32_t reserved;
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes;
+  uint64_t totalNanos;
+  uint64_t maxNanos;
+  uint64_t histogram[kPandoraLatencyBuckets];
+};
+
 struct PandoraUserClientMethodLookup {
   const IOExternalMethodDispatch *dispatch;
   void *reference;
@@ -91,6 +157,11 @@ size_t pandora_modules_count();
 bool pandora_modules_get_info(size_t index, PandoraModuleInfo *out);
 bool pandora_modules_is_started(uint16_t moduleId);
 
+size_t pandora_modules_capabilities_size();
+IOReturn pandora_modules_copy_capabilities(void *out, size_t *size);
+size_t pandora_modules_method_stats_size();
+IOReturn pandora_modules_copy_method_stats(void *out, size_t *size, bool reset);
+
 bool pandora_modules_authorize_user_client(task_t owningTask, void *securityID,
                                            uint32_t type);
 bool pandora_modules_lookup_userclient_method(uint32_t selector,
@@ -6,6 +6,24 @@
 
 #include <IOKit/IOTimerEventSource.h>
 #include <IOKit/IOWorkLoop.h>
+#include <string.h>
+
+namespace {
+
+enum PatchOSVariantUserClientMethod : uint16_t {
+  kMethodWatchAdd = 0,
+  kMethodWatchRemove = 1,
+  kMethodWatchList = 2,
+  kMethodWatchSetInterval = 3,
+};
+
+static constexpr uint64_t kOsVariantPatchedValue = 0x70010000f38882cf;
+
+static inline uint64_t widthMask(uint32_t width) {
+  return width == 8 ? ~0ull : 0xffffffffull;
+}
+
+} // namespace
 
 PatchOSVariantModule *PatchOSVariantModule::activeInstance_ = nullptr;
 
@@ -33,31 +51,14 @@ IOReturn PatchOSVariantModule::onStart(Pandora &service) {
     return kIOReturnError;
   }
 
-  if (!service.versionUtilities().init()) {
-    PANDORA_LOG_DEFAULT("patch_osvariant: VersionUtilities init failed");
-    resetState();
-    return kIOReturnError;
-  }
-
-  if (!service.versionUtilities().isSupportedVersion()) {
-    PANDORA_LOG_DEFAULT("patch_osvariant: unsupported macOS/device: %s / %s",
-                        service.versionUtilities().getBuildVersion(),
-                        service.versionUtilities().getModelIdentifier());
-    resetState();
-    return kIOReturnUnsupported;
-  }
-
-  uintptr_t unslid = 0;
-  if (!service.versionUtilities().getOsVariantStatusBacking(&unslid) ||
-      unslid == 0 || unslid == kNoHook) {
-    PANDORA_LOG_DEFAULT(
-        "patch_osvariant: failed to get osvariant_status_backing address");
-    resetState();
-    return kIOReturnNotFound;
+  if (!rulesLock_) {
+    rulesLock_ = IOLockAlloc();
+    if (!rulesLock_) {
+      resetState();
+      return kIOReturnNoMemory;
+    }
   }
 
-  uint64_t slid = service.kernelUtilities().kslide(unslid);
-
   IOWorkLoop *workLoop = service.getWorkLoop();
   if (!workLoop) {
     PANDORA_LOG_DEFAULT("patch_osvariant: no workloop available");
@@ -82,32 +83,97 @@ IOReturn PatchOSVariantModule::onStart(Pandora &service) {
     return addRc;
   }
 
+  IOLockLock(rulesLock_);
   timer_ = timer;
-  unslidAddr_ = unslid;
-  slidAddr_ = slid;
-  lastValue_ = 0;
+  IOLockUnlock(rulesLock_);
   activeInstance_ = this;
 
-  PANDORA_LOG_DEFAULT("patch_osvariant: started (unslid=0x%llx slid=0x%llx)",
-                      static_cast<unsigned long long>(unslid),
-                      static_cast<unsigned long long>(slid));
-
-  timer_->setTimeoutUS(kPatchIntervalUS);
+  // The rule table is useful on its own, so a missing osvariant address only
+  // costs the built-in rule.
+  installOsVariantRule(service);
   return kIOReturnSuccess;
 }
 
+void PatchOSVariantModule::installOsVariantRule(Pandora &service) {
+  if (!service.versionUtilities().init()) {
+    PANDORA_LOG_DEFAULT("patch_osvariant: VersionUtilities init failed");
+    return;
+  }
+
+  if (!service.versionUtilities().isSupportedVersion()) {
+    PANDORA_LOG_DEFAULT("patch_osvariant: unsupported macOS/device: %s / %s",
+                        service.versionUtilities().getBuildVersion(),
+                        service.versionUtilities().getModelIdentifier());
+    return;
+  }
+
+  uintptr_t unslid = 0;
+  if (!service.versionUtilities().getOsVariantStatusBacking(&unslid) ||
+      unslid == 0 || unslid == kNoHook) {
+    PANDORA_LOG_DEFAULT(
+        "patch_osvariant: failed to get osvariant_status_backing address");
+    return;
+  }
+
+  uint64_t slid = service.kernelUtilities().kslide(unslid);
+
+  // Swap in the patched value only while the word is still zero, so a write
+  // by the kernel between our check and our store is never overwritten.
+  PandoraWatchRule spec = {};
+  spec.kaddr = slid;
+  spec.mask = ~0ull;
+  spec.expected = 0;
+  spec.enforced = kOsVariantPatchedValue;
+  spec.width = sizeof(uint64_t);
+
+  uint32_t id = 0;
+  IOLockLock(rulesLock_);
+  IOReturn rc = addRuleLocked(spec, true, kOsVariantMaxIntervalUS,
+                              osVariantPatched, &id);
+  IOLockUnlock(rulesLock_);
+  if (rc != kIOReturnSuccess) {
+    PANDORA_LOG_DEFAULT("patch_osvariant: failed to add osvariant rule: 0x%x",
+                        rc);
+    return;
+  }
+
+  PANDORA_LOG_DEFAULT(
+      "patch_osvariant: started (unslid=0x%llx slid=0x%llx rule=%u)",
+      static_cast<unsigned long long>(unslid),
+      static_cast<unsigned long long>(slid), id);
+}
+
+void PatchOSVariantModule::osVariantPatched(uint64_t previous, uint64_t value) {
+  pandora_runtime_state().telemetry.workloopSawZero = true;
+  PANDORA_LOG_DEFAULT("patch_osvariant: patched 0x%016llx -> 0x%016llx",
+                      static_cast<unsigned long long>(previous),
+                      static_cast<unsigned long long>(value));
+}
+
 void PatchOSVariantModule::onStop(Pandora &service) {
   (void)service;
 
-  if (timer_) {
-    timer_->cancelTimeout();
+  // Detach the timer under the lock first: once timer_ is null, neither a
+  // rule added concurrently nor a tick in flight can re-arm it, so the
+  // cancel below is final.
+  if (rulesLock_) {
+    IOLockLock(rulesLock_);
+  }
+  IOTimerEventSource *timer = timer_;
+  timer_ = nullptr;
+  if (rulesLock_) {
+    IOLockUnlock(rulesLock_);
+  }
+
+  if (timer) {
+    timer->cancelTimeout();
     if (service_) {
       IOWorkLoop *workLoop = service_->getWorkLoop();
       if (workLoop) {
-        workLoop->removeEventSource(timer_);
+        workLoop->removeEventSource(timer);
       }
     }
-    timer_->release();
+    timer->release();
   }
 
   if (activeInstance_ == this) {
@@ -127,6 +193,38 @@ void PatchOSVariantModule::onShutdown() {
     activeInstance_ = nullptr;
   }
   resetState();
+  if (rulesLock_) {
+    IOLockFree(rulesLock_);
+    rulesLock_ = nullptr;
+  }
+}
+
+void PatchOSVariantModule::registerUserClientMethods(
+    PandoraUserClientMethodRegistrar &registrar) {
+  (void)registrar.addMethod(kMethodWatchAdd,
+                            &PatchOSVariantModule::methodWatchAdd, 0,
+                            sizeof(PandoraWatchRule), 1, 0);
+  (void)registrar.addMethod(kMethodWatchRemove,
+                            &PatchOSVariantModule::methodWatchRemove, 1, 0, 0,
+                            0);
+  (void)registrar.addMethod(kMethodWatchList,
+                            &PatchOSVariantModule::methodWatchList, 1, 0, 2,
+                            kIOUCVariableStructureSize);
+  (void)registrar.addMethod(kMethodWatchSetInterval,
+                            &PatchOSVariantModule::methodWatchSetInterval, 2,
+                            0, 0, 0);
+}
+
+PatchOSVariantModule *PatchOSVariantModule::fromModule(PandoraModule *module) {
+  if (!module) {
+    return nullptr;
+  }
+
+  if (module->descriptor().identifier != kModuleId) {
+    return nullptr;
+  }
+
+  return static_cast<PatchOSVariantModule *>(module);
 }
 
 void PatchOSVariantModule::timerHandler(OSObject *owner,
@@ -134,9 +232,6 @@ void PatchOSVariantModule::timerHandler(OSObject *owner,
   (void)owner;
 
   if (!sender || !activeInstance_) {
-    if (sender) {
-      sender->setTimeoutUS(kPatchIntervalUS);
-    }
     return;
   }
 
@@ -144,52 +239,340 @@ void PatchOSVariantModule::timerHandler(OSObject *owner,
 }
 
 void PatchOSVariantModule::runTimerTick(IOTimerEventSource *sender) {
-  if (!sender || !service_) {
-    if (sender) {
-      sender->setTimeoutUS(kPatchIntervalUS);
-    }
+  if (!sender || !service_ || !rulesLock_) {
     return;
   }
 
-  if (slidAddr_ == 0) {
-    sender->setTimeoutUS(kPatchIntervalUS);
-    return;
+  IOLockLock(rulesLock_);
+  bool active = runPassLocked();
+  const uint32_t maxUS = maxIntervalLocked();
+  if (active) {
+    intervalUS_ = minIntervalUS_;
+  } else if (intervalUS_ < maxUS) {
+    intervalUS_ = (intervalUS_ > maxUS / 2) ? maxUS : intervalUS_ * 2;
+  } else {
+    intervalUS_ = maxUS;
   }
 
+  // An empty table leaves the timer idle until the next rule is added, and a
+  // timer that onStop has detached is never re-armed.
+  if (ruleCount_ != 0 && timer_ == sender) {
+    sender->setTimeoutUS(intervalUS_);
+  }
+  IOLockUnlock(rulesLock_);
+}
+
+uint32_t PatchOSVariantModule::maxIntervalLocked() const {
+  uint32_t maxUS = maxIntervalUS_;
+  for (uint32_t i = 0; i < ruleCount_; ++i) {
+    const uint32_t ruleMax = rules_[i].maxIntervalUS;
+    if (ruleMax != 0 && ruleMax < maxUS) {
+      maxUS = ruleMax;
+    }
+  }
+  return maxUS < minIntervalUS_ ? minIntervalUS_ : maxUS;
+}
+
+bool PatchOSVariantModule::runPassLocked() {
+  bool active = false;
+  uint8_t span[kReadSpan];
+
+  uint32_t i = 0;
+  while (i < ruleCount_) {
+    // Rules are sorted by address, so neighbours share one read.
+    const uint64_t base = rules_[i].spec.kaddr;
+    uint64_t end = base + rules_[i].spec.width;
+    uint32_t j = i + 1;
+    for (; j < ruleCount_; ++j) {
+      uint64_t ruleEnd = rules_[j].spec.kaddr + rules_[j].spec.width;
+      if (ruleEnd - base > kReadSpan) {
+        break;
+      }
+      if (ruleEnd > end) {
+        end = ruleEnd;
+      }
+    }
+
+    // If the group read fails, fall back to reading the rules one by one so
+    // a single bad address does not blind its neighbours.
+    const bool spanOk =
+        KernelUtilities::kread(base, span, static_cast<size_t>(end - base)) ==
+        KUErrorSuccess;
+    for (; i < j; ++i) {
+      Rule &rule = rules_[i];
+      uint64_t value = 0;
+      if (spanOk) {
+        memcpy(&value, span + (rule.spec.kaddr - base), rule.spec.width);
+      } else if (KernelUtilities::kread(rule.spec.kaddr, &value,
+                                        rule.spec.width) != KUErrorSuccess) {
+        rule.faults++;
+        continue;
+      }
+      if (applyRuleLocked(rule, value)) {
+        active = true;
+      }
+    }
+  }
+  return active;
+}
+
+bool PatchOSVariantModule::applyRuleLocked(Rule &rule, uint64_t value) {
+  const PandoraWatchRule &spec = rule.spec;
+  const uint64_t wmask = widthMask(spec.width);
+  const uint64_t mask = spec.mask & wmask;
+  const uint64_t target = spec.enforced & mask;
+  value &= wmask;
+
+  bool active = false;
+  if (rule.seen && value != rule.lastValue) {
+    rule.changes++;
+    active = true;
+  }
+  rule.seen = true;
+  rule.lastValue = value;
+
+  const bool matches = (spec.flags & kPandoraWatchEnforceAlways)
+                           ? (value & mask) != target
+                           : (value & mask) == (spec.expected & mask);
+
+  if (spec.flags & kPandoraWatchObserveOnly) {
+    if (matches && !rule.matched) {
+      rule.hits++;
+      active = true;
+      if (rule.onHit) {
+        rule.onHit(value, value);
+      }
+    }
+    rule.matched = matches;
+    return active;
+  }
+
+  if (!matches || (value & mask) == target) {
+    return active;
+  }
+
+  const uint64_t desired = (value & ~mask) | target;
+  uint64_t previous = 0;
+  KUError rc =
+      KernelUtilities::kcas(spec.kaddr, spec.width, value, desired, &previous);
+  if (rc == KUErrorSuccess) {
+    rule.hits++;
+    rule.lastValue = desired;
+    if (rule.onHit) {
+      rule.onHit(value, desired);
+    }
+    return true;
+  }
+  if (rc == KUErrorCompareMismatch) {
+    // Someone else is writing the word; look again soon.
+    rule.lastValue = previous & wmask;
+    rule.changes++;
+    return true;
+  }
+
+  rule.faults++;
+  return active;
+}
+
+IOReturn PatchOSVariantModule::addRuleLocked(const PandoraWatchRule &spec,
+                                             bool builtin,
+                                             uint32_t maxIntervalUS,
+                                             HitCallback onHit, uint32_t *id) {
+  const uint32_t knownFlags =
+      kPandoraWatchEnforceAlways | kPandoraWatchObserveOnly;
+  if (spec.kaddr == 0 || (spec.width != 4 && spec.width != 8) ||
+      (spec.kaddr & (spec.width - 1)) != 0 ||
+      (spec.mask & widthMask(spec.width)) == 0 ||
+      (spec.flags & ~knownFlags) != 0) {
+    return kIOReturnBadArgument;
+  }
+  if (ruleCount_ == kPandoraWatchMaxRules) {
+    return kIOReturnNoSpace;
+  }
+
+  // Refuse addresses that cannot be read now rather than counting faults
+  // forever.
   uint64_t value = 0;
-  KUError rc = KernelUtilities::kread(slidAddr_, &value, sizeof(value));
-  if (rc != KUErrorSuccess) {
-    PANDORA_LOG_DEFAULT("patch_osvariant: kread failed: %d", rc);
-    sender->setTimeoutUS(kPatchIntervalUS);
-    return;
+  if (KernelUtilities::kread(spec.kaddr, &value, spec.width) !=
+      KUErrorSuccess) {
+    return kIOReturnNotReadable;
   }
 
-  if (value != lastValue_) {
-    PANDORA_LOG_DEFAULT("patch_osvariant: value changed 0x%016llx -> 0x%016llx",
-                        static_cast<unsigned long long>(lastValue_),
-                        static_cast<unsigned long long>(value));
-    lastValue_ = value;
+  uint32_t pos = ruleCount_;
+  while (pos > 0 && rules_[pos - 1].spec.kaddr > spec.kaddr) {
+    rules_[pos] = rules_[pos - 1];
+    --pos;
+  }
+
+  Rule &rule = rules_[pos];
+  rule = Rule{};
+  rule.spec = spec;
+  rule.id = nextRuleId_++;
+  rule.builtin = builtin;
+  rule.maxIntervalUS = maxIntervalUS;
+  rule.onHit = onHit;
+  ruleCount_++;
+
+  // A new rule is activity: poll fast, and start the timer if it was idle.
+  intervalUS_ = minIntervalUS_;
+  if (timer_) {
+    timer_->setTimeoutUS(intervalUS_);
   }
 
-  if (value == 0) {
-    uint64_t newValue = 0x70010000f38882cf;
-    rc = KernelUtilities::kwrite(slidAddr_, &newValue, sizeof(newValue));
-    if (rc == KUErrorSuccess) {
-      pandora_runtime_state().telemetry.workloopSawZero = true;
-      PANDORA_LOG_DEFAULT("patch_osvariant: kwrite succeeded");
-    } else {
-      PANDORA_LOG_DEFAULT("patch_osvariant: kwrite failed: %d", rc);
+  if (id) {
+    *id = rule.id;
+  }
+  return kIOReturnSuccess;
+}
+
+IOReturn PatchOSVariantModule::methodWatchAdd(PandoraUserClient *client,
+                                              PandoraModule *module,
+                                              IOExternalMethodArguments *args) {
+  (void)client;
+
+  PatchOSVariantModule *self = fromModule(module);
+  if (!self || !args || !args->structureInput || !self->rulesLock_) {
+    return kIOReturnBadArgument;
+  }
+
+  PandoraWatchRule spec;
+  memcpy(&spec, args->structureInput, sizeof(spec));
+
+  uint32_t id = 0;
+  IOLockLock(self->rulesLock_);
+  IOReturn rc = self->addRuleLocked(spec, false, 0, nullptr, &id);
+  IOLockUnlock(self->rulesLock_);
+  if (rc != kIOReturnSuccess) {
+    return rc;
+  }
+
+  PANDORA_LOG_DEFAULT("patch_osvariant: added rule %u at 0x%llx", id,
+                      static_cast<unsigned long long>(spec.kaddr));
+  args->scalarOutput[0] = id;
+  return kIOReturnSuccess;
+}
+
+IOReturn
+PatchOSVariantModule::methodWatchRemove(PandoraUserClient *client,
+                                        PandoraModule *module,
+                                        IOExternalMethodArguments *args) {
+  (void)client;
+
+  PatchOSVariantModule *self = fromModule(module);
+  if (!self || !args || !self->rulesLock_) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint64_t id = args->scalarInput[0];
+  IOReturn rc = kIOReturnNotFound;
+
+  IOLockLock(self->rulesLock_);
+  for (uint32_t i = 0; i < self->ruleCount_; ++i) {
+    if (self->rules_[i].id != id) {
+      continue;
+    }
+    if (self->rules_[i].builtin) {
+      rc = kIOReturnNotPermitted;
+      break;
+    }
+    for (uint32_t j = i + 1; j < self->ruleCount_; ++j) {
+      self->rules_[j - 1] = self->rules_[j];
+    }
+    self->ruleCount_--;
+    rc = kIOReturnSuccess;
+    break;
+  }
+  IOLockUnlock(self->rulesLock_);
+  return rc;
+}
+
+IOReturn PatchOSVariantModule::methodWatchList(PandoraUserClient *client,
+                                               PandoraModule *module,
+                                               IOExternalMethodArguments *args) {
+  (void)client;
+
+  PatchOSVariantModule *self = fromModule(module);
+  if (!self || !args || !self->rulesLock_ ||
+      (args->structureOutputSize && !args->structureOutput)) {
+    return kIOReturnBadArgument;
+  }
+
+  const bool reset = (args->scalarInput[0] & kPandoraWatchListReset) != 0;
+  auto *out = static_cast<PandoraWatchRuleStats *>(args->structureOutput);
+  const uint32_t capacity =
+      args->structureOutputSize / sizeof(PandoraWatchRuleStats);
+
+  IOLockLock(self->rulesLock_);
+  const uint32_t count = self->ruleCount_;
+  const uint32_t copied = count < capacity ? count : capacity;
+  for (uint32_t i = 0; i < copied; ++i) {
+    const Rule &rule = self->rules_[i];
+    out[i] = PandoraWatchRuleStats{};
+    out[i].id = rule.id;
+    out[i].flags = rule.spec.flags | (rule.builtin ? kPandoraWatchBuiltin : 0);
+    out[i].kaddr = rule.spec.kaddr;
+    out[i].lastValue = rule.lastValue;
+    out[i].hits = rule.hits;
+    out[i].changes = rule.changes;
+    out[i].faults = rule.faults;
+  }
+  if (reset) {
+    for (uint32_t i = 0; i < count; ++i) {
+      self->rules_[i].hits = 0;
+      self->rules_[i].changes = 0;
+      self->rules_[i].faults = 0;
     }
   }
+  const uint32_t interval = self->intervalUS_;
+  IOLockUnlock(self->rulesLock_);
 
-  sender->setTimeoutUS(kPatchIntervalUS);
+  // The full rule count is reported even if the buffer held fewer records.
+  args->structureOutputSize = copied * sizeof(PandoraWatchRuleStats);
+  args->scalarOutput[0] = count;
+  args->scalarOutput[1] = interval;
+  return kIOReturnSuccess;
+}
+
+IOReturn
+PatchOSVariantModule::methodWatchSetInterval(PandoraUserClient *client,
+                                             PandoraModule *module,
+                                             IOExternalMethodArguments *args) {
+  (void)client;
+
+  PatchOSVariantModule *self = fromModule(module);
+  if (!self || !args || !self->rulesLock_) {
+    return kIOReturnBadArgument;
+  }
+
+  const uint64_t minUS = args->scalarInput[0];
+  const uint64_t maxUS = args->scalarInput[1];
+  if (minUS < kPandoraWatchIntervalFloorUS ||
+      maxUS > kPandoraWatchIntervalCeilingUS || minUS > maxUS) {
+    return kIOReturnBadArgument;
+  }
+
+  IOLockLock(self->rulesLock_);
+  self->minIntervalUS_ = static_cast<uint32_t>(minUS);
+  self->maxIntervalUS_ = static_cast<uint32_t>(maxUS);
+  self->intervalUS_ = self->minIntervalUS_;
+  if (self->timer_ && self->ruleCount_) {
+    self->timer_->setTimeoutUS(self->intervalUS_);
+  }
+  IOLockUnlock(self->rulesLock_);
+  return kIOReturnSuccess;
 }
 
 void PatchOSVariantModule::resetState() {
-  timer_ = nullptr;
-  unslidAddr_ = 0;
-  slidAddr_ = 0;
-  lastValue_ = 0;
   service_ = nullptr;
+  if (rulesLock_) {
+    IOLockLock(rulesLock_);
+  }
+  timer_ = nullptr;
+  ruleCount_ = 0;
+  minIntervalUS_ = kPandoraWatchDefaultMinIntervalUS;
+  maxIntervalUS_ = kPandoraWatchDefaultMaxIntervalUS;
+  intervalUS_ = minIntervalUS_;
+  if (rulesLock_) {
+    IOLockUnlock(rulesLock_);
+  }
 }
-
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "ModuleSystem.h"
+#include "../PandoraUserClient.h"
+
+#include <IOKit/IOLib.h>
 
 class IOTimerEventSource;
 class Pandora;
 
+// Watches and enforces a table of kernel words (see PandoraWatchRule). Rules
+// come from userland through the module's selectors; the osvariant patch is
+// installed as a built-in rule when its address is known. Every rule is
+// served by one timer, whose period adapts to how busy the rules are.
 class PatchOSVariantModule final : public PandoraModule {
 public:
   static constexpr uint16_t kModuleId = 0x0002;
@@ -16,19 +23,75 @@ public:
   void onError(Pandora &service, IOReturn error) override;
   void onShutdown() override;
 
+  void registerUserClientMethods(
+      PandoraUserClientMethodRegistrar &registrar) override;
+
 private:
-  static constexpr uint32_t kPatchIntervalUS = 50000;
+  using HitCallback = void (*)(uint64_t previous, uint64_t value);
+
+  struct Rule {
+    PandoraWatchRule spec;
+    uint32_t id;
+    bool builtin;
+    bool seen;    // lastValue holds a value read by a pass
+    bool matched; // observe-only rules: matched on the previous pass
+    uint32_t maxIntervalUS; // backoff cap for this rule, 0 = maxIntervalUS_
+    uint64_t lastValue;
+    uint64_t hits;
+    uint64_t changes;
+    uint64_t faults;
+    HitCallback onHit;
+  };
+
+  // The osvariant word was polled every 50 ms before the rule table existed;
+  // idle backoff never stretches the built-in rule beyond that.
+  static constexpr uint32_t kOsVariantMaxIntervalUS = 50000;
+
+  // Rules within this many bytes of the first rule of a group are fetched
+  // with a single read.
+  static constexpr size_t kReadSpan = 256;
 
   IOTimerEventSource *timer_{nullptr};
-  uintptr_t unslidAddr_{0};
-  uint64_t slidAddr_{0};
-  uint64_t lastValue_{0};
   Pandora *service_{nullptr};
 
+  // Guards the rule table and the interval state. Sorted by address.
+  IOLock *rulesLock_{nullptr};
+  Rule rules_[kPandoraWatchMaxRules] = {};
+  uint32_t ruleCount_{0};
+  uint32_t nextRuleId_{1};
+  uint32_t minIntervalUS_{kPandoraWatchDefaultMinIntervalUS};
+  uint32_t maxIntervalUS_{kPandoraWatchDefaultMaxIntervalUS};
+  uint32_t intervalUS_{kPandoraWatchDefaultMinIntervalUS};
+
   static PatchOSVariantModule *activeInstance_;
 
+  static PatchOSVariantModule *fromModule(PandoraModule *module);
+
   static void timerHandler(OSObject *owner, IOTimerEventSource *sender);
   void runTimerTick(IOTimerEventSource *sender);
   void resetState();
-};
 
+  void installOsVariantRule(Pandora &service);
+  static void osVariantPatched(uint64_t previous, uint64_t value);
+
+  // Callers hold rulesLock_.
+  IOReturn addRuleLocked(const PandoraWatchRule &spec, bool builtin,
+                         uint32_t maxIntervalUS, HitCallback onHit,
+                         uint32_t *id);
+  bool runPassLocked();
+  uint32_t maxIntervalLocked() const;
+  bool applyRuleLocked(Rule &rule, uint64_t value);
+
+  static IOReturn methodWatchAdd(PandoraUserClient *client,
+                                 PandoraModule *module,
+                                 IOExternalMethodArguments *args);
+  static IOReturn methodWatchRemove(PandoraUserClient *client,
+                                    PandoraModule *module,
+                                    IOExternalMethodArguments *args);
+  static IOReturn methodWatchList(PandoraUserClient *client,
+                                  PandoraModule *module,
+                                  IOExternalMethodArguments *args);
+  static IOReturn methodWatchSetInterval(PandoraUserClient *client,
+                                         PandoraModule *module,
+                                         IOExternalMethodArguments *args);
+};
@@ -1,6 +1,7 @@
 #ifndef PANDORA_H
 #define PANDORA_H
 
+#include "Globals.h"
 #include "Utils/KernelUtilities.h"
 #include "Utils/VersionUtilities.h"
 #include <IOKit/IOService.h>
@@ -13,15 +14,16 @@ OSDeclareFinalStructors(Pandora)
   void free() override;
   IOWorkLoop *getWorkLoop() const override { return workloop_; }
 
-  KernelUtilities &kernelUtilities() { return ku_; }
-  const KernelUtilities &kernelUtilities() const { return ku_; }
+  KernelUtilities &kernelUtilities() { return pandora_kernel_utilities(); }
+  const KernelUtilities &kernelUtilities() const {
+    return pandora_kernel_utilities();
+  }
   VersionUtilities &versionUtilities() { return vu_; }
   const VersionUtilities &versionUtilities() const { return vu_; }
 
 private:
   IOWorkLoop *workloop_{nullptr};
 
-  KernelUtilities ku_; // single instance
   VersionUtilities vu_;
 };
 
@@ -4,6 +4,30 @@
 #include "Modules/ModuleSystem.h"
 #include "Utils/PandoraLog.h"
 
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/IOLib.h>
+#include <kern/task.h>
+#include <libkern/OSAtomic.h>
+#include <mach/vm_param.h>
+#include <sys/proc.h>
+
+extern "C" task_t proc_task(proc_t p);
+
+// A handle is the slot index in the low byte and the slot's generation above
+// it, so a closed handle is not mistaken for a later one in the same slot.
+static constexpr unsigned kProcHandleSlotBits = 8;
+
+static inline uint64_t makeProcHandle(uint32_t slot, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << kProcHandleSlotBits) | slot;
+}
+
+static inline bool splitProcHandle(uint64_t handle, uint32_t *slot,
+                                   uint32_t *generation) {
+  *slot = static_cast<uint32_t>(handle & ((1u << kProcHandleSlotBits) - 1));
+  *generation = static_cast<uint32_t>(handle >> kProcHandleSlotBits);
+  return *slot < kPandoraMaxProcHandles && *generation != 0;
+}
+
 #define super IOUserClient
 OSDefineMetaClassAndFinalStructors(PandoraUserClient, IOUserClient);
 
@@ -33,6 +57,13 @@ bool PandoraUserClient::initWithTask(task_t owningTask, void *securityID,
     return false;
   }
 
+  procLock_ = IOLockAlloc();
+  if (!procLock_) {
+    return false;
+  }
+
+  owningTask_ = owningTask;
+
   const PandoraRuntimeState &runtime = pandora_runtime_state();
   PANDORA_LOG_DEFAULT("PandoraUserClient::initWithTask: workloop saw zero=%d",
                       runtime.telemetry.workloopSawZero ? 1 : 0);
@@ -60,3 +91,189 @@ IOReturn PandoraUserClient::externalMethod(uint32_t selector,
       const_cast<IOExternalMethodDispatch *>(lookup.dispatch), this,
       lookup.reference);
 }
+
+IOReturn PandoraUserClient::clientClose() {
+  // Drop task references now; free() may run much later, and the handles
+  // would otherwise pin the target tasks until then.
+  closeAllProcesses();
+  terminate();
+  return kIOReturnSuccess;
+}
+
+IOReturn PandoraUserClient::clientDied() {
+  closeAllProcesses();
+  return super::clientDied();
+}
+
+IOReturn PandoraUserClient::clientMemoryForType(UInt32 type,
+                                                IOOptionBits *options,
+                                                IOMemoryDescriptor **memory) {
+  if (!options || !memory) {
+    return kIOReturnBadArgument;
+  }
+
+  if (type != kPandoraUserClientMemoryTypeReadWindow) {
+    return kIOReturnUnsupported;
+  }
+
+  // Window selectors may run concurrently with the first mapping, so the
+  // buffer is published with a compare-and-swap; a racing mapper that loses
+  // drops its own allocation and uses the winner's.
+  IOBufferMemoryDescriptor *window = readWindow_;
+  if (!window) {
+    window = IOBufferMemoryDescriptor::withOptions(
+        kIODirectionInOut | kIOMemoryKernelUserShared, kPandoraReadWindowSize,
+        PAGE_SIZE);
+    if (!window) {
+      PANDORA_USERCLIENT_LOG_ERROR(
+          "PandoraUserClient: failed to allocate %zu byte read window",
+          kPandoraReadWindowSize);
+      return kIOReturnNoMemory;
+    }
+    if (!OSCompareAndSwapPtr(
+            nullptr, window, reinterpret_cast<void *volatile *>(&readWindow_))) {
+      window->release();
+      window = readWindow_;
+    }
+  }
+
+  // The caller consumes one reference.
+  window->retain();
+  *memory = window;
+  *options = kIOMapReadOnly;
+  return kIOReturnSuccess;
+}
+
+uint8_t *PandoraUserClient::readWindow(size_t *size) const {
+  IOBufferMemoryDescriptor *window = readWindow_;
+  if (!window) {
+    return nullptr;
+  }
+
+  if (size) {
+    *size = kPandoraReadWindowSize;
+  }
+  return static_cast<uint8_t *>(window->getBytesNoCopy());
+}
+
+bool PandoraUserClient::reserveAsyncRequest() {
+  if (OSIncrementAtomic(&asyncInFlight_) >=
+      static_cast<SInt32>(kPandoraAsyncMaxInFlight)) {
+    OSDecrementAtomic(&asyncInFlight_);
+    return false;
+  }
+  return true;
+}
+
+void PandoraUserClient::releaseAsyncRequest() {
+  OSDecrementAtomic(&asyncInFlight_);
+}
+
+IOReturn PandoraUserClient::openProcess(pid_t pid, uint64_t *handle) {
+  if (!pid || !handle || !procLock_) {
+    return kIOReturnBadArgument;
+  }
+
+  proc_t p = proc_find(pid);
+  if (!p) {
+    return kIOReturnNotFound;
+  }
+  task_t task = proc_task(p);
+  if (task != TASK_NULL) {
+    task_reference(task);
+  }
+  proc_rele(p);
+  if (task == TASK_NULL) {
+    return kIOReturnNotFound;
+  }
+
+  IOLockLock(procLock_);
+  for (uint32_t slot = 0; slot < kPandoraMaxProcHandles; ++slot) {
+    PandoraProcHandle &entry = procs_[slot];
+    if (entry.task != TASK_NULL) {
+      continue;
+    }
+    // Generation 0 is never handed out so a handle is never 0.
+    if (++procGeneration_ == 0) {
+      procGeneration_ = 1;
+    }
+    entry.task = task;
+    entry.pid = pid;
+    entry.generation = procGeneration_;
+    *handle = makeProcHandle(slot, entry.generation);
+    IOLockUnlock(procLock_);
+    return kIOReturnSuccess;
+  }
+  IOLockUnlock(procLock_);
+
+  task_deallocate(task);
+  return kIOReturnNoResources;
+}
+
+IOReturn PandoraUserClient::closeProcess(uint64_t handle) {
+  uint32_t slot = 0;
+  uint32_t generation = 0;
+  if (!procLock_ || !splitProcHandle(handle, &slot, &generation)) {
+    return kIOReturnBadArgument;
+  }
+
+  IOLockLock(procLock_);
+  PandoraProcHandle &entry = procs_[slot];
+  if (entry.task == TASK_NULL || entry.generation != generation) {
+    IOLockUnlock(procLock_);
+    return kIOReturnBadArgument;
+  }
+  task_t task = entry.task;
+  entry = PandoraProcHandle{};
+  IOLockUnlock(procLock_);
+
+  task_deallocate(task);
+  return kIOReturnSuccess;
+}
+
+task_t PandoraUserClient::copyProcessTask(uint64_t handle) {
+  uint32_t slot = 0;
+  uint32_t generation = 0;
+  if (!procLock_ || !splitProcHandle(handle, &slot, &generation)) {
+    return TASK_NULL;
+  }
+
+  IOLockLock(procLock_);
+  const PandoraProcHandle &entry = procs_[slot];
+  task_t task = TASK_NULL;
+  if (entry.task != TASK_NULL && entry.generation == generation) {
+    task = entry.task;
+    task_reference(task);
+  }
+  IOLockUnlock(procLock_);
+  return task;
+}
+
+void PandoraUserClient::closeAllProcesses() {
+  if (!procLock_) {
+    return;
+  }
+
+  for (uint32_t slot = 0; slot < kPandoraMaxProcHandles; ++slot) {
+    IOLockLock(procLock_);
+    task_t task = procs_[slot].task;
+    procs_[slot] = PandoraProcHandle{};
+    IOLockUnlock(procLock_);
+    if (task != TASK_NULL) {
+      task_deallocate(task);
+    }
+  }
+}
+
+void PandoraUserClient::free() {
+  closeAllProcesses();
+  if (procLock_) {
+    IOLockFree(procLock_);
+    procLock_ = nullptr;
+  }
+  if (readWindow_) {
+    readWindow_->release();
+    readWindow_ = nullptr;
+  }
+  super::free();
+}
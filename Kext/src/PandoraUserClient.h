@@ -1,10 +1,15 @@
 #pragma once
 
 #include "Utils/TimeUtilities.h"
+#include "calypso/kcall_chain.h"
+#include "calypso/query_vm.h"
+#include "calypso/xxhash64.h"
 
 #include <IOKit/IOUserClient.h>
 #include <stdint.h>
 
+class IOBufferMemoryDescriptor;
+
 static constexpr uint32_t kPandoraUserClientModuleSelectorShift = 16u;
 static constexpr uint16_t kPandoraUserClientModuleIdHwAccess = 0x0001;
 static constexpr uint16_t kPandoraUserClientModuleIdPatchOsVariant = 0x0002;
@@ -22,20 +27,289 @@ struct PandoraMetadata {
   TimestampPair io_service_start_time;
   TimestampPair user_client_init_time;
   bool pid1_exists;
+  uint64_t bounce_pool_hits;
+  uint64_t bounce_pool_misses;
+  uint64_t kernel_base_scan_ns;
 };
 
-struct PandoraKCallRequest {
-  uint64_t fn;
-  uint32_t argCount;
-  uint32_t reserved;
-  uint64_t args[8];
-};
+// Shared with the library (see calypso/kcall_chain.h). Batched calls only:
+// bit i of chainMask makes args[i] a reference to an earlier call's ret0.
+using PandoraKCallRequest = kcall_request;
 
 struct PandoraKCallResponse {
   IOReturn status;
   uint64_t ret0;
 };
 
+// Scratch kernel buffer for a marshalled kcall. The kext allocates `size`
+// bytes, fills them from `uaddr` (kPandoraKCallBufferIn) or zeroes them, points
+// args[argIndex] at them for the call and copies them back to `uaddr` when the
+// call returns (kPandoraKCallBufferOut).
+struct PandoraKCallBuffer {
+  uint64_t uaddr;
+  uint32_t size;
+  uint8_t argIndex;
+  uint8_t flags;
+  uint16_t reserved;
+};
+
+static constexpr uint8_t kPandoraKCallBufferIn = 1u << 0;
+static constexpr uint8_t kPandoraKCallBufferOut = 1u << 1;
+static constexpr uint32_t kPandoraKCallMaxBuffers = 4;
+static constexpr uint32_t kPandoraKCallMaxBufferSize = 64 * 1024;
+
+// kMethodKCall accepts either a bare PandoraKCallRequest or this.
+struct PandoraKCallMarshalledRequest {
+  PandoraKCallRequest call;
+  uint32_t bufferCount;
+  uint32_t reserved;
+  PandoraKCallBuffer buffers[kPandoraKCallMaxBuffers];
+};
+
+// One result of a batched kcall (see calypso/kcall_chain.h).
+using PandoraKCallTimedResponse = kcall_timed_response;
+static_assert(KCALL_STATUS_BAD_ARGUMENT == kIOReturnBadArgument &&
+                  KCALL_STATUS_ABORTED == kIOReturnAborted,
+              "kcall chain statuses must use the IOReturn encoding");
+
+static constexpr uint32_t kPandoraKCallBatchMax = 64;
+// Requests may exceed the 4096-byte inband limit (they are copied in from a
+// descriptor); the responses are written inband and must not.
+static_assert(kPandoraKCallBatchMax * sizeof(PandoraKCallTimedResponse) <= 4096,
+              "kcall batch responses must fit the inband structure output");
+// Batch flags (scalarInput[0]).
+static constexpr uint64_t kPandoraKCallBatchLog = 1u << 0;
+
+// One entry of a scatter-gather kernel read. `len` bytes at `kaddr` are copied
+// to `offset` within the caller's output buffer.
+struct PandoraKReadVDescriptor {
+  uint64_t kaddr;
+  uint32_t len;
+  uint32_t offset;
+};
+
+// Keeps the descriptor array within the inband structure input limit.
+static constexpr uint32_t kPandoraKReadVMaxDescriptors = 256;
+
+// Vectored process reads reuse PandoraKReadVDescriptor with `kaddr` holding
+// the target-process address. Ranges are gathered into multi-range
+// descriptors of at most this many bytes.
+static constexpr size_t kPandoraPReadVMaxBatchBytes = 1024 * 1024;
+
+// Vectored kernel write input: a header, `count` runs, then the payload the
+// runs point into. `offset` is relative to the start of the payload.
+struct PandoraKWriteVHeader {
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct PandoraKWriteVRun {
+  uint64_t kaddr;
+  uint32_t len;
+  uint32_t offset;
+};
+
+static constexpr uint32_t kPandoraKWriteVMaxRuns = 1024;
+static constexpr uint32_t kPandoraKWriteVMaxInputSize = 1024 * 1024;
+
+// Memory type for clientMemoryForType: a persistent buffer mapped read-only
+// into the client that window read selectors fill directly.
+static constexpr uint32_t kPandoraUserClientMemoryTypeReadWindow = 0;
+static constexpr size_t kPandoraReadWindowSize = 1024 * 1024;
+
+// Async requests complete with sendAsyncResult64; these bound how much work
+// each client can have queued and how large a single async transfer may be.
+static constexpr uint32_t kPandoraAsyncMaxInFlight = 256;
+static constexpr size_t kPandoraAsyncMaxTransfer = 1024 * 1024;
+
+// Kernel-side list walk. Starting at `head`, each node's next pointer is read
+// at `nextOffset`, PAC-stripped, and `nodeBias` is subtracted to get the next
+// node (nonzero for links that point into the middle of a node, e.g. le_prev).
+// Only the requested fields are returned, one record per node:
+//   uint64_t node; then each field's bytes back to back, padded to 8.
+struct PandoraWalkField {
+  int32_t offset; // field offset, or pointer offset for indirect fields
+  uint32_t size;
+  int32_t indirectOffset; // offset from the loaded pointer (indirect only)
+  uint32_t flags;
+};
+
+static constexpr uint32_t kPandoraWalkFieldIndirect = 1u << 0;
+
+static constexpr uint32_t kPandoraWalkMaxFields = 16;
+static constexpr uint32_t kPandoraWalkMaxFieldSize = 512;
+static constexpr uint32_t kPandoraWalkMaxNodes = 65536;
+
+struct PandoraWalkListRequest {
+  uint64_t head;
+  int64_t nextOffset;
+  int64_t nodeBias;
+  uint32_t maxNodes;
+  uint32_t fieldCount;
+  PandoraWalkField fields[kPandoraWalkMaxFields];
+};
+
+// Why a walk stopped; returned in scalarOutput[1].
+enum PandoraWalkEnd : uint32_t {
+  kPandoraWalkEndNull = 0,       // next pointer was NULL
+  kPandoraWalkEndHead = 1,       // list wrapped back to the head
+  kPandoraWalkEndLoop = 2,       // cycle not through the head
+  kPandoraWalkEndLimit = 3,      // maxNodes or output buffer reached
+  kPandoraWalkEndFault = 4,      // a node could not be read
+  kPandoraWalkEndBadPointer = 5, // next pointer is not a kernel address
+};
+
+// In-kernel masked pattern search over [start, start + size). `mask` holds
+// `patternLen` characters of 'x'/'?' as in search_pattern(); `stride` 0 means
+// the pattern length. Match addresses are copied to the caller's buffer.
+static constexpr uint32_t kPandoraSearchMaxPattern = 256;
+
+struct PandoraSearchRequest {
+  uint64_t start;
+  uint64_t size;
+  uint64_t stride;
+  uint32_t patternLen;
+  uint32_t reserved;
+  uint8_t pattern[kPandoraSearchMaxPattern];
+  char mask[kPandoraSearchMaxPattern];
+};
+
+// Query program run in-kernel by the query selector (see calypso/query_vm.h).
+// `regs` seeds the registers; the emitted bytes are copied to the caller's
+// buffer. The limits are clamped to the kPandoraQueryMax* values below.
+struct PandoraQueryRequest {
+  uint32_t insnCount;
+  uint32_t reserved;
+  uint64_t maxSteps;
+  uint64_t maxReadBytes;
+  uint64_t regs[QVM_NUM_REGS];
+  qvm_insn insns[QVM_MAX_INSNS];
+};
+
+static constexpr uint64_t kPandoraQueryMaxSteps = 1u << 20;
+static constexpr uint64_t kPandoraQueryMaxReadBytes = 16u * 1024 * 1024;
+static constexpr size_t kPandoraQueryMaxOutput = 64 * 1024;
+
+// One range for the hash selector. Each range is hashed with XXH64 (see
+// calypso/xxhash64.h) in-kernel; only the digests are returned.
+struct PandoraHashRange {
+  uint64_t kaddr;
+  uint64_t len;
+};
+
+struct PandoraHashResult {
+  uint64_t hash;
+  IOReturn status;
+  uint32_t reserved;
+};
+
+static constexpr uint32_t kPandoraHashMaxRanges = 256;
+static constexpr uint64_t kPandoraHashMaxTotalBytes = 256ull * 1024 * 1024;
+
+// One entry of an atomic patch set. kPandoraAtomicCompareSwap stores `value`
+// if the word holds `operand`; kPandoraAtomicMaskedWrite replaces the bits set
+// in `operand` with those of `value`. `width` is 4 or 8 and `kaddr` must be
+// aligned to it.
+struct PandoraAtomicOp {
+  uint64_t kaddr;
+  uint64_t operand;
+  uint64_t value;
+  uint32_t op;
+  uint32_t width;
+};
+
+static constexpr uint32_t kPandoraAtomicCompareSwap = 0;
+static constexpr uint32_t kPandoraAtomicMaskedWrite = 1;
+
+// `previous` is the word's value before the operation (or the value that
+// made a compare-and-swap fail, with status kIOReturnNotPermitted).
+struct PandoraAtomicResult {
+  uint64_t previous;
+  IOReturn status;
+  uint32_t reserved;
+};
+
+static constexpr uint32_t kPandoraAtomicMaxOps = 128;
+// Flags (scalarInput[0]): skip the remaining ops after the first failure.
+static constexpr uint64_t kPandoraAtomicStopOnFailure = 1u << 0;
+
+// Upper bound on one kernel-to-kernel memmove or memset call.
+static constexpr uint64_t kPandoraKMemMaxLength = 64ull * 1024 * 1024;
+
+// Physical reads. Transfers larger than the bounce pool's biggest class are
+// streamed through a staging buffer of kPandoraPhysReadChunk bytes.
+static constexpr uint64_t kPandoraPhysReadMaxLength = 64ull * 1024 * 1024;
+static constexpr size_t kPandoraPhysReadChunk = 1024 * 1024;
+// Most ranges the physical-ranges selector returns; the output is an array of
+// phys_range (calypso/phys_ranges.h).
+static constexpr uint32_t kPandoraPhysMaxRanges = 64;
+
+// Batch VA-to-PA translation. The input is an array of kernel VAs; each one
+// gets a result decoded from PAR_EL1 (see KUTranslation).
+struct PandoraVToPResult {
+  uint64_t paddr;
+  uint32_t flags;
+  uint8_t attr;         // MAIR attribute byte
+  uint8_t shareability; // PAR_EL1.SH
+  uint16_t reserved;
+};
+
+static constexpr uint32_t kPandoraVToPValid = 1u << 0;
+static constexpr uint32_t kPandoraVToPWritable = 1u << 1;
+static constexpr uint32_t kPandoraVToPMaxAddresses = 256;
+
+// Watch/enforce rule for the patch module. A rule matches when the masked
+// word equals `expected` (or, with kPandoraWatchEnforceAlways, whenever it
+// differs from `enforced`); the masked bits are then replaced by those of
+// `enforced` with a compare-and-swap. kPandoraWatchObserveOnly rules never
+// write and count each time they start matching. `width` is 4 or 8 and
+// `kaddr` must be aligned to it.
+struct PandoraWatchRule {
+  uint64_t kaddr;
+  uint64_t mask;
+  uint64_t expected;
+  uint64_t enforced;
+  uint32_t width;
+  uint32_t flags;
+};
+
+static constexpr uint32_t kPandoraWatchEnforceAlways = 1u << 0;
+static constexpr uint32_t kPandoraWatchObserveOnly = 1u << 1;
+static constexpr uint32_t kPandoraWatchBuiltin = 1u << 31; // reported only
+
+// Per-rule counters returned by the list selector. `hits` counts enforced
+// writes (or matches for observe-only rules), `changes` values that differed
+// from the previous pass, `faults` failed reads and writes.
+struct PandoraWatchRuleStats {
+  uint32_t id;
+  uint32_t flags;
+  uint64_t kaddr;
+  uint64_t lastValue;
+  uint64_t hits;
+  uint64_t changes;
+  uint64_t faults;
+};
+
+static constexpr uint32_t kPandoraWatchMaxRules = 64;
+// All rules share one timer. Its period drops to the minimum after any
+// activity and doubles on every quiet pass up to the maximum.
+static constexpr uint32_t kPandoraWatchDefaultMinIntervalUS = 10000;
+static constexpr uint32_t kPandoraWatchDefaultMaxIntervalUS = 500000;
+static constexpr uint32_t kPandoraWatchIntervalFloorUS = 1000;
+static constexpr uint32_t kPandoraWatchIntervalCeilingUS = 10000000;
+// Flags (scalarInput[0]) of the list selector.
+static constexpr uint64_t kPandoraWatchListReset = 1u << 0;
+
+// Process handles returned by the open-process selector. Each one holds a
+// task reference for the lifetime of the handle (or of the client).
+static constexpr uint32_t kPandoraMaxProcHandles = 64;
+
+struct PandoraProcHandle {
+  task_t task;
+  pid_t pid;
+  uint32_t generation;
+};
+
 class PandoraUserClient final : public IOUserClient {
   OSDeclareFinalStructors(PandoraUserClient);
 
@@ -44,4 +318,39 @@ public:
   IOReturn externalMethod(uint32_t selector, IOExternalMethodArguments *args,
                           IOExternalMethodDispatch *dispatch,
                           OSObject *target, void *reference) override;
+  IOReturn clientClose() override;
+  IOReturn clientDied() override;
+  IOReturn clientMemoryForType(UInt32 type, IOOptionBits *options,
+                               IOMemoryDescriptor **memory) override;
+  void free() override;
+
+  // Kernel address of the shared read window, or nullptr if the client has
+  // not mapped it yet.
+  uint8_t *readWindow(size_t *size) const;
+
+  task_t owningTask() const { return owningTask_; }
+
+  IOReturn openProcess(pid_t pid, uint64_t *handle);
+  IOReturn closeProcess(uint64_t handle);
+  // Referenced task behind `handle`, or TASK_NULL. The caller drops the
+  // reference with task_deallocate().
+  task_t copyProcessTask(uint64_t handle);
+
+  // Per-client accounting of queued async requests. Reserve fails once
+  // kPandoraAsyncMaxInFlight requests are outstanding.
+  bool reserveAsyncRequest();
+  void releaseAsyncRequest();
+
+private:
+  task_t owningTask_{TASK_NULL};
+  // Created by the first clientMemoryForType and never replaced.
+  IOBufferMemoryDescriptor *volatile readWindow_{nullptr};
+
+  IOLock *procLock_{nullptr};
+  PandoraProcHandle procs_[kPandoraMaxProcHandles] = {};
+  uint32_t procGeneration_{0};
+
+  volatile SInt32 asyncInFlight_{0};
+
+  void closeAllProcesses();
 };
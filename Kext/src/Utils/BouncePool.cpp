@@ -0,0 +1,105 @@
+#include "BouncePool.h"
+
+constexpr size_t BouncePool::kClassSizes[BouncePool::kClassCount];
+
+bool BouncePool::init() {
+  if (!lock_) {
+    lock_ = IOLockAlloc();
+    if (!lock_) {
+      return false;
+    }
+  }
+
+  IOLockLock(lock_);
+  enabled_ = true;
+  IOLockUnlock(lock_);
+  return true;
+}
+
+void BouncePool::drain() {
+  if (!lock_) {
+    return;
+  }
+
+  IOLockLock(lock_);
+  enabled_ = false;
+  for (uint32_t cls = 0; cls < kClassCount; cls++) {
+    for (uint32_t i = 0; i < slotCount_[cls]; i++) {
+      IOFree(slots_[cls][i], kClassSizes[cls]);
+      slots_[cls][i] = nullptr;
+    }
+    slotCount_[cls] = 0;
+  }
+  IOLockUnlock(lock_);
+}
+
+void BouncePool::free() {
+  if (!lock_) {
+    return;
+  }
+
+  drain();
+  IOLockFree(lock_);
+  lock_ = nullptr;
+}
+
+uint32_t BouncePool::classForSize(size_t len) {
+  for (uint32_t cls = 0; cls < kClassCount; cls++) {
+    if (len <= kClassSizes[cls]) {
+      return cls;
+    }
+  }
+  return kClassCount - 1;
+}
+
+void *BouncePool::get(size_t len, size_t *capacity) {
+  if (!capacity) {
+    return nullptr;
+  }
+
+  uint32_t cls = classForSize(len);
+  size_t size = kClassSizes[cls];
+  void *buffer = nullptr;
+
+  if (lock_) {
+    IOLockLock(lock_);
+    if (slotCount_[cls] > 0) {
+      buffer = slots_[cls][--slotCount_[cls]];
+      slots_[cls][slotCount_[cls]] = nullptr;
+      hits_++;
+    } else {
+      misses_++;
+    }
+    IOLockUnlock(lock_);
+  }
+
+  if (!buffer) {
+    buffer = IOMalloc(size);
+    if (!buffer) {
+      return nullptr;
+    }
+  }
+
+  *capacity = size;
+  return buffer;
+}
+
+void BouncePool::put(void *buffer, size_t capacity) {
+  if (!buffer) {
+    return;
+  }
+
+  uint32_t cls = classForSize(capacity);
+  if (lock_ && kClassSizes[cls] == capacity) {
+    IOLockLock(lock_);
+    if (enabled_ && slotCount_[cls] < kSlotsPerClass) {
+      slots_[cls][slotCount_[cls]++] = buffer;
+      buffer = nullptr;
+    }
+    IOLockUnlock(lock_);
+  }
+
+  if (buffer) {
+    IOFree(buffer, capacity);
+  }
+}
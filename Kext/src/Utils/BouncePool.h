@@ -0,0 +1,48 @@
+#ifndef BOUNCE_POOL_H
+#define BOUNCE_POOL_H
+
+#include <IOKit/IOLib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Recycles kernel bounce buffers for the user client read/write paths. Buffers
+// are handed out from a few fixed size classes so the common small transfers
+// never reach the general allocator; larger transfers are streamed through the
+// largest class in chunks.
+class BouncePool {
+public:
+  static constexpr uint32_t kClassCount = 4;
+  static constexpr size_t kClassSizes[kClassCount] = {64, 512, 4096, 16384};
+  static constexpr size_t kMaxClassSize = kClassSizes[kClassCount - 1];
+  static constexpr uint32_t kSlotsPerClass = 8;
+
+  // init() may be called again after drain() to re-enable caching.
+  bool init();
+  // Releases the cached buffers and stops caching new ones. The lock stays
+  // alive, so get()/put() from user client calls still in progress remain
+  // safe; this is what a stopping module calls.
+  void drain();
+  // drain() plus freeing the lock. Only for teardown, once no user client can
+  // reach the pool any more (kext unload).
+  void free();
+
+  // Returns a buffer of at least min(len, kMaxClassSize) bytes and stores its
+  // real size in `capacity`, or nullptr on allocation failure.
+  void *get(size_t len, size_t *capacity);
+  void put(void *buffer, size_t capacity);
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+private:
+  IOLock *lock_{nullptr};
+  bool enabled_{false}; // guarded by lock_
+  void *slots_[kClassCount][kSlotsPerClass]{};
+  uint32_t slotCount_[kClassCount]{};
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+
+  static uint32_t classForSize(size_t len);
+};
+
+#endif // BOUNCE_POOL_H
@@ -4,8 +4,16 @@
 
 #include "../routines.h"
 
+#include <mach/mach_time.h>
+
+// At most this many calls are logged per second; the rest are counted and
+// reported when the next second opens.
+static constexpr uint32_t kKCallLogBurst = 10;
+static constexpr uint64_t kKCallLogIntervalNanos = 1000000000ULL;
+static PandoraLogRateLimit g_kcall_log_limit;
+
 PandoraKCallResult pandora_kcall(uint64_t fn, const uint64_t *args,
-                                 size_t argCount) {
+                                 size_t argCount, uint32_t flags) {
   (void)fn;
   (void)args;
   (void)argCount;
@@ -35,13 +43,23 @@ PandoraKCallResult pandora_kcall(uint64_t fn, const uint64_t *args,
     callArgs[i] = args[i];
   }
 
-  PANDORA_LOG_DEFAULT("KernelCall: invoking 0x%08x%08x with %zu arg(s)",
-                      (uint32_t)(fn >> 32), (uint32_t)(fn & 0xffffffffu),
-                      argCount);
+  uint32_t suppressed = 0;
+  if (!(flags & kPandoraKCallNoLog) &&
+      pandora_log_ratelimit(&g_kcall_log_limit, kKCallLogBurst,
+                            kKCallLogIntervalNanos, &suppressed)) {
+    if (suppressed) {
+      PANDORA_LOG_DEFAULT("KernelCall: %u call log(s) suppressed", suppressed);
+    }
+    PANDORA_LOG_DEFAULT("KernelCall: invoking 0x%08x%08x with %zu arg(s)",
+                        (uint32_t)(fn >> 32), (uint32_t)(fn & 0xffffffffu),
+                        argCount);
+  }
 
+  uint64_t start = mach_absolute_time();
   uint64_t ret0 = arbitrary_call(
       fn, callArgs[0], callArgs[1], callArgs[2], callArgs[3], callArgs[4],
       callArgs[5], callArgs[6], callArgs[7], callArgs[8], callArgs[9]);
+  uint64_t elapsed = mach_absolute_time() - start;
 
-  return {.status = kIOReturnSuccess, .ret0 = ret0};
+  return {.status = kIOReturnSuccess, .ret0 = ret0, .elapsed = elapsed};
 }
@@ -14,9 +14,13 @@
 struct PandoraKCallResult {
   IOReturn status;
   uint64_t ret0;
+  uint64_t elapsed; // mach_absolute_time ticks spent in the call
 };
 
-// Call a function at `fn` with up to 8 integer args. This stub always returns
-// `kIOReturnUnsupported`.
+// pandora_kcall flags.
+static constexpr uint32_t kPandoraKCallNoLog = 1u << 0;
+
+// Call a function at `fn` with up to 8 integer args. Each call is logged
+// (rate-limited) unless kPandoraKCallNoLog is passed.
 PandoraKCallResult pandora_kcall(uint64_t fn, const uint64_t *args,
-                                 size_t argCount);
+                                 size_t argCount, uint32_t flags = 0);
@@ -1,6 +1,7 @@
 #include "KernelUtilities.h"
 #include "../Globals.h"
 #include "PandoraLog.h"
+#include "TimeUtilities.h"
 #include "../routines.h"
 
 #include <stddef.h>
@@ -8,11 +9,13 @@
 
 #include <IOKit/IOLib.h>
 #include <IOKit/IOMemoryDescriptor.h>
+#include <IOKit/IORegistryEntry.h>
 #include <IOKit/IOReturn.h>
 #include <IOKit/IOService.h>
 #include <IOKit/IOSharedDataQueue.h>
 #include <IOKit/IOUserClient.h>
 #include <kern/task.h>
+#include <libkern/OSAtomic.h>
 #include <libkern/OSDebug.h>
 #include <libkern/copyio.h>
 #include <mach-o/loader.h>
@@ -51,140 +54,297 @@ static KUError kread_iomd(uint64_t address, void *buffer, size_t size) {
   return (bytesRead == size) ? KUErrorSuccess : KUErrorNotEnoughBytesRead;
 }
 
-static KUError kread_via_physmap(uint64_t address, void *buffer, size_t size) {
-  if (address == 0 || buffer == nullptr || size == 0) {
-    return KUErrorBadArgument;
-  }
+// A physically contiguous piece of a virtual range.
+struct PhysRun {
+  uint64_t paddr;
+  size_t len;
+};
+
+static constexpr uint32_t kPhysRunBatch = 16;
 
-  uint8_t *out = static_cast<uint8_t *>(buffer);
-  uint64_t vaddr = address;
-  size_t remaining = size;
+// Translates [vaddr, vaddr + size) page by page, merging pages that are
+// physically adjacent. Fills at most `maxRuns` runs and returns how many bytes
+// they cover, or 0 if the first page has no translation.
+static size_t collect_phys_runs(uint64_t vaddr, size_t size, PhysRun *runs,
+                                uint32_t maxRuns, uint32_t *runCount) {
+  size_t covered = 0;
+  uint32_t count = 0;
 
-  while (remaining) {
-    vm_offset_t paddr = arm_kvtophys(vaddr);
+  while (covered < size) {
+    vm_offset_t paddr = arm_kvtophys(vaddr + covered);
     if (paddr == 0) {
-      return KUErrorNotEnoughBytesRead;
+      break;
     }
 
-    size_t page_off = static_cast<size_t>(paddr & PAGE_MASK);
-    size_t chunk = PAGE_SIZE - page_off;
-    if (chunk > remaining) {
-      chunk = remaining;
+    size_t chunk = PAGE_SIZE - static_cast<size_t>(paddr & PAGE_MASK);
+    if (chunk > size - covered) {
+      chunk = size - covered;
     }
 
-    IOPhysicalAddress paddr_aligned =
-        static_cast<IOPhysicalAddress>(paddr & ~static_cast<vm_offset_t>(PAGE_MASK));
-    IOByteCount map_len = static_cast<IOByteCount>(page_off + chunk);
-
-    IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withPhysicalAddress(
-        paddr_aligned, map_len, kIODirectionIn);
-    if (!memDesc) {
-      return KUErrorMemoryAllocationFailed;
+    if (count && runs[count - 1].paddr + runs[count - 1].len == paddr) {
+      runs[count - 1].len += chunk;
+    } else if (count < maxRuns) {
+      runs[count].paddr = paddr;
+      runs[count].len = chunk;
+      count++;
+    } else {
+      break;
     }
+    covered += chunk;
+  }
 
-    IOReturn ret = memDesc->prepare();
-    if (ret != kIOReturnSuccess) {
-      pandora_runtime_state().debug.extraErrorData1 = (uint64_t)(uint32_t)ret;
-      memDesc->release();
-      return KUErrorMemoryPreperationFailed;
-    }
+  *runCount = count;
+  return covered;
+}
 
-    uint64_t bytesRead = memDesc->readBytes(
-        static_cast<IOByteCount>(page_off), out, static_cast<IOByteCount>(chunk));
-    memDesc->complete();
+// Copies one physical run with a single descriptor.
+static KUError physmap_transfer_run(uint64_t paddr, uint8_t *data, size_t len,
+                                    bool write) {
+  size_t page_off = static_cast<size_t>(paddr & PAGE_MASK);
+  IOPhysicalAddress paddr_aligned = static_cast<IOPhysicalAddress>(
+      paddr & ~static_cast<uint64_t>(PAGE_MASK));
+  IOByteCount map_len = static_cast<IOByteCount>(page_off + len);
+
+  IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withPhysicalAddress(
+      paddr_aligned, map_len, write ? kIODirectionInOut : kIODirectionIn);
+  if (!memDesc) {
+    return KUErrorMemoryAllocationFailed;
+  }
+
+  IOReturn ret = memDesc->prepare();
+  if (ret != kIOReturnSuccess) {
+    pandora_runtime_state().debug.extraErrorData1 = (uint64_t)(uint32_t)ret;
     memDesc->release();
+    return KUErrorMemoryPreperationFailed;
+  }
 
-    if (bytesRead != chunk) {
-      pandora_runtime_state().debug.extraErrorData1 = chunk;
-      pandora_runtime_state().debug.extraErrorData2 = bytesRead;
-      return KUErrorNotEnoughBytesRead;
-    }
+  uint64_t bytesDone =
+      write ? memDesc->writeBytes(static_cast<IOByteCount>(page_off), data,
+                                  static_cast<IOByteCount>(len))
+            : memDesc->readBytes(static_cast<IOByteCount>(page_off), data,
+                                 static_cast<IOByteCount>(len));
+  memDesc->complete();
+  memDesc->release();
 
-    out += chunk;
-    vaddr += chunk;
-    remaining -= chunk;
+  if (bytesDone != len) {
+    pandora_runtime_state().debug.extraErrorData1 = len;
+    pandora_runtime_state().debug.extraErrorData2 = bytesDone;
+    return KUErrorNotEnoughBytesRead;
   }
 
   return KUErrorSuccess;
 }
 
-static KUError kwrite_via_physmap(uint64_t address, const void *buffer,
-                                  size_t size) {
-  if (address == 0 || buffer == nullptr || size == 0) {
+// Runs that span several pages are retried one page at a time if the single
+// descriptor cannot be set up (e.g. the run crosses into a different memory
+// region).
+static KUError physmap_transfer_run_or_pages(uint64_t paddr, uint8_t *data,
+                                             size_t len, bool write) {
+  KUError err = physmap_transfer_run(paddr, data, len, write);
+  if (err == KUErrorSuccess || len <= PAGE_SIZE - (paddr & PAGE_MASK)) {
+    return err;
+  }
+
+  while (len) {
+    size_t chunk = PAGE_SIZE - static_cast<size_t>(paddr & PAGE_MASK);
+    if (chunk > len) {
+      chunk = len;
+    }
+    err = physmap_transfer_run(paddr, data, chunk, write);
+    if (err != KUErrorSuccess) {
+      return err;
+    }
+    paddr += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+
+  return KUErrorSuccess;
+}
+
+// Accesses kernel memory through its physical pages, which works for mappings
+// IOMemoryDescriptor::withAddressRange refuses (proc_ro, read-only zones). The
+// range is translated up front and each physically contiguous run is moved
+// with one descriptor instead of one per page.
+static KUError physmap_transfer(uint64_t address, uint8_t *data, size_t size,
+                                bool write) {
+  if (address == 0 || data == nullptr || size == 0) {
     return KUErrorBadArgument;
   }
 
-  const uint8_t *in = static_cast<const uint8_t *>(buffer);
-  uint64_t vaddr = address;
-  size_t remaining = size;
+  PhysRun runs[kPhysRunBatch];
+  size_t done = 0;
 
-  while (remaining) {
-    vm_offset_t paddr = arm_kvtophys(vaddr);
-    if (paddr == 0) {
+  while (done < size) {
+    uint32_t runCount = 0;
+    size_t covered = collect_phys_runs(address + done, size - done, runs,
+                                       kPhysRunBatch, &runCount);
+    if (covered == 0) {
       return KUErrorNotEnoughBytesRead;
     }
 
-    size_t page_off = static_cast<size_t>(paddr & PAGE_MASK);
-    size_t chunk = PAGE_SIZE - page_off;
-    if (chunk > remaining) {
-      chunk = remaining;
+    for (uint32_t i = 0; i < runCount; ++i) {
+      KUError err = physmap_transfer_run_or_pages(runs[i].paddr, data + done,
+                                                  runs[i].len, write);
+      if (err != KUErrorSuccess) {
+        return err;
+      }
+      done += runs[i].len;
     }
+  }
 
-    IOPhysicalAddress paddr_aligned =
-        static_cast<IOPhysicalAddress>(paddr & ~static_cast<vm_offset_t>(PAGE_MASK));
-    IOByteCount map_len = static_cast<IOByteCount>(page_off + chunk);
+  return KUErrorSuccess;
+}
 
-    IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withPhysicalAddress(
-        paddr_aligned, map_len, kIODirectionInOut);
-    if (!memDesc) {
-      return KUErrorMemoryAllocationFailed;
-    }
+static KUError kread_via_physmap(uint64_t address, void *buffer, size_t size) {
+  return physmap_transfer(address, static_cast<uint8_t *>(buffer), size, false);
+}
 
-    IOReturn ret = memDesc->prepare();
-    if (ret != kIOReturnSuccess) {
-      pandora_runtime_state().debug.extraErrorData1 = (uint64_t)(uint32_t)ret;
-      memDesc->release();
-      return KUErrorMemoryPreperationFailed;
-    }
+static KUError kwrite_via_physmap(uint64_t address, const void *buffer,
+                                  size_t size) {
+  // The buffer is only read from when `write` is set.
+  return physmap_transfer(address,
+                          static_cast<uint8_t *>(const_cast<void *>(buffer)),
+                          size, true);
+}
+
+// Pages that IOMemoryDescriptor::withAddressRange cannot prepare (read-only
+// zones, proc_ro) are remembered here so later accesses go straight to the
+// physmap path. Direct-mapped by page number; a slot holds page + 1 so that
+// zero means empty. Lookups are lock-free; learn, forget and reset take
+// g_access_path_lock so cachedPages stays in step with the table.
+static constexpr uint32_t kPhysmapPageSlots = 256;
+static constexpr uint32_t kPhysmapLearnMaxPages = 8;
+static volatile uint64_t g_physmap_pages[kPhysmapPageSlots];
+static KUAccessPathStats g_access_path_stats;
+static IOLock *g_access_path_lock = nullptr;
+static IOLock *g_init_lock = nullptr;
 
-    uint64_t bytesWritten =
-        memDesc->writeBytes(static_cast<IOByteCount>(page_off), in,
-                            static_cast<IOByteCount>(chunk));
+static inline uint32_t physmap_page_slot(uint64_t page) {
+  return static_cast<uint32_t>((page * 0x9E3779B97F4A7C15ULL) >> 56) &
+         (kPhysmapPageSlots - 1);
+}
+
+static bool physmap_page_known(uint64_t address) {
+  uint64_t page = address >> PAGE_SHIFT;
+  return g_physmap_pages[physmap_page_slot(page)] == page + 1;
+}
+
+// Callers hold g_access_path_lock.
+static void physmap_learn_page_locked(uint64_t page) {
+  volatile uint64_t *slot = &g_physmap_pages[physmap_page_slot(page)];
+  if (*slot == page + 1) {
+    return;
+  }
+  if (*slot == 0) {
+    g_access_path_stats.cachedPages++;
+  }
+  *slot = page + 1;
+}
+
+static bool iomd_page_prepares(uint64_t page, IODirection direction) {
+  IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withAddressRange(
+      page << PAGE_SHIFT, PAGE_SIZE, direction, kernel_task);
+  if (!memDesc) {
+    return true; // not a property of the page; don't learn it
+  }
+  bool ok = memDesc->prepare() == kIOReturnSuccess;
+  if (ok) {
     memDesc->complete();
-    memDesc->release();
+  }
+  memDesc->release();
+  return ok;
+}
 
-    if (bytesWritten != chunk) {
-      pandora_runtime_state().debug.extraErrorData1 = chunk;
-      pandora_runtime_state().debug.extraErrorData2 = bytesWritten;
-      return KUErrorNotEnoughBytesRead;
+// Called after an access fell back to the physmap path. Only the pages the
+// IOMD path actually refuses are remembered: a multi-page request is probed
+// page by page (this is the slow path already), so its readable neighbours
+// keep using the cheaper IOMD route.
+static void physmap_learn(uint64_t address, size_t size, bool write) {
+  if (!g_access_path_lock) {
+    return;
+  }
+
+  uint64_t first = address >> PAGE_SHIFT;
+  uint64_t last = (address + size - 1) >> PAGE_SHIFT;
+  if (last - first >= kPhysmapLearnMaxPages) {
+    last = first + kPhysmapLearnMaxPages - 1;
+  }
+
+  uint64_t refused[kPhysmapLearnMaxPages];
+  uint32_t refusedCount = 0;
+  if (first == last) {
+    refused[refusedCount++] = first;
+  } else {
+    for (uint64_t page = first; page <= last; ++page) {
+      if (!iomd_page_prepares(page,
+                              write ? kIODirectionInOut : kIODirectionIn)) {
+        refused[refusedCount++] = page;
+      }
     }
+  }
 
-    in += chunk;
-    vaddr += chunk;
-    remaining -= chunk;
+  IOLockLock(g_access_path_lock);
+  for (uint32_t i = 0; i < refusedCount; ++i) {
+    physmap_learn_page_locked(refused[i]);
   }
+  IOLockUnlock(g_access_path_lock);
+}
 
-  return KUErrorSuccess;
+static void physmap_forget(uint64_t address) {
+  if (!g_access_path_lock) {
+    return;
+  }
+
+  uint64_t page = address >> PAGE_SHIFT;
+  volatile uint64_t *slot = &g_physmap_pages[physmap_page_slot(page)];
+  IOLockLock(g_access_path_lock);
+  if (*slot == page + 1) {
+    *slot = 0;
+    g_access_path_stats.cachedPages--;
+  }
+  IOLockUnlock(g_access_path_lock);
+}
+
+static inline void access_path_count(uint64_t *counter) {
+  OSIncrementAtomic64(reinterpret_cast<volatile SInt64 *>(counter));
 }
 
 KUError KernelUtilities::kread(uint64_t address, void *buffer, size_t size) {
+  if (address == 0 || buffer == nullptr || size == 0) {
+    return KUErrorBadArgument;
+  }
+
+  if (physmap_page_known(address)) {
+    KUError err = kread_via_physmap(address, buffer, size);
+    if (err == KUErrorSuccess) {
+      access_path_count(&g_access_path_stats.physmapCachedReads);
+      return KUErrorSuccess;
+    }
+    // The page may have been freed and reused; relearn from scratch.
+    physmap_forget(address);
+  }
+
   KUError err = kread_iomd(address, buffer, size);
   if (err == KUErrorSuccess) {
+    access_path_count(&g_access_path_stats.iomdReads);
     return KUErrorSuccess;
   }
 
   // IOMemoryDescriptor reads can fail for certain protected mappings (e.g.
   // Z_SUBMAP_IDX_READ_ONLY / PMAP_MAPPING_TYPE_ROZONE used by proc_ro).
   bzero(buffer, size);
-  return kread_via_physmap(address, buffer, size);
-};
-
-KUError KernelUtilities::kwrite(uint64_t address, const void *buffer,
-                                size_t size) {
-  if (address == 0 || buffer == nullptr || size == 0) {
-    return KUErrorBadArgument;
+  err = kread_via_physmap(address, buffer, size);
+  if (err == KUErrorSuccess) {
+    physmap_learn(address, size, false);
+    access_path_count(&g_access_path_stats.fallbackReads);
+  } else {
+    access_path_count(&g_access_path_stats.failedReads);
   }
+  return err;
+};
 
+static KUError kwrite_iomd(uint64_t address, const void *buffer, size_t size) {
   IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withAddressRange(
       address, size, kIODirectionInOut, kernel_task);
   if (!memDesc) {
@@ -200,29 +360,563 @@ KUError KernelUtilities::kwrite(uint64_t address, const void *buffer,
                         address, ret);
     pandora_runtime_state().debug.extraErrorData1 = (uint64_t)(uint32_t)ret;
     memDesc->release();
-    KUError fallbackErr = kwrite_via_physmap(address, buffer, size);
-    return (fallbackErr == KUErrorSuccess) ? KUErrorSuccess
-                                          : KUErrorMemoryPreperationFailed;
+    return KUErrorMemoryPreperationFailed;
   }
 
   uint64_t bytesWritten = memDesc->writeBytes(0, buffer, size);
+  memDesc->complete();
+  memDesc->release();
   if (bytesWritten != size) {
     PANDORA_LOG_DEFAULT("Write operation incomplete at address 0x%llx: "
                         "expected %zu bytes, wrote %llu bytes",
                         address, size, bytesWritten);
     pandora_runtime_state().debug.extraErrorData1 = size;
     pandora_runtime_state().debug.extraErrorData2 = bytesWritten;
-    memDesc->complete();
-    memDesc->release();
-    KUError fallbackErr = kwrite_via_physmap(address, buffer, size);
-    return (fallbackErr == KUErrorSuccess) ? KUErrorSuccess
-                                          : KUErrorNotEnoughBytesRead;
+    return KUErrorNotEnoughBytesRead;
+  }
+  return KUErrorSuccess;
+}
+
+KUError KernelUtilities::kwrite(uint64_t address, const void *buffer,
+                                size_t size) {
+  if (address == 0 || buffer == nullptr || size == 0) {
+    return KUErrorBadArgument;
+  }
+
+  if (physmap_page_known(address)) {
+    if (kwrite_via_physmap(address, buffer, size) == KUErrorSuccess) {
+      access_path_count(&g_access_path_stats.physmapCachedWrites);
+      return KUErrorSuccess;
+    }
+    physmap_forget(address);
+  }
+
+  KUError err = kwrite_iomd(address, buffer, size);
+  if (err == KUErrorSuccess) {
+    access_path_count(&g_access_path_stats.iomdWrites);
+    return KUErrorSuccess;
+  }
+
+  if (kwrite_via_physmap(address, buffer, size) == KUErrorSuccess) {
+    physmap_learn(address, size, true);
+    access_path_count(&g_access_path_stats.fallbackWrites);
+    return KUErrorSuccess;
+  }
+
+  access_path_count(&g_access_path_stats.failedWrites);
+  return err;
+}
+
+static bool read_dt_u64(IORegistryEntry *entry, const char *key,
+                        uint64_t *out) {
+  OSData *data = OSDynamicCast(OSData, entry->getProperty(key));
+  if (!data || data->getLength() != sizeof(*out)) {
+    return false;
+  }
+  memcpy(out, data->getBytesNoCopy(), sizeof(*out));
+  return true;
+}
+
+KUError KernelUtilities::dramRange(uint64_t *base, uint64_t *size) {
+  static uint64_t dramBase = 0;
+  static uint64_t dramSize = 0;
+
+  if (dramSize == 0) {
+    IORegistryEntry *chosen = IORegistryEntry::fromPath("/chosen", gIODTPlane);
+    if (!chosen) {
+      return KUErrorInvalidAddress;
+    }
+    uint64_t b = 0;
+    uint64_t s = 0;
+    bool ok = read_dt_u64(chosen, "dram-base", &b) &&
+              read_dt_u64(chosen, "dram-size", &s) && s != 0;
+    chosen->release();
+    if (!ok) {
+      return KUErrorInvalidAddress;
+    }
+    // Benign race: every caller computes the same values.
+    dramBase = b;
+    dramSize = s;
+  }
+
+  if (base) {
+    *base = dramBase;
+  }
+  if (size) {
+    *size = dramSize;
   }
-  memDesc->complete();
-  memDesc->release();
   return KUErrorSuccess;
 }
 
+// Physical memory physRead() may touch: the DRAM window minus every region
+// iBoot lists under /chosen/carveout-memory-map (SEP, TZ0/TZ1, secure ROM and
+// friends), rounded out to pages. Reading those can hang or fault the
+// machine. Built once, under g_init_lock.
+static constexpr uint32_t kPhysSafeRangesMax = 64;
+static phys_range g_phys_safe_ranges[kPhysSafeRangesMax];
+static uint32_t g_phys_safe_range_count = 0;
+static bool g_phys_safe_ranges_ready = false;
+
+static uint32_t subtract_dt_carveouts(IORegistryEntry *entry,
+                                      phys_range *ranges, uint32_t count) {
+  OSDictionary *props = entry->dictionaryWithProperties();
+  if (!props) {
+    return count;
+  }
+  OSCollectionIterator *iter = OSCollectionIterator::withCollection(props);
+  if (!iter) {
+    props->release();
+    return count;
+  }
+
+  // Regions are {base, size} pairs; "name" and the phandle are skipped by
+  // their length.
+  while (OSSymbol *key = OSDynamicCast(OSSymbol, iter->getNextObject())) {
+    OSData *data = OSDynamicCast(OSData, props->getObject(key));
+    uint64_t region[2];
+    if (!data || data->getLength() != sizeof(region)) {
+      continue;
+    }
+    memcpy(region, data->getBytesNoCopy(), sizeof(region));
+    if (region[1] == 0) {
+      continue;
+    }
+    uint64_t start = region[0] & ~static_cast<uint64_t>(PAGE_MASK);
+    uint64_t end = region[0] + region[1];
+    end = (end < region[0] || end > UINT64_MAX - PAGE_MASK)
+              ? UINT64_MAX
+              : (end + PAGE_MASK) & ~static_cast<uint64_t>(PAGE_MASK);
+    count = phys_ranges_subtract(ranges, count, kPhysSafeRangesMax, start,
+                                 end - start);
+  }
+
+  iter->release();
+  props->release();
+  return count;
+}
+
+static KUError build_phys_safe_ranges() {
+  uint64_t base = 0;
+  uint64_t size = 0;
+  KUError err = KernelUtilities::dramRange(&base, &size);
+  if (err != KUErrorSuccess) {
+    return err;
+  }
+
+  // Without the carve-out map there is no telling what is safe.
+  IORegistryEntry *carveouts = IORegistryEntry::fromPath(
+      "/chosen/carveout-memory-map", gIODTPlane);
+  if (!carveouts) {
+    return KUErrorInvalidAddress;
+  }
+
+  g_phys_safe_ranges[0].base = base;
+  g_phys_safe_ranges[0].size = size;
+  g_phys_safe_range_count =
+      subtract_dt_carveouts(carveouts, g_phys_safe_ranges, 1);
+  carveouts->release();
+  return KUErrorSuccess;
+}
+
+KUError KernelUtilities::physSafeRanges(phys_range *out, uint32_t max,
+                                        uint32_t *count) {
+  if (!count || (max != 0 && !out)) {
+    return KUErrorBadArgument;
+  }
+
+  if (!__atomic_load_n(&g_phys_safe_ranges_ready, __ATOMIC_ACQUIRE)) {
+    if (!g_init_lock) {
+      return KUErrorInvalidAddress;
+    }
+    IOLockLock(g_init_lock);
+    KUError err = KUErrorSuccess;
+    if (!g_phys_safe_ranges_ready) {
+      err = build_phys_safe_ranges();
+      if (err == KUErrorSuccess) {
+        __atomic_store_n(&g_phys_safe_ranges_ready, true, __ATOMIC_RELEASE);
+      }
+    }
+    IOLockUnlock(g_init_lock);
+    if (err != KUErrorSuccess) {
+      return err;
+    }
+  }
+
+  uint32_t n = g_phys_safe_range_count < max ? g_phys_safe_range_count : max;
+  if (n) {
+    memcpy(out, g_phys_safe_ranges, n * sizeof(*out));
+  }
+  *count = g_phys_safe_range_count;
+  return KUErrorSuccess;
+}
+
+KUError KernelUtilities::physRead(uint64_t paddr, void *buffer, size_t size) {
+  if (buffer == nullptr || size == 0) {
+    return KUErrorBadArgument;
+  }
+
+  uint32_t count = 0;
+  KUError err = physSafeRanges(nullptr, 0, &count);
+  if (err != KUErrorSuccess) {
+    return err;
+  }
+  if (!phys_ranges_contains(g_phys_safe_ranges, count, paddr, size)) {
+    return KUErrorInvalidAddress;
+  }
+
+  return physmap_transfer_run_or_pages(paddr, static_cast<uint8_t *>(buffer),
+                                       size, false);
+}
+
+KUError KernelUtilities::translate(uint64_t vaddr, KUTranslation *out) {
+  if (out == nullptr) {
+    return KUErrorBadArgument;
+  }
+  *out = KUTranslation{};
+
+  uint64_t parWrite = 0;
+  uint64_t par = arm_kvtopar(vaddr, &parWrite);
+  // PAR_EL1.F set means the walk faulted.
+  if (par & 1) {
+    return KUErrorInvalidAddress;
+  }
+
+  out->paddr = (par & 0x0000fffffffff000ULL) | (vaddr & 0xfffULL);
+  out->attr = static_cast<uint8_t>(par >> 56);
+  out->shareability = static_cast<uint8_t>((par >> 7) & 3);
+  out->writable = (parWrite & 1) == 0;
+  return KUErrorSuccess;
+}
+
+void KernelUtilities::translationRegisters(uint64_t *ttbr1, uint64_t *tcr) {
+  uint64_t t = 0;
+  uint64_t c = 0;
+  asm volatile("mrs %0, ttbr1_el1" : "=r"(t));
+  asm volatile("mrs %0, tcr_el1" : "=r"(c));
+  if (ttbr1) {
+    *ttbr1 = t;
+  }
+  if (tcr) {
+    *tcr = c;
+  }
+}
+
+KUError KernelUtilities::kmemmove(uint64_t dst, uint64_t src, size_t size,
+                                  void *scratch, size_t scratchSize) {
+  if (dst == 0 || src == 0 || size == 0 || scratch == nullptr ||
+      scratchSize == 0) {
+    return KUErrorBadArgument;
+  }
+  if (dst == src) {
+    return KUErrorSuccess;
+  }
+
+  // Copy back to front when the destination overlaps the tail of the source
+  // so no chunk is overwritten before it has been read.
+  const bool backwards = dst > src && dst - src < size;
+  size_t done = 0;
+  while (done < size) {
+    size_t chunk = (size - done < scratchSize) ? (size - done) : scratchSize;
+    size_t off = backwards ? size - done - chunk : done;
+
+    KUError err = kread(src + off, scratch, chunk);
+    if (err != KUErrorSuccess) {
+      return err;
+    }
+    err = kwrite(dst + off, scratch, chunk);
+    if (err != KUErrorSuccess) {
+      return err;
+    }
+    done += chunk;
+  }
+
+  return KUErrorSuccess;
+}
+
+KUError KernelUtilities::kmemset(uint64_t dst, uint8_t value, size_t size,
+                                 void *scratch, size_t scratchSize) {
+  if (dst == 0 || size == 0 || scratch == nullptr || scratchSize == 0) {
+    return KUErrorBadArgument;
+  }
+
+  size_t fill = (size < scratchSize) ? size : scratchSize;
+  memset(scratch, value, fill);
+
+  for (size_t done = 0; done < size;) {
+    size_t chunk = (size - done < fill) ? (size - done) : fill;
+    KUError err = kwrite(dst + done, scratch, chunk);
+    if (err != KUErrorSuccess) {
+      return err;
+    }
+    done += chunk;
+  }
+
+  return KUErrorSuccess;
+}
+
+// Writable kernel mappings of the physical pages kcas/kwriteMasked touch.
+// Creating an IOMemoryDescriptor and an IOMemoryMap per operation costs far
+// more than the atomic itself, so mappings are kept per physical page and
+// recycled least recently used first. Physical pages never go away, so a
+// cached mapping stays valid even if the kernel VA that led to it is freed.
+struct PhysWordMapSlot {
+  uint64_t page; // physical page number + 1; 0 means empty
+  IOMemoryDescriptor *desc;
+  IOMemoryMap *map;
+  uint64_t va;
+  uint64_t lastUse;
+};
+
+static constexpr uint32_t kPhysWordMapSlots = 16;
+static PhysWordMapSlot g_phys_word_maps[kPhysWordMapSlots];
+static uint64_t g_phys_word_clock = 0;
+static IOLock *g_phys_word_lock = nullptr;
+
+static void phys_word_slot_release(PhysWordMapSlot *slot) {
+  if (slot->map) {
+    slot->map->release();
+  }
+  if (slot->desc) {
+    slot->desc->release();
+  }
+  *slot = PhysWordMapSlot{};
+}
+
+struct PhysWordMapping {
+  volatile void *word;
+};
+
+// On success the mapping is returned with g_phys_word_lock held, so it
+// cannot be recycled under the caller; unmap_phys_word() drops the lock.
+static KUError map_phys_word(uint64_t address, size_t width,
+                             PhysWordMapping *out) {
+  *out = PhysWordMapping{};
+  if (address == 0 || (width != 4 && width != 8) ||
+      (address & (width - 1)) != 0) {
+    return KUErrorBadArgument;
+  }
+  if (!g_phys_word_lock) {
+    return KUErrorMemoryAllocationFailed;
+  }
+
+  vm_offset_t paddr = arm_kvtophys(address);
+  if (paddr == 0) {
+    return KUErrorInvalidAddress;
+  }
+  const uint64_t page = (static_cast<uint64_t>(paddr) >> PAGE_SHIFT) + 1;
+
+  IOLockLock(g_phys_word_lock);
+  PhysWordMapSlot *slot = nullptr;
+  for (uint32_t i = 0; i < kPhysWordMapSlots; ++i) {
+    PhysWordMapSlot *candidate = &g_phys_word_maps[i];
+    if (candidate->page == page) {
+      slot = candidate;
+      break;
+    }
+    if (!slot || candidate->lastUse < slot->lastUse) {
+      slot = candidate; // empty slots have lastUse 0 and win
+    }
+  }
+
+  if (slot->page != page) {
+    phys_word_slot_release(slot);
+
+    IOMemoryDescriptor *desc = IOMemoryDescriptor::withPhysicalAddress(
+        static_cast<IOPhysicalAddress>(paddr &
+                                       ~static_cast<uint64_t>(PAGE_MASK)),
+        PAGE_SIZE, kIODirectionInOut);
+    if (!desc) {
+      IOLockUnlock(g_phys_word_lock);
+      return KUErrorMemoryAllocationFailed;
+    }
+
+    // Default (write-back) caching: exclusives need normal cacheable memory.
+    IOMemoryMap *map =
+        desc->createMappingInTask(kernel_task, 0, kIOMapAnywhere);
+    if (!map) {
+      desc->release();
+      IOLockUnlock(g_phys_word_lock);
+      return KUErrorMemoryPreperationFailed;
+    }
+
+    slot->page = page;
+    slot->desc = desc;
+    slot->map = map;
+    slot->va = map->getVirtualAddress();
+  }
+
+  slot->lastUse = ++g_phys_word_clock;
+  out->word = reinterpret_cast<volatile void *>(slot->va + (paddr & PAGE_MASK));
+  return KUErrorSuccess;
+}
+
+static void unmap_phys_word(PhysWordMapping *mapping) {
+  *mapping = PhysWordMapping{};
+  IOLockUnlock(g_phys_word_lock);
+}
+
+// Compare-and-swap on a mapped word; `*observed` gets the value it held.
+static bool phys_word_cas(const PhysWordMapping &mapping, size_t width,
+                          uint64_t expected, uint64_t desired,
+                          uint64_t *observed) {
+  if (width == 4) {
+    uint32_t cur = static_cast<uint32_t>(expected);
+    bool ok = __atomic_compare_exchange_n(
+        static_cast<volatile uint32_t *>(mapping.word), &cur,
+        static_cast<uint32_t>(desired), false, __ATOMIC_SEQ_CST,
+        __ATOMIC_SEQ_CST);
+    *observed = cur;
+    return ok;
+  }
+
+  uint64_t cur = expected;
+  bool ok = __atomic_compare_exchange_n(
+      static_cast<volatile uint64_t *>(mapping.word), &cur, desired, false,
+      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  *observed = cur;
+  return ok;
+}
+
+static uint64_t phys_word_load(const PhysWordMapping &mapping, size_t width) {
+  if (width == 4) {
+    return __atomic_load_n(static_cast<volatile uint32_t *>(mapping.word),
+                           __ATOMIC_SEQ_CST);
+  }
+  return __atomic_load_n(static_cast<volatile uint64_t *>(mapping.word),
+                         __ATOMIC_SEQ_CST);
+}
+
+KUError KernelUtilities::kcas(uint64_t address, size_t width,
+                              uint64_t expected, uint64_t desired,
+                              uint64_t *previous) {
+  PhysWordMapping mapping;
+  KUError err = map_phys_word(address, width, &mapping);
+  if (err != KUErrorSuccess) {
+    return err;
+  }
+
+  uint64_t observed = 0;
+  bool swapped = phys_word_cas(mapping, width, expected, desired, &observed);
+  unmap_phys_word(&mapping);
+
+  if (previous) {
+    *previous = observed;
+  }
+  return swapped ? KUErrorSuccess : KUErrorCompareMismatch;
+}
+
+KUError KernelUtilities::kwriteMasked(uint64_t address, size_t width,
+                                      uint64_t value, uint64_t mask,
+                                      uint64_t *previous) {
+  PhysWordMapping mapping;
+  KUError err = map_phys_word(address, width, &mapping);
+  if (err != KUErrorSuccess) {
+    return err;
+  }
+
+  // A failed CAS hands back the fresh value, so each retry only loses to a
+  // concurrent writer that actually changed the word.
+  uint64_t observed = phys_word_load(mapping, width);
+  uint64_t desired = 0;
+  do {
+    desired = (observed & ~mask) | (value & mask);
+  } while (!phys_word_cas(mapping, width, observed, desired, &observed));
+  unmap_phys_word(&mapping);
+
+  if (previous) {
+    *previous = observed;
+  }
+  return KUErrorSuccess;
+}
+
+void KernelUtilities::accessPathStats(KUAccessPathStats *out) {
+  if (!out) {
+    return;
+  }
+  // Counters are sampled individually; a snapshot taken under load may be
+  // slightly inconsistent across fields.
+  *out = g_access_path_stats;
+}
+
+void KernelUtilities::resetAccessPathCache() {
+  if (!g_access_path_lock) {
+    return;
+  }
+
+  IOLockLock(g_access_path_lock);
+  for (uint32_t i = 0; i < kPhysmapPageSlots; ++i) {
+    g_physmap_pages[i] = 0;
+  }
+  bzero(&g_access_path_stats, sizeof(g_access_path_stats));
+  IOLockUnlock(g_access_path_lock);
+}
+
+KUError KernelUtilities::init() {
+  if (__atomic_load_n(&initialized_, __ATOMIC_ACQUIRE)) {
+    return initStatus_;
+  }
+  if (!g_init_lock) {
+    return KUErrorKernelBaseNotFound;
+  }
+
+  IOLockLock(g_init_lock);
+  if (!initialized_) {
+    uint64_t base = 0;
+    uint64_t slide = 0;
+    KUError status = locateKernelBase(&base, &slide);
+    if (status == KUErrorSuccess) {
+      kernelBaseAddress = base;
+      kernelSlide = slide;
+    }
+    initStatus_ = status;
+    __atomic_store_n(&initialized_, status == KUErrorSuccess,
+                     __ATOMIC_RELEASE);
+  }
+  KUError status = initStatus_;
+  IOLockUnlock(g_init_lock);
+  return status;
+}
+
+KUError KernelUtilities::setup() {
+  if (!g_init_lock) {
+    g_init_lock = IOLockAlloc();
+    if (!g_init_lock) {
+      return KUErrorMemoryAllocationFailed;
+    }
+  }
+  if (!g_access_path_lock) {
+    g_access_path_lock = IOLockAlloc();
+    if (!g_access_path_lock) {
+      return KUErrorMemoryAllocationFailed;
+    }
+  }
+  if (!g_phys_word_lock) {
+    g_phys_word_lock = IOLockAlloc();
+    if (!g_phys_word_lock) {
+      return KUErrorMemoryAllocationFailed;
+    }
+  }
+  return KUErrorSuccess;
+}
+
+void KernelUtilities::teardown() {
+  if (g_access_path_lock) {
+    IOLockFree(g_access_path_lock);
+    g_access_path_lock = nullptr;
+  }
+  if (g_init_lock) {
+    IOLockFree(g_init_lock);
+    g_init_lock = nullptr;
+  }
+  if (g_phys_word_lock) {
+    for (uint32_t i = 0; i < kPhysWordMapSlots; ++i) {
+      phys_word_slot_release(&g_phys_word_maps[i]);
+    }
+    IOLockFree(g_phys_word_lock);
+    g_phys_word_lock = nullptr;
+  }
+}
+
 KUError KernelUtilities::pread(task_t task, uint64_t address, void *buffer,
                                size_t size) {
   if (task == TASK_NULL || address == 0 || buffer == nullptr || size == 0) {
@@ -305,6 +999,62 @@ KUError KernelUtilities::pwrite(task_t task, uint64_t address,
   return KUErrorSuccess;
 }
 
+// The kernel Mach-O header sits at the start of a page, so only page starts
+// are tested. Windows of this size are mapped with a single descriptor; one
+// that cannot be prepared is probed page by page, and a window with no mapped
+// page at all is skipped whole.
+static constexpr size_t kKernelBaseSearchWindow = 64 * PAGE_SIZE;
+
+static inline bool is_kernel_header(const struct mach_header_64 *header) {
+  return (header->magic == MH_MAGIC_64 || header->magic == MH_CIGAM_64) &&
+         header->filetype == MH_EXECUTE;
+}
+
+// Looks for the kernel header in the pages of [start, start + len), highest
+// first. Returns true and sets `found` on a hit; `mapped` reports whether any
+// page of the window was readable.
+static bool scan_kernel_base_window(uint64_t start, size_t len, uint64_t *found,
+                                    bool *mapped) {
+  struct mach_header_64 header;
+  *mapped = false;
+
+  IOMemoryDescriptor *memDesc = IOMemoryDescriptor::withAddressRange(
+      start, len, kIODirectionIn, kernel_task);
+  if (memDesc && memDesc->prepare() == kIOReturnSuccess) {
+    *mapped = true;
+    for (size_t off = len; off >= PAGE_SIZE;) {
+      off -= PAGE_SIZE;
+      if (memDesc->readBytes(off, &header, sizeof(header)) == sizeof(header) &&
+          is_kernel_header(&header)) {
+        *found = start + off;
+        memDesc->complete();
+        memDesc->release();
+        return true;
+      }
+    }
+    memDesc->complete();
+    memDesc->release();
+    return false;
+  }
+  if (memDesc) {
+    memDesc->release();
+  }
+
+  for (size_t off = len; off >= PAGE_SIZE;) {
+    off -= PAGE_SIZE;
+    if (arm_kvtophys(start + off) == 0) {
+      continue;
+    }
+    *mapped = true;
+    if (kread_iomd(start + off, &header, sizeof(header)) == KUErrorSuccess &&
+        is_kernel_header(&header)) {
+      *found = start + off;
+      return true;
+    }
+  }
+  return false;
+}
+
 KUError KernelUtilities::locateKernelBase(uint64_t *kernelBaseAddress,
                                           uint64_t *kernelSlide) {
 
@@ -318,63 +1068,42 @@ KUError KernelUtilities::locateKernelBase(uint64_t *kernelBaseAddress,
     return KUErrorInvalidResetVector;
   }
 
-  uint64_t address = kernelPage & ~(uint64_t)0xFFF;
   const uint64_t minAddress = 0xfffffe0000000000;
-  const size_t chunkSize = 0x1000;
+  uint64_t startTime = mach_absolute_time();
+  uint32_t windows = 0;
+  uint32_t skipped = 0;
 
-  uint8_t *buffer = (uint8_t *)IOMalloc(chunkSize);
-  if (!buffer) {
-    PANDORA_LOG_DEFAULT(
-        "Failed to allocate %zu bytes for kernel base search buffer",
-        chunkSize);
-    return KUErrorMemoryAllocationFailed;
-  }
+  // `top` is the end of the next window to scan; the first one ends just past
+  // the page holding the vectors.
+  uint64_t top = (kernelPage & ~static_cast<uint64_t>(PAGE_MASK)) + PAGE_SIZE;
+  while (top > minAddress) {
+    size_t len = (top - minAddress < kKernelBaseSearchWindow)
+                     ? static_cast<size_t>(top - minAddress)
+                     : kKernelBaseSearchWindow;
+    uint64_t start = top - len;
 
-  while (address >= minAddress) {
-    size_t readSize = chunkSize;
-    if (address < minAddress + chunkSize) {
-      readSize = address - minAddress;
-      address = minAddress;
-    }
+    uint64_t found = 0;
+    bool mapped = false;
+    windows++;
+    if (scan_kernel_base_window(start, len, &found, &mapped)) {
+      *kernelBaseAddress = found;
+      *kernelSlide = found - _KU_DEFAULT_KB;
 
-    KUError err = kread_iomd(address, buffer, readSize);
-    if (err != KUErrorSuccess) {
-      if (address >= chunkSize) {
-        address -= chunkSize;
-      } else {
-        break;
-      }
-      continue;
+      uint64_t elapsed =
+          TimeUtilities::machTimeToNanoseconds(mach_absolute_time() - startTime);
+      pandora_runtime_state().telemetry.kernelBaseScanNanos = elapsed;
+      PANDORA_LOG_DEFAULT("Kernel base 0x%llx found in %llu ns (%u windows, "
+                          "%u unmapped)",
+                          found, elapsed, windows, skipped);
+      return KUErrorSuccess;
     }
-
-    for (size_t offset = 0; offset < readSize - sizeof(struct mach_header_64);
-         offset += 4) {
-      uint32_t magic = *(uint32_t *)(buffer + offset);
-      if (magic == MH_MAGIC_64 || magic == MH_CIGAM_64) {
-        uint64_t potentialBase = address + offset;
-        // cast to mach_header_64
-        struct mach_header_64 *header =
-            (struct mach_header_64 *)(buffer + offset);
-        if (header->filetype == MH_EXECUTE) {
-          *kernelBaseAddress = potentialBase;
-          *kernelSlide = potentialBase - _KU_DEFAULT_KB;
-
-          // free
-          IOFree(buffer, chunkSize);
-
-          return KUErrorSuccess;
-        }
-      }
+    if (!mapped) {
+      skipped++;
     }
 
-    if (address >= chunkSize) {
-      address -= chunkSize;
-    } else {
-      break;
-    }
+    top = start;
   }
 
   PANDORA_LOG_DEFAULT("Kernel base address not found after exhaustive search");
-  IOFree(buffer, chunkSize);
   return KUErrorKernelBaseNotFound;
 }
@@ -6,6 +6,7 @@
 
 #include <IOKit/IOLib.h>
 #include <IOKit/IOMemoryDescriptor.h>
+#include <IOKit/IORegistryEntry.h>
 #include <IOKit/IOReturn.h>
 #include <IOKit/IOService.h>
 #include <IOKit/IOSharedDataQueue.h>
@@ -17,6 +18,8 @@
 #include <mach/vm_param.h>
 #include <string.h>
 
+#include "calypso/phys_ranges.h"
+
 #define _KU_DEFAULT_KB 0xFFFFFE0007004000
 
 // KUError enumeration for error handling
@@ -32,6 +35,7 @@ enum KUError {
   KUErrorBadArgument = -8,
   KUErrorMemoryPreperationFailed = -9,
   KUErrorNotEnoughBytesRead = -10,
+  KUErrorCompareMismatch = -11,
 };
 
 static inline const char *get_error_name(KUError error) {
@@ -58,30 +62,96 @@ static inline const char *get_error_name(KUError error) {
     return "Memory preparation failed";
   case KUErrorNotEnoughBytesRead:
     return "Not enough bytes read";
+  case KUErrorCompareMismatch:
+    return "Compare value mismatch";
   default:
     return "Unknown error";
   }
 }
 
+// How kread/kwrite reached memory. `physmapCached*` accesses skipped the
+// IOMemoryDescriptor attempt because the page was already known to need the
+// physmap path; `fallback*` accesses tried it first and fell back.
+struct KUAccessPathStats {
+  uint64_t iomdReads;
+  uint64_t iomdWrites;
+  uint64_t physmapCachedReads;
+  uint64_t physmapCachedWrites;
+  uint64_t fallbackReads;
+  uint64_t fallbackWrites;
+  uint64_t failedReads;
+  uint64_t failedWrites;
+  uint64_t cachedPages;
+};
+
+// Result of a stage 1 translation of a kernel VA, decoded from PAR_EL1.
+// `attr` is the MAIR attribute byte of the mapping and `shareability` the
+// PAR_EL1.SH field.
+struct KUTranslation {
+  uint64_t paddr;
+  uint8_t attr;
+  uint8_t shareability;
+  bool writable;
+};
+
 class KernelUtilities {
 public:
   KernelUtilities()
       : kernelBaseAddress(0), kernelSlide(0),
         initStatus_(KUErrorKernelBaseNotFound) {}
 
-  KUError init() {
-    if (initialized_)
-      return initStatus_;
-    initStatus_ = locateKernelBase(&kernelBaseAddress, &kernelSlide);
-    initialized_ = (initStatus_ == KUErrorSuccess);
-    return initStatus_;
-  }
+  // Locates the kernel base once. Safe to call from any thread (module
+  // start, the proc_task shim); concurrent callers serialize on a lock
+  // allocated by setup().
+  KUError init();
 
-  bool isInitialized() const { return initialized_; }
+  // Allocates the locks behind the static helpers. Called once at kext load
+  // (kmod start) before any client can reach them; teardown() at unload.
+  static KUError setup();
+  static void teardown();
+
+  bool isInitialized() const {
+    return __atomic_load_n(&initialized_, __ATOMIC_ACQUIRE);
+  }
   KUError status() const { return initStatus_; }
 
   static KUError kread(uint64_t address, void *buffer, size_t size);
   static KUError kwrite(uint64_t address, const void *buffer, size_t size);
+  // Reads physical memory inside one of the physSafeRanges().
+  static KUError physRead(uint64_t paddr, void *buffer, size_t size);
+  // The DRAM window minus the device tree's carve-outs (SEP, TZ, iBoot), as
+  // sorted ranges. Copies up to `max` entries and sets `*count` to the total.
+  static KUError physSafeRanges(phys_range *out, uint32_t max,
+                                uint32_t *count);
+  // DRAM base and size from the device tree's /chosen node. Looked up once.
+  static KUError dramRange(uint64_t *base, uint64_t *size);
+  // Translates one kernel VA with the hardware walker. Fails with
+  // KUErrorInvalidAddress if it has no readable mapping.
+  static KUError translate(uint64_t vaddr, KUTranslation *out);
+  // TTBR1_EL1 and TCR_EL1 of the current CPU, for walking the kernel's
+  // translation tables from physical memory.
+  static void translationRegisters(uint64_t *ttbr1, uint64_t *tcr);
+  // Kernel-to-kernel copy (overlap-safe) and fill, staged through `scratch`
+  // so nothing passes through userland. Each chunk takes the same IOMD or
+  // physmap path kread/kwrite would pick.
+  static KUError kmemmove(uint64_t dst, uint64_t src, size_t size,
+                          void *scratch, size_t scratchSize);
+  static KUError kmemset(uint64_t dst, uint8_t value, size_t size,
+                         void *scratch, size_t scratchSize);
+  // Atomic 4- or 8-byte updates of naturally aligned kernel words, performed
+  // through a writable alias of the word's physical page so they also work on
+  // read-only mappings. `previous` receives the value seen before the update.
+  // kcas fails with KUErrorCompareMismatch (and leaves memory untouched) if
+  // the word does not hold `expected`. kwriteMasked replaces only the bits
+  // set in `mask`.
+  static KUError kcas(uint64_t address, size_t width, uint64_t expected,
+                      uint64_t desired, uint64_t *previous);
+  static KUError kwriteMasked(uint64_t address, size_t width, uint64_t value,
+                              uint64_t mask, uint64_t *previous);
+  static void accessPathStats(KUAccessPathStats *out);
+  // Forgets every page learned to need the physmap path and zeroes the
+  // counters.
+  static void resetAccessPathCache();
   static KUError pread(task_t task, uint64_t address, void *buffer,
                        size_t size);
   static KUError pwrite(task_t task, uint64_t address, const void *buffer,
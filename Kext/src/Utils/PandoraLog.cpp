@@ -1,4 +1,6 @@
 #include "PandoraLog.h"
+#include "TimeUtilities.h"
+#include <mach/mach_time.h>
 #include <os/log.h>
 
 bool pandora_log_initialized = false;
@@ -62,3 +64,32 @@ void pandora_log_cleanup(void) {
 
   pandora_log_initialized = false;
 }
+
+bool pandora_log_ratelimit(PandoraLogRateLimit *limit, uint32_t burst,
+                           uint64_t intervalNanos, uint32_t *suppressed) {
+  if (suppressed) {
+    *suppressed = 0;
+  }
+  if (!limit) {
+    return true;
+  }
+
+  uint64_t now = mach_absolute_time();
+  if (limit->windowStart == 0 ||
+      TimeUtilities::machTimeToNanoseconds(now - limit->windowStart) >=
+          intervalNanos) {
+    if (suppressed) {
+      *suppressed = limit->suppressed;
+    }
+    limit->windowStart = now;
+    limit->count = 0;
+    limit->suppressed = 0;
+  }
+
+  if (limit->count < burst) {
+    limit->count++;
+    return true;
+  }
+  limit->suppressed++;
+  return false;
+}
@@ -104,6 +104,19 @@ void pandora_log_cleanup(void);
 #error Unsupported pointer size
 #endif
 
+// Simple per-site rate limiter for hot paths. Allows `burst` messages per
+// `intervalNanos`; updates are unlocked, so the limit is approximate under
+// contention. When a new interval opens after messages were dropped,
+// `*suppressed` receives how many.
+struct PandoraLogRateLimit {
+  uint64_t windowStart;
+  uint32_t count;
+  uint32_t suppressed;
+};
+
+bool pandora_log_ratelimit(PandoraLogRateLimit *limit, uint32_t burst,
+                           uint64_t intervalNanos, uint32_t *suppressed);
+
 static inline void pandora_log_ensure_initialized(void) {
   if (!pandora_log_initialized) {
     pandora_log_init();
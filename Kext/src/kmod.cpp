@@ -1,5 +1,6 @@
 #include "Globals.h"
 #include "Modules/ModuleSystem.h"
+#include "Utils/KernelUtilities.h"
 #include "Utils/PandoraLog.h"
 #include "Utils/TimeUtilities.h"
 
@@ -14,6 +15,15 @@ static kern_return_t initialize_cpp() {
   // Initialize time utilities first
   TimeUtilities::init();
 
+  KUError kuSetup = KernelUtilities::setup();
+  if (kuSetup != KUErrorSuccess) {
+    PANDORA_LOG_DEFAULT("kmod.cpp:initialize_cpp: KernelUtilities setup failed: %d",
+                        kuSetup);
+    KernelUtilities::teardown();
+    pandora_log_cleanup();
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
   PANDORA_LOG_DEFAULT("kmod.cpp:initialize_cpp: I've been run!");
   PandoraRuntimeState &runtime = pandora_runtime_state();
   runtime.telemetry.kmodRan = true;
@@ -27,6 +37,7 @@ kern_return_t finalize_cpp() {
       "kmod.cpp:finalize_cpp: Shutting down Pandora kernel extension");
 
   pandora_modules_shutdown();
+  KernelUtilities::teardown();
   pandora_log_cleanup();
   return KERN_SUCCESS;
 }
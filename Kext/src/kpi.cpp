@@ -1,5 +1,6 @@
 #include "kpi.h"
 
+#include "Globals.h"
 #include "Utils/KernelCall.h"
 #include "Utils/KernelUtilities.h"
 #include "Utils/PandoraLog.h"
@@ -38,7 +39,7 @@ static bool resolve_proc_task_fn(uint64_t *out) {
     return false;
   }
 
-  KernelUtilities ku;
+  KernelUtilities &ku = pandora_kernel_utilities();
   KUError kuInit = ku.init();
   if (kuInit != KUErrorSuccess) {
     PANDORA_LOG_DEFAULT("proc_task shim: KernelUtilities init failed: %d",
@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 extern "C" uint64_t arm_kvtophys(uint64_t va);
+// Raw PAR_EL1 after AT S1E1R on `va`; `parWrite` receives it after AT S1E1W.
+extern "C" uint64_t arm_kvtopar(uint64_t va, uint64_t *parWrite);
 
 extern "C" uint64_t arbitrary_call(uint64_t func, uint64_t arg0, uint64_t arg1,
                                    uint64_t arg2, uint64_t arg3, uint64_t arg4,
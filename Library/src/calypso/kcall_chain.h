@@ -0,0 +1,78 @@
+#ifndef CALYPSO_KCALL_CHAIN_H
+#define CALYPSO_KCALL_CHAIN_H
+
+// Wire format of kernel-call requests and batch results, and the argument
+// chaining of batched calls: an argument can stand for ret0 of an earlier
+// call in the same batch plus a byte offset. The kext resolves chains behind
+// its batch selector; header-only and dependency-free so the same rules
+// build in the kernel, in the library and on Linux.
+
+#include <stdint.h>
+
+#define KCALL_MAX_ARGS 8
+#define KCALL_CHAIN_INDEX_BITS 8
+
+// Argument value standing for ret0 of call `index` plus a signed `offset`
+// (56 bits) in bytes. Set the argument's bit in chainMask to use it.
+#define KCALL_CHAIN(index, offset)                                             \
+  (((uint64_t)(int64_t)(offset) << KCALL_CHAIN_INDEX_BITS) |                   \
+   ((uint64_t)(index) & ((1u << KCALL_CHAIN_INDEX_BITS) - 1)))
+
+// Result status values (IOReturn encoding).
+#define KCALL_STATUS_SUCCESS ((int32_t)0)
+#define KCALL_STATUS_BAD_ARGUMENT ((int32_t)0xe00002c2) // kIOReturnBadArgument
+#define KCALL_STATUS_ABORTED ((int32_t)0xe00002eb)      // kIOReturnAborted
+
+typedef struct {
+  uint64_t fn;        // kernel VA of the function to call
+  uint32_t argCount;  // number of args used (<= KCALL_MAX_ARGS)
+  uint32_t chainMask; // batches only: bit i marks args[i] as KCALL_CHAIN()
+  uint64_t args[KCALL_MAX_ARGS];
+} kcall_request;
+
+// One result of a batched call. `elapsed` is in mach_absolute_time ticks.
+typedef struct {
+  int32_t status;
+  uint32_t reserved;
+  uint64_t ret0;
+  uint64_t elapsed;
+} kcall_timed_response;
+
+// Computes the arguments of call `index` of a batch into `args`, given the
+// results of calls [0, index). Returns KCALL_STATUS_SUCCESS, or the status to
+// report for the call without running it: KCALL_STATUS_BAD_ARGUMENT for a
+// malformed request or a chain to itself or a later call, and
+// KCALL_STATUS_ABORTED for a chain to a call that failed or returned NULL, so
+// a dependent call is never handed a NULL pointer.
+static inline int32_t kcall_chain_resolve(const kcall_request *req,
+                                          uint32_t index,
+                                          const kcall_timed_response *results,
+                                          uint64_t args[KCALL_MAX_ARGS]) {
+  for (uint32_t a = 0; a < KCALL_MAX_ARGS; a++) {
+    args[a] = 0;
+  }
+  if (req->argCount > KCALL_MAX_ARGS ||
+      (req->chainMask >> req->argCount) != 0) {
+    return KCALL_STATUS_BAD_ARGUMENT;
+  }
+
+  for (uint32_t a = 0; a < req->argCount; a++) {
+    if (!(req->chainMask & (1u << a))) {
+      args[a] = req->args[a];
+      continue;
+    }
+    uint32_t src =
+        (uint32_t)(req->args[a] & ((1u << KCALL_CHAIN_INDEX_BITS) - 1));
+    int64_t offset = (int64_t)req->args[a] >> KCALL_CHAIN_INDEX_BITS;
+    if (src >= index) {
+      return KCALL_STATUS_BAD_ARGUMENT;
+    }
+    if (results[src].status != KCALL_STATUS_SUCCESS || results[src].ret0 == 0) {
+      return KCALL_STATUS_ABORTED;
+    }
+    args[a] = results[src].ret0 + (uint64_t)offset;
+  }
+  return KCALL_STATUS_SUCCESS;
+}
+
+#endif // CALYPSO_KCALL_CHAIN_H
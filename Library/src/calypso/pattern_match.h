@@ -0,0 +1,165 @@
+#ifndef CALYPSO_PATTERN_MATCH_H
+#define CALYPSO_PATTERN_MATCH_H
+
+// Masked byte-pattern matcher behind search_pattern() and the kext's in-kernel
+// search selector. Header-only and free of anything but memcmp so the same
+// code builds in the kernel, in the library and on Linux.
+//
+// The pattern is a byte array alongside a mask string. In the mask string:
+//   - 'x' means the corresponding byte in the pattern must match exactly.
+//   - '?' means the corresponding byte in the pattern is a wildcard.
+//   -     any other character makes the mask invalid.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define PATTERN_NOT_FOUND ((size_t)-1)
+#define PATTERN_MAX_REQ_IDX 64
+
+typedef struct {
+  const uint8_t *pattern;
+  const char *mask;
+  size_t len;
+  size_t first_req;
+  size_t req_count;
+  bool no_wildcards;
+  // Exact bytes other than the anchor, when there are few enough to list.
+  bool use_req_idx;
+  size_t req_idx_count;
+  size_t req_idx[PATTERN_MAX_REQ_IDX];
+} pattern_plan;
+
+// Validates `mask` and precomputes the anchor byte and exact-byte list.
+// Returns false for an empty or invalid mask.
+static inline bool pattern_plan_init(pattern_plan *plan, const uint8_t *pattern,
+                                     const char *mask) {
+  if (!plan || !pattern || !mask) {
+    return false;
+  }
+
+  plan->pattern = pattern;
+  plan->mask = mask;
+  plan->len = 0;
+  plan->first_req = PATTERN_NOT_FOUND;
+  plan->req_count = 0;
+
+  for (;; ++plan->len) {
+    char m = mask[plan->len];
+    if (m == '\0') {
+      break;
+    }
+    if (m != 'x' && m != '?') {
+      return false;
+    }
+    if (m == 'x') {
+      if (plan->first_req == PATTERN_NOT_FOUND) {
+        plan->first_req = plan->len;
+      }
+      ++plan->req_count;
+    }
+  }
+
+  if (plan->len == 0) {
+    return false;
+  }
+
+  plan->no_wildcards = (plan->req_count == plan->len);
+  plan->req_idx_count = 0;
+  plan->use_req_idx = (!plan->no_wildcards && plan->req_count != 0 &&
+                       (plan->req_count - 1) <= PATTERN_MAX_REQ_IDX);
+  if (plan->use_req_idx) {
+    for (size_t i = 0; i < plan->len; ++i) {
+      if (mask[i] == 'x' && i != plan->first_req) {
+        plan->req_idx[plan->req_idx_count++] = i;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Whether the `plan->len` bytes at `cand` match.
+static inline bool pattern_match_at(const pattern_plan *plan,
+                                    const uint8_t *cand) {
+  if (plan->req_count == 0) {
+    return true;
+  }
+  if (cand[plan->first_req] != plan->pattern[plan->first_req]) {
+    return false;
+  }
+  if (plan->no_wildcards) {
+    return memcmp(cand, plan->pattern, plan->len) == 0;
+  }
+
+  const uint8_t *pattern = plan->pattern;
+  if (plan->use_req_idx) {
+    for (size_t k = 0; k < plan->req_idx_count; ++k) {
+      size_t i = plan->req_idx[k];
+      if (cand[i] != pattern[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char *mask = plan->mask;
+  size_t i = 0;
+  for (; i + 4 <= plan->len; i += 4) {
+    if ((mask[i + 0] == 'x' && cand[i + 0] != pattern[i + 0]) |
+        (mask[i + 1] == 'x' && cand[i + 1] != pattern[i + 1]) |
+        (mask[i + 2] == 'x' && cand[i + 2] != pattern[i + 2]) |
+        (mask[i + 3] == 'x' && cand[i + 3] != pattern[i + 3])) {
+      return false;
+    }
+  }
+  for (; i < plan->len; ++i) {
+    if (mask[i] == 'x' && cand[i] != pattern[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Offset of the first match at or after `off`, trying every `stride` bytes
+// (nonzero), or PATTERN_NOT_FOUND. Any stride is safe: the scan stops before
+// `off + stride` could wrap.
+static inline size_t pattern_find(const pattern_plan *plan, const uint8_t *base,
+                                  size_t size, size_t off, size_t stride) {
+  if (plan->len > size) {
+    return PATTERN_NOT_FOUND;
+  }
+
+  const size_t max_off = size - plan->len;
+  while (off <= max_off) {
+    if (pattern_match_at(plan, base + off)) {
+      return off;
+    }
+    if (max_off - off < stride) {
+      break;
+    }
+    off += stride;
+  }
+  return PATTERN_NOT_FOUND;
+}
+
+// Offset of the candidate after a match at `off`, or PATTERN_NOT_FOUND when it
+// would not fit in `size` bytes; for resuming pattern_find() without wrapping.
+static inline size_t pattern_next_candidate(size_t size, size_t off,
+                                            size_t stride) {
+  return (off < size && size - off > stride) ? off + stride
+                                             : PATTERN_NOT_FOUND;
+}
+
+// For searches that read the haystack in chunks: how far the next chunk must
+// start after a chunk of `chunk_len` (>= plan->len) bytes whose first byte was
+// a candidate offset, so that every candidate is tried exactly once.
+static inline size_t pattern_chunk_advance(const pattern_plan *plan,
+                                           size_t chunk_len, size_t stride) {
+  return ((chunk_len - plan->len) / stride + 1) * stride;
+}
+
+#endif
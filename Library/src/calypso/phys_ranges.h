@@ -0,0 +1,87 @@
+#ifndef CALYPSO_PHYS_RANGES_H
+#define CALYPSO_PHYS_RANGES_H
+
+// Sorted, disjoint lists of physical address ranges. The kext builds the list
+// of physical memory that is safe to read (DRAM minus the SEP/TZ/iBoot
+// carve-outs) with these, and the library checks requests against it.
+// Header-only and dependency-free so the same code builds in the kernel, in
+// the library and on Linux.
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// base + size must not wrap.
+typedef struct {
+  uint64_t base;
+  uint64_t size;
+} phys_range;
+
+// Removes [base, base + size) from the sorted list `ranges` of `count`
+// entries. A range split in two needs one more slot; if `cap` is reached the
+// upper piece is dropped, which only ever shrinks the list. Returns the new
+// count.
+static inline uint32_t phys_ranges_subtract(phys_range *ranges, uint32_t count,
+                                            uint32_t cap, uint64_t base,
+                                            uint64_t size) {
+  if (size == 0) {
+    return count;
+  }
+  uint64_t end = (size > UINT64_MAX - base) ? UINT64_MAX : base + size;
+
+  for (uint32_t i = 0; i < count;) {
+    phys_range *r = &ranges[i];
+    uint64_t r_end = r->base + r->size;
+    if (end <= r->base || base >= r_end) {
+      i++;
+      continue;
+    }
+
+    bool keep_low = base > r->base;
+    bool keep_high = end < r_end;
+    if (keep_low && keep_high) {
+      r->size = base - r->base;
+      if (count < cap) {
+        for (uint32_t j = count; j > i + 1; j--) {
+          ranges[j] = ranges[j - 1];
+        }
+        ranges[i + 1].base = end;
+        ranges[i + 1].size = r_end - end;
+        count++;
+      }
+      return count; // the hole lies inside this one range
+    }
+    if (keep_low) {
+      r->size = base - r->base;
+      i++;
+    } else if (keep_high) {
+      r->size = r_end - end;
+      r->base = end;
+      i++;
+    } else {
+      for (uint32_t j = i; j + 1 < count; j++) {
+        ranges[j] = ranges[j + 1];
+      }
+      count--;
+    }
+  }
+  return count;
+}
+
+// True if [addr, addr + len) lies entirely inside one range of the list.
+static inline bool phys_ranges_contains(const phys_range *ranges,
+                                        uint32_t count, uint64_t addr,
+                                        uint64_t len) {
+  for (uint32_t i = 0; i < count; i++) {
+    const phys_range *r = &ranges[i];
+    if (addr >= r->base && addr - r->base <= r->size &&
+        len <= r->size - (addr - r->base)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif // CALYPSO_PHYS_RANGES_H
@@ -0,0 +1,279 @@
+#ifndef CALYPSO_QUERY_VM_H
+#define CALYPSO_QUERY_VM_H
+
+// Tiny register machine for pointer-chasing queries (read a global,
+// dereference, add an offset, compare, loop, emit). The kext runs it behind
+// its query selector and the library runs it locally when that selector is
+// missing. Header-only and free of anything but memcpy so the same code
+// builds in the kernel, in the library and on Linux, where it can be driven
+// against a simulated memory image through `qvm_state.read`.
+//
+// Programs are checked by qvm_verify() before they run: every operand is in
+// range, and only QVM_OP_LOOP may branch backwards. qvm_run() additionally
+// enforces the caller's step, read-byte and output limits.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define QVM_NUM_REGS 8
+#define QVM_MAX_INSNS 128
+#define QVM_MAX_EMITMEM 4096
+
+enum {
+  QVM_OP_HALT = 0,   // stop
+  QVM_OP_MOVI = 1,   // r[dst] = imm
+  QVM_OP_MOV = 2,    // r[dst] = r[src]
+  QVM_OP_LOAD = 3,   // r[dst] = zero-extended `size` bytes at r[src] + imm
+  QVM_OP_ADDI = 4,   // r[dst] = r[src] + imm
+  QVM_OP_ADD = 5,    // r[dst] = r[dst] + r[src]
+  QVM_OP_ANDI = 6,   // r[dst] = r[src] & imm
+  QVM_OP_STRIP = 7,  // r[dst] = r[src] with bits >= imm replaced by bit 55
+  QVM_OP_JMP = 8,    // pc = target
+  QVM_OP_JEQ = 9,    // if (r[dst] == r[src]) pc = target
+  QVM_OP_JNE = 10,   // if (r[dst] != r[src]) pc = target
+  QVM_OP_JEQI = 11,  // if (r[dst] == imm) pc = target
+  QVM_OP_JNEI = 12,  // if (r[dst] != imm) pc = target
+  QVM_OP_LOOP = 13,  // if (r[dst] != 0) { r[dst]--; pc = target }
+  QVM_OP_EMIT = 14,  // append the low `size` bytes of r[src] to the output
+  QVM_OP_EMITMEM = 15, // append `imm` bytes read from r[src] to the output
+  QVM_OP_COUNT
+};
+
+typedef enum {
+  QVM_OK = 0,
+  QVM_ERR_INVALID = 1,     // program failed verification
+  QVM_ERR_FAULT = 2,       // a read failed
+  QVM_ERR_STEP_LIMIT = 3,  // max_steps instructions executed
+  QVM_ERR_READ_LIMIT = 4,  // a read would exceed max_read_bytes
+  QVM_ERR_OUTPUT_FULL = 5, // an emit would exceed out_cap
+} qvm_status;
+
+typedef struct {
+  uint8_t op;
+  uint8_t dst;
+  uint8_t src;
+  uint8_t size;
+  uint32_t target; // instruction index for branches; `count` means halt
+  uint64_t imm;
+} qvm_insn;
+
+// Reads `len` bytes at `addr` into `out`; returns false on fault.
+typedef bool (*qvm_read_fn)(void *ctx, uint64_t addr, void *out, size_t len);
+
+typedef struct {
+  // Set by the caller.
+  qvm_read_fn read;
+  void *ctx;
+  uint8_t *out;
+  size_t out_cap;
+  uint64_t max_steps;
+  uint64_t max_read_bytes;
+  uint64_t regs[QVM_NUM_REGS]; // initial values are the program's inputs
+
+  // Set by qvm_run().
+  size_t out_len;
+  uint64_t steps;
+  uint64_t read_bytes;
+  uint32_t pc; // instruction that stopped the program
+} qvm_state;
+
+static inline bool qvm_is_branch(uint8_t op) {
+  return op >= QVM_OP_JMP && op <= QVM_OP_LOOP;
+}
+
+// Returns QVM_OK if `prog` is well formed, QVM_ERR_INVALID otherwise.
+static inline qvm_status qvm_verify(const qvm_insn *prog, uint32_t count) {
+  if (!prog || count == 0 || count > QVM_MAX_INSNS) {
+    return QVM_ERR_INVALID;
+  }
+
+  for (uint32_t pc = 0; pc < count; ++pc) {
+    const qvm_insn *in = &prog[pc];
+    if (in->op >= QVM_OP_COUNT || in->dst >= QVM_NUM_REGS ||
+        in->src >= QVM_NUM_REGS) {
+      return QVM_ERR_INVALID;
+    }
+
+    switch (in->op) {
+    case QVM_OP_LOAD:
+      if (in->size != 1 && in->size != 2 && in->size != 4 && in->size != 8) {
+        return QVM_ERR_INVALID;
+      }
+      break;
+    case QVM_OP_STRIP:
+      if (in->imm == 0 || in->imm > 55) {
+        return QVM_ERR_INVALID;
+      }
+      break;
+    case QVM_OP_EMIT:
+      if (in->size == 0 || in->size > 8) {
+        return QVM_ERR_INVALID;
+      }
+      break;
+    case QVM_OP_EMITMEM:
+      if (in->imm == 0 || in->imm > QVM_MAX_EMITMEM) {
+        return QVM_ERR_INVALID;
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (qvm_is_branch(in->op)) {
+      if (in->target > count) {
+        return QVM_ERR_INVALID;
+      }
+      // Only the counted loop may go backwards.
+      if (in->op == QVM_OP_LOOP ? in->target > pc : in->target <= pc) {
+        return QVM_ERR_INVALID;
+      }
+    }
+  }
+  return QVM_OK;
+}
+
+static inline bool qvm_charge_read(qvm_state *st, uint64_t len) {
+  if (len > st->max_read_bytes - st->read_bytes) {
+    return false;
+  }
+  st->read_bytes += len;
+  return true;
+}
+
+static inline bool qvm_emit(qvm_state *st, const void *data, size_t len) {
+  if (len > st->out_cap - st->out_len) {
+    return false;
+  }
+  memcpy(st->out + st->out_len, data, len);
+  st->out_len += len;
+  return true;
+}
+
+// Sign-extends from the top VA bit the way the hardware does when it strips a
+// PAC: bit 55 picks between the kernel (all ones) and user (all zeros) halves.
+static inline uint64_t qvm_strip(uint64_t value, unsigned va_bits) {
+  uint64_t mask = (1ULL << va_bits) - 1;
+  return (value & (1ULL << 55)) ? (value | ~mask) : (value & mask);
+}
+
+// Runs a verified program. `st->out` may be NULL only if `st->out_cap` is 0.
+static inline qvm_status qvm_run(const qvm_insn *prog, uint32_t count,
+                                 qvm_state *st) {
+  st->out_len = 0;
+  st->steps = 0;
+  st->read_bytes = 0;
+  st->pc = 0;
+  if (!st->read || qvm_verify(prog, count) != QVM_OK) {
+    return QVM_ERR_INVALID;
+  }
+
+  uint64_t *r = st->regs;
+  uint32_t pc = 0;
+  while (pc < count) {
+    st->pc = pc;
+    if (st->steps >= st->max_steps) {
+      return QVM_ERR_STEP_LIMIT;
+    }
+    st->steps++;
+
+    const qvm_insn *in = &prog[pc++];
+    switch (in->op) {
+    case QVM_OP_HALT:
+      return QVM_OK;
+    case QVM_OP_MOVI:
+      r[in->dst] = in->imm;
+      break;
+    case QVM_OP_MOV:
+      r[in->dst] = r[in->src];
+      break;
+    case QVM_OP_LOAD: {
+      if (!qvm_charge_read(st, in->size)) {
+        return QVM_ERR_READ_LIMIT;
+      }
+      uint64_t value = 0;
+      uint8_t bytes[8] = {0};
+      if (!st->read(st->ctx, r[in->src] + in->imm, bytes, in->size)) {
+        return QVM_ERR_FAULT;
+      }
+      for (unsigned i = 0; i < in->size; ++i) {
+        value |= (uint64_t)bytes[i] << (8 * i);
+      }
+      r[in->dst] = value;
+      break;
+    }
+    case QVM_OP_ADDI:
+      r[in->dst] = r[in->src] + in->imm;
+      break;
+    case QVM_OP_ADD:
+      r[in->dst] += r[in->src];
+      break;
+    case QVM_OP_ANDI:
+      r[in->dst] = r[in->src] & in->imm;
+      break;
+    case QVM_OP_STRIP:
+      r[in->dst] = qvm_strip(r[in->src], (unsigned)in->imm);
+      break;
+    case QVM_OP_JMP:
+      pc = in->target;
+      break;
+    case QVM_OP_JEQ:
+      if (r[in->dst] == r[in->src]) {
+        pc = in->target;
+      }
+      break;
+    case QVM_OP_JNE:
+      if (r[in->dst] != r[in->src]) {
+        pc = in->target;
+      }
+      break;
+    case QVM_OP_JEQI:
+      if (r[in->dst] == in->imm) {
+        pc = in->target;
+      }
+      break;
+    case QVM_OP_JNEI:
+      if (r[in->dst] != in->imm) {
+        pc = in->target;
+      }
+      break;
+    case QVM_OP_LOOP:
+      if (r[in->dst] != 0) {
+        r[in->dst]--;
+        pc = in->target;
+      }
+      break;
+    case QVM_OP_EMIT: {
+      uint8_t bytes[8];
+      for (unsigned i = 0; i < in->size; ++i) {
+        bytes[i] = (uint8_t)(r[in->src] >> (8 * i));
+      }
+      if (!qvm_emit(st, bytes, in->size)) {
+        return QVM_ERR_OUTPUT_FULL;
+      }
+      break;
+    }
+    case QVM_OP_EMITMEM: {
+      if (in->imm > st->out_cap - st->out_len) {
+        return QVM_ERR_OUTPUT_FULL;
+      }
+      if (!qvm_charge_read(st, in->imm)) {
+        return QVM_ERR_READ_LIMIT;
+      }
+      if (!st->read(st->ctx, r[in->src], st->out + st->out_len,
+                    (size_t)in->imm)) {
+        return QVM_ERR_FAULT;
+      }
+      st->out_len += (size_t)in->imm;
+      break;
+    }
+    }
+  }
+  st->pc = count;
+  return QVM_OK;
+}
+
+#endif // CALYPSO_QUERY_VM_H
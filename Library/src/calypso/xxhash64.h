@@ -0,0 +1,152 @@
+#ifndef CALYPSO_XXHASH64_H
+#define CALYPSO_XXHASH64_H
+
+// XXH64 (https://github.com/Cyan4973/xxHash), used by the kext's range hash
+// selector and by memdiff to detect changed kernel memory without reading it
+// back. Header-only and free of anything but memcpy so the same code builds
+// in the kernel, in the library and on Linux. The streaming form gives the
+// same digest as the one-shot xxh64() however the input is split.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define XXH64_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH64_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH64_PRIME3 0x165667B19E3779F9ULL
+#define XXH64_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH64_PRIME5 0x27D4EB2F165667C5ULL
+
+typedef struct {
+  uint64_t total_len;
+  uint64_t v[4];
+  uint8_t buf[32];
+  uint32_t buf_len;
+  uint64_t seed;
+} xxh64_state;
+
+static inline uint64_t xxh64_rotl(uint64_t x, unsigned r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh64_read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v; // little-endian hosts only (arm64, x86_64)
+}
+
+static inline uint32_t xxh64_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH64_PRIME2;
+  acc = xxh64_rotl(acc, 31);
+  return acc * XXH64_PRIME1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+  acc ^= xxh64_round(0, val);
+  return acc * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+static inline void xxh64_reset(xxh64_state *st, uint64_t seed) {
+  memset(st, 0, sizeof(*st));
+  st->seed = seed;
+  st->v[0] = seed + XXH64_PRIME1 + XXH64_PRIME2;
+  st->v[1] = seed + XXH64_PRIME2;
+  st->v[2] = seed;
+  st->v[3] = seed - XXH64_PRIME1;
+}
+
+static inline void xxh64_consume(xxh64_state *st, const uint8_t *p) {
+  st->v[0] = xxh64_round(st->v[0], xxh64_read64(p));
+  st->v[1] = xxh64_round(st->v[1], xxh64_read64(p + 8));
+  st->v[2] = xxh64_round(st->v[2], xxh64_read64(p + 16));
+  st->v[3] = xxh64_round(st->v[3], xxh64_read64(p + 24));
+}
+
+static inline void xxh64_update(xxh64_state *st, const void *data,
+                                size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  st->total_len += len;
+
+  if (st->buf_len) {
+    size_t fill = 32 - st->buf_len;
+    if (len < fill) {
+      memcpy(st->buf + st->buf_len, p, len);
+      st->buf_len += (uint32_t)len;
+      return;
+    }
+    memcpy(st->buf + st->buf_len, p, fill);
+    xxh64_consume(st, st->buf);
+    p += fill;
+    len -= fill;
+    st->buf_len = 0;
+  }
+
+  while (len >= 32) {
+    xxh64_consume(st, p);
+    p += 32;
+    len -= 32;
+  }
+
+  if (len) {
+    memcpy(st->buf, p, len);
+    st->buf_len = (uint32_t)len;
+  }
+}
+
+static inline uint64_t xxh64_digest(const xxh64_state *st) {
+  uint64_t h;
+  if (st->total_len >= 32) {
+    h = xxh64_rotl(st->v[0], 1) + xxh64_rotl(st->v[1], 7) +
+        xxh64_rotl(st->v[2], 12) + xxh64_rotl(st->v[3], 18);
+    h = xxh64_merge_round(h, st->v[0]);
+    h = xxh64_merge_round(h, st->v[1]);
+    h = xxh64_merge_round(h, st->v[2]);
+    h = xxh64_merge_round(h, st->v[3]);
+  } else {
+    h = st->seed + XXH64_PRIME5;
+  }
+  h += st->total_len;
+
+  const uint8_t *p = st->buf;
+  uint32_t len = st->buf_len;
+  while (len >= 8) {
+    h ^= xxh64_round(0, xxh64_read64(p));
+    h = xxh64_rotl(h, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    p += 8;
+    len -= 8;
+  }
+  if (len >= 4) {
+    h ^= (uint64_t)xxh64_read32(p) * XXH64_PRIME1;
+    h = xxh64_rotl(h, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+    p += 4;
+    len -= 4;
+  }
+  while (len) {
+    h ^= (*p) * XXH64_PRIME5;
+    h = xxh64_rotl(h, 11) * XXH64_PRIME1;
+    p++;
+    len--;
+  }
+
+  h ^= h >> 33;
+  h *= XXH64_PRIME2;
+  h ^= h >> 29;
+  h *= XXH64_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+static inline uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+  xxh64_state st;
+  xxh64_reset(&st, seed);
+  xxh64_update(&st, data, len);
+  return xxh64_digest(&st);
+}
+
+#endif // CALYPSO_XXHASH64_H
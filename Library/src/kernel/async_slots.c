@@ -0,0 +1,121 @@
+#include "async_slots.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct async_slot {
+  async_slots_callback cb;
+  void *ctx;
+  bool busy;
+};
+
+struct async_slots {
+  async_slots_poll poll;
+  void *poll_ctx;
+  uint32_t depth;
+  uint32_t in_flight;
+  uint32_t next; // search hint: the slot after the last one claimed
+  async_slot slots[];
+};
+
+async_slots *async_slots_create(uint32_t depth, async_slots_poll poll,
+                                void *poll_ctx) {
+  if (depth == 0 || !poll) {
+    return NULL;
+  }
+
+  async_slots *slots =
+      calloc(1, sizeof(*slots) + (size_t)depth * sizeof(async_slot));
+  if (!slots) {
+    return NULL;
+  }
+  slots->poll = poll;
+  slots->poll_ctx = poll_ctx;
+  slots->depth = depth;
+  return slots;
+}
+
+void async_slots_destroy(async_slots *slots) {
+  if (!slots) {
+    return;
+  }
+  async_slots_drain(slots);
+  free(slots);
+}
+
+async_slot *async_slots_acquire(async_slots *slots, async_slots_callback cb,
+                                void *ctx) {
+  if (!slots) {
+    return NULL;
+  }
+
+  while (slots->in_flight >= slots->depth) {
+    if (slots->poll(slots->poll_ctx, -1) < 0) {
+      return NULL;
+    }
+  }
+
+  for (uint32_t n = 0; n < slots->depth; n++) {
+    uint32_t i = (slots->next + n) % slots->depth;
+    async_slot *slot = &slots->slots[i];
+    if (!slot->busy) {
+      slot->busy = true;
+      slot->cb = cb;
+      slot->ctx = ctx;
+      slots->in_flight++;
+      slots->next = (i + 1) % slots->depth;
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+static bool async_slots_owns(const async_slots *slots, const async_slot *slot) {
+  return slot >= slots->slots && slot < slots->slots + slots->depth;
+}
+
+void async_slots_release(async_slots *slots, async_slot *slot) {
+  if (!slots || !slot || !async_slots_owns(slots, slot) || !slot->busy) {
+    return;
+  }
+  slot->busy = false;
+  slot->cb = NULL;
+  slot->ctx = NULL;
+  slots->in_flight--;
+}
+
+void async_slots_complete(async_slots *slots, async_slot *slot, int32_t status,
+                          uint64_t value) {
+  if (!slots || !slot || !async_slots_owns(slots, slot) || !slot->busy) {
+    return;
+  }
+
+  // Free the slot first so the callback may submit a follow-up request.
+  async_slots_callback cb = slot->cb;
+  void *ctx = slot->ctx;
+  async_slots_release(slots, slot);
+
+  if (cb) {
+    cb(ctx, status, value);
+  }
+}
+
+int async_slots_drain(async_slots *slots) {
+  if (!slots) {
+    return -1;
+  }
+  while (slots->in_flight > 0) {
+    if (slots->poll(slots->poll_ctx, -1) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+uint32_t async_slots_in_flight(const async_slots *slots) {
+  return slots ? slots->in_flight : 0;
+}
+
+uint32_t async_slots_depth(const async_slots *slots) {
+  return slots ? slots->depth : 0;
+}
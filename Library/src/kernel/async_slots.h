@@ -0,0 +1,45 @@
+#ifndef ASYNC_SLOTS_H
+#define ASYNC_SLOTS_H
+
+#include <stdint.h>
+
+// Completion bookkeeping for the pipelined async API: a fixed table of
+// in-flight request slots, each remembering the callback to run when its
+// completion arrives. Submitters block in `poll` while every slot is busy.
+// This file has no IOKit dependency, so the pipelining can be driven by a
+// simulated transport; pd_read_async() and friends use it over mach
+// notification ports. Not thread-safe: one thread submits and polls.
+
+typedef struct async_slots async_slots;
+typedef struct async_slot async_slot;
+
+// Status is an IOReturn; `value` is bytes transferred or ret0.
+typedef void (*async_slots_callback)(void *ctx, int32_t status, uint64_t value);
+
+// Waits up to `timeout_ms` (-1 forever) for completions and hands each one to
+// async_slots_complete(). Returns the number dispatched, or -1 on error.
+typedef int (*async_slots_poll)(void *ctx, int timeout_ms);
+
+async_slots *async_slots_create(uint32_t depth, async_slots_poll poll,
+                                void *poll_ctx);
+// Drains outstanding requests through `poll`, then frees the table.
+void async_slots_destroy(async_slots *slots);
+
+// Claims a slot for a request about to be submitted, polling for completions
+// while the table is full. Returns NULL if polling fails.
+async_slot *async_slots_acquire(async_slots *slots, async_slots_callback cb,
+                                void *ctx);
+// Returns a slot whose submission failed; its callback is not run.
+void async_slots_release(async_slots *slots, async_slot *slot);
+// Frees `slot` and runs its callback. Completions for a slot that is not in
+// flight are ignored.
+void async_slots_complete(async_slots *slots, async_slot *slot, int32_t status,
+                          uint64_t value);
+
+// Polls until nothing is in flight. Returns 0, or -1 if polling failed.
+int async_slots_drain(async_slots *slots);
+
+uint32_t async_slots_in_flight(const async_slots *slots);
+uint32_t async_slots_depth(const async_slots *slots);
+
+#endif
@@ -1,6 +1,7 @@
 
 
 #include "kernel_macho.h"
+#include "pandora.h"
 #include "ptr_utils.h"
 #include <stdio.h>
 #include <string.h>
@@ -103,6 +104,7 @@ int kernel_macho_init(uint64_t kbase) {
   }
 
   kernel_macho_once = 1;
+  kernel_macho_cache_text();
   return 0;
 
 fail:
@@ -139,6 +141,48 @@ uint64_t kernel_macho_deinit() {
   return 0;
 }
 
+int kernel_macho_cache_text() {
+  if (!kernel_macho_segments || !pd_cache_enabled()) {
+    return -1;
+  }
+
+  // Kernel text never changes under us, so it can be cached for good.
+  int registered = 0;
+  for (size_t i = 0; i < kernel_macho_segment_count; i++) {
+    struct segment_command_64 *seg = kernel_macho_segments[i];
+    if (strcmp(seg->segname, "__TEXT") != 0 &&
+        strcmp(seg->segname, "__TEXT_EXEC") != 0) {
+      continue;
+    }
+    if (pd_cache_add_range(seg->vmaddr, seg->vmsize,
+                           PAGE_CACHE_POLICY_IMMUTABLE, 0) == 0) {
+      registered++;
+    }
+  }
+  return registered;
+}
+
+int kernel_macho_cache_data(uint64_t ttl_ms) {
+  if (!kernel_macho_segments || !pd_cache_enabled()) {
+    return -1;
+  }
+
+  page_cache_policy policy =
+      ttl_ms ? PAGE_CACHE_POLICY_TTL : PAGE_CACHE_POLICY_EPOCH;
+  int registered = 0;
+  for (size_t i = 0; i < kernel_macho_segment_count; i++) {
+    struct segment_command_64 *seg = kernel_macho_segments[i];
+    if (strcmp(seg->segname, "__DATA_CONST") != 0 &&
+        strcmp(seg->segname, "__DATA") != 0) {
+      continue;
+    }
+    if (pd_cache_add_range(seg->vmaddr, seg->vmsize, policy, ttl_ms) == 0) {
+      registered++;
+    }
+  }
+  return registered;
+}
+
 uint64_t kernel_macho_fileoff_to_vmaddr(uint64_t fileoff) {
   for (size_t i = 0; i < kernel_macho_segment_count; i++) {
     struct segment_command_64 *seg = kernel_macho_segments[i];
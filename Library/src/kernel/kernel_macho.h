@@ -26,6 +26,16 @@ extern size_t kernel_macho_segment_count;
 int kernel_macho_init(uint64_t kbase);
 uint64_t kernel_macho_deinit();
 uint64_t kernel_macho_fileoff_to_vmaddr(uint64_t fileoff);
+// Registers __TEXT and __TEXT_EXEC with the page cache as immutable. Called by
+// kernel_macho_init(); call again if the cache is enabled later. Returns the
+// number of segments registered, or -1 if the cache is off.
+int kernel_macho_cache_text();
+// Registers __DATA_CONST and __DATA with the page cache. They can change under
+// us, so pages expire `ttl_ms` after they were read, or on
+// pd_cache_bump_epoch() when `ttl_ms` is 0. Not done by kernel_macho_init():
+// callers that poll kernel state opt in with a TTL they can tolerate.
+// Returns the number of segments registered, or -1 if the cache is off.
+int kernel_macho_cache_data(uint64_t ttl_ms);
 uint64_t kernel_macho_find_symbol(const char *symbol_name);
 uint64_t kernel_macho_find_symbol_or_die(const char *symbol_name);
 uint64_t kernel_macho_find_symbol_partial(const char *needle);
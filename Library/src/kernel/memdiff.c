@@ -1,5 +1,7 @@
 #include "memdiff.h"
+#include "calypso/xxhash64.h"
 #include "pandora.h"
+#include <IOKit/IOReturn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,24 +51,86 @@ int diff_bytes(const uint8_t *a, const uint8_t *b, size_t size) {
   return diff_count;
 }
 
-int memdiff_commit(memdiff_view *view) {
-  // read the memory at the current kernel address and compare to stored
-  // original copy
+// Collects runs of bytes that differ between the original and modified
+// copies. Run offsets index into modified_copy. Pass NULL to only count.
+static size_t memdiff_collect_runs(memdiff_view *view, PandoraKWriteVRun *runs) {
+  size_t count = 0;
+  size_t i = 0;
+  while (i < view->size) {
+    if (view->original_copy[i] == view->modified_copy[i]) {
+      i++;
+      continue;
+    }
+
+    size_t start = i;
+    while (i < view->size && i - start < UINT32_MAX &&
+           view->original_copy[i] != view->modified_copy[i]) {
+      i++;
+    }
+
+    if (runs) {
+      runs[count].kaddr = view->base_address + start;
+      runs[count].len = (uint32_t)(i - start);
+      runs[count].offset = (uint32_t)start;
+    }
+    count++;
+  }
+  return count;
+}
+
+// Compares the view against kernel memory by reading it all back. Used when
+// the kext cannot hash the range itself.
+static int memdiff_check_by_read(memdiff_view *view) {
   uint8_t *current_copy = malloc(view->size);
   if (!current_copy) {
-    printf("memdiff_commit: failed to allocate memory for current copy\n");
+    printf("memdiff_check: failed to allocate memory for current copy\n");
     return -1;
   }
   int err = pd_readbuf(view->base_address, current_copy, view->size);
   if (err != 0) {
-    printf("memdiff_commit: failed to read kernel memory at 0x%llx: %d\n",
+    printf("memdiff_check: failed to read kernel memory at 0x%llx: %d\n",
            (unsigned long long)view->base_address, err);
     free(current_copy);
     return -1;
   };
 
   int diff_count = diff_bytes(view->original_copy, current_copy, view->size);
+  free(current_copy);
+  if (diff_count != 0) {
+    printf("memdiff_check: %d byte(s) changed at 0x%llx\n", diff_count,
+           (unsigned long long)view->base_address);
+  }
+  return diff_count != 0;
+}
+
+int memdiff_check(memdiff_view *view) {
+  if (!view || !view->original_copy) {
+    return -1;
+  }
+
+  // Let the kernel hash the range and compare digests instead of copying
+  // the whole view back out.
+  if (view->size <= PANDORA_HASH_MAX_TOTAL_BYTES) {
+    PandoraHashRange range = {view->base_address, view->size};
+    PandoraHashResult result = {0};
+    kern_return_t kr = pd_hash_ranges(&range, 1, 0, &result);
+    if (kr == KERN_SUCCESS) {
+      kr = result.status;
+    }
+    if (kr == KERN_SUCCESS) {
+      return result.hash != xxh64(view->original_copy, view->size, 0);
+    }
+    if (kr != kIOReturnUnsupported) {
+      printf("memdiff_check: failed to hash kernel memory at 0x%llx: %x\n",
+             (unsigned long long)view->base_address, kr);
+      return -1;
+    }
+  }
 
+  return memdiff_check_by_read(view);
+}
+
+int memdiff_commit(memdiff_view *view) {
   // perform some simple TOCTOU checks to see if the memory has changed since
   // the view was created if so abort committing changes as this could lead to
   // corrupted lock states or similar if the memory is being modified
@@ -74,31 +138,51 @@ int memdiff_commit(memdiff_view *view) {
   //
   // THIS IS NOT SAFE but neither is monkeypatching kernel memory
   // it is possible and very likely kernel memory will change values in between now and actual committing but this is a simple check to at least catch some cases where the memory has changed since view creation and warn the user about potential issues with committing in that case
-  if (diff_count != 0) {
+  int changed = memdiff_check(view);
+  if (changed < 0) {
+    return -1;
+  }
+  if (changed) {
     printf("memdiff_commit: aborting commit due to TOCTOU check failure - "
-           "memory has changed since view creation (diff_count=%d)\n",
-           diff_count);
-    free(current_copy);
+           "memory has changed since view creation\n");
     return -1;
   }
 
-  // iterate through size bytes in both original and modified copies and write
-  // any different bytes to kernel memory
-  int commit_count = 0;
-  for (size_t i = 0; i < view->size; i++) {
-    if (view->original_copy[i] != view->modified_copy[i]) {
-      int write_err = pd_write8(view->base_address + i, view->modified_copy[i]);
-      if (write_err != 0) {
-        printf("memdiff_commit: failed to write byte at offset %zu (0x%llx) to kernel memory: %x\n", i, (unsigned long long)(view->base_address + i), write_err);
-              free(current_copy);
-        return -1;
-      }
-      commit_count++;
-    }
+  // coalesce changed bytes into maximal contiguous runs so the whole patch
+  // reaches the kernel in a single vectored write
+  size_t run_count = memdiff_collect_runs(view, NULL);
+  if (run_count == 0) {
+    printf("memdiff_commit: no changes to commit at 0x%llx\n",
+           (unsigned long long)view->base_address);
+    return 0;
+  }
+
+  PandoraKWriteVRun *runs = malloc(run_count * sizeof(*runs));
+  if (!runs) {
+    printf("memdiff_commit: failed to allocate memory for %zu write runs\n",
+           run_count);
+    return -1;
+  }
+  memdiff_collect_runs(view, runs);
+
+  size_t commit_count = 0;
+  for (size_t i = 0; i < run_count; i++) {
+    commit_count += runs[i].len;
+  }
+
+  kern_return_t write_err =
+      pd_writev(runs, (uint32_t)run_count, view->modified_copy, view->size);
+  free(runs);
+  if (write_err != KERN_SUCCESS) {
+    printf("memdiff_commit: failed to write %zu run(s) to kernel memory at "
+           "0x%llx: %x\n",
+           run_count, (unsigned long long)view->base_address, write_err);
+    return -1;
   }
 
-  printf("memdiff_commit: committed %d byte(s) to kernel memory at 0x%llx\n",
-         commit_count, (unsigned long long)view->base_address);
+  printf("memdiff_commit: committed %zu byte(s) in %zu run(s) to kernel "
+         "memory at 0x%llx\n",
+         commit_count, run_count, (unsigned long long)view->base_address);
   return 0;
 }
 
@@ -15,6 +15,9 @@ typedef struct {
 } memdiff_view;
 
 memdiff_view *memdiff_create(const uintptr_t kernel_address, size_t size);
+// Returns 0 if the kernel memory behind `view` still matches original_copy,
+// 1 if it changed and -1 on error.
+int memdiff_check(memdiff_view *view);
 int memdiff_commit(memdiff_view *view);
 void memdiff_destroy(memdiff_view *view);
 
@@ -0,0 +1,558 @@
+// clock_gettime()/CLOCK_MONOTONIC under strict -std=c11.
+#define _POSIX_C_SOURCE 199309L
+
+#include "page_cache.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE_CACHE_NIL UINT32_MAX
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+  page_cache_policy policy;
+  uint64_t ttl_ns;
+} page_cache_range;
+
+typedef struct {
+  uint64_t page;
+  uint64_t filled_ns;
+  uint64_t epoch;
+  uint32_t lru_prev;
+  uint32_t lru_next;
+  uint32_t hash_next;
+  bool valid;
+} page_cache_entry;
+
+struct page_cache {
+  size_t page_size;
+  uint64_t page_mask;
+  uint32_t capacity;
+  uint32_t used;
+
+  page_cache_entry *entries;
+  uint8_t *data;
+
+  // Staging buffer for one run of missing pages; max_run pages long.
+  uint8_t *scratch;
+  uint32_t max_run;
+
+  uint32_t *buckets;
+  uint32_t bucket_mask;
+
+  // Most recently used at head, eviction candidate at tail.
+  uint32_t lru_head;
+  uint32_t lru_tail;
+
+  page_cache_range ranges[PAGE_CACHE_MAX_RANGES];
+  uint32_t range_count;
+
+  uint64_t epoch;
+  page_cache_fill fill;
+  void *ctx;
+  page_cache_stats stats;
+};
+
+static uint64_t page_cache_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t page_cache_bucket(const page_cache *pc, uint64_t page) {
+  uint64_t h = (page / pc->page_size) * 0x9E3779B97F4A7C15ull;
+  return (uint32_t)(h >> 32) & pc->bucket_mask;
+}
+
+static const page_cache_range *page_cache_find_range(const page_cache *pc,
+                                                     uint64_t page) {
+  for (uint32_t i = pc->range_count; i > 0; i--) {
+    const page_cache_range *r = &pc->ranges[i - 1];
+    if (page >= r->start && page < r->end) {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+static void page_cache_lru_unlink(page_cache *pc, uint32_t idx) {
+  page_cache_entry *e = &pc->entries[idx];
+  if (e->lru_prev != PAGE_CACHE_NIL) {
+    pc->entries[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    pc->lru_head = e->lru_next;
+  }
+  if (e->lru_next != PAGE_CACHE_NIL) {
+    pc->entries[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    pc->lru_tail = e->lru_prev;
+  }
+  e->lru_prev = e->lru_next = PAGE_CACHE_NIL;
+}
+
+static void page_cache_lru_push_head(page_cache *pc, uint32_t idx) {
+  page_cache_entry *e = &pc->entries[idx];
+  e->lru_prev = PAGE_CACHE_NIL;
+  e->lru_next = pc->lru_head;
+  if (pc->lru_head != PAGE_CACHE_NIL) {
+    pc->entries[pc->lru_head].lru_prev = idx;
+  }
+  pc->lru_head = idx;
+  if (pc->lru_tail == PAGE_CACHE_NIL) {
+    pc->lru_tail = idx;
+  }
+}
+
+static void page_cache_lru_push_tail(page_cache *pc, uint32_t idx) {
+  page_cache_entry *e = &pc->entries[idx];
+  e->lru_next = PAGE_CACHE_NIL;
+  e->lru_prev = pc->lru_tail;
+  if (pc->lru_tail != PAGE_CACHE_NIL) {
+    pc->entries[pc->lru_tail].lru_next = idx;
+  }
+  pc->lru_tail = idx;
+  if (pc->lru_head == PAGE_CACHE_NIL) {
+    pc->lru_head = idx;
+  }
+}
+
+static uint32_t page_cache_lookup(const page_cache *pc, uint64_t page) {
+  uint32_t idx = pc->buckets[page_cache_bucket(pc, page)];
+  while (idx != PAGE_CACHE_NIL) {
+    const page_cache_entry *e = &pc->entries[idx];
+    if (e->valid && e->page == page) {
+      return idx;
+    }
+    idx = e->hash_next;
+  }
+  return PAGE_CACHE_NIL;
+}
+
+static void page_cache_hash_remove(page_cache *pc, uint32_t idx) {
+  uint32_t *link = &pc->buckets[page_cache_bucket(pc, pc->entries[idx].page)];
+  while (*link != PAGE_CACHE_NIL) {
+    if (*link == idx) {
+      *link = pc->entries[idx].hash_next;
+      break;
+    }
+    link = &pc->entries[*link].hash_next;
+  }
+  pc->entries[idx].hash_next = PAGE_CACHE_NIL;
+}
+
+// Invalid entries are kept at the LRU tail so they are reused first.
+static void page_cache_drop(page_cache *pc, uint32_t idx) {
+  page_cache_hash_remove(pc, idx);
+  pc->entries[idx].valid = false;
+  pc->used--;
+  page_cache_lru_unlink(pc, idx);
+  page_cache_lru_push_tail(pc, idx);
+}
+
+static bool page_cache_entry_fresh(const page_cache *pc,
+                                   const page_cache_entry *e,
+                                   const page_cache_range *r, uint64_t now) {
+  switch (r->policy) {
+  case PAGE_CACHE_POLICY_IMMUTABLE:
+    return true;
+  case PAGE_CACHE_POLICY_TTL:
+    return now - e->filled_ns < r->ttl_ns;
+  case PAGE_CACHE_POLICY_EPOCH:
+    return e->epoch == pc->epoch;
+  }
+  return false;
+}
+
+// Returns the entry holding a fresh copy of `page`, or PAGE_CACHE_NIL after
+// counting the miss (and dropping a stale entry).
+static uint32_t page_cache_lookup_fresh(page_cache *pc, uint64_t page,
+                                        const page_cache_range *r,
+                                        uint64_t now) {
+  uint32_t idx = page_cache_lookup(pc, page);
+  if (idx != PAGE_CACHE_NIL) {
+    if (page_cache_entry_fresh(pc, &pc->entries[idx], r, now)) {
+      pc->stats.hits++;
+      page_cache_lru_unlink(pc, idx);
+      page_cache_lru_push_head(pc, idx);
+      return idx;
+    }
+    pc->stats.expired++;
+    page_cache_drop(pc, idx);
+  }
+
+  pc->stats.misses++;
+  return PAGE_CACHE_NIL;
+}
+
+// Takes the LRU tail for `page`. The caller fills its data before the next
+// lookup.
+static uint32_t page_cache_insert(page_cache *pc, uint64_t page, uint64_t now) {
+  uint32_t idx = pc->lru_tail;
+  page_cache_entry *e = &pc->entries[idx];
+  if (e->valid) {
+    pc->stats.evictions++;
+    page_cache_drop(pc, idx);
+  }
+
+  pc->used++;
+  e->page = page;
+  e->filled_ns = now;
+  e->epoch = pc->epoch;
+  e->valid = true;
+
+  uint32_t bucket = page_cache_bucket(pc, page);
+  e->hash_next = pc->buckets[bucket];
+  pc->buckets[bucket] = idx;
+
+  page_cache_lru_unlink(pc, idx);
+  page_cache_lru_push_head(pc, idx);
+  return idx;
+}
+
+static inline uint8_t *page_cache_slot(const page_cache *pc, uint32_t idx) {
+  return pc->data + (size_t)idx * pc->page_size;
+}
+
+page_cache *page_cache_create(size_t capacity_pages, size_t page_size,
+                              page_cache_fill fill, void *ctx) {
+  if (!fill || capacity_pages == 0 || capacity_pages >= PAGE_CACHE_NIL ||
+      page_size == 0 || (page_size & (page_size - 1)) != 0) {
+    return NULL;
+  }
+
+  page_cache *pc = calloc(1, sizeof(*pc));
+  if (!pc) {
+    return NULL;
+  }
+
+  uint32_t buckets = 1;
+  while (buckets < capacity_pages * 2) {
+    buckets <<= 1;
+  }
+
+  pc->max_run = capacity_pages < PAGE_CACHE_MAX_RUN
+                    ? (uint32_t)capacity_pages
+                    : PAGE_CACHE_MAX_RUN;
+
+  pc->entries = calloc(capacity_pages, sizeof(*pc->entries));
+  pc->data = malloc(capacity_pages * page_size);
+  pc->scratch = malloc((size_t)pc->max_run * page_size);
+  pc->buckets = malloc(buckets * sizeof(*pc->buckets));
+  if (!pc->entries || !pc->data || !pc->scratch || !pc->buckets) {
+    page_cache_destroy(pc);
+    return NULL;
+  }
+
+  pc->page_size = page_size;
+  pc->page_mask = ~((uint64_t)page_size - 1);
+  pc->capacity = (uint32_t)capacity_pages;
+  pc->bucket_mask = buckets - 1;
+  pc->fill = fill;
+  pc->ctx = ctx;
+  pc->lru_head = pc->lru_tail = PAGE_CACHE_NIL;
+
+  for (uint32_t i = 0; i < buckets; i++) {
+    pc->buckets[i] = PAGE_CACHE_NIL;
+  }
+  for (uint32_t i = 0; i < pc->capacity; i++) {
+    pc->entries[i].hash_next = PAGE_CACHE_NIL;
+    pc->entries[i].lru_prev = pc->entries[i].lru_next = PAGE_CACHE_NIL;
+    page_cache_lru_push_tail(pc, i);
+  }
+
+  return pc;
+}
+
+void page_cache_destroy(page_cache *pc) {
+  if (!pc) {
+    return;
+  }
+  free(pc->entries);
+  free(pc->data);
+  free(pc->scratch);
+  free(pc->buckets);
+  free(pc);
+}
+
+int page_cache_add_range(page_cache *pc, uint64_t start, uint64_t len,
+                         page_cache_policy policy, uint64_t ttl_ms) {
+  if (!pc || len == 0 || pc->range_count >= PAGE_CACHE_MAX_RANGES) {
+    return -1;
+  }
+  if (policy != PAGE_CACHE_POLICY_IMMUTABLE &&
+      policy != PAGE_CACHE_POLICY_TTL && policy != PAGE_CACHE_POLICY_EPOCH) {
+    return -1;
+  }
+  if (policy == PAGE_CACHE_POLICY_TTL && ttl_ms == 0) {
+    return -1;
+  }
+
+  // Ranges are tracked at page granularity since that is what gets cached.
+  uint64_t end = start + len;
+  if (end < start) {
+    end = UINT64_MAX;
+  }
+
+  page_cache_range *r = &pc->ranges[pc->range_count++];
+  r->start = start & pc->page_mask;
+  r->end = end;
+  r->policy = policy;
+  r->ttl_ns = ttl_ms * 1000000ull;
+
+  // Pages cached under an older policy must not outlive it.
+  page_cache_invalidate(pc, start, (size_t)(end - start));
+  return 0;
+}
+
+void page_cache_clear_ranges(page_cache *pc) {
+  if (!pc) {
+    return;
+  }
+  pc->range_count = 0;
+  page_cache_flush(pc);
+}
+
+// A run of consecutive cached-range pages that missed. `addr`/`len` is the
+// part of the caller's read they cover and `out` where it goes.
+typedef struct {
+  uint64_t first_page;
+  uint32_t pages;
+  uint64_t addr;
+  size_t len;
+  uint8_t *out;
+} page_cache_run;
+
+// Copies the part of `page` (whose data is at `src`) that the run covers.
+static void page_cache_run_copy(const page_cache *pc, const page_cache_run *run,
+                                uint64_t page, const uint8_t *src) {
+  uint64_t from = page > run->addr ? page : run->addr;
+  uint64_t to = page + pc->page_size;
+  if (to > run->addr + run->len) {
+    to = run->addr + run->len;
+  }
+  memcpy(run->out + (from - run->addr), src + (from - page),
+         (size_t)(to - from));
+}
+
+// Page by page, for when a run could not be filled in one go: each readable
+// page is cached, and the rest falls back to the exact span.
+static int page_cache_fill_run_slow(page_cache *pc, const page_cache_run *run,
+                                    uint64_t now) {
+  for (uint32_t i = 0; i < run->pages; i++) {
+    uint64_t page = run->first_page + (uint64_t)i * pc->page_size;
+    uint32_t idx = page_cache_insert(pc, page, now);
+    if (pc->fill(pc->ctx, page, page_cache_slot(pc, idx), pc->page_size) == 0) {
+      page_cache_run_copy(pc, run, page, page_cache_slot(pc, idx));
+      continue;
+    }
+    page_cache_drop(pc, idx);
+
+    // The whole page may not be readable; read just the covered span.
+    uint64_t from = page > run->addr ? page : run->addr;
+    uint64_t to = page + pc->page_size;
+    if (to > run->addr + run->len) {
+      to = run->addr + run->len;
+    }
+    pc->stats.bypass_reads++;
+    int rc = pc->fill(pc->ctx, from, run->out + (from - run->addr),
+                      (size_t)(to - from));
+    if (rc != 0) {
+      return rc;
+    }
+  }
+  return 0;
+}
+
+static int page_cache_fill_run(page_cache *pc, page_cache_run *run,
+                               uint64_t now) {
+  if (!run->pages) {
+    return 0;
+  }
+
+  int rc;
+  pc->stats.fills++;
+  if (pc->fill(pc->ctx, run->first_page, pc->scratch,
+               (size_t)run->pages * pc->page_size) == 0) {
+    for (uint32_t i = 0; i < run->pages; i++) {
+      uint64_t page = run->first_page + (uint64_t)i * pc->page_size;
+      const uint8_t *src = pc->scratch + (size_t)i * pc->page_size;
+      memcpy(page_cache_slot(pc, page_cache_insert(pc, page, now)), src,
+             pc->page_size);
+      page_cache_run_copy(pc, run, page, src);
+    }
+    rc = 0;
+  } else {
+    rc = page_cache_fill_run_slow(pc, run, now);
+  }
+
+  run->pages = 0;
+  run->len = 0;
+  return rc;
+}
+
+static int page_cache_fill_bypass(page_cache *pc, uint64_t addr, uint8_t *out,
+                                  size_t *len) {
+  if (!*len) {
+    return 0;
+  }
+  pc->stats.bypass_reads++;
+  int rc = pc->fill(pc->ctx, addr, out, *len);
+  *len = 0;
+  return rc;
+}
+
+int page_cache_read(page_cache *pc, uint64_t addr, void *buf, size_t len) {
+  if (!pc || !buf) {
+    return -1;
+  }
+
+  uint8_t *out = (uint8_t *)buf;
+
+  // Reads longer than a fill run would only churn the cache one page at a
+  // time (a multi-megabyte diff of kernel text, say); one direct fill lets
+  // the transport use its bulk path instead.
+  if (len > (size_t)pc->max_run * pc->page_size) {
+    pc->stats.bypass_reads++;
+    pc->stats.large_reads++;
+    return pc->fill(pc->ctx, addr, out, len);
+  }
+
+  uint64_t now = 0;
+  for (uint32_t i = 0; i < pc->range_count; i++) {
+    if (pc->ranges[i].policy == PAGE_CACHE_POLICY_TTL) {
+      now = page_cache_now_ns();
+      break;
+    }
+  }
+
+  // Runs of uncached pages are coalesced into one fill, and so are runs of
+  // missing cached pages. At most one of the two is open at a time.
+  uint64_t bypass_addr = 0;
+  size_t bypass_len = 0;
+  page_cache_run run = {0};
+  int rc = 0;
+
+  while (len) {
+    uint64_t page = addr & pc->page_mask;
+    size_t off = (size_t)(addr - page);
+    size_t chunk = pc->page_size - off;
+    if (chunk > len) {
+      chunk = len;
+    }
+
+    const page_cache_range *r = page_cache_find_range(pc, page);
+    if (!r) {
+      if ((rc = page_cache_fill_run(pc, &run, now)) != 0) {
+        return rc;
+      }
+      if (!bypass_len) {
+        bypass_addr = addr;
+      }
+      bypass_len += chunk;
+    } else {
+      rc = page_cache_fill_bypass(pc, bypass_addr, out - bypass_len,
+                                  &bypass_len);
+      if (rc != 0) {
+        return rc;
+      }
+
+      uint32_t idx = page_cache_lookup_fresh(pc, page, r, now);
+      if (idx != PAGE_CACHE_NIL) {
+        if ((rc = page_cache_fill_run(pc, &run, now)) != 0) {
+          return rc;
+        }
+        memcpy(out, page_cache_slot(pc, idx) + off, chunk);
+      } else {
+        if (run.pages == pc->max_run &&
+            (rc = page_cache_fill_run(pc, &run, now)) != 0) {
+          return rc;
+        }
+        if (!run.pages) {
+          run.first_page = page;
+          run.addr = addr;
+          run.out = out;
+        }
+        run.pages++;
+        run.len += chunk;
+      }
+    }
+
+    out += chunk;
+    addr += chunk;
+    len -= chunk;
+  }
+
+  if ((rc = page_cache_fill_run(pc, &run, now)) != 0) {
+    return rc;
+  }
+  return page_cache_fill_bypass(pc, bypass_addr, out - bypass_len,
+                                &bypass_len);
+}
+
+void page_cache_invalidate(page_cache *pc, uint64_t addr, size_t len) {
+  if (!pc || len == 0 || pc->used == 0) {
+    return;
+  }
+
+  uint64_t first = addr & pc->page_mask;
+  uint64_t last = (addr + len - 1) & pc->page_mask;
+  if (last < first) {
+    last = UINT64_MAX & pc->page_mask;
+  }
+
+  // Large invalidations walk the entries instead of probing every page.
+  if ((last - first) / pc->page_size >= pc->capacity) {
+    for (uint32_t i = 0; i < pc->capacity; i++) {
+      page_cache_entry *e = &pc->entries[i];
+      if (e->valid && e->page >= first && e->page <= last) {
+        page_cache_drop(pc, i);
+        pc->stats.invalidations++;
+      }
+    }
+    return;
+  }
+
+  for (uint64_t page = first;; page += pc->page_size) {
+    uint32_t idx = page_cache_lookup(pc, page);
+    if (idx != PAGE_CACHE_NIL) {
+      page_cache_drop(pc, idx);
+      pc->stats.invalidations++;
+    }
+    if (page == last) {
+      break;
+    }
+  }
+}
+
+void page_cache_bump_epoch(page_cache *pc) {
+  if (pc) {
+    pc->epoch++;
+  }
+}
+
+void page_cache_flush(page_cache *pc) {
+  if (!pc) {
+    return;
+  }
+  for (uint32_t i = 0; i < pc->capacity; i++) {
+    if (pc->entries[i].valid) {
+      page_cache_drop(pc, i);
+    }
+  }
+}
+
+void page_cache_get_stats(const page_cache *pc, page_cache_stats *stats) {
+  if (!pc || !stats) {
+    return;
+  }
+  *stats = pc->stats;
+}
+
+void page_cache_reset_stats(page_cache *pc) {
+  if (pc) {
+    memset(&pc->stats, 0, sizeof(pc->stats));
+  }
+}
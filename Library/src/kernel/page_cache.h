@@ -0,0 +1,66 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Page-granular LRU cache for kernel reads. Only addresses inside a registered
+// range are cached; everything else is passed straight to the fill callback.
+// This file has no IOKit dependency so it can be driven by a recorded trace.
+
+typedef enum {
+  PAGE_CACHE_POLICY_IMMUTABLE = 1, // never expires (__TEXT, __TEXT_EXEC)
+  PAGE_CACHE_POLICY_TTL = 2,       // expires `ttl_ms` after it was filled
+  PAGE_CACHE_POLICY_EPOCH = 3,     // expires on page_cache_bump_epoch()
+} page_cache_policy;
+
+typedef struct {
+  uint64_t hits;          // pages served from the cache
+  uint64_t misses;        // pages filled from the kernel
+  uint64_t expired;       // misses caused by a stale TTL/epoch entry
+  uint64_t evictions;     // valid pages dropped to make room
+  uint64_t invalidations; // pages dropped by page_cache_invalidate()
+  uint64_t bypass_reads;  // reads of uncached ranges passed through
+  uint64_t fills;         // fills of one or more consecutive missing pages
+  uint64_t large_reads;   // reads too long to cache, passed through whole
+} page_cache_stats;
+
+// Reads `len` bytes at `addr` into `buf`. Returns 0 on success.
+typedef int (*page_cache_fill)(void *ctx, uint64_t addr, void *buf,
+                               size_t len);
+
+typedef struct page_cache page_cache;
+
+#define PAGE_CACHE_MAX_RANGES 32
+// Consecutive missing pages are fetched with one fill of up to this many
+// pages (or the capacity, if smaller). Reads longer than that bypass the
+// cache altogether.
+#define PAGE_CACHE_MAX_RUN 64
+
+// `page_size` must be a power of two. Returns NULL on bad arguments or OOM.
+page_cache *page_cache_create(size_t capacity_pages, size_t page_size,
+                              page_cache_fill fill, void *ctx);
+void page_cache_destroy(page_cache *pc);
+
+// Later ranges take precedence over earlier overlapping ones. Returns 0 on
+// success, -1 on bad arguments or when the range table is full.
+int page_cache_add_range(page_cache *pc, uint64_t start, uint64_t len,
+                         page_cache_policy policy, uint64_t ttl_ms);
+void page_cache_clear_ranges(page_cache *pc);
+
+// Serves cached pages from memory and fills the rest through the callback,
+// one fill per run of missing pages. Returns 0 on success, or the first
+// nonzero fill result.
+int page_cache_read(page_cache *pc, uint64_t addr, void *buf, size_t len);
+
+// Drops every cached page overlapping [addr, addr + len).
+void page_cache_invalidate(page_cache *pc, uint64_t addr, size_t len);
+// Expires every page cached under PAGE_CACHE_POLICY_EPOCH.
+void page_cache_bump_epoch(page_cache *pc);
+// Drops every cached page.
+void page_cache_flush(page_cache *pc);
+
+void page_cache_get_stats(const page_cache *pc, page_cache_stats *stats);
+void page_cache_reset_stats(page_cache *pc);
+
+#endif
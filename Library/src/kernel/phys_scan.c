@@ -0,0 +1,179 @@
+#include "phys_scan.h"
+#include "calypso/pattern_match.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const phys_scan_params *params;
+  phys_scan_result *result;
+  pattern_plan plan;
+  size_t stride;
+  size_t chunk_size;
+  size_t step; // distance between chunk starts
+
+  // Chunks are numbered across all ranges; range i owns chunk numbers
+  // [first_chunk[i], first_chunk[i + 1]).
+  uint64_t *first_chunk;
+  _Atomic uint64_t next_chunk;
+  _Atomic bool full;
+
+  pthread_mutex_t lock;
+  uint64_t bytes_scanned;
+  uint64_t unreadable_bytes;
+} phys_scan_job;
+
+static uint64_t phys_scan_chunks_in(const phys_scan_job *job,
+                                    const phys_range *range) {
+  if (range->size < job->plan.len) {
+    return 0;
+  }
+  return (range->size - job->plan.len) / job->step + 1;
+}
+
+static void phys_scan_report(phys_scan_job *job, const uint64_t *found,
+                             uint32_t count, size_t len, bool readable) {
+  pthread_mutex_lock(&job->lock);
+  phys_scan_result *res = job->result;
+  for (uint32_t i = 0; i < count; i++) {
+    if (res->count == res->max_results) {
+      res->truncated = true;
+      atomic_store(&job->full, true);
+      break;
+    }
+    res->results[res->count++] = found[i];
+  }
+  if (readable) {
+    job->bytes_scanned += len;
+  } else {
+    job->unreadable_bytes += len;
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+static void *phys_scan_worker(void *arg) {
+  phys_scan_job *job = arg;
+  const phys_scan_params *p = job->params;
+
+  uint8_t *chunk = malloc(job->chunk_size);
+  if (!chunk) {
+    return NULL;
+  }
+
+  uint64_t found[64];
+  uint32_t range_index = 0;
+  while (!atomic_load(&job->full)) {
+    uint64_t n = atomic_fetch_add(&job->next_chunk, 1);
+    if (n >= job->first_chunk[p->range_count]) {
+      break;
+    }
+    // Chunk numbers only grow, so each worker's range cursor does too.
+    while (n >= job->first_chunk[range_index + 1]) {
+      range_index++;
+    }
+
+    const phys_range *range = &p->ranges[range_index];
+    uint64_t off = (n - job->first_chunk[range_index]) * job->step;
+    size_t len = (range->size - off < job->chunk_size)
+                     ? (size_t)(range->size - off)
+                     : job->chunk_size;
+
+    if (p->read(p->ctx, range->base + off, chunk, len) != 0) {
+      phys_scan_report(job, NULL, 0, len, false);
+      continue;
+    }
+
+    uint32_t count = 0;
+    size_t rel = 0;
+    while ((rel = pattern_find(&job->plan, chunk, len, rel, job->stride)) !=
+           PATTERN_NOT_FOUND) {
+      found[count++] = range->base + off + rel;
+      rel = pattern_next_candidate(len, rel, job->stride);
+      if (count == sizeof(found) / sizeof(found[0])) {
+        phys_scan_report(job, found, count, 0, true);
+        count = 0;
+      }
+    }
+    phys_scan_report(job, found, count, len, true);
+  }
+
+  free(chunk);
+  return NULL;
+}
+
+static int phys_scan_compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+int phys_scan(const phys_scan_params *params, phys_scan_result *result) {
+  if (!params || !result || !params->read || !params->ranges ||
+      params->range_count == 0 || !result->results ||
+      result->max_results == 0) {
+    return -1;
+  }
+  result->count = 0;
+  result->truncated = false;
+  result->bytes_scanned = 0;
+  result->unreadable_bytes = 0;
+
+  phys_scan_job job;
+  memset(&job, 0, sizeof(job));
+  job.params = params;
+  job.result = result;
+  if (!pattern_plan_init(&job.plan, params->pattern, params->mask)) {
+    return -1;
+  }
+  job.stride = params->stride ? params->stride : job.plan.len;
+  job.chunk_size =
+      params->chunk_size ? params->chunk_size : PHYS_SCAN_DEFAULT_CHUNK;
+  if (job.chunk_size < job.plan.len) {
+    return -1;
+  }
+  // Consecutive chunks overlap by up to len - 1 bytes so matches that
+  // straddle a chunk boundary are still seen, each exactly once.
+  job.step = pattern_chunk_advance(&job.plan, job.chunk_size, job.stride);
+
+  job.first_chunk = malloc((params->range_count + 1) * sizeof(uint64_t));
+  if (!job.first_chunk) {
+    return -1;
+  }
+  job.first_chunk[0] = 0;
+  for (uint32_t i = 0; i < params->range_count; i++) {
+    job.first_chunk[i + 1] =
+        job.first_chunk[i] + phys_scan_chunks_in(&job, &params->ranges[i]);
+  }
+  atomic_init(&job.next_chunk, 0);
+  atomic_init(&job.full, false);
+  pthread_mutex_init(&job.lock, NULL);
+
+  uint32_t threads = params->threads ? params->threads
+                                     : PHYS_SCAN_DEFAULT_THREADS;
+  if (threads > PHYS_SCAN_MAX_THREADS) {
+    threads = PHYS_SCAN_MAX_THREADS;
+  }
+  pthread_t workers[PHYS_SCAN_MAX_THREADS];
+  uint32_t started = 0;
+  for (; started < threads; started++) {
+    if (pthread_create(&workers[started], NULL, phys_scan_worker, &job) != 0) {
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  pthread_mutex_destroy(&job.lock);
+  free(job.first_chunk);
+  if (started == 0) {
+    return -1;
+  }
+
+  qsort(result->results, result->count, sizeof(uint64_t), phys_scan_compare);
+  result->bytes_scanned = job.bytes_scanned;
+  result->unreadable_bytes = job.unreadable_bytes;
+  return 0;
+}
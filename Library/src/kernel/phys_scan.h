@@ -0,0 +1,51 @@
+#ifndef PHYS_SCAN_H
+#define PHYS_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "calypso/phys_ranges.h"
+
+// Parallel sweep of physical memory for a masked byte pattern (search_pattern()
+// rules), e.g. Mach-O headers on page boundaries. This file has no IOKit
+// dependency: memory is reached through `read`, so the sweep can be run
+// against a file standing in for physical memory.
+
+#define PHYS_SCAN_DEFAULT_CHUNK (1024 * 1024)
+#define PHYS_SCAN_DEFAULT_THREADS 4
+#define PHYS_SCAN_MAX_THREADS 64
+
+// Reads `len` bytes at physical address `paddr` into `buf`. Returns 0 on
+// success. Called concurrently from the worker threads.
+typedef int (*phys_scan_read_fn)(void *ctx, uint64_t paddr, void *buf,
+                                 size_t len);
+
+typedef struct {
+  phys_scan_read_fn read;
+  void *ctx;
+  const phys_range *ranges; // e.g. as returned by pd_phys_ranges()
+  uint32_t range_count;
+  const uint8_t *pattern;
+  const char *mask;
+  size_t stride;     // candidate step from each range start; 0 = pattern length
+  size_t chunk_size; // bytes per read; 0 = PHYS_SCAN_DEFAULT_CHUNK
+  uint32_t threads;  // 0 = PHYS_SCAN_DEFAULT_THREADS
+} phys_scan_params;
+
+typedef struct {
+  uint64_t *results; // set by the caller, filled in ascending order
+  uint32_t max_results;
+  uint32_t count;
+  // More than max_results matches exist; `results` then holds an arbitrary
+  // subset of them (whichever workers reported first).
+  bool truncated;
+  uint64_t bytes_scanned;
+  uint64_t unreadable_bytes; // chunks whose read failed were skipped
+} phys_scan_result;
+
+// Returns 0 when the sweep ran (some chunks may have been unreadable), -1 on
+// bad arguments or if no worker thread could be started.
+int phys_scan(const phys_scan_params *params, phys_scan_result *result);
+
+#endif
@@ -0,0 +1,296 @@
+#include "pt_walk.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PT_OA_MASK 0x0000fffffffff000ull // output address bits [47:12]
+
+#define PT_DESC_VALID (1ull << 0)
+#define PT_DESC_TABLE (1ull << 1) // table (levels 0-2) or page (level 3)
+#define PT_DESC_AP_EL0 (1ull << 6)
+#define PT_DESC_AP_RO (1ull << 7)
+#define PT_DESC_NG (1ull << 11)
+#define PT_DESC_PXN (1ull << 53)
+#define PT_DESC_UXN (1ull << 54)
+#define PT_DESC_PXN_TABLE (1ull << 59)
+#define PT_DESC_UXN_TABLE (1ull << 60)
+#define PT_DESC_AP_TABLE_NO_EL0 (1ull << 61)
+#define PT_DESC_AP_TABLE_RO (1ull << 62)
+
+#define PT_TCR_T1SZ_SHIFT 16
+#define PT_TCR_EPD1 (1ull << 23)
+#define PT_TCR_TG1_SHIFT 30
+#define PT_TCR_HPD1 (1ull << 42)
+
+typedef struct {
+  const pt_walk_params *params;
+  pt_map *map;
+  unsigned granule_shift;
+  unsigned bits_per_level;
+  unsigned start_level;
+  bool hierarchical;
+  uint64_t first; // window, inclusive
+  uint64_t last;
+  uint64_t *tables[4]; // one table buffer per level
+} pt_walker;
+
+static inline unsigned pt_level_shift(const pt_walker *w, unsigned level) {
+  return w->granule_shift + (3 - level) * w->bits_per_level;
+}
+
+static bool pt_block_allowed(const pt_walker *w, unsigned level) {
+  // Level 1 blocks only exist with the 4 KB granule (without LPA2).
+  return level == 2 || (level == 1 && w->granule_shift == 12);
+}
+
+static int pt_append(pt_map *map, const pt_region *r) {
+  if (map->count) {
+    pt_region *last = &map->regions[map->count - 1];
+    if (last->vaddr + last->size == r->vaddr &&
+        last->paddr + last->size == r->paddr && last->flags == r->flags &&
+        last->attr_index == r->attr_index &&
+        last->shareability == r->shareability) {
+      last->size += r->size;
+      return 0;
+    }
+  }
+
+  if (map->count == map->capacity) {
+    size_t cap = map->capacity ? map->capacity * 2 : 256;
+    pt_region *grown = realloc(map->regions, cap * sizeof(*grown));
+    if (!grown) {
+      return -1;
+    }
+    map->regions = grown;
+    map->capacity = cap;
+  }
+  map->regions[map->count++] = *r;
+  return 0;
+}
+
+// Flags the table descriptors above a leaf impose on it.
+static uint32_t pt_table_flags(const pt_walker *w, uint64_t desc) {
+  if (!w->hierarchical) {
+    return 0;
+  }
+  uint32_t flags = 0;
+  if (desc & PT_DESC_AP_TABLE_RO) {
+    flags |= PT_REGION_READ_ONLY;
+  }
+  if (desc & PT_DESC_PXN_TABLE) {
+    flags |= PT_REGION_PXN;
+  }
+  if (desc & PT_DESC_UXN_TABLE) {
+    flags |= PT_REGION_UXN;
+  }
+  return flags;
+}
+
+static uint32_t pt_leaf_flags(uint64_t desc, uint32_t inherited,
+                              bool no_el0) {
+  uint32_t flags = inherited;
+  if (desc & PT_DESC_AP_RO) {
+    flags |= PT_REGION_READ_ONLY;
+  }
+  if ((desc & PT_DESC_AP_EL0) && !no_el0) {
+    flags |= PT_REGION_EL0;
+  }
+  if (desc & PT_DESC_PXN) {
+    flags |= PT_REGION_PXN;
+  }
+  if (desc & PT_DESC_UXN) {
+    flags |= PT_REGION_UXN;
+  }
+  if (desc & PT_DESC_NG) {
+    flags |= PT_REGION_NG;
+  }
+  return flags;
+}
+
+static int pt_walk_table(pt_walker *w, unsigned level, uint64_t table_pa,
+                         uint64_t entries, uint64_t va_base,
+                         uint32_t inherited, bool no_el0) {
+  const pt_walk_params *p = w->params;
+  uint64_t *table = w->tables[level];
+  if (p->read(p->ctx, table_pa, table, entries * sizeof(uint64_t)) != 0) {
+    w->map->table_faults++;
+    return 0;
+  }
+  w->map->table_reads++;
+
+  const unsigned shift = pt_level_shift(w, level);
+  const uint64_t span = 1ull << shift;
+  for (uint64_t i = 0; i < entries; i++) {
+    uint64_t va = va_base + (i << shift);
+    if (va + (span - 1) < w->first) {
+      continue;
+    }
+    if (va > w->last) {
+      break;
+    }
+
+    uint64_t desc = table[i];
+    if (!(desc & PT_DESC_VALID)) {
+      continue;
+    }
+
+    if (level < 3 && (desc & PT_DESC_TABLE)) {
+      bool child_no_el0 =
+          no_el0 || (w->hierarchical && (desc & PT_DESC_AP_TABLE_NO_EL0));
+      // Each level has its own buffer, so `table` survives the recursion.
+      if (pt_walk_table(w, level + 1, desc & PT_OA_MASK,
+                        1ull << w->bits_per_level, va,
+                        inherited | pt_table_flags(w, desc),
+                        child_no_el0) != 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    bool page = level == 3 && (desc & PT_DESC_TABLE);
+    bool block = level < 3 && pt_block_allowed(w, level);
+    if (!page && !block) {
+      continue;
+    }
+
+    pt_region r = {
+        .vaddr = va,
+        .paddr = desc & PT_OA_MASK & ~(span - 1),
+        .size = span,
+        .flags = pt_leaf_flags(desc, inherited, no_el0),
+        .attr_index = (uint8_t)((desc >> 2) & 7),
+        .shareability = (uint8_t)((desc >> 8) & 3),
+    };
+    if (pt_append(w->map, &r) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int pt_walk_ttbr1(const pt_walk_params *params, pt_map *map) {
+  if (!params || !params->read || !map) {
+    return -1;
+  }
+  memset(map, 0, sizeof(*map));
+
+  pt_walker w;
+  memset(&w, 0, sizeof(w));
+  w.params = params;
+  w.map = map;
+
+  switch ((params->tcr >> PT_TCR_TG1_SHIFT) & 3) {
+  case 1:
+    w.granule_shift = 14;
+    break;
+  case 2:
+    w.granule_shift = 12;
+    break;
+  case 3:
+    w.granule_shift = 16;
+    break;
+  default:
+    return -1;
+  }
+  w.bits_per_level = w.granule_shift - 3;
+
+  const unsigned t1sz = (unsigned)((params->tcr >> PT_TCR_T1SZ_SHIFT) & 0x3f);
+  const unsigned va_bits = 64 - t1sz;
+  if (va_bits < 25 || va_bits > 48) {
+    return -1;
+  }
+  if (params->tcr & PT_TCR_EPD1) {
+    return 0; // TTBR1 walks are disabled; nothing is mapped
+  }
+  w.hierarchical = !(params->tcr & PT_TCR_HPD1);
+
+  const unsigned levels =
+      (va_bits - w.granule_shift + w.bits_per_level - 1) / w.bits_per_level;
+  w.start_level = 4 - levels;
+  const uint64_t top_entries =
+      1ull << (va_bits - pt_level_shift(&w, w.start_level));
+
+  const uint64_t space_start = ~0ull << va_bits;
+  w.first = params->va_start > space_start ? params->va_start : space_start;
+  w.last = params->va_end ? params->va_end - 1 : UINT64_MAX;
+  if (w.first > w.last) {
+    return 0;
+  }
+
+  const size_t table_bytes = (size_t)1 << w.granule_shift;
+  int ret = 0;
+  for (unsigned level = w.start_level; level < 4; level++) {
+    w.tables[level] = malloc(table_bytes);
+    if (!w.tables[level]) {
+      ret = -1;
+    }
+  }
+
+  // TTBR1_EL1.BADDR is bits [47:1]; bit 0 is CnP.
+  const uint64_t top_pa = params->ttbr1 & 0x0000fffffffffffeull;
+  if (ret == 0) {
+    ret = pt_walk_table(&w, w.start_level, top_pa, top_entries, space_start, 0,
+                        false);
+  }
+
+  for (unsigned level = 0; level < 4; level++) {
+    free(w.tables[level]);
+  }
+  if (ret != 0) {
+    pt_map_free(map);
+  }
+  return ret;
+}
+
+void pt_map_free(pt_map *map) {
+  if (!map) {
+    return;
+  }
+  free(map->regions);
+  map->regions = NULL;
+  map->count = 0;
+  map->capacity = 0;
+}
+
+// Index of the first region starting above `vaddr`.
+static size_t pt_map_upper_bound(const pt_map *map, uint64_t vaddr) {
+  size_t lo = 0;
+  size_t hi = map->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (map->regions[mid].vaddr <= vaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+const pt_region *pt_map_find(const pt_map *map, uint64_t vaddr) {
+  if (!map || map->count == 0) {
+    return NULL;
+  }
+  size_t pos = pt_map_upper_bound(map, vaddr);
+  if (pos == 0) {
+    return NULL;
+  }
+  const pt_region *r = &map->regions[pos - 1];
+  return (vaddr - r->vaddr < r->size) ? r : NULL;
+}
+
+bool pt_map_next_mapped(const pt_map *map, uint64_t vaddr, uint64_t *next) {
+  if (!map || !next || map->count == 0) {
+    return false;
+  }
+  if (pt_map_find(map, vaddr)) {
+    *next = vaddr;
+    return true;
+  }
+  size_t pos = pt_map_upper_bound(map, vaddr);
+  if (pos == map->count) {
+    return false;
+  }
+  *next = map->regions[pos].vaddr;
+  return true;
+}
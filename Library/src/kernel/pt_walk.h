@@ -0,0 +1,67 @@
+#ifndef PT_WALK_H
+#define PT_WALK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Software walk of the ARMv8 stage 1 tables behind TTBR1 (the kernel half of
+// the address space), producing a sorted map of mapped regions. Tables are
+// fetched a whole table at a time through `read`; like page_cache.c this
+// file has no IOKit dependency, so it can walk a page-table image on Linux.
+//
+// 4 KB, 16 KB and 64 KB granules are supported, with 48-bit output
+// addresses. On chips with SPRR the AP bits select a permission index rather
+// than the literal permissions, so PT_REGION_* access bits are what the
+// descriptors say, not necessarily what the hardware enforces.
+
+#define PT_REGION_READ_ONLY (1u << 0) // AP[2], including APTable
+#define PT_REGION_EL0 (1u << 1)       // AP[1], minus APTable
+#define PT_REGION_PXN (1u << 2)       // including PXNTable
+#define PT_REGION_UXN (1u << 3)       // including UXNTable
+#define PT_REGION_NG (1u << 4)        // not global
+
+// Reads `len` bytes of physical memory at `paddr` into `buf`. Returns 0 on
+// success.
+typedef int (*pt_read_fn)(void *ctx, uint64_t paddr, void *buf, size_t len);
+
+typedef struct {
+  uint64_t vaddr;
+  uint64_t paddr;
+  uint64_t size;
+  uint32_t flags; // PT_REGION_*
+  uint8_t attr_index; // AttrIndx, an index into MAIR_EL1
+  uint8_t shareability;
+} pt_region;
+
+typedef struct {
+  pt_region *regions; // ascending vaddr, never overlapping
+  size_t count;
+  size_t capacity;
+  uint64_t table_reads;  // tables fetched through `read`
+  uint64_t table_faults; // tables that could not be read and were skipped
+} pt_map;
+
+typedef struct {
+  pt_read_fn read;
+  void *ctx;
+  uint64_t ttbr1; // TTBR1_EL1
+  uint64_t tcr;   // TCR_EL1
+  // Optional window; only regions overlapping it are walked. Both 0 means
+  // the whole TTBR1 half.
+  uint64_t va_start;
+  uint64_t va_end;
+} pt_walk_params;
+
+// Returns 0 when the walk ran (unreadable tables are counted and skipped),
+// -1 on bad arguments, an unsupported TCR_EL1 or OOM. `map` is reset first;
+// free it with pt_map_free().
+int pt_walk_ttbr1(const pt_walk_params *params, pt_map *map);
+void pt_map_free(pt_map *map);
+
+// Region containing `vaddr`, or NULL.
+const pt_region *pt_map_find(const pt_map *map, uint64_t vaddr);
+// Lowest mapped address >= `vaddr`; false if nothing is mapped at or above it.
+bool pt_map_next_mapped(const pt_map *map, uint64_t vaddr, uint64_t *next);
+
+#endif
@@ -0,0 +1,25 @@
+#include "read_window.h"
+
+#include <string.h>
+
+int read_window_run(read_window_fill fill, void *ctx, const uint8_t *window,
+                    size_t window_size, uint64_t kaddr, void *buf,
+                    size_t len) {
+  if (!fill || !window || window_size == 0 || (!buf && len)) {
+    return -1;
+  }
+
+  uint8_t *out = buf;
+  while (len) {
+    size_t chunk = len < window_size ? len : window_size;
+    int err = fill(ctx, kaddr, chunk);
+    if (err != 0) {
+      return err;
+    }
+    memcpy(out, window, chunk);
+    out += chunk;
+    kaddr += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef READ_WINDOW_H
+#define READ_WINDOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunking of large kernel reads through the shared read window: the kext
+// fills the window (mapped read-only into the client) with one selector call
+// and the library copies each chunk out. This file has no IOKit dependency,
+// so the chunking can be driven by an in-process transport.
+
+// Reads of at least this many bytes go through the window when one is
+// mapped; smaller ones stay on the per-call bounce path.
+#define READ_WINDOW_THRESHOLD (64 * 1024)
+
+// Has the kext copy `len` bytes at `kaddr` to the start of the window; `len`
+// never exceeds the window size. Returns 0 on success or a nonzero error
+// (kern_return_t) that read_window_run() passes back.
+typedef int (*read_window_fill)(void *ctx, uint64_t kaddr, size_t len);
+
+// True if a read of `len` bytes should use a window of `window_size` bytes
+// (0 = none mapped).
+static inline bool read_window_wanted(size_t window_size, size_t len) {
+  return window_size != 0 && len >= READ_WINDOW_THRESHOLD;
+}
+
+// Reads `len` bytes at `kaddr` into `buf`, one window-sized chunk per `fill`
+// call. Stops at the first failing chunk and returns its error; `buf` then
+// holds the chunks before it. Returns -1 on bad arguments.
+int read_window_run(read_window_fill fill, void *ctx, const uint8_t *window,
+                    size_t window_size, uint64_t kaddr, void *buf, size_t len);
+
+#endif
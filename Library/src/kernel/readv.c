@@ -0,0 +1,67 @@
+#include "readv.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+int32_t readv_check_desc(const readv_desc *desc, size_t buf_len) {
+  if (!desc || desc->kaddr == 0 || desc->len == 0) {
+    return READV_STATUS_BAD_ARGUMENT;
+  }
+  if ((size_t)desc->offset > buf_len ||
+      (size_t)desc->len > buf_len - (size_t)desc->offset) {
+    return READV_STATUS_BAD_ARGUMENT;
+  }
+  return READV_STATUS_SUCCESS;
+}
+
+int readv_run(readv_transport transport, void *ctx, const readv_desc *descs,
+              size_t count, void *buf, size_t buf_len, int32_t *statuses,
+              size_t *failed) {
+  if (!transport || !descs || !buf || !statuses || count == 0) {
+    return -1;
+  }
+
+  readv_desc batch[READV_MAX_BATCH];
+  int32_t batch_status[READV_MAX_BATCH];
+  size_t batch_index[READV_MAX_BATCH];
+  size_t bad = 0;
+  int rc = 0;
+
+  size_t i = 0;
+  while (i < count) {
+    uint32_t n = 0;
+
+    // Invalid descriptors are answered locally and never sent.
+    for (; i < count && n < READV_MAX_BATCH; ++i) {
+      statuses[i] = readv_check_desc(&descs[i], buf_len);
+      if (statuses[i] != READV_STATUS_SUCCESS) {
+        bad++;
+        continue;
+      }
+      batch[n] = descs[i];
+      batch_index[n] = i;
+      n++;
+    }
+
+    if (n == 0) {
+      continue;
+    }
+
+    if (rc == 0) {
+      rc = transport(ctx, batch, n, buf, buf_len, batch_status);
+    }
+
+    for (uint32_t k = 0; k < n; ++k) {
+      int32_t st = (rc == 0) ? batch_status[k] : READV_STATUS_ABORTED;
+      statuses[batch_index[k]] = st;
+      if (st != READV_STATUS_SUCCESS) {
+        bad++;
+      }
+    }
+  }
+
+  if (failed) {
+    *failed = bad;
+  }
+  return (rc == 0) ? 0 : -1;
+}
@@ -0,0 +1,47 @@
+#ifndef READV_H
+#define READV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scatter-gather read core shared by pd_readv() and anything else that wants
+// to batch kernel reads. This file has no IOKit dependency so the descriptor
+// handling can be exercised against an in-process transport.
+
+// Wire format of one descriptor, identical to PandoraKReadVDescriptor in the
+// kext: `len` bytes at `kaddr` land at `offset` in the caller's buffer.
+typedef struct {
+  uint64_t kaddr;
+  uint32_t len;
+  uint32_t offset;
+} readv_desc;
+
+// Largest number of descriptors the kext accepts in one call.
+#define READV_MAX_BATCH 256
+
+// Per-descriptor status values (IOReturn encoding).
+#define READV_STATUS_SUCCESS ((int32_t)0)
+#define READV_STATUS_BAD_ARGUMENT ((int32_t)0xe00002c2) // kIOReturnBadArgument
+#define READV_STATUS_ABORTED ((int32_t)0xe00002eb)      // kIOReturnAborted
+
+// Serves one batch of at most READV_MAX_BATCH pre-validated descriptors into
+// `buf`, filling `statuses[i]` for every descriptor. Returns 0 when the batch
+// was delivered (individual descriptors may still have failed) or a nonzero
+// transport error, in which case `statuses` is ignored.
+typedef int (*readv_transport)(void *ctx, const readv_desc *descs,
+                               uint32_t count, void *buf, size_t buf_len,
+                               int32_t *statuses);
+
+// Returns READV_STATUS_SUCCESS if `desc` can be served into a buffer of
+// `buf_len` bytes, READV_STATUS_BAD_ARGUMENT otherwise.
+int32_t readv_check_desc(const readv_desc *desc, size_t buf_len);
+
+// Validates `descs`, splits the valid ones into batches and hands each batch
+// to `transport`. `statuses` receives one status per input descriptor and
+// `failed` (optional) the number of descriptors that did not succeed.
+// Returns 0 on success, -1 on bad arguments or the first transport error.
+int readv_run(readv_transport transport, void *ctx, const readv_desc *descs,
+              size_t count, void *buf, size_t buf_len, int32_t *statuses,
+              size_t *failed);
+
+#endif
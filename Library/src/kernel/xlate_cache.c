@@ -0,0 +1,325 @@
+#include "xlate_cache.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  xlate_run run;
+  uint64_t last_used;
+} xlate_entry;
+
+struct xlate_cache {
+  size_t page_size;
+  uint64_t page_mask;
+
+  // Sorted by vaddr, never overlapping.
+  xlate_entry *entries;
+  uint32_t count;
+  uint32_t capacity;
+  uint64_t tick;
+
+  uint64_t *batch_vaddrs;
+  xlate_page *batch_pages;
+  uint32_t batch_size;
+
+  xlate_cache_fill fill;
+  void *ctx;
+  xlate_cache_stats stats;
+};
+
+// Index of the first entry starting above `vaddr`.
+static uint32_t xlate_upper_bound(const xlate_cache *xc, uint64_t vaddr) {
+  uint32_t lo = 0;
+  uint32_t hi = xc->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (xc->entries[mid].run.vaddr <= vaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static xlate_entry *xlate_find(xlate_cache *xc, uint64_t vaddr) {
+  uint32_t pos = xlate_upper_bound(xc, vaddr);
+  if (pos == 0) {
+    return NULL;
+  }
+  xlate_entry *e = &xc->entries[pos - 1];
+  return (vaddr - e->run.vaddr < e->run.len) ? e : NULL;
+}
+
+static void xlate_remove(xlate_cache *xc, uint32_t idx) {
+  memmove(&xc->entries[idx], &xc->entries[idx + 1],
+          (xc->count - idx - 1) * sizeof(*xc->entries));
+  xc->count--;
+}
+
+static void xlate_evict_one(xlate_cache *xc) {
+  uint32_t victim = 0;
+  for (uint32_t i = 1; i < xc->count; i++) {
+    if (xc->entries[i].last_used < xc->entries[victim].last_used) {
+      victim = i;
+    }
+  }
+  xlate_remove(xc, victim);
+  xc->stats.evictions++;
+}
+
+// True if `b` continues `a` both virtually and physically.
+static bool xlate_joins(const xlate_run *a, const xlate_run *b) {
+  return a->vaddr + a->len == b->vaddr && a->paddr + a->len == b->paddr &&
+         a->flags == b->flags && a->attr == b->attr &&
+         a->shareability == b->shareability;
+}
+
+static xlate_run xlate_page_run(const xlate_cache *xc, uint64_t vaddr,
+                                const xlate_page *page) {
+  xlate_run run = {
+      .vaddr = vaddr,
+      .paddr = page->paddr & xc->page_mask,
+      .len = xc->page_size,
+      .flags = page->flags,
+      .attr = page->attr,
+      .shareability = page->shareability,
+  };
+  return run;
+}
+
+static void xlate_insert_page(xlate_cache *xc, uint64_t vaddr,
+                              const xlate_page *page) {
+  xlate_run run = xlate_page_run(xc, vaddr, page);
+
+  uint32_t pos = xlate_upper_bound(xc, vaddr);
+  xlate_entry *prev = pos ? &xc->entries[pos - 1] : NULL;
+  xlate_entry *next = pos < xc->count ? &xc->entries[pos] : NULL;
+
+  if (prev && xlate_joins(&prev->run, &run)) {
+    prev->run.len += run.len;
+    prev->last_used = xc->tick;
+    if (next && xlate_joins(&prev->run, &next->run)) {
+      prev->run.len += next->run.len;
+      xlate_remove(xc, pos);
+    }
+    return;
+  }
+  if (next && xlate_joins(&run, &next->run)) {
+    next->run.vaddr = run.vaddr;
+    next->run.paddr = run.paddr;
+    next->run.len += run.len;
+    next->last_used = xc->tick;
+    return;
+  }
+
+  if (xc->count == xc->capacity) {
+    xlate_evict_one(xc);
+    pos = xlate_upper_bound(xc, vaddr);
+  }
+  memmove(&xc->entries[pos + 1], &xc->entries[pos],
+          (xc->count - pos) * sizeof(*xc->entries));
+  xc->entries[pos].run = run;
+  xc->entries[pos].last_used = xc->tick;
+  xc->count++;
+}
+
+// Translates the uncached pages among the next batch starting at the page of
+// `vaddr`, without going past `end`. The pages asked for are contiguous from
+// there; `*filled` gets how many, and their translations stay in
+// xc->batch_pages until the next fill.
+static int xlate_fill_from(xlate_cache *xc, uint64_t vaddr, uint64_t end,
+                           uint32_t *filled) {
+  *filled = 0;
+  uint64_t page = vaddr & xc->page_mask;
+  uint32_t n = 0;
+  for (; n < xc->batch_size && page < end; page += xc->page_size) {
+    if (!xlate_find(xc, page)) {
+      xc->batch_vaddrs[n++] = page;
+    } else if (n) {
+      break;
+    }
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  if (xc->fill(xc->ctx, xc->batch_vaddrs, n, xc->batch_pages) != 0) {
+    return -1;
+  }
+  xc->stats.translated_pages += n;
+  *filled = n;
+  for (uint32_t i = 0; i < n; i++) {
+    if (xc->batch_pages[i].flags & XLATE_VALID) {
+      xlate_insert_page(xc, xc->batch_vaddrs[i], &xc->batch_pages[i]);
+    } else {
+      xc->stats.unmapped_pages++;
+    }
+  }
+  return 0;
+}
+
+xlate_cache *xlate_cache_create(uint32_t max_runs, size_t page_size,
+                                uint32_t batch_pages, xlate_cache_fill fill,
+                                void *ctx) {
+  if (!fill || max_runs == 0 || batch_pages == 0 || page_size == 0 ||
+      (page_size & (page_size - 1)) != 0) {
+    return NULL;
+  }
+
+  xlate_cache *xc = calloc(1, sizeof(*xc));
+  if (!xc) {
+    return NULL;
+  }
+
+  xc->entries = calloc(max_runs, sizeof(*xc->entries));
+  xc->batch_vaddrs = calloc(batch_pages, sizeof(*xc->batch_vaddrs));
+  xc->batch_pages = calloc(batch_pages, sizeof(*xc->batch_pages));
+  if (!xc->entries || !xc->batch_vaddrs || !xc->batch_pages) {
+    xlate_cache_destroy(xc);
+    return NULL;
+  }
+
+  xc->page_size = page_size;
+  xc->page_mask = ~((uint64_t)page_size - 1);
+  xc->capacity = max_runs;
+  xc->batch_size = batch_pages;
+  xc->fill = fill;
+  xc->ctx = ctx;
+  return xc;
+}
+
+void xlate_cache_destroy(xlate_cache *xc) {
+  if (!xc) {
+    return;
+  }
+  free(xc->entries);
+  free(xc->batch_vaddrs);
+  free(xc->batch_pages);
+  free(xc);
+}
+
+size_t xlate_cache_map(xlate_cache *xc, uint64_t vaddr, size_t len,
+                       xlate_run *runs, uint32_t max_runs, uint32_t *count) {
+  uint32_t n = 0;
+  size_t covered = 0;
+  if (!xc || !runs || max_runs == 0 || len == 0 || vaddr + len < vaddr) {
+    if (count) {
+      *count = 0;
+    }
+    return 0;
+  }
+
+  const uint64_t end = vaddr + len;
+  uint64_t reply_start = 0;
+  uint64_t reply_bytes = 0; // no fill reply yet
+  while (covered < len) {
+    uint64_t va = vaddr + covered;
+    uint64_t page = va & xc->page_mask;
+    xlate_run src;
+    xlate_entry *e = xlate_find(xc, va);
+    if (e) {
+      xc->stats.hits++;
+      e->last_used = ++xc->tick;
+      src = e->run;
+    } else {
+      // Pages of the last fill are served from its reply: with a small
+      // cache, inserting the rest of a batch can evict the runs it just
+      // added, including va's.
+      if (page < reply_start || page - reply_start >= reply_bytes) {
+        xc->stats.misses++;
+        uint32_t filled = 0;
+        if (xlate_fill_from(xc, va, end, &filled) != 0 || filled == 0) {
+          break;
+        }
+        reply_start = xc->batch_vaddrs[0];
+        reply_bytes = (uint64_t)filled * xc->page_size;
+      } else {
+        xc->stats.hits++;
+      }
+      uint32_t first = (uint32_t)((page - reply_start) / xc->page_size);
+      uint32_t filled = (uint32_t)(reply_bytes / xc->page_size);
+      if (!(xc->batch_pages[first].flags & XLATE_VALID)) {
+        break; // unmapped
+      }
+      src = xlate_page_run(xc, page, &xc->batch_pages[first]);
+      for (uint32_t i = first + 1; i < filled; i++) {
+        xlate_run next =
+            xlate_page_run(xc, xc->batch_vaddrs[i], &xc->batch_pages[i]);
+        if (!(next.flags & XLATE_VALID) || !xlate_joins(&src, &next)) {
+          break;
+        }
+        src.len += next.len;
+      }
+      xc->tick++;
+    }
+
+    uint64_t off = va - src.vaddr;
+    size_t chunk = (src.len - off < len - covered) ? (size_t)(src.len - off)
+                                                   : len - covered;
+    xlate_run piece = src;
+    piece.vaddr = va;
+    piece.paddr = src.paddr + off;
+    piece.len = chunk;
+
+    if (n && xlate_joins(&runs[n - 1], &piece)) {
+      runs[n - 1].len += chunk;
+    } else if (n < max_runs) {
+      runs[n++] = piece;
+    } else {
+      break;
+    }
+    covered += chunk;
+  }
+
+  if (count) {
+    *count = n;
+  }
+  return covered;
+}
+
+void xlate_cache_invalidate(xlate_cache *xc, uint64_t vaddr, size_t len) {
+  if (!xc || len == 0) {
+    return;
+  }
+  uint64_t end = vaddr + len;
+  if (end < vaddr) {
+    end = UINT64_MAX;
+  }
+
+  // The entry before the first one starting at or above `vaddr` may still
+  // reach into the range.
+  uint32_t i = xlate_upper_bound(xc, vaddr);
+  if (i > 0) {
+    i--;
+  }
+  while (i < xc->count && xc->entries[i].run.vaddr < end) {
+    const xlate_run *r = &xc->entries[i].run;
+    if (r->vaddr + r->len > vaddr) {
+      xlate_remove(xc, i);
+      xc->stats.invalidations++;
+    } else {
+      i++;
+    }
+  }
+}
+
+void xlate_cache_flush(xlate_cache *xc) {
+  if (xc) {
+    xc->count = 0;
+  }
+}
+
+void xlate_cache_get_stats(const xlate_cache *xc, xlate_cache_stats *stats) {
+  if (!xc || !stats) {
+    return;
+  }
+  *stats = xc->stats;
+}
+
+void xlate_cache_reset_stats(xlate_cache *xc) {
+  if (xc) {
+    memset(&xc->stats, 0, sizeof(xc->stats));
+  }
+}
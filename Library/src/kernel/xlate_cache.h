@@ -0,0 +1,73 @@
+#ifndef XLATE_CACHE_H
+#define XLATE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache of kernel VA-to-PA translations, kept as runs of pages that are
+// contiguous both virtually and physically and share the same attributes.
+// Misses are translated a batch of pages at a time through the fill callback.
+// Unmapped pages are never cached. Like page_cache.c this file has no IOKit
+// dependency.
+//
+// Translations of static kernel memory (text, const data, the physmap) do not
+// change, but zone and kalloc pages can be freed and remapped: drop those with
+// xlate_cache_invalidate() or xlate_cache_flush() once they may be stale.
+
+#define XLATE_VALID (1u << 0)
+#define XLATE_WRITABLE (1u << 1)
+
+// Translation of a single page as reported by the fill callback.
+typedef struct {
+  uint64_t paddr;
+  uint32_t flags; // XLATE_*; pages without XLATE_VALID are unmapped
+  uint8_t attr;   // MAIR attribute byte
+  uint8_t shareability;
+} xlate_page;
+
+typedef struct {
+  uint64_t vaddr;
+  uint64_t paddr;
+  uint64_t len;
+  uint32_t flags;
+  uint8_t attr;
+  uint8_t shareability;
+} xlate_run;
+
+typedef struct {
+  uint64_t hits;             // lookups served by a cached run
+  uint64_t misses;           // lookups that had to call the fill callback
+  uint64_t translated_pages; // pages reported by the fill callback
+  uint64_t unmapped_pages;   // of those, pages without a translation
+  uint64_t evictions;        // runs dropped to make room
+  uint64_t invalidations;    // runs dropped by xlate_cache_invalidate()
+} xlate_cache_stats;
+
+// Translates `count` page-aligned VAs into `out`. Returns 0 on success.
+typedef int (*xlate_cache_fill)(void *ctx, const uint64_t *vaddrs,
+                                uint32_t count, xlate_page *out);
+
+typedef struct xlate_cache xlate_cache;
+
+// `page_size` must be a power of two; `batch_pages` bounds one fill call.
+// Returns NULL on bad arguments or OOM.
+xlate_cache *xlate_cache_create(uint32_t max_runs, size_t page_size,
+                                uint32_t batch_pages, xlate_cache_fill fill,
+                                void *ctx);
+void xlate_cache_destroy(xlate_cache *xc);
+
+// Splits [vaddr, vaddr + len) into physically contiguous runs, translating
+// pages that are not cached. Fills at most `max_runs` runs and returns how
+// many bytes they cover: less than `len` if an unmapped page was reached, the
+// runs ran out or the fill callback failed.
+size_t xlate_cache_map(xlate_cache *xc, uint64_t vaddr, size_t len,
+                       xlate_run *runs, uint32_t max_runs, uint32_t *count);
+
+// Drops every cached run overlapping [vaddr, vaddr + len).
+void xlate_cache_invalidate(xlate_cache *xc, uint64_t vaddr, size_t len);
+void xlate_cache_flush(xlate_cache *xc);
+
+void xlate_cache_get_stats(const xlate_cache *xc, xlate_cache_stats *stats);
+void xlate_cache_reset_stats(xlate_cache *xc);
+
+#endif
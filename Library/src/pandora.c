@@ -1,10 +1,14 @@
 #include "pandora.h"
+#include "calypso/pattern_match.h"
+#include "kernel/async_slots.h"
 #include <IOKit/IOKitLib.h>
 #include <mach-o/loader.h>
 #include <mach/error.h>
 #include <mach/kern_return.h>
 #include <mach/mach.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define KADDR_OBFUSCATION_KEY 0x6869726520706C7A
 #define STATIC_KERNEL_BASE 0xFFFFFE0007004000
@@ -14,40 +18,166 @@ uint64_t pd_kslide = 0;
 
 io_connect_t gClient = MACH_PORT_NULL;
 
-static inline bool pandora_should_try_legacy_selector(kern_return_t kr) {
-  return (kr == kIOReturnBadArgument || kr == kIOReturnUnsupported);
-}
+static mach_vm_address_t gReadWindow = 0;
+static mach_vm_size_t gReadWindowSize = 0;
+
+static page_cache *gPageCache = NULL;
+static xlate_cache *gXlateCache = NULL;
+
+static IONotificationPortRef gAsyncPort = NULL;
+static async_slots *gAsyncSlots = NULL;
+
+// Operations whose selector number depends on the kext generation.
+typedef enum {
+  PANDORA_OP_KREAD,
+  PANDORA_OP_KWRITE,
+  PANDORA_OP_GET_KERNEL_BASE,
+  PANDORA_OP_GET_METADATA,
+  PANDORA_OP_PREAD_PID,
+  PANDORA_OP_PWRITE_PID,
+  PANDORA_OP_KCALL,
+  PANDORA_OP_RUN_ARB_FUNC_WITH_TASK_ARG_PID,
+  PANDORA_OP_COUNT,
+} pandora_op;
+
+#define PANDORA_SELECTOR_UNAVAILABLE UINT32_MAX
+
+// Selector numbers per op: module-scoped, then the two unscoped numberings
+// older kexts shipped with (they only disagree on the kcall pair).
+static const uint32_t kPandoraOpSelectors[PANDORA_OP_COUNT][3] = {
+    [PANDORA_OP_KREAD] = {PANDORA_UC_SELECTOR_KREAD, 0, 0},
+    [PANDORA_OP_KWRITE] = {PANDORA_UC_SELECTOR_KWRITE, 1, 1},
+    [PANDORA_OP_GET_KERNEL_BASE] = {PANDORA_UC_SELECTOR_GET_KERNEL_BASE, 2, 2},
+    [PANDORA_OP_GET_METADATA] = {PANDORA_UC_SELECTOR_GET_METADATA, 3, 3},
+    [PANDORA_OP_PREAD_PID] = {PANDORA_UC_SELECTOR_PREAD_PID, 4, 4},
+    [PANDORA_OP_PWRITE_PID] = {PANDORA_UC_SELECTOR_PWRITE_PID, 5, 5},
+    [PANDORA_OP_KCALL] = {PANDORA_UC_SELECTOR_KCALL, 6, 7},
+    [PANDORA_OP_RUN_ARB_FUNC_WITH_TASK_ARG_PID] =
+        {PANDORA_UC_SELECTOR_RUN_ARB_FUNC_WITH_TASK_ARG_PID, 7, 8},
+};
+
+typedef enum {
+  PANDORA_SELECTOR_SCHEME_SCOPED = 0,
+  PANDORA_SELECTOR_SCHEME_LEGACY = 1,
+  PANDORA_SELECTOR_SCHEME_LEGACY_ALT = 2,
+} pandora_selector_scheme;
+
+static uint32_t gSelectors[PANDORA_OP_COUNT];
+static pandora_selector_scheme gSelectorScheme = PANDORA_SELECTOR_SCHEME_SCOPED;
+static bool gHaveCapabilities = false;
+static PandoraCapabilitiesModule gModules[PANDORA_CAPABILITIES_MAX_MODULES];
+static uint32_t gModuleCount = 0;
+static uint32_t gMethodSelectors[PANDORA_CAPABILITIES_MAX_METHODS];
+static uint32_t gMethodCount = 0;
 
 static inline kern_return_t pandora_call_scalar_method(io_connect_t client,
-                                                       uint32_t selector,
+                                                       pandora_op op,
                                                        const uint64_t *input,
                                                        uint32_t inputCount,
                                                        uint64_t *output,
-                                                       uint32_t *outputCount,
-                                                       uint32_t legacySelector) {
-  kern_return_t kr = IOConnectCallScalarMethod(client, selector, input,
-                                               inputCount, output, outputCount);
-  if (pandora_should_try_legacy_selector(kr)) {
-    kr = IOConnectCallScalarMethod(client, legacySelector, input, inputCount,
-                                   output, outputCount);
+                                                       uint32_t *outputCount) {
+  if (gSelectors[op] == PANDORA_SELECTOR_UNAVAILABLE) {
+    return kIOReturnUnsupported;
   }
-  return kr;
+  return IOConnectCallScalarMethod(client, gSelectors[op], input, inputCount,
+                                   output, outputCount);
 }
 
 static inline kern_return_t pandora_call_struct_method(io_connect_t client,
-                                                       uint32_t selector,
+                                                       pandora_op op,
                                                        const void *input,
                                                        size_t inputSize,
                                                        void *output,
-                                                       size_t *outputSize,
-                                                       uint32_t legacySelector) {
-  kern_return_t kr = IOConnectCallStructMethod(client, selector, input, inputSize,
-                                               output, outputSize);
-  if (pandora_should_try_legacy_selector(kr)) {
-    kr = IOConnectCallStructMethod(client, legacySelector, input, inputSize,
+                                                       size_t *outputSize) {
+  if (gSelectors[op] == PANDORA_SELECTOR_UNAVAILABLE) {
+    return kIOReturnUnsupported;
+  }
+  return IOConnectCallStructMethod(client, gSelectors[op], input, inputSize,
                                    output, outputSize);
+}
+
+static bool pandora_fetch_capabilities(io_connect_t client) {
+  uint8_t reply[4096];
+  size_t replySize = sizeof(reply);
+  kern_return_t kr = IOConnectCallStructMethod(
+      client, PANDORA_UC_SELECTOR_CAPABILITIES, NULL, 0, reply, &replySize);
+  if (kr != KERN_SUCCESS || replySize < sizeof(PandoraCapabilitiesHeader)) {
+    return false;
   }
-  return kr;
+
+  PandoraCapabilitiesHeader header;
+  memcpy(&header, reply, sizeof(header));
+  size_t needed = sizeof(header) +
+                  (size_t)header.moduleCount * sizeof(PandoraCapabilitiesModule) +
+                  (size_t)header.methodCount * sizeof(PandoraCapabilitiesMethod);
+  if (header.version != PANDORA_CAPABILITIES_VERSION || replySize < needed ||
+      header.moduleCount > PANDORA_CAPABILITIES_MAX_MODULES ||
+      header.methodCount > PANDORA_CAPABILITIES_MAX_METHODS) {
+    printf("Unexpected Pandora capabilities reply (version %u, %zu bytes)\n",
+           header.version, replySize);
+    return false;
+  }
+
+  const uint8_t *cursor = reply + sizeof(header);
+  memcpy(gModules, cursor, header.moduleCount * sizeof(PandoraCapabilitiesModule));
+  cursor += header.moduleCount * sizeof(PandoraCapabilitiesModule);
+  gModuleCount = header.moduleCount;
+
+  for (uint32_t i = 0; i < header.methodCount; i++) {
+    PandoraCapabilitiesMethod method;
+    memcpy(&method, cursor, sizeof(method));
+    cursor += sizeof(method);
+    gMethodSelectors[i] = method.selector;
+  }
+  gMethodCount = header.methodCount;
+  return true;
+}
+
+// Resolves every op to one selector so no call has to retry on a failed
+// transition. Kexts without the handshake are probed with calls that cannot
+// reach a handler: a scoped kernel-base query, then a zero-argument call to
+// selector 8, which only the alternate legacy numbering defines (a defined
+// selector fails argument checks, an undefined one is unsupported).
+static void pandora_resolve_selectors(io_connect_t client) {
+  gHaveCapabilities = pandora_fetch_capabilities(client);
+
+  if (gHaveCapabilities) {
+    gSelectorScheme = PANDORA_SELECTOR_SCHEME_SCOPED;
+    for (int op = 0; op < PANDORA_OP_COUNT; op++) {
+      uint32_t selector = kPandoraOpSelectors[op][PANDORA_SELECTOR_SCHEME_SCOPED];
+      gSelectors[op] = pd_supports_selector(selector)
+                           ? selector
+                           : PANDORA_SELECTOR_UNAVAILABLE;
+    }
+    return;
+  }
+
+  uint64_t kbase = 0;
+  uint32_t outCnt = 1;
+  kern_return_t kr = IOConnectCallScalarMethod(
+      client, PANDORA_UC_SELECTOR_GET_KERNEL_BASE, NULL, 0, &kbase, &outCnt);
+  if (kr == KERN_SUCCESS) {
+    gSelectorScheme = PANDORA_SELECTOR_SCHEME_SCOPED;
+  } else {
+    kr = IOConnectCallScalarMethod(client, 8, NULL, 0, NULL, NULL);
+    gSelectorScheme = (kr == kIOReturnUnsupported)
+                          ? PANDORA_SELECTOR_SCHEME_LEGACY
+                          : PANDORA_SELECTOR_SCHEME_LEGACY_ALT;
+  }
+
+  for (int op = 0; op < PANDORA_OP_COUNT; op++) {
+    gSelectors[op] = kPandoraOpSelectors[op][gSelectorScheme];
+  }
+}
+
+static void pandora_reset_selectors(void) {
+  for (int op = 0; op < PANDORA_OP_COUNT; op++) {
+    gSelectors[op] = PANDORA_SELECTOR_UNAVAILABLE;
+  }
+  gSelectorScheme = PANDORA_SELECTOR_SCHEME_SCOPED;
+  gHaveCapabilities = false;
+  gModuleCount = 0;
+  gMethodCount = 0;
 }
 
 static inline io_connect_t pandora_open(void) {
@@ -72,55 +202,145 @@ static inline io_connect_t pandora_open(void) {
 static inline kern_return_t pandora_read(io_connect_t client, uint64_t kaddr,
                                          void *uaddr, uint64_t len) {
   uint64_t in[] = {kaddr, (uint64_t)uaddr, len};
-  return pandora_call_scalar_method(client, PANDORA_UC_SELECTOR_KREAD, in, 3,
-                                    NULL, NULL,
-                                    PANDORA_UC_LOCAL_SELECTOR_KREAD);
+  return pandora_call_scalar_method(client, PANDORA_OP_KREAD, in, 3, NULL,
+                                    NULL);
+}
+
+static inline kern_return_t pandora_read_window(io_connect_t client,
+                                                uint64_t kaddr,
+                                                uint64_t offset,
+                                                uint64_t len) {
+  uint64_t in[] = {kaddr, offset, len};
+  return IOConnectCallScalarMethod(client, PANDORA_UC_SELECTOR_KREAD_WINDOW, in,
+                                   3, NULL, NULL);
+}
+
+static void pandora_map_read_window(io_connect_t client) {
+  mach_vm_address_t addr = 0;
+  mach_vm_size_t size = 0;
+  kern_return_t kr = IOConnectMapMemory64(
+      client, PANDORA_UC_MEMORY_TYPE_READ_WINDOW, mach_task_self(), &addr,
+      &size, kIOMapAnywhere);
+  if (kr != KERN_SUCCESS) {
+    // Older kexts have no window; large reads keep using the bounce path.
+    gReadWindow = 0;
+    gReadWindowSize = 0;
+    return;
+  }
+
+  gReadWindow = addr;
+  gReadWindowSize = size;
+}
+
+static void pandora_unmap_read_window(io_connect_t client) {
+  if (gReadWindow) {
+    IOConnectUnmapMemory64(client, PANDORA_UC_MEMORY_TYPE_READ_WINDOW,
+                           mach_task_self(), gReadWindow);
+  }
+  gReadWindow = 0;
+  gReadWindowSize = 0;
+}
+
+static int pandora_read_window_fill(void *ctx, uint64_t kaddr, size_t len) {
+  return pandora_read_window(*(io_connect_t *)ctx, kaddr, 0, len);
+}
+
+// Large reads are streamed through the shared window one window-sized chunk
+// at a time (see kernel/read_window.h): the kext reads straight into the
+// window, so each chunk costs one transition and one userland memcpy.
+static kern_return_t pandora_read_direct(uint64_t kaddr, void *buf,
+                                         size_t len) {
+  if (gReadWindow && buf && read_window_wanted((size_t)gReadWindowSize, len)) {
+    io_connect_t client = gClient;
+    return read_window_run(pandora_read_window_fill, &client,
+                           (const uint8_t *)(uintptr_t)gReadWindow,
+                           (size_t)gReadWindowSize, kaddr, buf, len);
+  }
+  return pandora_read(gClient, kaddr, buf, len);
+}
+
+static int pandora_page_cache_fill(void *ctx, uint64_t addr, void *buf,
+                                   size_t len) {
+  (void)ctx;
+  return pandora_read_direct(addr, buf, len);
+}
+
+static inline kern_return_t pandora_read_cached(uint64_t kaddr, void *buf,
+                                                size_t len) {
+  if (gPageCache && buf) {
+    return page_cache_read(gPageCache, kaddr, buf, len);
+  }
+  return pandora_read_direct(kaddr, buf, len);
+}
+
+static inline void pandora_cache_invalidate(uint64_t kaddr, size_t len) {
+  if (gPageCache) {
+    page_cache_invalidate(gPageCache, kaddr, len);
+  }
+}
+
+static int pandora_readv_transport(void *ctx, const readv_desc *descs,
+                                   uint32_t count, void *buf, size_t buf_len,
+                                   int32_t *statuses) {
+  kern_return_t *kr_out = (kern_return_t *)ctx;
+  uint64_t in[] = {(uint64_t)buf, (uint64_t)buf_len};
+  uint64_t failed = 0;
+  uint32_t outCnt = 1;
+  size_t statusSize = (size_t)count * sizeof(*statuses);
+
+  kern_return_t kr = IOConnectCallMethod(
+      gClient, PANDORA_UC_SELECTOR_KREADV, in, 2, descs,
+      (size_t)count * sizeof(*descs), &failed, &outCnt, statuses, &statusSize);
+  *kr_out = kr;
+  return (kr == KERN_SUCCESS) ? 0 : -1;
 }
 
 static inline kern_return_t pandora_write(io_connect_t client, void *uaddr,
                                           uint64_t kaddr, uint64_t len) {
   uint64_t in[] = {(uint64_t)uaddr, kaddr, len};
-  return pandora_call_scalar_method(client, PANDORA_UC_SELECTOR_KWRITE, in, 3,
-                                    NULL, NULL,
-                                    PANDORA_UC_LOCAL_SELECTOR_KWRITE);
+  return pandora_call_scalar_method(client, PANDORA_OP_KWRITE, in, 3, NULL,
+                                    NULL);
+}
+
+static inline kern_return_t pandora_writev(io_connect_t client, void *req,
+                                           size_t req_len) {
+  uint64_t written = 0;
+  uint32_t outCnt = 1;
+  return IOConnectCallMethod(client, PANDORA_UC_SELECTOR_KWRITEV, NULL, 0, req,
+                             req_len, &written, &outCnt, NULL, NULL);
 }
 
 static inline kern_return_t pandora_get_kbase(io_connect_t client,
                                               uint64_t *out) {
   uint32_t outCnt = 1;
-  return pandora_call_scalar_method(client, PANDORA_UC_SELECTOR_GET_KERNEL_BASE,
-                                    NULL, 0, out, &outCnt,
-                                    PANDORA_UC_LOCAL_SELECTOR_GET_KERNEL_BASE);
+  return pandora_call_scalar_method(client, PANDORA_OP_GET_KERNEL_BASE, NULL,
+                                    0, out, &outCnt);
 }
 
 static inline kern_return_t pandora_get_metadata(io_connect_t client,
                                                  PandoraMetadata *metadata) {
   size_t outputSize = sizeof(PandoraMetadata);
-  return pandora_call_struct_method(client, PANDORA_UC_SELECTOR_GET_METADATA,
-                                    NULL, 0, metadata, &outputSize,
-                                    PANDORA_UC_LOCAL_SELECTOR_GET_METADATA);
+  return pandora_call_struct_method(client, PANDORA_OP_GET_METADATA, NULL, 0,
+                                    metadata, &outputSize);
 }
 
 static inline kern_return_t pandora_proc_read(io_connect_t client, pid_t pid,
                                               uint64_t paddr, void *uaddr,
                                               uint64_t len) {
   uint64_t in[] = {(uint64_t)(int64_t)pid, paddr, (uint64_t)uaddr, len};
-  return pandora_call_scalar_method(client, PANDORA_UC_SELECTOR_PREAD_PID, in,
-                                    4, NULL, NULL,
-                                    PANDORA_UC_LOCAL_SELECTOR_PREAD_PID);
+  return pandora_call_scalar_method(client, PANDORA_OP_PREAD_PID, in, 4, NULL,
+                                    NULL);
 }
 
 static inline kern_return_t pandora_proc_write(io_connect_t client, pid_t pid,
                                                void *uaddr, uint64_t paddr,
                                                uint64_t len) {
   uint64_t in[] = {(uint64_t)(int64_t)pid, (uint64_t)uaddr, paddr, len};
-  return pandora_call_scalar_method(client, PANDORA_UC_SELECTOR_PWRITE_PID, in,
-                                    4, NULL, NULL,
-                                    PANDORA_UC_LOCAL_SELECTOR_PWRITE_PID);
+  return pandora_call_scalar_method(client, PANDORA_OP_PWRITE_PID, in, 4, NULL,
+                                    NULL);
 }
 
 static inline kern_return_t pandora_kcall(io_connect_t client,
-                                          uint32_t selector,
                                           const PandoraKCallRequest *req,
                                           PandoraKCallResponse *resp) {
   if (!req || !resp) {
@@ -128,17 +348,17 @@ static inline kern_return_t pandora_kcall(io_connect_t client,
   }
 
   size_t outSize = sizeof(*resp);
-  return IOConnectCallStructMethod(client, selector, req, sizeof(*req), resp, &outSize);
+  return pandora_call_struct_method(client, PANDORA_OP_KCALL, req,
+                                    sizeof(*req), resp, &outSize);
 }
 
 static inline kern_return_t pandora_run_arb_func_with_task_arg_pid(
-    io_connect_t client, uint32_t selector, uint64_t funcAddr, pid_t pid,
-    uint64_t *ret0) {
+    io_connect_t client, uint64_t funcAddr, pid_t pid, uint64_t *ret0) {
   uint64_t in[] = {funcAddr, (uint64_t)(int64_t)pid};
   uint64_t out = 0;
   uint32_t outCnt = 1;
-  kern_return_t kr =
-      IOConnectCallScalarMethod(client, selector, in, 2, &out, &outCnt);
+  kern_return_t kr = pandora_call_scalar_method(
+      client, PANDORA_OP_RUN_ARB_FUNC_WITH_TASK_ARG_PID, in, 2, &out, &outCnt);
   if (kr == KERN_SUCCESS && ret0 && outCnt == 1) {
     *ret0 = out;
   }
@@ -148,58 +368,95 @@ static inline kern_return_t pandora_run_arb_func_with_task_arg_pid(
 void pandora_close(io_connect_t client) { IOServiceClose(client); }
 
 int pd_init(void) {
+  pandora_reset_selectors();
   gClient = pandora_open();
-  return MACH_PORT_VALID(gClient) ? 0 : -1;
+  if (!MACH_PORT_VALID(gClient)) {
+    return -1;
+  }
+
+  pandora_resolve_selectors(gClient);
+  if (pd_supports_selector(PANDORA_UC_SELECTOR_KREAD_WINDOW)) {
+    pandora_map_read_window(gClient);
+  }
+  return 0;
 }
 
 void pd_deinit(void) {
+  pd_async_deinit();
+  pd_cache_disable();
+  pd_xlate_disable();
   if (MACH_PORT_VALID(gClient)) {
+    pandora_unmap_read_window(gClient);
     pandora_close(gClient);
     gClient = MACH_PORT_NULL;
   }
+  pandora_reset_selectors();
 }
 
 uint8_t pd_read8(uint64_t addr) {
   uint8_t val = 0;
-  pandora_read(gClient, addr, &val, sizeof(val));
+  pandora_read_cached(addr, &val, sizeof(val));
   return val;
 }
 
 uint16_t pd_read16(uint64_t addr) {
   uint16_t val = 0;
-  pandora_read(gClient, addr, &val, sizeof(val));
+  pandora_read_cached(addr, &val, sizeof(val));
   return val;
 }
 
 uint32_t pd_read32(uint64_t addr) {
   uint32_t val = 0;
-  pandora_read(gClient, addr, &val, sizeof(val));
+  pandora_read_cached(addr, &val, sizeof(val));
   return val;
 }
 
 uint64_t pd_read64(uint64_t addr) {
   uint64_t val = 0;
-  pandora_read(gClient, addr, &val, sizeof(val));
+  pandora_read_cached(addr, &val, sizeof(val));
   return val;
 }
 
 int pd_readbuf(uint64_t addr, void *buf, size_t len) {
-  return pandora_read(gClient, addr, buf, len);
+  return pandora_read_cached(addr, buf, len);
+}
+
+kern_return_t pd_readv(const PandoraKReadVDescriptor *descs, uint32_t count,
+                       void *buf, size_t len, kern_return_t *statuses) {
+  if (!descs || !buf || !statuses || count == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KREADV)) {
+    return kIOReturnUnsupported;
+  }
+
+  kern_return_t kr = KERN_SUCCESS;
+  size_t failed = 0;
+  if (readv_run(pandora_readv_transport, &kr, descs, count, buf, len,
+                (int32_t *)statuses, &failed) != 0) {
+    return (kr != KERN_SUCCESS) ? kr : KERN_INVALID_ARGUMENT;
+  }
+
+  return (failed == 0) ? KERN_SUCCESS : KERN_FAILURE;
 }
 
 kern_return_t pd_write8(uint64_t addr, uint8_t val) {
+  pandora_cache_invalidate(addr, sizeof(val));
   return pandora_write(gClient, &val, addr, sizeof(val));
 }
 
 kern_return_t pd_write16(uint64_t addr, uint16_t val) {
+  pandora_cache_invalidate(addr, sizeof(val));
   return pandora_write(gClient, &val, addr, sizeof(val));
 }
 
 kern_return_t pd_write32(uint64_t addr, uint32_t val) {
+  pandora_cache_invalidate(addr, sizeof(val));
   return pandora_write(gClient, &val, addr, sizeof(val));
 }
 
 kern_return_t pd_write64(uint64_t addr, uint64_t val) {
+  pandora_cache_invalidate(addr, sizeof(val));
   return pandora_write(gClient, &val, addr, sizeof(val));
 }
 
@@ -207,9 +464,110 @@ kern_return_t pd_writebuf(uint64_t addr, const void *buf, size_t len) {
   if (!buf || len == 0) {
     return KERN_INVALID_ARGUMENT;
   }
+  pandora_cache_invalidate(addr, len);
   return pandora_write(gClient, (void *)buf, addr, len);
 }
 
+// Payload bytes one kwritev request can carry when it also holds the maximum
+// number of runs. Runs are staged in place and the payload is slid down to
+// follow them when the request is flushed.
+#define PANDORA_KWRITEV_RUNS_AREA                                               \
+  (sizeof(PandoraKWriteVHeader) +                                              \
+   PANDORA_KWRITEV_MAX_RUNS * sizeof(PandoraKWriteVRun))
+#define PANDORA_KWRITEV_PAYLOAD_CAP                                             \
+  (PANDORA_KWRITEV_MAX_INPUT_SIZE - PANDORA_KWRITEV_RUNS_AREA)
+
+static kern_return_t pd_writev_flush(uint8_t *req, uint32_t count,
+                                     size_t payload_used) {
+  PandoraKWriteVHeader *header = (PandoraKWriteVHeader *)req;
+  header->count = count;
+  header->reserved = 0;
+
+  size_t runs_end =
+      sizeof(PandoraKWriteVHeader) + (size_t)count * sizeof(PandoraKWriteVRun);
+  memmove(req + runs_end, req + PANDORA_KWRITEV_RUNS_AREA, payload_used);
+  return pandora_writev(gClient, req, runs_end + payload_used);
+}
+
+kern_return_t pd_writev(const PandoraKWriteVRun *runs, uint32_t count,
+                        const void *payload, size_t payload_len) {
+  if (!runs || !payload || count == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KWRITEV)) {
+    return kIOReturnUnsupported;
+  }
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (runs[i].len == 0 || runs[i].offset > payload_len ||
+        runs[i].len > payload_len - runs[i].offset) {
+      return KERN_INVALID_ARGUMENT;
+    }
+    total += runs[i].len;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    pandora_cache_invalidate(runs[i].kaddr, runs[i].len);
+  }
+
+  size_t req_size = PANDORA_KWRITEV_RUNS_AREA +
+                    (total < PANDORA_KWRITEV_PAYLOAD_CAP
+                         ? total
+                         : PANDORA_KWRITEV_PAYLOAD_CAP);
+  uint8_t *req = malloc(req_size);
+  if (!req) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  PandoraKWriteVRun *staged =
+      (PandoraKWriteVRun *)(req + sizeof(PandoraKWriteVHeader));
+  uint8_t *staged_payload = req + PANDORA_KWRITEV_RUNS_AREA;
+  const uint8_t *src = (const uint8_t *)payload;
+  uint32_t n = 0;
+  size_t used = 0;
+  kern_return_t kr = KERN_SUCCESS;
+
+  for (uint32_t i = 0; i < count && kr == KERN_SUCCESS; i++) {
+    uint64_t kaddr = runs[i].kaddr;
+    size_t off = runs[i].offset;
+    size_t left = runs[i].len;
+
+    // Runs larger than one request are split across requests.
+    while (left && kr == KERN_SUCCESS) {
+      if (n == PANDORA_KWRITEV_MAX_RUNS || used == PANDORA_KWRITEV_PAYLOAD_CAP) {
+        kr = pd_writev_flush(req, n, used);
+        n = 0;
+        used = 0;
+        continue;
+      }
+
+      size_t chunk = PANDORA_KWRITEV_PAYLOAD_CAP - used;
+      if (chunk > left) {
+        chunk = left;
+      }
+
+      staged[n].kaddr = kaddr;
+      staged[n].len = (uint32_t)chunk;
+      staged[n].offset = (uint32_t)used;
+      memcpy(staged_payload + used, src + off, chunk);
+      n++;
+      used += chunk;
+
+      kaddr += chunk;
+      off += chunk;
+      left -= chunk;
+    }
+  }
+
+  if (kr == KERN_SUCCESS && n) {
+    kr = pd_writev_flush(req, n, used);
+  }
+
+  free(req);
+  return kr;
+}
+
 uint8_t pd_pread8(pid_t pid, uint64_t addr) {
   uint8_t val = 0;
   pandora_proc_read(gClient, pid, addr, &val, sizeof(val));
@@ -262,6 +620,120 @@ kern_return_t pd_pwritebuf(pid_t pid, uint64_t addr, const void *buf,
   return pandora_proc_write(gClient, pid, (void *)buf, addr, len);
 }
 
+kern_return_t pd_proc_open(pid_t pid, pd_proc_handle *handle) {
+  if (!handle || pid <= 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PROC_OPEN)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {(uint64_t)(int64_t)pid};
+  uint64_t out = 0;
+  uint32_t outCnt = 1;
+  kern_return_t kr = IOConnectCallScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_PROC_OPEN, in, 1, &out, &outCnt);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+
+  *handle = out;
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_proc_close(pd_proc_handle handle) {
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PROC_CLOSE)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {handle};
+  return IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_PROC_CLOSE, in,
+                                   1, NULL, NULL);
+}
+
+kern_return_t pd_proc_read(pd_proc_handle handle, uint64_t addr, void *buf,
+                           size_t len) {
+  if (!buf || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PROC_READ)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {handle, addr, (uint64_t)buf, len};
+  return IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_PROC_READ, in,
+                                   4, NULL, NULL);
+}
+
+kern_return_t pd_proc_write(pd_proc_handle handle, uint64_t addr,
+                            const void *buf, size_t len) {
+  if (!buf || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PROC_WRITE)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {handle, (uint64_t)buf, addr, len};
+  return IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_PROC_WRITE, in,
+                                   4, NULL, NULL);
+}
+
+static kern_return_t pandora_preadv(pid_t pid, pd_proc_handle handle,
+                                    const PandoraKReadVDescriptor *descs,
+                                    uint32_t count, void *buf, size_t len,
+                                    kern_return_t *statuses) {
+  if (!descs || !buf || !statuses || count == 0 || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PREADV)) {
+    return kIOReturnUnsupported;
+  }
+
+  // Offsets are relative to `buf`, so batches can share it.
+  uint64_t failed = 0;
+  for (uint32_t first = 0; first < count; first += READV_MAX_BATCH) {
+    uint32_t batch = count - first;
+    if (batch > READV_MAX_BATCH) {
+      batch = READV_MAX_BATCH;
+    }
+
+    uint64_t in[] = {(uint64_t)(int64_t)pid, handle, (uint64_t)buf, len};
+    uint64_t batchFailed = 0;
+    uint32_t outCnt = 1;
+    size_t statusSize = (size_t)batch * sizeof(*statuses);
+    kern_return_t kr = IOConnectCallMethod(
+        gClient, PANDORA_UC_SELECTOR_PREADV, in, 4, descs + first,
+        (size_t)batch * sizeof(*descs), &batchFailed, &outCnt,
+        statuses + first, &statusSize);
+    if (kr != KERN_SUCCESS) {
+      return kr;
+    }
+    failed += batchFailed;
+  }
+
+  return (failed == 0) ? KERN_SUCCESS : KERN_FAILURE;
+}
+
+kern_return_t pd_preadv(pid_t pid, const PandoraKReadVDescriptor *descs,
+                        uint32_t count, void *buf, size_t len,
+                        kern_return_t *statuses) {
+  if (pid <= 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  return pandora_preadv(pid, 0, descs, count, buf, len, statuses);
+}
+
+kern_return_t pd_proc_readv(pd_proc_handle handle,
+                            const PandoraKReadVDescriptor *descs,
+                            uint32_t count, void *buf, size_t len,
+                            kern_return_t *statuses) {
+  if (handle == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  return pandora_preadv(0, handle, descs, count, buf, len, statuses);
+}
+
 uint64_t pd_get_kernel_base() {
   static uint64_t kbase = 0;
 
@@ -298,17 +770,7 @@ kern_return_t pd_kcall(const PandoraKCallRequest *req, PandoraKCallResponse *res
     return KERN_INVALID_CAPABILITY;
   }
 
-  // Prefer module-scoped selector, then fall back to legacy numbering.
-  kern_return_t kr = pandora_kcall(gClient, PANDORA_UC_SELECTOR_KCALL, req, resp);
-  if (kr == kIOReturnBadArgument || kr == kIOReturnUnsupported) {
-    // Historical preferred value in unscoped builds.
-    kr = pandora_kcall(gClient, 6, req, resp);
-  }
-  if (kr == kIOReturnBadArgument || kr == kIOReturnUnsupported) {
-    // Older legacy value in unscoped builds.
-    kr = pandora_kcall(gClient, 7 /* legacy KCALL */, req, resp);
-  }
-  return kr;
+  return pandora_kcall(gClient, req, resp);
 }
 
 kern_return_t pd_kcall_simple(uint64_t fn, const uint64_t *args,
@@ -320,7 +782,7 @@ kern_return_t pd_kcall_simple(uint64_t fn, const uint64_t *args,
   PandoraKCallRequest req = {
       .fn = fn,
       .argCount = argCount,
-      .reserved = 0,
+      .chainMask = 0,
       .args = {0},
   };
   for (uint32_t i = 0; i < argCount; i++) {
@@ -335,22 +797,1329 @@ kern_return_t pd_kcall_simple(uint64_t fn, const uint64_t *args,
   return (kr == KERN_SUCCESS) ? resp.status : kr;
 }
 
+kern_return_t pd_kcall_buffers(uint64_t fn, const uint64_t *args,
+                               uint32_t argCount,
+                               const PandoraKCallBuffer *buffers,
+                               uint32_t bufferCount, uint64_t *ret0) {
+  if (argCount > 8 || bufferCount > PANDORA_KCALL_MAX_BUFFERS ||
+      (bufferCount && !buffers)) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!MACH_PORT_VALID(gClient)) {
+    return KERN_INVALID_CAPABILITY;
+  }
+
+  PandoraKCallMarshalledRequest req = {0};
+  req.call.fn = fn;
+  req.call.argCount = argCount;
+  for (uint32_t i = 0; i < argCount; i++) {
+    req.call.args[i] = args ? args[i] : 0;
+  }
+  req.bufferCount = bufferCount;
+  for (uint32_t i = 0; i < bufferCount; i++) {
+    req.buffers[i] = buffers[i];
+  }
+
+  PandoraKCallResponse resp = {.status = KERN_FAILURE, .ret0 = 0};
+  size_t outSize = sizeof(resp);
+  kern_return_t kr = pandora_call_struct_method(
+      gClient, PANDORA_OP_KCALL, &req, sizeof(req), &resp, &outSize);
+  if (ret0) {
+    *ret0 = resp.ret0;
+  }
+  return (kr == KERN_SUCCESS) ? resp.status : kr;
+}
+
+kern_return_t pd_kcall_batch(const PandoraKCallRequest *reqs, uint32_t count,
+                             PandoraKCallTimedResponse *resps, bool log) {
+  if (!reqs || !resps || count == 0 || count > PANDORA_KCALL_BATCH_MAX) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KCALL_BATCH)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {log ? PANDORA_KCALL_BATCH_LOG : 0};
+  uint64_t executed = 0;
+  uint32_t outCnt = 1;
+  size_t outSize = (size_t)count * sizeof(*resps);
+  kern_return_t kr = IOConnectCallMethod(
+      gClient, PANDORA_UC_SELECTOR_KCALL_BATCH, in, 1, reqs,
+      (size_t)count * sizeof(*reqs), &executed, &outCnt, resps, &outSize);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (resps[i].status != KERN_SUCCESS) {
+      return KERN_FAILURE;
+    }
+  }
+  return KERN_SUCCESS;
+}
+
 kern_return_t pd_run_arb_func_with_task_arg_pid(uint64_t funcAddr, pid_t pid,
                                                 uint64_t *ret0) {
   if (!MACH_PORT_VALID(gClient)) {
     return KERN_INVALID_CAPABILITY;
   }
 
-  kern_return_t kr = pandora_run_arb_func_with_task_arg_pid(
-      gClient, PANDORA_UC_SELECTOR_RUN_ARB_FUNC_WITH_TASK_ARG_PID,
-      funcAddr, pid, ret0);
-  if (kr == kIOReturnBadArgument || kr == kIOReturnUnsupported) {
-    kr = pandora_run_arb_func_with_task_arg_pid(gClient, 7,
-                                                funcAddr, pid, ret0);
+  return pandora_run_arb_func_with_task_arg_pid(gClient, funcAddr, pid, ret0);
+}
+
+// Chunk size for the userland search fallback.
+#define PANDORA_SEARCH_FALLBACK_CHUNK (64 * 1024)
+
+static kern_return_t pandora_search_local(const pattern_plan *plan,
+                                          uint64_t start, uint64_t size,
+                                          size_t stride, uint64_t *results,
+                                          uint32_t max_results,
+                                          uint32_t *count) {
+  uint8_t *chunk = malloc(PANDORA_SEARCH_FALLBACK_CHUNK);
+  if (!chunk) {
+    return KERN_RESOURCE_SHORTAGE;
   }
-  if (kr == kIOReturnBadArgument || kr == kIOReturnUnsupported) {
-    kr = pandora_run_arb_func_with_task_arg_pid(gClient, 8 /* legacy RUN_ARB */,
-                                                funcAddr, pid, ret0);
+
+  kern_return_t kr = KERN_SUCCESS;
+  uint32_t found = 0;
+  uint64_t off = 0;
+  while (off + plan->len <= size && found < max_results) {
+    size_t chunk_len = (size - off < PANDORA_SEARCH_FALLBACK_CHUNK)
+                           ? (size_t)(size - off)
+                           : PANDORA_SEARCH_FALLBACK_CHUNK;
+    kr = pandora_read_cached(start + off, chunk, chunk_len);
+    if (kr != KERN_SUCCESS) {
+      break;
+    }
+
+    size_t rel = 0;
+    while (found < max_results &&
+           (rel = pattern_find(plan, chunk, chunk_len, rel, stride)) !=
+               PATTERN_NOT_FOUND) {
+      results[found++] = start + off + rel;
+      rel = pattern_next_candidate(chunk_len, rel, stride);
+    }
+    uint64_t advance = pattern_chunk_advance(plan, chunk_len, stride);
+    if (advance >= size - off) {
+      break;
+    }
+    off += advance;
   }
+
+  free(chunk);
+  *count = found;
   return kr;
 }
+
+kern_return_t pd_search_pattern(uint64_t start, uint64_t size,
+                                const uint8_t *pattern, const char *mask,
+                                size_t stride, uint64_t *results,
+                                uint32_t max_results, uint32_t *count) {
+  if (!results || !count || max_results == 0 || size == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  *count = 0;
+
+  pattern_plan plan;
+  if (!pattern_plan_init(&plan, pattern, mask)) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (stride == 0) {
+    stride = plan.len;
+  }
+
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_SEARCH_PATTERN) ||
+      plan.len > PANDORA_SEARCH_MAX_PATTERN) {
+    return pandora_search_local(&plan, start, size, stride, results,
+                                max_results, count);
+  }
+
+  PandoraSearchRequest req = {0};
+  req.start = start;
+  req.size = size;
+  req.stride = stride;
+  req.patternLen = (uint32_t)plan.len;
+  memcpy(req.pattern, pattern, plan.len);
+  memcpy(req.mask, mask, plan.len);
+
+  uint64_t in[] = {(uint64_t)results, max_results};
+  uint64_t out[2] = {0};
+  uint32_t outCnt = 2;
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_SEARCH_PATTERN, in, 2,
+                          &req, sizeof(req), out, &outCnt, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to search 0x%llx-0x%llx: %x\n", (unsigned long long)start,
+           (unsigned long long)(start + size), kr);
+    return kr;
+  }
+
+  *count = (uint32_t)out[0];
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_phys_read(uint64_t paddr, void *buf, size_t len) {
+  if (!buf || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PHYS_READ)) {
+    return kIOReturnUnsupported;
+  }
+
+  for (size_t done = 0; done < len;) {
+    size_t chunk = (len - done < PANDORA_PHYS_READ_MAX_LENGTH)
+                       ? len - done
+                       : (size_t)PANDORA_PHYS_READ_MAX_LENGTH;
+    uint64_t in[] = {(uint64_t)buf + done, paddr + done, chunk};
+    kern_return_t kr = IOConnectCallScalarMethod(
+        gClient, PANDORA_UC_SELECTOR_PHYS_READ, in, 3, NULL, NULL);
+    if (kr != KERN_SUCCESS) {
+      return kr;
+    }
+    done += chunk;
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_phys_dram_range(uint64_t *base, uint64_t *size) {
+  if (!base || !size) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PHYS_INFO)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t out[2] = {0};
+  uint32_t outCnt = 2;
+  kern_return_t kr = IOConnectCallScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_PHYS_INFO, NULL, 0, out, &outCnt);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  *base = out[0];
+  *size = out[1];
+  return KERN_SUCCESS;
+}
+
+static int pandora_phys_scan_read(void *ctx, uint64_t paddr, void *buf,
+                                  size_t len) {
+  (void)ctx;
+  return pd_phys_read(paddr, buf, len) == KERN_SUCCESS ? 0 : -1;
+}
+
+kern_return_t pd_phys_ranges(phys_range *ranges, uint32_t max,
+                             uint32_t *count) {
+  if (!ranges || max == 0 || !count) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PHYS_RANGES)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t out[1] = {0};
+  uint32_t outCnt = 1;
+  size_t outSize = (size_t)max * sizeof(*ranges);
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_PHYS_RANGES, NULL, 0,
+                          NULL, 0, out, &outCnt, ranges, &outSize);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  *count = (uint32_t)out[0];
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_phys_scan_ranges(const phys_range *ranges,
+                                  uint32_t range_count, const uint8_t *pattern,
+                                  const char *mask, size_t stride,
+                                  uint32_t threads, phys_scan_result *result) {
+  phys_scan_params params = {
+      .read = pandora_phys_scan_read,
+      .ctx = NULL,
+      .ranges = ranges,
+      .range_count = range_count,
+      .pattern = pattern,
+      .mask = mask,
+      .stride = stride,
+      .chunk_size = 0,
+      .threads = threads,
+  };
+  return phys_scan(&params, result) == 0 ? KERN_SUCCESS
+                                         : KERN_INVALID_ARGUMENT;
+}
+
+kern_return_t pd_phys_scan(const uint8_t *pattern, const char *mask,
+                           size_t stride, uint32_t threads,
+                           phys_scan_result *result) {
+  phys_range ranges[PANDORA_PHYS_MAX_RANGES];
+  uint32_t count = 0;
+  kern_return_t kr = pd_phys_ranges(ranges, PANDORA_PHYS_MAX_RANGES, &count);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  if (count > PANDORA_PHYS_MAX_RANGES) {
+    count = PANDORA_PHYS_MAX_RANGES;
+  }
+  return pd_phys_scan_ranges(ranges, count, pattern, mask, stride, threads,
+                             result);
+}
+
+kern_return_t pd_vtop_batch(const uint64_t *vaddrs, uint32_t count,
+                            PandoraVToPResult *results, uint32_t *valid) {
+  if (valid) {
+    *valid = 0;
+  }
+  if (!vaddrs || !results || count == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_VTOP_BATCH)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint32_t total = 0;
+  for (uint32_t done = 0; done < count;) {
+    uint32_t n = count - done < PANDORA_VTOP_MAX_ADDRESSES
+                     ? count - done
+                     : PANDORA_VTOP_MAX_ADDRESSES;
+    uint64_t out[1] = {0};
+    uint32_t outCnt = 1;
+    size_t outSize = (size_t)n * sizeof(*results);
+    kern_return_t kr = IOConnectCallMethod(
+        gClient, PANDORA_UC_SELECTOR_VTOP_BATCH, NULL, 0, vaddrs + done,
+        (size_t)n * sizeof(*vaddrs), out, &outCnt, results + done, &outSize);
+    if (kr != KERN_SUCCESS) {
+      printf("Failed to translate %u address(es): %x\n", n, kr);
+      return kr;
+    }
+    total += (uint32_t)out[0];
+    done += n;
+  }
+
+  if (valid) {
+    *valid = total;
+  }
+  return KERN_SUCCESS;
+}
+
+static int pandora_xlate_fill(void *ctx, const uint64_t *vaddrs,
+                              uint32_t count, xlate_page *out) {
+  (void)ctx;
+  PandoraVToPResult results[PANDORA_VTOP_MAX_ADDRESSES];
+  if (count > PANDORA_VTOP_MAX_ADDRESSES ||
+      pd_vtop_batch(vaddrs, count, results, NULL) != KERN_SUCCESS) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    out[i].paddr = results[i].paddr;
+    out[i].flags = ((results[i].flags & PANDORA_VTOP_VALID) ? XLATE_VALID : 0) |
+                   ((results[i].flags & PANDORA_VTOP_WRITABLE) ? XLATE_WRITABLE
+                                                               : 0);
+    out[i].attr = results[i].attr;
+    out[i].shareability = results[i].shareability;
+  }
+  return 0;
+}
+
+int pd_xlate_enable(uint32_t max_runs) {
+  if (gXlateCache) {
+    return 0;
+  }
+
+  gXlateCache =
+      xlate_cache_create(max_runs, PANDORA_PAGE_CACHE_PAGE_SIZE,
+                         PANDORA_VTOP_MAX_ADDRESSES, pandora_xlate_fill, NULL);
+  if (!gXlateCache) {
+    printf("pd_xlate_enable: failed to create translation cache (%u runs)\n",
+           max_runs);
+    return -1;
+  }
+  return 0;
+}
+
+void pd_xlate_disable(void) {
+  xlate_cache_destroy(gXlateCache);
+  gXlateCache = NULL;
+}
+
+size_t pd_xlate_map(uint64_t kaddr, size_t len, xlate_run *runs,
+                    uint32_t max_runs, uint32_t *count) {
+  if (count) {
+    *count = 0;
+  }
+  if (!gXlateCache && pd_xlate_enable(PANDORA_XLATE_DEFAULT_RUNS) != 0) {
+    return 0;
+  }
+  return xlate_cache_map(gXlateCache, kaddr, len, runs, max_runs, count);
+}
+
+void pd_xlate_invalidate(uint64_t kaddr, size_t len) {
+  xlate_cache_invalidate(gXlateCache, kaddr, len);
+}
+
+void pd_xlate_flush(void) { xlate_cache_flush(gXlateCache); }
+
+void pd_xlate_get_stats(xlate_cache_stats *stats) {
+  if (!stats) {
+    return;
+  }
+  memset(stats, 0, sizeof(*stats));
+  xlate_cache_get_stats(gXlateCache, stats);
+}
+
+void pd_xlate_print_stats(void) {
+  xlate_cache_stats stats;
+  pd_xlate_get_stats(&stats);
+
+  uint64_t lookups = stats.hits + stats.misses;
+  printf("translation cache: %llu hits, %llu misses, %llu pages translated "
+         "(%llu unmapped), %llu evictions, %llu invalidations, hit rate "
+         "%.1f%%\n",
+         (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+         (unsigned long long)stats.translated_pages,
+         (unsigned long long)stats.unmapped_pages,
+         (unsigned long long)stats.evictions,
+         (unsigned long long)stats.invalidations,
+         lookups ? (100.0 * (double)stats.hits / (double)lookups) : 0.0);
+}
+
+kern_return_t pd_read_via_phys(uint64_t kaddr, void *buf, size_t len) {
+  if (!buf || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_VTOP_BATCH) ||
+      !pd_supports_selector(PANDORA_UC_SELECTOR_PHYS_READ)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint8_t *out = buf;
+  size_t done = 0;
+  while (done < len) {
+    xlate_run runs[64];
+    uint32_t count = 0;
+    size_t covered = pd_xlate_map(kaddr + done, len - done, runs,
+                                  sizeof(runs) / sizeof(runs[0]), &count);
+    if (covered == 0) {
+      return KERN_INVALID_ADDRESS;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      kern_return_t kr =
+          pd_phys_read(runs[i].paddr, out + (runs[i].vaddr - kaddr),
+                       (size_t)runs[i].len);
+      if (kr != KERN_SUCCESS) {
+        return kr;
+      }
+    }
+    done += covered;
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_translation_regs(uint64_t *ttbr1, uint64_t *tcr) {
+  if (!ttbr1 || !tcr) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_TRANSLATION_REGS)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t out[2] = {0};
+  uint32_t outCnt = 2;
+  kern_return_t kr = IOConnectCallScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_TRANSLATION_REGS, NULL, 0, out, &outCnt);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  *ttbr1 = out[0];
+  *tcr = out[1];
+  return KERN_SUCCESS;
+}
+
+static int pandora_pt_read(void *ctx, uint64_t paddr, void *buf, size_t len) {
+  (void)ctx;
+  return pd_phys_read(paddr, buf, len) == KERN_SUCCESS ? 0 : -1;
+}
+
+kern_return_t pd_kernel_region_map(uint64_t va_start, uint64_t va_end,
+                                   pt_map *map) {
+  if (!map) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  memset(map, 0, sizeof(*map));
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_PHYS_READ)) {
+    return kIOReturnUnsupported;
+  }
+
+  pt_walk_params params = {
+      .read = pandora_pt_read,
+      .ctx = NULL,
+      .va_start = va_start,
+      .va_end = va_end,
+  };
+  kern_return_t kr = pd_translation_regs(&params.ttbr1, &params.tcr);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  if (pt_walk_ttbr1(&params, map) != 0) {
+    printf("Failed to walk kernel page tables (TCR_EL1 0x%llx)\n",
+           (unsigned long long)params.tcr);
+    return KERN_FAILURE;
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_search_pattern_mapped(const pt_map *map, uint64_t start,
+                                       uint64_t size, const uint8_t *pattern,
+                                       const char *mask, size_t stride,
+                                       uint64_t *results, uint32_t max_results,
+                                       uint32_t *count) {
+  if (!map || !results || !count || max_results == 0 || size == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  *count = 0;
+
+  pattern_plan plan;
+  if (!pattern_plan_init(&plan, pattern, mask)) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (stride == 0) {
+    stride = plan.len;
+  }
+
+  const uint64_t end = start + size;
+  size_t i = 0;
+  while (i < map->count && *count < max_results) {
+    // Regions that only differ in attributes are still one readable span.
+    uint64_t lo = map->regions[i].vaddr;
+    uint64_t hi = lo + map->regions[i].size;
+    for (i++; i < map->count && map->regions[i].vaddr == hi; i++) {
+      hi += map->regions[i].size;
+    }
+
+    if (hi <= start || lo >= end) {
+      continue;
+    }
+    lo = lo > start ? lo : start;
+    hi = hi < end ? hi : end;
+    // Stay on the caller's stride grid, which starts at `start`.
+    uint64_t misalign = (lo - start) % stride;
+    uint64_t skip = misalign ? stride - misalign : 0;
+    if (skip >= hi - lo || hi - lo - skip < plan.len) {
+      continue;
+    }
+    uint64_t first = lo + skip;
+
+    uint32_t found = 0;
+    kern_return_t kr = pd_search_pattern(first, hi - first, pattern, mask,
+                                         stride, results + *count,
+                                         max_results - *count, &found);
+    if (kr != KERN_SUCCESS) {
+      return kr;
+    }
+    *count += found;
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_watch_add(const PandoraWatchRule *rule, uint32_t *id) {
+  if (!rule) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_WATCH_ADD)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t out[1] = {0};
+  uint32_t outCnt = 1;
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_WATCH_ADD, NULL, 0, rule,
+                          sizeof(*rule), out, &outCnt, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to add watch rule at 0x%llx: %x\n",
+           (unsigned long long)rule->kaddr, kr);
+    return kr;
+  }
+  if (id) {
+    *id = (uint32_t)out[0];
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_watch_remove(uint32_t id) {
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_WATCH_REMOVE)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {id};
+  return IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_WATCH_REMOVE,
+                                   in, 1, NULL, NULL);
+}
+
+kern_return_t pd_watch_list(PandoraWatchRuleStats *stats, uint32_t max,
+                            uint32_t *count, uint32_t *interval_us,
+                            bool reset) {
+  if (!count || (max && !stats)) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  *count = 0;
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_WATCH_LIST)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {reset ? PANDORA_WATCH_LIST_RESET : 0};
+  uint64_t out[2] = {0};
+  uint32_t outCnt = 2;
+  size_t outSize = (size_t)max * sizeof(*stats);
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_WATCH_LIST, in, 1, NULL,
+                          0, out, &outCnt, max ? stats : NULL, &outSize);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  *count = (uint32_t)out[0];
+  if (interval_us) {
+    *interval_us = (uint32_t)out[1];
+  }
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_watch_set_interval(uint32_t min_us, uint32_t max_us) {
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_WATCH_SET_INTERVAL)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {min_us, max_us};
+  return IOConnectCallScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_WATCH_SET_INTERVAL, in, 2, NULL, NULL);
+}
+
+void pd_watch_print(void) {
+  PandoraWatchRuleStats stats[PANDORA_WATCH_MAX_RULES];
+  uint32_t count = 0;
+  uint32_t interval = 0;
+  kern_return_t kr = pd_watch_list(stats, PANDORA_WATCH_MAX_RULES, &count,
+                                   &interval, false);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to list watch rules: %x\n", kr);
+    return;
+  }
+
+  printf("watch rules: %u, polling every %u us\n", count, interval);
+  for (uint32_t i = 0; i < count && i < PANDORA_WATCH_MAX_RULES; i++) {
+    printf("  #%u 0x%llx%s value 0x%llx: %llu hits, %llu changes, "
+           "%llu faults\n",
+           stats[i].id, (unsigned long long)stats[i].kaddr,
+           (stats[i].flags & PANDORA_WATCH_BUILTIN) ? " (built-in)" : "",
+           (unsigned long long)stats[i].last_value,
+           (unsigned long long)stats[i].hits,
+           (unsigned long long)stats[i].changes,
+           (unsigned long long)stats[i].faults);
+  }
+}
+
+// Fallback for kexts without the kmem selectors: stage through userland.
+static kern_return_t pandora_kmem_local(uint64_t dst, uint64_t src,
+                                        uint8_t value, size_t len,
+                                        bool copy) {
+  uint8_t *buf = malloc(len);
+  if (!buf) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  kern_return_t kr = KERN_SUCCESS;
+  if (copy) {
+    kr = pd_readbuf(src, buf, len);
+  } else {
+    memset(buf, value, len);
+  }
+  if (kr == KERN_SUCCESS) {
+    kr = pd_writebuf(dst, buf, len);
+  }
+  free(buf);
+  return kr;
+}
+
+kern_return_t pd_kmemcpy(uint64_t dst, uint64_t src, size_t len) {
+  if (!dst || !src || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KMEMMOVE)) {
+    return pandora_kmem_local(dst, src, 0, len, true);
+  }
+
+  // Split like memmove so overlapping ranges stay correct across calls.
+  bool backwards = dst > src && dst - src < len;
+  kern_return_t kr = KERN_SUCCESS;
+  for (size_t done = 0; done < len && kr == KERN_SUCCESS;) {
+    size_t chunk = (len - done < PANDORA_KMEM_MAX_LENGTH)
+                       ? len - done
+                       : (size_t)PANDORA_KMEM_MAX_LENGTH;
+    size_t off = backwards ? len - done - chunk : done;
+    uint64_t in[] = {dst + off, src + off, chunk};
+    kr = IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_KMEMMOVE, in,
+                                   3, NULL, NULL);
+    done += chunk;
+  }
+  pandora_cache_invalidate(dst, len);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to copy 0x%zx bytes 0x%llx -> 0x%llx: %x\n", len,
+           (unsigned long long)src, (unsigned long long)dst, kr);
+  }
+  return kr;
+}
+
+kern_return_t pd_kmemset(uint64_t dst, uint8_t value, size_t len) {
+  if (!dst || len == 0) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KMEMSET)) {
+    return pandora_kmem_local(dst, 0, value, len, false);
+  }
+
+  kern_return_t kr = KERN_SUCCESS;
+  for (size_t done = 0; done < len && kr == KERN_SUCCESS;) {
+    size_t chunk = (len - done < PANDORA_KMEM_MAX_LENGTH)
+                       ? len - done
+                       : (size_t)PANDORA_KMEM_MAX_LENGTH;
+    uint64_t in[] = {dst + done, value, chunk};
+    kr = IOConnectCallScalarMethod(gClient, PANDORA_UC_SELECTOR_KMEMSET, in, 3,
+                                   NULL, NULL);
+    done += chunk;
+  }
+  pandora_cache_invalidate(dst, len);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to fill 0x%zx bytes at 0x%llx: %x\n", len,
+           (unsigned long long)dst, kr);
+  }
+  return kr;
+}
+
+kern_return_t pd_katomicv(const PandoraAtomicOp *ops, uint32_t count,
+                          uint32_t flags, PandoraAtomicResult *results,
+                          uint32_t *applied) {
+  if (!ops || !results || count == 0 || count > PANDORA_ATOMIC_MAX_OPS) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (applied) {
+    *applied = 0;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KATOMIC)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {flags};
+  uint64_t out = 0;
+  uint32_t outCnt = 1;
+  size_t outSize = (size_t)count * sizeof(*results);
+  kern_return_t kr = IOConnectCallMethod(
+      gClient, PANDORA_UC_SELECTOR_KATOMIC, in, 1, ops,
+      (size_t)count * sizeof(*ops), &out, &outCnt, results, &outSize);
+  for (uint32_t i = 0; i < count; i++) {
+    pandora_cache_invalidate(ops[i].kaddr, ops[i].width);
+  }
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to apply %u atomic op(s): %x\n", count, kr);
+    return kr;
+  }
+  if (applied) {
+    *applied = (uint32_t)out;
+  }
+  return KERN_SUCCESS;
+}
+
+static kern_return_t pandora_katomic(uint32_t op, uint32_t width,
+                                     uint64_t kaddr, uint64_t operand,
+                                     uint64_t value, uint64_t *previous) {
+  PandoraAtomicOp req = {
+      .kaddr = kaddr,
+      .operand = operand,
+      .value = value,
+      .op = op,
+      .width = width,
+  };
+  PandoraAtomicResult res = {0};
+  kern_return_t kr = pd_katomicv(&req, 1, 0, &res, NULL);
+  if (kr != KERN_SUCCESS) {
+    return kr;
+  }
+  if (previous) {
+    *previous = res.previous;
+  }
+  return res.status;
+}
+
+kern_return_t pd_cas32(uint64_t kaddr, uint32_t expected, uint32_t desired,
+                       uint32_t *previous) {
+  uint64_t prev = 0;
+  kern_return_t kr =
+      pandora_katomic(PANDORA_ATOMIC_CAS, 4, kaddr, expected, desired, &prev);
+  if (previous) {
+    *previous = (uint32_t)prev;
+  }
+  return kr;
+}
+
+kern_return_t pd_cas64(uint64_t kaddr, uint64_t expected, uint64_t desired,
+                       uint64_t *previous) {
+  return pandora_katomic(PANDORA_ATOMIC_CAS, 8, kaddr, expected, desired,
+                         previous);
+}
+
+kern_return_t pd_write_masked32(uint64_t kaddr, uint32_t value, uint32_t mask,
+                                uint32_t *previous) {
+  uint64_t prev = 0;
+  kern_return_t kr = pandora_katomic(PANDORA_ATOMIC_MASKED_WRITE, 4, kaddr,
+                                     mask, value, &prev);
+  if (previous) {
+    *previous = (uint32_t)prev;
+  }
+  return kr;
+}
+
+kern_return_t pd_write_masked64(uint64_t kaddr, uint64_t value, uint64_t mask,
+                                uint64_t *previous) {
+  return pandora_katomic(PANDORA_ATOMIC_MASKED_WRITE, 8, kaddr, mask, value,
+                         previous);
+}
+
+kern_return_t pd_hash_ranges(const PandoraHashRange *ranges, uint32_t count,
+                             uint64_t seed, PandoraHashResult *results) {
+  if (!ranges || !results || count == 0 || count > PANDORA_HASH_MAX_RANGES) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_HASH_RANGES)) {
+    return kIOReturnUnsupported;
+  }
+
+  uint64_t in[] = {seed};
+  size_t outSize = (size_t)count * sizeof(*results);
+  kern_return_t kr = IOConnectCallMethod(
+      gClient, PANDORA_UC_SELECTOR_HASH_RANGES, in, 1, ranges,
+      (size_t)count * sizeof(*ranges), NULL, NULL, results, &outSize);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to hash %u range(s): %x\n", count, kr);
+  }
+  return kr;
+}
+
+static bool pandora_query_read(void *ctx, uint64_t addr, void *out,
+                               size_t len) {
+  (void)ctx;
+  return pandora_read_cached(addr, out, len) == KERN_SUCCESS;
+}
+
+kern_return_t pd_query_run(const qvm_insn *prog, uint32_t count,
+                           const uint64_t *regs, void *out, size_t out_cap,
+                           pd_query_result *result) {
+  if (!result || (out_cap && !out) || out_cap > PANDORA_QUERY_MAX_OUTPUT ||
+      qvm_verify(prog, count) != QVM_OK) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  memset(result, 0, sizeof(*result));
+
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_QUERY_RUN)) {
+    qvm_state st = {0};
+    st.read = pandora_query_read;
+    st.out = out;
+    st.out_cap = out_cap;
+    st.max_steps = PANDORA_QUERY_MAX_STEPS;
+    st.max_read_bytes = PANDORA_QUERY_MAX_READ_BYTES;
+    if (regs) {
+      memcpy(st.regs, regs, sizeof(st.regs));
+    }
+    result->status = qvm_run(prog, count, &st);
+    result->out_len = st.out_len;
+    result->steps = st.steps;
+    result->pc = st.pc;
+    return KERN_SUCCESS;
+  }
+
+  PandoraQueryRequest req = {0};
+  req.insnCount = count;
+  memcpy(req.insns, prog, count * sizeof(*prog));
+  if (regs) {
+    memcpy(req.regs, regs, sizeof(req.regs));
+  }
+
+  uint64_t in[] = {(uint64_t)out, out_cap};
+  uint64_t res[4] = {0};
+  uint32_t outCnt = 4;
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_QUERY_RUN, in, 2, &req,
+                          sizeof(req), res, &outCnt, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to run query: %x\n", kr);
+    return kr;
+  }
+
+  result->status = (qvm_status)res[0];
+  result->out_len = (size_t)res[1];
+  result->steps = res[2];
+  result->pc = (uint32_t)res[3];
+  return KERN_SUCCESS;
+}
+
+kern_return_t pd_walk_list(pd_walk_iter *it, uint64_t head, int64_t next_offset,
+                           int64_t node_bias, const PandoraWalkField *fields,
+                           uint32_t field_count, uint32_t max_nodes) {
+  if (!it || !head || (!fields && field_count) ||
+      field_count > PANDORA_WALK_MAX_FIELDS || max_nodes == 0 ||
+      max_nodes > PANDORA_WALK_MAX_NODES) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  memset(it, 0, sizeof(*it));
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_WALK_LIST)) {
+    return kIOReturnUnsupported;
+  }
+
+  PandoraWalkListRequest req = {0};
+  req.head = head;
+  req.nextOffset = next_offset;
+  req.nodeBias = node_bias;
+  req.maxNodes = max_nodes;
+  req.fieldCount = field_count;
+
+  size_t record_size = sizeof(uint64_t);
+  for (uint32_t i = 0; i < field_count; i++) {
+    if (fields[i].size == 0 || fields[i].size > PANDORA_WALK_MAX_FIELD_SIZE) {
+      return KERN_INVALID_ARGUMENT;
+    }
+    req.fields[i] = fields[i];
+    it->field_offsets[i] = (uint32_t)record_size;
+    record_size += fields[i].size;
+  }
+  record_size = (record_size + 7) & ~(size_t)7;
+
+  size_t buf_len = record_size * max_nodes;
+  uint8_t *records = malloc(buf_len);
+  if (!records) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  uint64_t in[] = {(uint64_t)records, (uint64_t)buf_len};
+  uint64_t out[2] = {0};
+  uint32_t outCnt = 2;
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_WALK_LIST, in, 2, &req,
+                          sizeof(req), out, &outCnt, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    printf("Failed to walk list at 0x%llx: %x\n", (unsigned long long)head, kr);
+    free(records);
+    return kr;
+  }
+
+  it->records = records;
+  it->record_size = record_size;
+  it->count = out[0];
+  it->field_count = field_count;
+  it->end = (PandoraWalkEnd)out[1];
+  return KERN_SUCCESS;
+}
+
+bool pd_walk_next(pd_walk_iter *it, uint64_t *node) {
+  if (!it || !it->records || it->index >= it->count) {
+    return false;
+  }
+  it->index++;
+  if (node) {
+    memcpy(node, it->records + (it->index - 1) * it->record_size,
+           sizeof(*node));
+  }
+  return true;
+}
+
+const void *pd_walk_field(const pd_walk_iter *it, uint32_t index) {
+  if (!it || !it->records || it->index == 0 || index >= it->field_count) {
+    return NULL;
+  }
+  return it->records + (it->index - 1) * it->record_size +
+         it->field_offsets[index];
+}
+
+void pd_walk_free(pd_walk_iter *it) {
+  if (!it) {
+    return;
+  }
+  free(it->records);
+  memset(it, 0, sizeof(*it));
+}
+
+uint32_t pd_module_count(void) { return gModuleCount; }
+
+bool pd_module_info(uint32_t index, PandoraCapabilitiesModule *out) {
+  if (!out || index >= gModuleCount) {
+    return false;
+  }
+  *out = gModules[index];
+  return true;
+}
+
+bool pd_supports_selector(uint32_t selector) {
+  if (gHaveCapabilities) {
+    for (uint32_t i = 0; i < gMethodCount; i++) {
+      if (gMethodSelectors[i] == selector) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Without a handshake only the ops resolved by probing are known.
+  for (int op = 0; op < PANDORA_OP_COUNT; op++) {
+    if (gSelectors[op] == selector) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int pd_get_method_stats(PandoraMethodStats *out, uint32_t max, uint32_t *count,
+                        bool reset) {
+  if (!count || (!out && max)) {
+    return -1;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_METHOD_STATS)) {
+    return -1;
+  }
+
+  size_t replySize = sizeof(PandoraMethodStatsHeader) +
+                     PANDORA_CAPABILITIES_MAX_METHODS * sizeof(PandoraMethodStats);
+  uint8_t *reply = malloc(replySize);
+  if (!reply) {
+    return -1;
+  }
+
+  uint64_t in[] = {reset ? 1 : 0};
+  kern_return_t kr =
+      IOConnectCallMethod(gClient, PANDORA_UC_SELECTOR_METHOD_STATS, in, 1, NULL,
+                          0, NULL, NULL, reply, &replySize);
+  if (kr != KERN_SUCCESS || replySize < sizeof(PandoraMethodStatsHeader)) {
+    printf("Failed to get Pandora method stats: %x\n", kr);
+    free(reply);
+    return -1;
+  }
+
+  PandoraMethodStatsHeader header;
+  memcpy(&header, reply, sizeof(header));
+  if (header.version != PANDORA_METHOD_STATS_VERSION ||
+      header.bucketCount != PANDORA_LATENCY_BUCKETS ||
+      replySize < sizeof(header) + header.count * sizeof(PandoraMethodStats)) {
+    printf("Unexpected Pandora method stats reply (version %u)\n",
+           header.version);
+    free(reply);
+    return -1;
+  }
+
+  uint32_t n = header.count < max ? header.count : max;
+  if (n) {
+    memcpy(out, reply + sizeof(header), n * sizeof(PandoraMethodStats));
+  }
+  *count = header.count;
+  free(reply);
+  return 0;
+}
+
+void pd_print_method_stats(bool reset) {
+  PandoraMethodStats stats[PANDORA_CAPABILITIES_MAX_METHODS];
+  uint32_t count = 0;
+  if (pd_get_method_stats(stats, PANDORA_CAPABILITIES_MAX_METHODS, &count,
+                          reset) != 0) {
+    return;
+  }
+  if (count > PANDORA_CAPABILITIES_MAX_METHODS) {
+    count = PANDORA_CAPABILITIES_MAX_METHODS;
+  }
+
+  printf("%-10s %10s %8s %14s %12s %12s  p50 bucket\n", "selector", "calls",
+         "errors", "bytes", "avg ns", "max ns");
+  for (uint32_t i = 0; i < count; i++) {
+    const PandoraMethodStats *s = &stats[i];
+    if (!s->calls) {
+      continue;
+    }
+
+    // Lower bound of the bucket holding the median call.
+    uint64_t seen = 0;
+    uint32_t median = 0;
+    for (uint32_t b = 0; b < PANDORA_LATENCY_BUCKETS; b++) {
+      seen += s->histogram[b];
+      if (seen * 2 >= s->calls) {
+        median = b;
+        break;
+      }
+    }
+
+    printf("0x%08x %10llu %8llu %14llu %12llu %12llu  >=%llu ns\n", s->selector,
+           (unsigned long long)s->calls, (unsigned long long)s->errors,
+           (unsigned long long)s->bytes,
+           (unsigned long long)(s->totalNanos / s->calls),
+           (unsigned long long)s->maxNanos, 1ull << median);
+  }
+}
+
+int pd_get_access_path_stats(PandoraAccessPathStats *stats, bool reset) {
+  if (!stats) {
+    return -1;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_ACCESS_PATH_STATS)) {
+    return -1;
+  }
+
+  uint64_t in[] = {reset ? 1 : 0};
+  size_t outSize = sizeof(*stats);
+  kern_return_t kr = IOConnectCallMethod(
+      gClient, PANDORA_UC_SELECTOR_ACCESS_PATH_STATS, in, 1, NULL, 0, NULL,
+      NULL, stats, &outSize);
+  if (kr != KERN_SUCCESS || outSize < sizeof(*stats)) {
+    printf("Failed to get Pandora access path stats: %x\n", kr);
+    return -1;
+  }
+  return 0;
+}
+
+int pd_cache_enable(size_t capacity_pages) {
+  if (gPageCache) {
+    return 0;
+  }
+
+  gPageCache = page_cache_create(capacity_pages, PANDORA_PAGE_CACHE_PAGE_SIZE,
+                                 pandora_page_cache_fill, NULL);
+  if (!gPageCache) {
+    printf("pd_cache_enable: failed to create page cache (%zu pages)\n",
+           capacity_pages);
+    return -1;
+  }
+  return 0;
+}
+
+void pd_cache_disable(void) {
+  page_cache_destroy(gPageCache);
+  gPageCache = NULL;
+}
+
+bool pd_cache_enabled(void) { return gPageCache != NULL; }
+
+int pd_cache_add_range(uint64_t start, uint64_t len, page_cache_policy policy,
+                       uint64_t ttl_ms) {
+  return page_cache_add_range(gPageCache, start, len, policy, ttl_ms);
+}
+
+void pd_cache_bump_epoch(void) { page_cache_bump_epoch(gPageCache); }
+
+void pd_cache_invalidate(uint64_t addr, size_t len) {
+  pandora_cache_invalidate(addr, len);
+}
+
+void pd_cache_get_stats(page_cache_stats *stats) {
+  if (!stats) {
+    return;
+  }
+  memset(stats, 0, sizeof(*stats));
+  page_cache_get_stats(gPageCache, stats);
+}
+
+void pd_cache_print_stats(void) {
+  page_cache_stats stats;
+  pd_cache_get_stats(&stats);
+
+  uint64_t lookups = stats.hits + stats.misses;
+  printf("page cache: %llu hits, %llu misses (%llu expired) in %llu fills, "
+         "%llu evictions, %llu invalidations, %llu bypass reads (%llu large), "
+         "hit rate %.1f%%\n",
+         (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+         (unsigned long long)stats.expired, (unsigned long long)stats.fills,
+         (unsigned long long)stats.evictions,
+         (unsigned long long)stats.invalidations,
+         (unsigned long long)stats.bypass_reads,
+         (unsigned long long)stats.large_reads,
+         lookups ? (100.0 * (double)stats.hits / (double)lookups) : 0.0);
+}
+
+static void pandora_async_complete(void *refcon, IOReturn result, void *arg0) {
+  async_slots_complete(gAsyncSlots, (async_slot *)refcon, result,
+                       (uint64_t)(uintptr_t)arg0);
+}
+
+static int pandora_async_poll(void *ctx, int timeout_ms) {
+  (void)ctx;
+  return pd_poll(timeout_ms);
+}
+
+static async_slot *pandora_async_acquire(pd_async_callback cb, void *ctx) {
+  if (!gAsyncPort || !gAsyncSlots) {
+    return NULL;
+  }
+  return async_slots_acquire(gAsyncSlots, cb, ctx);
+}
+
+static void pandora_async_release(async_slot *slot) {
+  async_slots_release(gAsyncSlots, slot);
+}
+
+static void pandora_async_reference(async_slot *slot,
+                                    uint64_t ref[kOSAsyncRef64Count]) {
+  memset(ref, 0, sizeof(uint64_t) * kOSAsyncRef64Count);
+  ref[kIOAsyncCalloutFuncIndex] = (uint64_t)(uintptr_t)pandora_async_complete;
+  ref[kIOAsyncCalloutRefconIndex] = (uint64_t)(uintptr_t)slot;
+}
+
+int pd_async_init(uint32_t depth) {
+  if (!MACH_PORT_VALID(gClient)) {
+    return -1;
+  }
+  if (gAsyncPort) {
+    return 0;
+  }
+
+  if (depth == 0 || depth > PANDORA_ASYNC_MAX_IN_FLIGHT) {
+    depth = PANDORA_ASYNC_MAX_IN_FLIGHT;
+  }
+
+  gAsyncSlots = async_slots_create(depth, pandora_async_poll, NULL);
+  if (!gAsyncSlots) {
+    return -1;
+  }
+
+  gAsyncPort = IONotificationPortCreate(kIOMainPortDefault);
+  if (!gAsyncPort) {
+    printf("Failed to create async notification port\n");
+    async_slots_destroy(gAsyncSlots);
+    gAsyncSlots = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+void pd_async_deinit(void) {
+  if (!gAsyncPort) {
+    return;
+  }
+
+  async_slots_drain(gAsyncSlots);
+
+  IONotificationPortDestroy(gAsyncPort);
+  gAsyncPort = NULL;
+  async_slots_destroy(gAsyncSlots);
+  gAsyncSlots = NULL;
+}
+
+kern_return_t pd_read_async(uint64_t addr, void *buf, size_t len,
+                            pd_async_callback cb, void *ctx) {
+  if (!buf || !len || len > PANDORA_ASYNC_MAX_TRANSFER) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KREAD_ASYNC)) {
+    return kIOReturnUnsupported;
+  }
+
+  async_slot *slot = pandora_async_acquire(cb, ctx);
+  if (!slot) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  uint64_t ref[kOSAsyncRef64Count];
+  pandora_async_reference(slot, ref);
+  uint64_t in[] = {addr, (uint64_t)(uintptr_t)buf, (uint64_t)len};
+  kern_return_t kr = IOConnectCallAsyncScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_KREAD_ASYNC,
+      IONotificationPortGetMachPort(gAsyncPort), ref, kOSAsyncRef64Count, in,
+      3, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    pandora_async_release(slot);
+  }
+  return kr;
+}
+
+kern_return_t pd_write_async(uint64_t addr, const void *buf, size_t len,
+                             pd_async_callback cb, void *ctx) {
+  if (!buf || !len || len > PANDORA_ASYNC_MAX_TRANSFER) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KWRITE_ASYNC)) {
+    return kIOReturnUnsupported;
+  }
+
+  async_slot *slot = pandora_async_acquire(cb, ctx);
+  if (!slot) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  pandora_cache_invalidate(addr, len);
+  uint64_t ref[kOSAsyncRef64Count];
+  pandora_async_reference(slot, ref);
+  uint64_t in[] = {(uint64_t)(uintptr_t)buf, addr, (uint64_t)len};
+  kern_return_t kr = IOConnectCallAsyncScalarMethod(
+      gClient, PANDORA_UC_SELECTOR_KWRITE_ASYNC,
+      IONotificationPortGetMachPort(gAsyncPort), ref, kOSAsyncRef64Count, in,
+      3, NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    pandora_async_release(slot);
+  }
+  return kr;
+}
+
+kern_return_t pd_kcall_async(const PandoraKCallRequest *req,
+                             pd_async_callback cb, void *ctx) {
+  if (!req || req->argCount > 8) {
+    return KERN_INVALID_ARGUMENT;
+  }
+  if (!pd_supports_selector(PANDORA_UC_SELECTOR_KCALL_ASYNC)) {
+    return kIOReturnUnsupported;
+  }
+
+  async_slot *slot = pandora_async_acquire(cb, ctx);
+  if (!slot) {
+    return KERN_RESOURCE_SHORTAGE;
+  }
+
+  uint64_t ref[kOSAsyncRef64Count];
+  pandora_async_reference(slot, ref);
+  kern_return_t kr = IOConnectCallAsyncStructMethod(
+      gClient, PANDORA_UC_SELECTOR_KCALL_ASYNC,
+      IONotificationPortGetMachPort(gAsyncPort), ref, kOSAsyncRef64Count, req,
+      sizeof(*req), NULL, NULL);
+  if (kr != KERN_SUCCESS) {
+    pandora_async_release(slot);
+  }
+  return kr;
+}
+
+int pd_poll(int timeout_ms) {
+  if (!gAsyncPort) {
+    return -1;
+  }
+
+  union {
+    mach_msg_header_t header;
+    uint8_t storage[1024];
+  } msg;
+
+  mach_port_t port = IONotificationPortGetMachPort(gAsyncPort);
+  int dispatched = 0;
+  mach_msg_option_t options = MACH_RCV_MSG;
+  mach_msg_timeout_t timeout = MACH_MSG_TIMEOUT_NONE;
+  if (timeout_ms >= 0) {
+    options |= MACH_RCV_TIMEOUT;
+    timeout = (mach_msg_timeout_t)timeout_ms;
+  }
+
+  // Wait for the first completion, then drain whatever else is queued.
+  for (;;) {
+    mach_msg_return_t mr =
+        mach_msg(&msg.header, options, 0, sizeof(msg), port, timeout,
+                 MACH_PORT_NULL);
+    if (mr == MACH_RCV_TIMED_OUT) {
+      return dispatched;
+    }
+    if (mr != MACH_MSG_SUCCESS) {
+      printf("pd_poll: mach_msg failed: %x\n", mr);
+      return dispatched ? dispatched : -1;
+    }
+
+    IODispatchCalloutFromMessage(NULL, &msg.header, gAsyncPort);
+    dispatched++;
+    options |= MACH_RCV_TIMEOUT;
+    timeout = 0;
+  }
+}
+
+uint32_t pd_async_in_flight(void) { return async_slots_in_flight(gAsyncSlots); }
@@ -6,6 +6,15 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "calypso/kcall_chain.h"
+#include "calypso/query_vm.h"
+#include "kernel/page_cache.h"
+#include "kernel/phys_scan.h"
+#include "kernel/pt_walk.h"
+#include "kernel/xlate_cache.h"
+#include "kernel/read_window.h"
+#include "kernel/readv.h"
+
 // Structure for holding both types of timestamps for debugging
 typedef struct {
   uint64_t machTime;       // mach_absolute_time value
@@ -24,6 +33,9 @@ typedef struct {
       user_client_init_time; // Timestamp when the last user client was
                              // initialized. 0 if not initialized yet
   bool pid1_exists; // Whether PID 1 (launchd) exists at the time of kext start
+  uint64_t bounce_pool_hits;    // Transfers served from a pooled bounce buffer
+  uint64_t bounce_pool_misses;  // Transfers that had to allocate one
+  uint64_t kernel_base_scan_ns; // Time the kext spent locating the kernel base
 } PandoraMetadata;
 
 // ---------------------------------------------------------------------------
@@ -32,11 +44,13 @@ typedef struct {
 // Note: The Kext and Library historically drifted on selector numbering.
 // The current Kext expects module-scoped selectors:
 //   selector = (module_id << 16) | local_selector
-// The library wrappers keep runtime fallback to legacy unscoped selectors.
+// pd_init() asks the kext for its selector list once (or probes older kexts
+// once) and every wrapper uses the resolved selector from then on.
 // ---------------------------------------------------------------------------
 typedef enum {
   PANDORA_UC_MODULE_ID_HW_ACCESS = 0x0001,
   PANDORA_UC_MODULE_ID_PATCH_OSVARIANT = 0x0002,
+  PANDORA_UC_MODULE_ID_CORE = 0x00FF,
 } PandoraUserClientModuleId;
 
 #define PANDORA_UC_MODULE_SELECTOR_SHIFT 16u
@@ -53,9 +67,45 @@ typedef enum {
   PANDORA_UC_LOCAL_SELECTOR_PWRITE_PID = 5,
   PANDORA_UC_LOCAL_SELECTOR_KCALL = 7,
   PANDORA_UC_LOCAL_SELECTOR_RUN_ARB_FUNC_WITH_TASK_ARG_PID = 8,
+  PANDORA_UC_LOCAL_SELECTOR_KREADV = 9,
+  PANDORA_UC_LOCAL_SELECTOR_KWRITEV = 10,
+  PANDORA_UC_LOCAL_SELECTOR_KREAD_WINDOW = 11,
+  PANDORA_UC_LOCAL_SELECTOR_KREAD_ASYNC = 12,
+  PANDORA_UC_LOCAL_SELECTOR_KWRITE_ASYNC = 13,
+  PANDORA_UC_LOCAL_SELECTOR_KCALL_ASYNC = 14,
+  PANDORA_UC_LOCAL_SELECTOR_WALK_LIST = 15,
+  PANDORA_UC_LOCAL_SELECTOR_SEARCH_PATTERN = 16,
+  PANDORA_UC_LOCAL_SELECTOR_ACCESS_PATH_STATS = 17,
+  PANDORA_UC_LOCAL_SELECTOR_PROC_OPEN = 18,
+  PANDORA_UC_LOCAL_SELECTOR_PROC_CLOSE = 19,
+  PANDORA_UC_LOCAL_SELECTOR_PROC_READ = 20,
+  PANDORA_UC_LOCAL_SELECTOR_PROC_WRITE = 21,
+  PANDORA_UC_LOCAL_SELECTOR_PREADV = 22,
+  PANDORA_UC_LOCAL_SELECTOR_KCALL_BATCH = 23,
+  PANDORA_UC_LOCAL_SELECTOR_QUERY_RUN = 24,
+  PANDORA_UC_LOCAL_SELECTOR_HASH_RANGES = 25,
+  PANDORA_UC_LOCAL_SELECTOR_KATOMIC = 26,
+  PANDORA_UC_LOCAL_SELECTOR_KMEMMOVE = 27,
+  PANDORA_UC_LOCAL_SELECTOR_KMEMSET = 28,
+  PANDORA_UC_LOCAL_SELECTOR_PHYS_READ = 29,
+  PANDORA_UC_LOCAL_SELECTOR_PHYS_INFO = 30,
+  PANDORA_UC_LOCAL_SELECTOR_VTOP_BATCH = 31,
+  PANDORA_UC_LOCAL_SELECTOR_TRANSLATION_REGS = 32,
+  PANDORA_UC_LOCAL_SELECTOR_PHYS_RANGES = 33,
 } PandoraHwAccessLocalSelector;
 
 typedef enum {
+  PANDORA_UC_LOCAL_SELECTOR_WATCH_ADD = 0,
+  PANDORA_UC_LOCAL_SELECTOR_WATCH_REMOVE = 1,
+  PANDORA_UC_LOCAL_SELECTOR_WATCH_LIST = 2,
+  PANDORA_UC_LOCAL_SELECTOR_WATCH_SET_INTERVAL = 3,
+} PandoraPatchOsVariantLocalSelector;
+
+typedef enum {
+  PANDORA_UC_SELECTOR_CAPABILITIES =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_CORE, 0),
+  PANDORA_UC_SELECTOR_METHOD_STATS =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_CORE, 1),
   PANDORA_UC_SELECTOR_KREAD =
       PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
                                   PANDORA_UC_LOCAL_SELECTOR_KREAD),
@@ -81,21 +131,414 @@ typedef enum {
       PANDORA_UC_SELECTOR_COMPOSE(
           PANDORA_UC_MODULE_ID_HW_ACCESS,
           PANDORA_UC_LOCAL_SELECTOR_RUN_ARB_FUNC_WITH_TASK_ARG_PID),
+  PANDORA_UC_SELECTOR_KREADV =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KREADV),
+  PANDORA_UC_SELECTOR_KWRITEV =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KWRITEV),
+  PANDORA_UC_SELECTOR_KREAD_WINDOW =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KREAD_WINDOW),
+  PANDORA_UC_SELECTOR_KREAD_ASYNC =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KREAD_ASYNC),
+  PANDORA_UC_SELECTOR_KWRITE_ASYNC =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KWRITE_ASYNC),
+  PANDORA_UC_SELECTOR_KCALL_ASYNC =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KCALL_ASYNC),
+  PANDORA_UC_SELECTOR_WALK_LIST =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_WALK_LIST),
+  PANDORA_UC_SELECTOR_SEARCH_PATTERN =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_SEARCH_PATTERN),
+  PANDORA_UC_SELECTOR_ACCESS_PATH_STATS =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_ACCESS_PATH_STATS),
+  PANDORA_UC_SELECTOR_PROC_OPEN =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PROC_OPEN),
+  PANDORA_UC_SELECTOR_PROC_CLOSE =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PROC_CLOSE),
+  PANDORA_UC_SELECTOR_PROC_READ =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PROC_READ),
+  PANDORA_UC_SELECTOR_PROC_WRITE =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PROC_WRITE),
+  PANDORA_UC_SELECTOR_PREADV =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PREADV),
+  PANDORA_UC_SELECTOR_KCALL_BATCH =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KCALL_BATCH),
+  PANDORA_UC_SELECTOR_QUERY_RUN =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_QUERY_RUN),
+  PANDORA_UC_SELECTOR_HASH_RANGES =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_HASH_RANGES),
+  PANDORA_UC_SELECTOR_KATOMIC =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KATOMIC),
+  PANDORA_UC_SELECTOR_KMEMMOVE =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KMEMMOVE),
+  PANDORA_UC_SELECTOR_KMEMSET =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_KMEMSET),
+  PANDORA_UC_SELECTOR_PHYS_READ =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PHYS_READ),
+  PANDORA_UC_SELECTOR_PHYS_INFO =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PHYS_INFO),
+  PANDORA_UC_SELECTOR_VTOP_BATCH =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_VTOP_BATCH),
+  PANDORA_UC_SELECTOR_TRANSLATION_REGS =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_TRANSLATION_REGS),
+  PANDORA_UC_SELECTOR_PHYS_RANGES =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_HW_ACCESS,
+                                  PANDORA_UC_LOCAL_SELECTOR_PHYS_RANGES),
+  PANDORA_UC_SELECTOR_WATCH_ADD =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_PATCH_OSVARIANT,
+                                  PANDORA_UC_LOCAL_SELECTOR_WATCH_ADD),
+  PANDORA_UC_SELECTOR_WATCH_REMOVE =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_PATCH_OSVARIANT,
+                                  PANDORA_UC_LOCAL_SELECTOR_WATCH_REMOVE),
+  PANDORA_UC_SELECTOR_WATCH_LIST =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_PATCH_OSVARIANT,
+                                  PANDORA_UC_LOCAL_SELECTOR_WATCH_LIST),
+  PANDORA_UC_SELECTOR_WATCH_SET_INTERVAL =
+      PANDORA_UC_SELECTOR_COMPOSE(PANDORA_UC_MODULE_ID_PATCH_OSVARIANT,
+                                  PANDORA_UC_LOCAL_SELECTOR_WATCH_SET_INTERVAL),
 } PandoraUserClientSelector;
 
-// Request/response for the kernel-call interface.
+// Reply of PANDORA_UC_SELECTOR_CAPABILITIES: a header followed by
+// `moduleCount` module records and `methodCount` method records.
+#define PANDORA_CAPABILITIES_VERSION 1
+#define PANDORA_CAPABILITIES_NAME_SIZE 32
+#define PANDORA_CAPABILITIES_MAX_MODULES 16
+#define PANDORA_CAPABILITIES_MAX_METHODS 128
+
 typedef struct {
-  uint64_t fn;       // kernel VA of function to call
-  uint32_t argCount; // number of args used (<= 8)
+  uint32_t version;
+  uint32_t moduleCount;
+  uint32_t methodCount;
   uint32_t reserved;
-  uint64_t args[8];
-} PandoraKCallRequest;
+} PandoraCapabilitiesHeader;
+
+typedef struct {
+  uint16_t identifier;
+  uint8_t enabled;
+  uint8_t started;
+  kern_return_t startError;
+  char name[PANDORA_CAPABILITIES_NAME_SIZE];
+} PandoraCapabilitiesModule;
+
+typedef struct {
+  uint32_t selector;
+  uint32_t scalarInputCount;
+  uint32_t structureInputSize;
+  uint32_t scalarOutputCount;
+  uint32_t structureOutputSize;
+} PandoraCapabilitiesMethod;
+
+// Reply of PANDORA_UC_SELECTOR_METHOD_STATS: a header followed by `count`
+// records. Histogram bucket i counts calls that took [2^i, 2^(i+1)) ns.
+#define PANDORA_METHOD_STATS_VERSION 1
+#define PANDORA_LATENCY_BUCKETS 32
+
+typedef struct {
+  uint32_t version;
+  uint32_t count;
+  uint32_t bucketCount;
+  uint32_t reserved;
+} PandoraMethodStatsHeader;
+
+typedef struct {
+  uint32_t selector;
+  uint32_t reserved;
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t bytes; // bytes moved by successful calls
+  uint64_t totalNanos;
+  uint64_t maxNanos;
+  uint64_t histogram[PANDORA_LATENCY_BUCKETS];
+} PandoraMethodStats;
+
+// Reply of PANDORA_UC_SELECTOR_ACCESS_PATH_STATS: how kernel reads and writes
+// were served. "physmap_cached" accesses went straight to the physmap path
+// because their page had failed an IOMemoryDescriptor prepare before.
+typedef struct {
+  uint64_t iomd_reads;
+  uint64_t iomd_writes;
+  uint64_t physmap_cached_reads;
+  uint64_t physmap_cached_writes;
+  uint64_t fallback_reads;
+  uint64_t fallback_writes;
+  uint64_t failed_reads;
+  uint64_t failed_writes;
+  uint64_t cached_pages;
+} PandoraAccessPathStats;
+
+// Memory type passed to IOConnectMapMemory64 for the shared read window the
+// kext fills directly for PANDORA_UC_SELECTOR_KREAD_WINDOW.
+#define PANDORA_UC_MEMORY_TYPE_READ_WINDOW 0
+
+// pd_readbuf() requests of at least this many bytes are served through the
+// shared read window (when mapped) instead of a per-call kernel bounce buffer.
+#define PANDORA_READ_WINDOW_THRESHOLD READ_WINDOW_THRESHOLD
+
+// Request/response for the kernel-call interface.
+// chainMask is for pd_kcall_batch() only and must be 0 otherwise.
+typedef kcall_request PandoraKCallRequest;
 
 typedef struct {
   kern_return_t status;
   uint64_t ret0;
 } PandoraKCallResponse;
 
+// Scratch kernel buffer for pd_kcall_buffers(). The kext allocates `size`
+// bytes, fills them from `uaddr` (PANDORA_KCALL_BUFFER_IN) or zeroes them,
+// passes their kernel address as args[argIndex] and copies them back to
+// `uaddr` after the call (PANDORA_KCALL_BUFFER_OUT).
+typedef struct {
+  uint64_t uaddr;
+  uint32_t size;
+  uint8_t argIndex;
+  uint8_t flags;
+  uint16_t reserved;
+} PandoraKCallBuffer;
+
+#define PANDORA_KCALL_BUFFER_IN (1u << 0)
+#define PANDORA_KCALL_BUFFER_OUT (1u << 1)
+#define PANDORA_KCALL_MAX_BUFFERS 4
+#define PANDORA_KCALL_MAX_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+  PandoraKCallRequest call;
+  uint32_t bufferCount;
+  uint32_t reserved;
+  PandoraKCallBuffer buffers[PANDORA_KCALL_MAX_BUFFERS];
+} PandoraKCallMarshalledRequest;
+
+// Result of one call in pd_kcall_batch(). `elapsed` is in mach_absolute_time
+// ticks.
+typedef kcall_timed_response PandoraKCallTimedResponse;
+
+#define PANDORA_KCALL_BATCH_MAX 64
+#define PANDORA_KCALL_BATCH_LOG (1u << 0)
+// Argument value standing for ret0 of call `index` in the same batch plus a
+// signed `offset` in bytes. Set the argument's bit in chainMask to use it.
+#define PANDORA_KCALL_CHAIN(index, offset) KCALL_CHAIN(index, offset)
+
+// Scatter-gather read descriptor: `len` bytes at `kaddr` are copied to
+// `offset` within the output buffer passed to pd_readv().
+typedef readv_desc PandoraKReadVDescriptor;
+
+// Vectored write run: `len` bytes at `offset` within the payload passed to
+// pd_writev() are written to `kaddr`.
+typedef struct {
+  uint64_t kaddr;
+  uint32_t len;
+  uint32_t offset;
+} PandoraKWriteVRun;
+
+// Wire header preceding the runs and payload of a kwritev request.
+typedef struct {
+  uint32_t count;
+  uint32_t reserved;
+} PandoraKWriteVHeader;
+
+#define PANDORA_KWRITEV_MAX_RUNS 1024
+#define PANDORA_KWRITEV_MAX_INPUT_SIZE (1024 * 1024)
+
+// Kext-side limits for the asynchronous selectors (in-flight is per client).
+#define PANDORA_ASYNC_MAX_IN_FLIGHT 256
+#define PANDORA_ASYNC_MAX_TRANSFER (1024 * 1024)
+
+// One field projected out of every node by PANDORA_UC_SELECTOR_WALK_LIST.
+// Indirect fields load the pointer at `offset`, strip it, and read `size`
+// bytes at `indirectOffset` from it (zero-filled when the pointer is NULL).
+typedef struct {
+  int32_t offset;
+  uint32_t size;
+  int32_t indirectOffset;
+  uint32_t flags;
+} PandoraWalkField;
+
+#define PANDORA_WALK_FIELD_INDIRECT (1u << 0)
+#define PANDORA_WALK_MAX_FIELDS 16
+#define PANDORA_WALK_MAX_FIELD_SIZE 512
+#define PANDORA_WALK_MAX_NODES 65536
+
+typedef struct {
+  uint64_t head;
+  int64_t nextOffset;
+  int64_t nodeBias;
+  uint32_t maxNodes;
+  uint32_t fieldCount;
+  PandoraWalkField fields[PANDORA_WALK_MAX_FIELDS];
+} PandoraWalkListRequest;
+
+// Why a list walk stopped.
+typedef enum {
+  PANDORA_WALK_END_NULL = 0,        // next pointer was NULL
+  PANDORA_WALK_END_HEAD = 1,        // list wrapped back to the head
+  PANDORA_WALK_END_LOOP = 2,        // cycle not through the head
+  PANDORA_WALK_END_LIMIT = 3,       // max_nodes reached
+  PANDORA_WALK_END_FAULT = 4,       // a node could not be read
+  PANDORA_WALK_END_BAD_POINTER = 5, // next pointer is not a kernel address
+} PandoraWalkEnd;
+
+// Wire request of PANDORA_UC_SELECTOR_SEARCH_PATTERN. `mask` is not
+// NUL-terminated; it holds `patternLen` 'x'/'?' characters.
+#define PANDORA_SEARCH_MAX_PATTERN 256
+
+typedef struct {
+  uint64_t start;
+  uint64_t size;
+  uint64_t stride;
+  uint32_t patternLen;
+  uint32_t reserved;
+  uint8_t pattern[PANDORA_SEARCH_MAX_PATTERN];
+  char mask[PANDORA_SEARCH_MAX_PATTERN];
+} PandoraSearchRequest;
+
+// Records returned by pd_walk_list(). Each record is the node address
+// followed by the requested fields back to back, padded to 8 bytes.
+typedef struct {
+  uint8_t *records;
+  size_t record_size;
+  uint64_t count;
+  uint64_t index;
+  uint32_t field_count;
+  uint32_t field_offsets[PANDORA_WALK_MAX_FIELDS];
+  PandoraWalkEnd end;
+} pd_walk_iter;
+
+// Wire request of PANDORA_UC_SELECTOR_QUERY_RUN (see calypso/query_vm.h).
+// Zero limits mean the kext's maxima.
+#define PANDORA_QUERY_MAX_STEPS (1u << 20)
+#define PANDORA_QUERY_MAX_READ_BYTES (16u * 1024 * 1024)
+#define PANDORA_QUERY_MAX_OUTPUT (64 * 1024)
+
+typedef struct {
+  uint32_t insnCount;
+  uint32_t reserved;
+  uint64_t maxSteps;
+  uint64_t maxReadBytes;
+  uint64_t regs[QVM_NUM_REGS];
+  qvm_insn insns[QVM_MAX_INSNS];
+} PandoraQueryRequest;
+
+typedef struct {
+  qvm_status status;
+  size_t out_len; // bytes emitted into `out`
+  uint64_t steps;
+  uint32_t pc;    // instruction the program stopped at
+} pd_query_result;
+
+// Ranges for pd_hash_ranges(). Each digest is xxh64() of the range's bytes
+// (see calypso/xxhash64.h).
+#define PANDORA_HASH_MAX_RANGES 256
+#define PANDORA_HASH_MAX_TOTAL_BYTES (256ull * 1024 * 1024)
+
+typedef struct {
+  uint64_t kaddr;
+  uint64_t len;
+} PandoraHashRange;
+
+typedef struct {
+  uint64_t hash;
+  kern_return_t status;
+  uint32_t reserved;
+} PandoraHashResult;
+
+// One entry of an atomic patch set for pd_katomicv().
+// PANDORA_ATOMIC_CAS stores `value` if the word holds `operand`;
+// PANDORA_ATOMIC_MASKED_WRITE replaces the bits set in `operand` with those
+// of `value`. `width` is 4 or 8 and `kaddr` must be aligned to it.
+#define PANDORA_ATOMIC_CAS 0
+#define PANDORA_ATOMIC_MASKED_WRITE 1
+#define PANDORA_ATOMIC_MAX_OPS 128
+#define PANDORA_ATOMIC_STOP_ON_FAILURE (1u << 0)
+
+typedef struct {
+  uint64_t kaddr;
+  uint64_t operand;
+  uint64_t value;
+  uint32_t op;
+  uint32_t width;
+} PandoraAtomicOp;
+
+// `previous` is the word's value before the operation. A compare-and-swap
+// that found another value fails with kIOReturnNotPermitted and reports it.
+typedef struct {
+  uint64_t previous;
+  kern_return_t status;
+  uint32_t reserved;
+} PandoraAtomicResult;
+
+// Result of pd_vtop_batch() for one kernel VA, decoded from PAR_EL1. `attr`
+// is the MAIR attribute byte of the mapping and `shareability` PAR_EL1.SH.
+#define PANDORA_VTOP_VALID (1u << 0)
+#define PANDORA_VTOP_WRITABLE (1u << 1)
+#define PANDORA_VTOP_MAX_ADDRESSES 256
+
+typedef struct {
+  uint64_t paddr;
+  uint32_t flags;
+  uint8_t attr;
+  uint8_t shareability;
+  uint16_t reserved;
+} PandoraVToPResult;
+
+// Watch/enforce rule for pd_watch_add(). The rule matches when the masked
+// word equals `expected` (with PANDORA_WATCH_ENFORCE_ALWAYS: whenever it
+// differs from `enforced`); the kext then swaps in the masked bits of
+// `enforced`. PANDORA_WATCH_OBSERVE_ONLY rules never write and count each
+// time they start matching. `width` is 4 or 8 and `kaddr` aligned to it.
+#define PANDORA_WATCH_ENFORCE_ALWAYS (1u << 0)
+#define PANDORA_WATCH_OBSERVE_ONLY (1u << 1)
+#define PANDORA_WATCH_BUILTIN (1u << 31)
+#define PANDORA_WATCH_MAX_RULES 64
+#define PANDORA_WATCH_LIST_RESET (1u << 0)
+
+typedef struct {
+  uint64_t kaddr;
+  uint64_t mask;
+  uint64_t expected;
+  uint64_t enforced;
+  uint32_t width;
+  uint32_t flags;
+} PandoraWatchRule;
+
+// `hits` counts enforced writes (or matches of observe-only rules),
+// `changes` values that differed from the previous pass, `faults` failed
+// reads and writes.
+typedef struct {
+  uint32_t id;
+  uint32_t flags;
+  uint64_t kaddr;
+  uint64_t last_value;
+  uint64_t hits;
+  uint64_t changes;
+  uint64_t faults;
+} PandoraWatchRuleStats;
+
+// Completion callback for the asynchronous API. `value` is the number of bytes
+// transferred for reads/writes and ret0 for kernel calls.
+typedef void (*pd_async_callback)(void *ctx, kern_return_t status,
+                                  uint64_t value);
+
 extern uint64_t pd_kbase;
 extern uint64_t pd_kslide;
 
@@ -106,17 +549,49 @@ extern uint64_t pd_kslide;
 int pd_init(void);
 void pd_deinit(void);
 
+/* Capabilities */
+// Module list from the pd_init() handshake; empty for kexts that predate it.
+uint32_t pd_module_count(void);
+bool pd_module_info(uint32_t index, PandoraCapabilitiesModule *out);
+// Whether the connected kext serves `selector` (a PANDORA_UC_SELECTOR_*).
+bool pd_supports_selector(uint32_t selector);
+// Copies up to `max` per-selector statistics records and stores the number
+// the kext reported in `count`. `reset` clears the kext counters after the
+// read. Returns 0 on success.
+int pd_get_method_stats(PandoraMethodStats *out, uint32_t max, uint32_t *count,
+                        bool reset);
+void pd_print_method_stats(bool reset);
+// Reads the kext's kread/kwrite path counters. `reset` also forgets every
+// page it learned needs the physmap path. Returns 0 on success.
+int pd_get_access_path_stats(PandoraAccessPathStats *stats, bool reset);
+
 /* Virtual read/write */
 uint8_t pd_read8(uint64_t addr);
 uint16_t pd_read16(uint64_t addr);
 uint32_t pd_read32(uint64_t addr);
 uint64_t pd_read64(uint64_t addr);
 int pd_readbuf(uint64_t addr, void *buf, size_t len);
+// Serves all descriptors with as few kernel transitions as possible. Returns
+// KERN_SUCCESS if every descriptor succeeded, KERN_FAILURE if some failed (see
+// `statuses`, one per descriptor), or the transport error.
+kern_return_t pd_readv(const PandoraKReadVDescriptor *descs, uint32_t count,
+                       void *buf, size_t len, kern_return_t *statuses);
 kern_return_t pd_write8(uint64_t addr, uint8_t val);
 kern_return_t pd_write16(uint64_t addr, uint16_t val);
 kern_return_t pd_write32(uint64_t addr, uint32_t val);
 kern_return_t pd_write64(uint64_t addr, uint64_t val);
 kern_return_t pd_writebuf(uint64_t addr, const void *buf, size_t len);
+// Writes every run in as few kernel transitions as the request size limit
+// allows (one for any patch up to ~1 MB). Stops at the first failing run.
+kern_return_t pd_writev(const PandoraKWriteVRun *runs, uint32_t count,
+                        const void *payload, size_t payload_len);
+// Kernel-to-kernel copy (overlapping ranges are fine) and fill, done inside
+// the kext without bouncing the data through userland. At most
+// PANDORA_KMEM_MAX_LENGTH bytes per kernel call; longer ranges are split.
+// Kexts without the selectors get a pd_readbuf()/pd_writebuf() round trip.
+#define PANDORA_KMEM_MAX_LENGTH (64ull * 1024 * 1024)
+kern_return_t pd_kmemcpy(uint64_t dst, uint64_t src, size_t len);
+kern_return_t pd_kmemset(uint64_t dst, uint8_t value, size_t len);
 
 /* Process read/write (by PID) */
 uint8_t pd_pread8(pid_t pid, uint64_t addr);
@@ -131,6 +606,31 @@ kern_return_t pd_pwrite64(pid_t pid, uint64_t addr, uint64_t val);
 kern_return_t pd_pwritebuf(pid_t pid, uint64_t addr, const void *buf,
                            size_t len);
 
+/* Process read/write (by handle) */
+// A handle pins the process's task in the kext until pd_proc_close() or until
+// the connection goes away, so repeated accesses skip the pid lookup. The kext
+// allows up to PANDORA_MAX_PROC_HANDLES open handles per connection.
+#define PANDORA_MAX_PROC_HANDLES 64
+typedef uint64_t pd_proc_handle;
+
+kern_return_t pd_proc_open(pid_t pid, pd_proc_handle *handle);
+kern_return_t pd_proc_close(pd_proc_handle handle);
+kern_return_t pd_proc_read(pd_proc_handle handle, uint64_t addr, void *buf,
+                           size_t len);
+kern_return_t pd_proc_write(pd_proc_handle handle, uint64_t addr,
+                            const void *buf, size_t len);
+// Scatter-gather process reads: `kaddr` in each descriptor is an address in
+// the target process. Same return convention as pd_readv(). Single ranges are
+// limited to PANDORA_PREADV_MAX_RANGE bytes.
+#define PANDORA_PREADV_MAX_RANGE (1024 * 1024)
+kern_return_t pd_preadv(pid_t pid, const PandoraKReadVDescriptor *descs,
+                        uint32_t count, void *buf, size_t len,
+                        kern_return_t *statuses);
+kern_return_t pd_proc_readv(pd_proc_handle handle,
+                            const PandoraKReadVDescriptor *descs,
+                            uint32_t count, void *buf, size_t len,
+                            kern_return_t *statuses);
+
 /* Kernel utilities */
 uint64_t pd_get_kernel_base();
 
@@ -141,5 +641,200 @@ int pd_get_metadata(PandoraMetadata *metadata);
 kern_return_t pd_kcall(const PandoraKCallRequest *req, PandoraKCallResponse *resp);
 kern_return_t pd_kcall_simple(uint64_t fn, const uint64_t *args, uint32_t argCount,
                               uint64_t *ret0);
+// Calls `fn` with up to PANDORA_KCALL_MAX_BUFFERS arguments replaced by
+// kernel scratch copies of user buffers (see PandoraKCallBuffer), all in one
+// transition. The scratch memory is freed before returning.
+kern_return_t pd_kcall_buffers(uint64_t fn, const uint64_t *args,
+                               uint32_t argCount,
+                               const PandoraKCallBuffer *buffers,
+                               uint32_t bufferCount, uint64_t *ret0);
+// Runs up to PANDORA_KCALL_BATCH_MAX calls in one transition, in order. Calls
+// whose chained source failed or returned 0 are skipped (kIOReturnAborted).
+// Returns KERN_FAILURE if any call did not succeed; see `resps`. `log` asks
+// the kext to log each call (rate-limited).
+kern_return_t pd_kcall_batch(const PandoraKCallRequest *reqs, uint32_t count,
+                             PandoraKCallTimedResponse *resps, bool log);
 kern_return_t pd_run_arb_func_with_task_arg_pid(uint64_t funcAddr, pid_t pid,
                                                 uint64_t *ret0);
+
+/* Kernel-side pattern search */
+// Finds up to `max_results` matches of `pattern`/`mask` (search_pattern()
+// rules) in the kernel range [start, start + size) without copying the range
+// to userland. `count` receives the number of matches stored. Falls back to
+// reading the range through pd_readbuf() on kexts without the selector.
+kern_return_t pd_search_pattern(uint64_t start, uint64_t size,
+                                const uint8_t *pattern, const char *mask,
+                                size_t stride, uint64_t *results,
+                                uint32_t max_results, uint32_t *count);
+
+/* Kernel-side query programs */
+// Runs `prog` (at most QVM_MAX_INSNS instructions) against kernel memory in
+// one call, with registers seeded from `regs` (may be NULL) and emitted bytes
+// written to `out`. Falls back to running it locally through pd_readbuf() on
+// kexts without the selector. Returns KERN_INVALID_ARGUMENT for a program
+// that fails qvm_verify(); runtime stops are reported in `result->status`.
+kern_return_t pd_query_run(const qvm_insn *prog, uint32_t count,
+                           const uint64_t *regs, void *out, size_t out_cap,
+                           pd_query_result *result);
+
+/* Physical memory */
+// Reads physical memory inside one of the kext's safe ranges (see
+// pd_phys_ranges()); longer requests are split into
+// PANDORA_PHYS_READ_MAX_LENGTH calls, each streamed by the kext in large
+// chunks. Returns kIOReturnUnsupported on kexts without the selector.
+#define PANDORA_PHYS_READ_MAX_LENGTH (64ull * 1024 * 1024)
+kern_return_t pd_phys_read(uint64_t paddr, void *buf, size_t len);
+kern_return_t pd_phys_dram_range(uint64_t *base, uint64_t *size);
+// Physical memory that is safe to read: the DRAM window minus the device
+// tree's SEP/TZ/iBoot carve-outs, sorted. Copies up to `max` ranges and sets
+// `*count` to the total.
+#define PANDORA_PHYS_MAX_RANGES 64
+kern_return_t pd_phys_ranges(phys_range *ranges, uint32_t max,
+                             uint32_t *count);
+// Sweeps the safe ranges for `pattern`/`mask` with phys_scan(), `stride`
+// bytes apart from each range start (e.g. PAGE_SIZE for Mach-O headers), on
+// `threads` worker threads (0 = default).
+kern_return_t pd_phys_scan(const uint8_t *pattern, const char *mask,
+                           size_t stride, uint32_t threads,
+                           phys_scan_result *result);
+// Same sweep over caller-chosen ranges. The kext still refuses reads outside
+// its safe ranges; those chunks count as unreadable.
+kern_return_t pd_phys_scan_ranges(const phys_range *ranges,
+                                  uint32_t range_count, const uint8_t *pattern,
+                                  const char *mask, size_t stride,
+                                  uint32_t threads, phys_scan_result *result);
+
+/* Address translation */
+// Translates `count` kernel VAs with the hardware walker, any number per call
+// (sent PANDORA_VTOP_MAX_ADDRESSES at a time). Addresses without a mapping get
+// flags 0. `valid` (may be NULL) receives how many translated. Returns
+// kIOReturnUnsupported on kexts without the selector.
+kern_return_t pd_vtop_batch(const uint64_t *vaddrs, uint32_t count,
+                            PandoraVToPResult *results, uint32_t *valid);
+// Cache of translated page runs on top of pd_vtop_batch(), created on first
+// use with PANDORA_XLATE_DEFAULT_RUNS runs unless pd_xlate_enable() sized it.
+// Mappings are not tracked: flush it once freed kernel memory may have been
+// remapped.
+#define PANDORA_XLATE_DEFAULT_RUNS 4096
+int pd_xlate_enable(uint32_t max_runs);
+void pd_xlate_disable(void);
+// Splits [kaddr, kaddr + len) into physically contiguous runs; returns the
+// bytes covered (see xlate_cache_map()).
+size_t pd_xlate_map(uint64_t kaddr, size_t len, xlate_run *runs,
+                    uint32_t max_runs, uint32_t *count);
+void pd_xlate_invalidate(uint64_t kaddr, size_t len);
+void pd_xlate_flush(void);
+void pd_xlate_get_stats(xlate_cache_stats *stats);
+void pd_xlate_print_stats(void);
+// Reads kernel virtual memory through its physical pages: translated with
+// the cache above and fetched with pd_phys_read(), one call per run. Useful
+// for large reads of memory whose virtual mapping faults or is slow to reach.
+kern_return_t pd_read_via_phys(uint64_t kaddr, void *buf, size_t len);
+// TTBR1_EL1 and TCR_EL1 as seen by the kext.
+kern_return_t pd_translation_regs(uint64_t *ttbr1, uint64_t *tcr);
+// Walks the kernel's translation tables with pd_phys_read() into a sorted,
+// run-length-compressed region map (see kernel/pt_walk.h), limited to
+// [va_start, va_end) unless both are 0. Free it with pt_map_free().
+kern_return_t pd_kernel_region_map(uint64_t va_start, uint64_t va_end,
+                                   pt_map *map);
+// pd_search_pattern() over the parts of [start, start + size) that `map`
+// shows as mapped, so holes are skipped instead of probed.
+kern_return_t pd_search_pattern_mapped(const pt_map *map, uint64_t start,
+                                       uint64_t size, const uint8_t *pattern,
+                                       const char *mask, size_t stride,
+                                       uint64_t *results, uint32_t max_results,
+                                       uint32_t *count);
+
+/* Watch/enforce rules */
+// Rules live in the patch module until removed or the module stops, not just
+// for the client that added them. All of them are polled by one kext timer
+// that runs at `min_us` after any activity and slows down to `max_us` while
+// nothing changes. These return kIOReturnUnsupported if the module is off.
+kern_return_t pd_watch_add(const PandoraWatchRule *rule, uint32_t *id);
+// Built-in rules cannot be removed (kIOReturnNotPermitted).
+kern_return_t pd_watch_remove(uint32_t id);
+// Copies up to `max` rule records; `count` receives the total number of
+// rules and `interval_us` (may be NULL) the current polling period.
+kern_return_t pd_watch_list(PandoraWatchRuleStats *stats, uint32_t max,
+                            uint32_t *count, uint32_t *interval_us,
+                            bool reset);
+kern_return_t pd_watch_set_interval(uint32_t min_us, uint32_t max_us);
+void pd_watch_print(void);
+
+/* Kernel-side atomics */
+// Applies up to PANDORA_ATOMIC_MAX_OPS atomic updates in one call, in order.
+// With PANDORA_ATOMIC_STOP_ON_FAILURE the ops after the first failure are
+// skipped (kIOReturnAborted). `applied` (may be NULL) receives the number of
+// ops that succeeded. Returns kIOReturnUnsupported on kexts without the
+// selector.
+kern_return_t pd_katomicv(const PandoraAtomicOp *ops, uint32_t count,
+                          uint32_t flags, PandoraAtomicResult *results,
+                          uint32_t *applied);
+// Single-word helpers. pd_cas* return kIOReturnNotPermitted if the word did
+// not hold `expected`; `previous` (may be NULL) receives what it held.
+kern_return_t pd_cas32(uint64_t kaddr, uint32_t expected, uint32_t desired,
+                       uint32_t *previous);
+kern_return_t pd_cas64(uint64_t kaddr, uint64_t expected, uint64_t desired,
+                       uint64_t *previous);
+kern_return_t pd_write_masked32(uint64_t kaddr, uint32_t value, uint32_t mask,
+                                uint32_t *previous);
+kern_return_t pd_write_masked64(uint64_t kaddr, uint64_t value, uint64_t mask,
+                                uint64_t *previous);
+
+/* Kernel-side range hashing */
+// Hashes each range in the kernel and returns only the digests, so callers
+// can tell whether kernel memory changed without reading it back. Returns
+// kIOReturnUnsupported on kexts without the selector.
+kern_return_t pd_hash_ranges(const PandoraHashRange *ranges, uint32_t count,
+                             uint64_t seed, PandoraHashResult *results);
+
+/* Kernel-side list walk */
+// Walks the list at `head` in one kernel transition: each node's next pointer
+// is read at `next_offset` and `node_bias` is subtracted from it (e.g.
+// offsetof(le_next) when following le_prev). Only `fields` are copied out.
+kern_return_t pd_walk_list(pd_walk_iter *it, uint64_t head, int64_t next_offset,
+                           int64_t node_bias, const PandoraWalkField *fields,
+                           uint32_t field_count, uint32_t max_nodes);
+// Advances to the next record; false once every node has been visited.
+bool pd_walk_next(pd_walk_iter *it, uint64_t *node);
+// Bytes of field `index` in the current record.
+const void *pd_walk_field(const pd_walk_iter *it, uint32_t index);
+void pd_walk_free(pd_walk_iter *it);
+
+/* Client-side page cache */
+// Kernel page size used as the cache granule.
+#define PANDORA_PAGE_CACHE_PAGE_SIZE 0x4000
+// Puts an LRU cache of `capacity_pages` pages in front of pd_read*(). Only
+// ranges registered with pd_cache_add_range() are cached; pd_write*() drop the
+// pages they touch. Returns 0 on success.
+int pd_cache_enable(size_t capacity_pages);
+void pd_cache_disable(void);
+bool pd_cache_enabled(void);
+// `ttl_ms` is only used with PAGE_CACHE_POLICY_TTL.
+int pd_cache_add_range(uint64_t start, uint64_t len, page_cache_policy policy,
+                       uint64_t ttl_ms);
+// Expires every page cached under PAGE_CACHE_POLICY_EPOCH, e.g. after a
+// kernel call that may have changed data the cache holds.
+void pd_cache_bump_epoch(void);
+void pd_cache_invalidate(uint64_t addr, size_t len);
+void pd_cache_get_stats(page_cache_stats *stats);
+void pd_cache_print_stats(void);
+
+/* Asynchronous requests */
+// Sets up the completion port and allows up to `depth` requests in flight
+// (capped at PANDORA_ASYNC_MAX_IN_FLIGHT). Call after pd_init().
+int pd_async_init(uint32_t depth);
+// Drains outstanding completions and tears down the completion port.
+void pd_async_deinit(void);
+// Submitters block in pd_poll() while every slot is in use. `buf` must stay
+// valid until the callback runs.
+kern_return_t pd_read_async(uint64_t addr, void *buf, size_t len,
+                            pd_async_callback cb, void *ctx);
+kern_return_t pd_write_async(uint64_t addr, const void *buf, size_t len,
+                             pd_async_callback cb, void *ctx);
+kern_return_t pd_kcall_async(const PandoraKCallRequest *req,
+                             pd_async_callback cb, void *ctx);
+// Dispatches completions, waiting up to `timeout_ms` for the first one (-1
+// waits forever). Returns the number of callbacks run, or -1 on error.
+int pd_poll(int timeout_ms);
+uint32_t pd_async_in_flight(void);
@@ -17,6 +17,21 @@
 #include "../../esym/b.h"
 #include "../../esym/nop.h"
 
+// Replaces the instruction at `pc` only if it still is `original`, in one
+// kernel call. Older kexts get a write followed by a read-back.
+static bool patch_insn(uint64_t pc, uint32_t original, uint32_t patched) {
+  uint32_t seen = 0;
+  kern_return_t kr = pd_cas32(pc, original, patched, &seen);
+  if (kr == kIOReturnUnsupported) {
+    pd_write32(pc, patched);
+    return pd_read32(pc) == patched;
+  }
+  if (kr == kIOReturnNotPermitted) {
+    printf("    ❌ Instruction changed to 0x%08x before patching\n", seen);
+  }
+  return kr == KERN_SUCCESS;
+}
+
 static bool patch_tbnz_to_nop(csh handle, uint64_t pc) {
   printf("🔍 Patching TBNZ to NOP at 0x%llx\n", pc);
   uint32_t original = pd_read32(pc);
@@ -31,8 +46,7 @@ static bool patch_tbnz_to_nop(csh handle, uint64_t pc) {
   }
   printf("    🌀 Patching TBNZ @0x%llx => NOP\n", pc);
   uint32_t nop = encode_nop();
-  pd_write32(pc, nop);
-  bool ok = (pd_read32(pc) == nop);
+  bool ok = patch_insn(pc, original, nop);
   puts(ok ? "    😎 Patch OK" : "    ❌ Verification failed");
   cs_free(insn, n);
   return ok;
@@ -65,8 +79,7 @@ static bool patch_tbz_to_b(csh handle, uint64_t pc) {
   uint32_t branch = encode_b_to(pc, target); /* B target */
   printf("    🌀 Patching TBZ @0x%llx => B 0x%llx (0x%08x)\n", pc, target,
          branch);
-  pd_write32(pc, branch);
-  bool ok = (pd_read32(pc) == branch);
+  bool ok = patch_insn(pc, original, branch);
   puts(ok ? "    😎 Patch OK" : "    ❌ Verification failed");
   cs_free(insn, n);
   return ok;
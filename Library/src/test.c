@@ -27,12 +27,14 @@
 #include <mach-o/loader.h>
 #include <mach-o/nlist.h>
 
-#include "calypso/string_search.h"
 #include "calypso/page_size.h"
 #include "calypso/xref.h"
 
 #include "patches/thread_set_state/tss.h"
 
+// How stale a cached kernel __DATA page may get in this demo.
+#define PD_DEMO_DATA_TTL_MS 50
+
 int main(int argc, char *argv[]) {
   if (pd_init() == -1) {
     printf("Failed to initialize Pandora. Is the kernel extension loaded?\n");
@@ -45,7 +47,9 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  pd_cache_enable(1024);
   kernel_macho_init(pd_kbase);
+  kernel_macho_cache_data(PD_DEMO_DATA_TTL_MS);
   kernel_proc_task_init();
 
   printf("Pandora demo\n\nFinding functions:\n");
@@ -57,52 +61,29 @@ int main(int argc, char *argv[]) {
     goto end;
   }
 
-  memdiff_view *cstring_view = memdiff_create(sect->addr, sect->size);
-  if (!cstring_view) {
-    printf("    failed to create memdiff view for __TEXT.__cstring section\n");
-    goto end;
-  }
-
-  uint8_t *tss_ptr = (uint8_t *)(uintptr_t)search_pattern(
+  uint64_t tss_kva = 0;
+  uint32_t tss_count = 0;
+  kern_return_t search_kr = pd_search_pattern(
+      sect->addr, sect->size,
       (const uint8_t *)"com.apple.private.thread-set-state",
-      "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
-      cstring_view->original_copy,
-      cstring_view->size,
-      1);
-  if (!tss_ptr) {
+      "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", 1, &tss_kva, 1, &tss_count);
+  if (search_kr != KERN_SUCCESS || tss_count == 0) {
     printf("    failed to find thread-set-state string in __TEXT.__cstring\n");
-    memdiff_destroy(cstring_view);
-    goto end;
-  }
-
-  const uint8_t *cstring_base = (const uint8_t *)cstring_view->original_copy;
-  const uint8_t *cstring_end = cstring_base + cstring_view->size;
-  if (tss_ptr < cstring_base || tss_ptr >= cstring_end) {
-    printf("    found thread-set-state pointer is out of view range: tss_ptr=0x%llx view=[0x%llx..0x%llx)\n",
-           (unsigned long long)(uintptr_t)tss_ptr,
-           (unsigned long long)(uintptr_t)cstring_base,
-           (unsigned long long)(uintptr_t)cstring_end);
-    memdiff_destroy(cstring_view);
     goto end;
   }
 
-  size_t tss_off = (size_t)(tss_ptr - cstring_base);
-  uint64_t tss_kva = cstring_view->base_address + (uint64_t)tss_off;
-
   printf("    'com.apple.private.thread-set-state' @ 0x%llx\n", (unsigned long long)tss_kva);
 
   struct section_64 *text_sect = NULL;
   findres = kernel_macho_find_section_by_name("__TEXT_EXEC", "__text", &text_sect);
   if (findres != 0 || !text_sect) {
     printf("    failed to find __TEXT_EXEC.__text section\n");
-    memdiff_destroy(cstring_view);
     goto end;
   }
 
   memdiff_view *text_view = memdiff_create(text_sect->addr, text_sect->size);
   if (!text_view) {
     printf("    failed to create memdiff view for __TEXT_EXEC.__text section\n");
-    memdiff_destroy(cstring_view);
     goto end;
   }
 
@@ -116,7 +97,6 @@ int main(int argc, char *argv[]) {
     printf("    failed to find any references to thread-set-state string\n");
     free(results);
     memdiff_destroy(text_view);
-    memdiff_destroy(cstring_view);
     goto end;
   }
 
@@ -133,63 +113,77 @@ int main(int argc, char *argv[]) {
 
   printf("\nInspecting processes:\n");
 
-  memdiff_view *proc_view = kernel_proc_view;
-  ks_proc_t proc_v = (ks_proc_t)proc_view->original_copy;
-  uintptr_t proc_addr = proc_view->base_address;
-
-  memdiff_view *proc_ro_view;
-
-  uintptr_t prev_link = 0;
-  uintptr_t prev_addr = 0;
-
-  int foundp = 0;
-
-  while (
-    (prev_link = (uintptr_t)proc_v->p_list.le_prev) != 0 &&
-    (prev_addr = prev_link - offsetof(struct ks_proc, p_list.le_next)) != 0 &&
-    prev_addr != proc_addr
-  ) {
-    memdiff_view *prev_view = memdiff_create(prev_addr, sizeof(struct ks_proc));
-    if (!prev_view) {
-      printf("Failed to create memdiff view for proc at 0x%llx\n",
-             (unsigned long long)prev_addr);
-      break;
-    }
-
-    ks_proc_t prev_v = (ks_proc_t)prev_view->original_copy;
-
-    if ((uintptr_t)prev_v->p_list.le_next != proc_addr) {
-      memdiff_destroy(prev_view);
-      break;
-    }
-
-    if (proc_view != kernel_proc_view) {
-      memdiff_destroy(proc_view);
-    }
-
-    proc_ro_view = memdiff_create((uintptr_t)prev_v->p_proc_ro, sizeof(struct ks_proc_ro));
+  // Walk allproc backwards through le_prev in one kernel call, pulling out
+  // only the fields this demo looks at.
+  PandoraWalkField proc_fields[] = {
+      {offsetof(struct ks_proc, p_pid), sizeof(kernel_proc->p_pid), 0, 0},
+      {offsetof(struct ks_proc, p_forkcopy.p_comm),
+       sizeof(kernel_proc->p_forkcopy.p_comm), 0, 0},
+      {offsetof(struct ks_proc, p_list.le_next), sizeof(uint64_t), 0, 0},
+      {offsetof(struct ks_proc, p_proc_ro),
+       sizeof(((ks_proc_ro_t)0)->task_data.t_flags_ro),
+       offsetof(struct ks_proc_ro, task_data.t_flags_ro),
+       PANDORA_WALK_FIELD_INDIRECT},
+  };
+
+  pd_walk_iter procs;
+  kern_return_t walk_kr = pd_walk_list(
+      &procs, kernel_proc_view->base_address,
+      offsetof(struct ks_proc, p_list.le_prev),
+      offsetof(struct ks_proc, p_list.le_next), proc_fields,
+      sizeof(proc_fields) / sizeof(proc_fields[0]), PANDORA_WALK_MAX_NODES);
+  if (walk_kr != KERN_SUCCESS) {
+    printf("    failed to walk process list: %x\n", walk_kr);
+  }
 
-    if (!proc_ro_view) {
-      printf("Failed to create memdiff view for proc_ro at 0x%llx\n",
-            (unsigned long long)(uintptr_t)prev_v->p_proc_ro);
-      memdiff_destroy(prev_view);
+  uint64_t proc_addr = 0;
+  uint64_t last_addr = 0;
+  while (walk_kr == KERN_SUCCESS && pd_walk_next(&procs, &proc_addr)) {
+    const int *pid = pd_walk_field(&procs, 0);
+    const char *comm = pd_walk_field(&procs, 1);
+    uint64_t next_link = 0;
+    unsigned int flags_ro = 0;
+    memcpy(&next_link, pd_walk_field(&procs, 2), sizeof(next_link));
+    memcpy(&flags_ro, pd_walk_field(&procs, 3), sizeof(flags_ro));
+
+    if (last_addr && next_link != last_addr) {
       break;
     }
+    last_addr = proc_addr;
 
-    ks_proc_ro_t proc_ro_v = (ks_proc_ro_t)proc_ro_view->original_copy;
-    if (proc_ro_v->task_data.t_flags_ro & 0x00000040) {
-      printf("    (%i) %s has TFRO_MACH_HARDENING_OPT_OUT\n", proc_v->p_pid, proc_v->p_forkcopy.p_comm);
+    if (flags_ro & 0x00000040) {
+      printf("    (%i) %.*s has TFRO_MACH_HARDENING_OPT_OUT\n", *pid,
+             (int)sizeof(kernel_proc->p_forkcopy.p_comm), comm);
     }
-
-    memdiff_destroy(proc_ro_view);
-
-    proc_view = prev_view;
-    proc_v = prev_v;
-    proc_addr = prev_addr;
   }
-
-  if (proc_view != kernel_proc_view) {
-    memdiff_destroy(proc_view);
+  pd_walk_free(&procs);
+
+  // kernproc -> p_proc_ro -> pr_task in one call, checking that pr_proc
+  // points back at the proc on the way.
+  qvm_insn proc_to_task[] = {
+      {QVM_OP_LOAD, 1, 0, 8, 0, offsetof(struct ks_proc, p_proc_ro)},
+      {QVM_OP_STRIP, 1, 1, 0, 0, 47},
+      {QVM_OP_JEQI, 1, 0, 0, 9, 0},
+      {QVM_OP_LOAD, 2, 1, 8, 0, offsetof(struct ks_proc_ro, pr_proc)},
+      {QVM_OP_STRIP, 2, 2, 0, 0, 47},
+      {QVM_OP_JNE, 2, 0, 0, 9, 0},
+      {QVM_OP_LOAD, 3, 1, 8, 0, offsetof(struct ks_proc_ro, pr_task)},
+      {QVM_OP_STRIP, 3, 3, 0, 0, 47},
+      {QVM_OP_EMIT, 0, 3, 8, 0, 0},
+  };
+  uint64_t query_regs[QVM_NUM_REGS] = {kernel_proc_view->base_address};
+  uint64_t query_task = 0;
+  pd_query_result query_res;
+  if (pd_query_run(proc_to_task, sizeof(proc_to_task) / sizeof(proc_to_task[0]),
+                   query_regs, &query_task, sizeof(query_task),
+                   &query_res) == KERN_SUCCESS &&
+      query_res.status == QVM_OK && query_res.out_len == sizeof(query_task)) {
+    printf("    kernproc task @ 0x%llx (%s kernel_task)\n",
+           (unsigned long long)query_task,
+           query_task == kernel_task_view->base_address ? "matches"
+                                                        : "does not match");
+  } else {
+    printf("    failed to resolve kernproc task with a query\n");
   }
 
   printf("\nFinding symbols:\n");
@@ -200,6 +194,7 @@ int main(int argc, char *argv[]) {
   printf("    _kernel_map @ 0x%llx\n", (unsigned long long)kmap_var_addr);
 
 end:
+  pd_cache_print_stats();
   pd_deinit();
   return 0;
 }
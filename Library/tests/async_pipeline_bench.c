@@ -0,0 +1,288 @@
+// Pipelining benchmark for the async API. Requests go through async_slots
+// (the slot table behind pd_read_async()) to a simulated kext: one worker
+// thread that serves requests in order, each after a fixed transport latency
+// plus a service time, and posts completions back to a queue that the poll
+// callback drains. Depth 1 is the synchronous baseline.
+//
+//   async_pipeline_bench [--quick] [--requests N] [--latency-us N]
+//                        [--service-us N]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "kernel/async_slots.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IMAGE_SIZE (1024 * 1024)
+#define READ_SIZE 256
+#define QUEUE_CAP 512 // >= PANDORA_ASYNC_MAX_IN_FLIGHT
+
+typedef struct {
+  async_slot *slot;
+  uint64_t offset;
+  void *buf;
+  uint64_t due_ns;
+  int32_t status;
+} sim_request;
+
+typedef struct {
+  sim_request items[QUEUE_CAP];
+  uint32_t head;
+  uint32_t count;
+} sim_queue;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t submitted;
+  pthread_cond_t completed;
+  sim_queue pending;
+  sim_queue done;
+  bool stop;
+  uint64_t latency_ns;
+  uint64_t service_ns;
+  const uint8_t *image;
+  async_slots *slots;
+} sim_kext;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void spin_until(uint64_t deadline) {
+  while (now_ns() < deadline) {
+  }
+}
+
+static void queue_push(sim_queue *q, const sim_request *r) {
+  q->items[(q->head + q->count) % QUEUE_CAP] = *r;
+  q->count++;
+}
+
+static sim_request queue_pop(sim_queue *q) {
+  sim_request r = q->items[q->head];
+  q->head = (q->head + 1) % QUEUE_CAP;
+  q->count--;
+  return r;
+}
+
+// The kext's async worker: requests are served one at a time, in order.
+static void *sim_worker(void *arg) {
+  sim_kext *k = arg;
+  pthread_mutex_lock(&k->lock);
+  for (;;) {
+    while (!k->stop && k->pending.count == 0) {
+      pthread_cond_wait(&k->submitted, &k->lock);
+    }
+    if (k->stop) {
+      break;
+    }
+    sim_request r = queue_pop(&k->pending);
+    pthread_mutex_unlock(&k->lock);
+
+    spin_until(r.due_ns);
+    spin_until(now_ns() + k->service_ns);
+    memcpy(r.buf, k->image + r.offset, READ_SIZE);
+    r.status = 0;
+
+    pthread_mutex_lock(&k->lock);
+    queue_push(&k->done, &r);
+    pthread_cond_signal(&k->completed);
+  }
+  pthread_mutex_unlock(&k->lock);
+  return NULL;
+}
+
+// pd_poll(): wait for the first completion, then dispatch everything queued.
+static int sim_poll(void *ctx, int timeout_ms) {
+  sim_kext *k = ctx;
+  sim_request batch[QUEUE_CAP];
+  uint32_t n = 0;
+
+  pthread_mutex_lock(&k->lock);
+  if (k->done.count == 0 && timeout_ms != 0) {
+    if (timeout_ms < 0) {
+      while (k->done.count == 0) {
+        pthread_cond_wait(&k->completed, &k->lock);
+      }
+    } else {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += timeout_ms / 1000;
+      ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&k->completed, &k->lock, &ts);
+    }
+  }
+  while (k->done.count) {
+    batch[n++] = queue_pop(&k->done);
+  }
+  pthread_mutex_unlock(&k->lock);
+
+  for (uint32_t i = 0; i < n; i++) {
+    // The "value" of a read completion is the byte count.
+    async_slots_complete(k->slots, batch[i].slot, batch[i].status, READ_SIZE);
+  }
+  return (int)n;
+}
+
+static void sim_submit(sim_kext *k, async_slot *slot, uint64_t offset,
+                       void *buf) {
+  sim_request r = {
+      .slot = slot,
+      .offset = offset,
+      .buf = buf,
+      .due_ns = now_ns() + k->latency_ns,
+  };
+  pthread_mutex_lock(&k->lock);
+  queue_push(&k->pending, &r);
+  pthread_cond_signal(&k->submitted);
+  pthread_mutex_unlock(&k->lock);
+}
+
+typedef struct {
+  uint32_t completions;
+  uint32_t errors;
+  uint32_t max_in_flight;
+} bench_counters;
+
+static void on_complete(void *ctx, int32_t status, uint64_t value) {
+  bench_counters *c = ctx;
+  c->completions++;
+  if (status != 0 || value != READ_SIZE) {
+    c->errors++;
+  }
+}
+
+static int run_depth(sim_kext *k, uint32_t depth, uint32_t requests,
+                     uint8_t *out, double *ops_per_sec) {
+  k->slots = async_slots_create(depth, sim_poll, k);
+  if (!k->slots) {
+    return -1;
+  }
+
+  bench_counters c = {0};
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < requests; i++) {
+    async_slot *slot = async_slots_acquire(k->slots, on_complete, &c);
+    if (!slot) {
+      async_slots_destroy(k->slots);
+      return -1;
+    }
+    uint32_t in_flight = async_slots_in_flight(k->slots);
+    if (in_flight > c.max_in_flight) {
+      c.max_in_flight = in_flight;
+    }
+    uint64_t offset = ((uint64_t)i * READ_SIZE) % IMAGE_SIZE;
+    sim_submit(k, slot, offset, out + offset);
+  }
+  int drained = async_slots_drain(k->slots);
+  uint64_t elapsed = now_ns() - start;
+  async_slots_destroy(k->slots);
+  k->slots = NULL;
+
+  *ops_per_sec = (double)requests * 1e9 / (double)(elapsed ? elapsed : 1);
+  if (drained != 0 || c.completions != requests || c.errors ||
+      c.max_in_flight > depth) {
+    fprintf(stderr,
+            "depth %u: %u/%u completions, %u errors, max in flight %u\n",
+            depth, c.completions, requests, c.errors, c.max_in_flight);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t requests = 20000;
+  uint64_t latency_us = 50;
+  uint64_t service_us = 2;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      requests = 1000;
+    } else if (!strcmp(argv[i], "--requests") && i + 1 < argc) {
+      requests = (uint32_t)strtoul(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--latency-us") && i + 1 < argc) {
+      latency_us = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--service-us") && i + 1 < argc) {
+      service_us = strtoull(argv[++i], NULL, 0);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--quick] [--requests N] [--latency-us N] "
+              "[--service-us N]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  uint8_t *image = malloc(IMAGE_SIZE);
+  uint8_t *out = malloc(IMAGE_SIZE);
+  if (!image || !out) {
+    fprintf(stderr, "allocation failed\n");
+    return 1;
+  }
+  for (size_t i = 0; i < IMAGE_SIZE; i++) {
+    image[i] = (uint8_t)(i * 37 + 11);
+  }
+
+  static sim_kext k;
+  pthread_mutex_init(&k.lock, NULL);
+  pthread_cond_init(&k.submitted, NULL);
+  pthread_cond_init(&k.completed, NULL);
+  k.latency_ns = latency_us * 1000;
+  k.service_ns = service_us * 1000;
+  k.image = image;
+
+  pthread_t worker;
+  if (pthread_create(&worker, NULL, sim_worker, &k) != 0) {
+    fprintf(stderr, "failed to start the simulated worker\n");
+    return 1;
+  }
+
+  printf("%u reads of %u bytes, latency %llu us, service %llu us\n", requests,
+         READ_SIZE, (unsigned long long)latency_us,
+         (unsigned long long)service_us);
+  printf("%6s %12s %8s\n", "depth", "reads/s", "speedup");
+
+  static const uint32_t kDepths[] = {1, 2, 4, 8, 16, 32, 64, 256};
+  double baseline = 0;
+  int rc = 0;
+  for (size_t i = 0; i < sizeof(kDepths) / sizeof(kDepths[0]); i++) {
+    double ops = 0;
+    memset(out, 0, IMAGE_SIZE);
+    if (run_depth(&k, kDepths[i], requests, out, &ops) != 0) {
+      rc = 1;
+      break;
+    }
+    size_t covered = (size_t)requests * READ_SIZE;
+    if (memcmp(out, image, covered < IMAGE_SIZE ? covered : IMAGE_SIZE)) {
+      fprintf(stderr, "depth %u: read data mismatch\n", kDepths[i]);
+      rc = 1;
+      break;
+    }
+    if (i == 0) {
+      baseline = ops;
+    }
+    printf("%6u %12.0f %7.2fx\n", kDepths[i], ops, ops / baseline);
+  }
+
+  pthread_mutex_lock(&k.lock);
+  k.stop = true;
+  pthread_cond_signal(&k.submitted);
+  pthread_mutex_unlock(&k.lock);
+  pthread_join(worker, NULL);
+
+  free(image);
+  free(out);
+  return rc;
+}
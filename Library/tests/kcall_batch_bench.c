@@ -0,0 +1,265 @@
+// Batch-vs-loop benchmark for kernel calls. A simulated kext runs
+// lookup -> lock -> read -> unlock sequences against an in-process object
+// table, either one call per transition (pd_kcall() in a loop, chaining done
+// in userland) or as chained batches of up to KCALL_BATCH_MAX calls
+// (pd_kcall_batch()). Every transition costs a fixed latency and every call a
+// fixed service time; the two modes must produce the same values.
+//
+//   kcall_batch_bench [--quick] [--sequences N] [--latency-us N]
+//                     [--service-us N]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "calypso/kcall_chain.h"
+#include "test_util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// PANDORA_KCALL_BATCH_MAX; pandora.h itself needs the IOKit headers.
+#define KCALL_BATCH_MAX 64
+
+enum { FN_LOOKUP = 1, FN_LOCK, FN_READ, FN_UNLOCK };
+
+#define OBJECT_COUNT 1024
+#define CALLS_PER_SEQUENCE 4
+
+typedef struct {
+  uint64_t lock;
+  uint64_t value;
+} sim_object;
+
+typedef struct {
+  sim_object objects[OBJECT_COUNT];
+  uint64_t latency_ns;
+  uint64_t service_ns;
+  uint64_t transitions;
+} sim_kext;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void spin_until(uint64_t deadline) {
+  while (now_ns() < deadline) {
+  }
+}
+
+static uint64_t sim_call(sim_kext *k, uint64_t fn, const uint64_t *args) {
+  spin_until(now_ns() + k->service_ns);
+  switch (fn) {
+  case FN_LOOKUP:
+    return args[0] < OBJECT_COUNT ? (uint64_t)(uintptr_t)&k->objects[args[0]]
+                                  : 0;
+  case FN_LOCK:
+    ((sim_object *)(uintptr_t)args[0])->lock++;
+    return 1;
+  case FN_READ:
+    return *(const uint64_t *)(uintptr_t)args[0];
+  case FN_UNLOCK:
+    ((sim_object *)(uintptr_t)args[0])->lock--;
+    return 1;
+  }
+  return 0;
+}
+
+// One transition of the single-call selector.
+static uint64_t sim_kcall(sim_kext *k, const kcall_request *req) {
+  spin_until(now_ns() + k->latency_ns);
+  k->transitions++;
+  return sim_call(k, req->fn, req->args);
+}
+
+// One transition of the batch selector; arguments are chained with the same
+// kcall_chain_resolve() as HwAccessModule::methodKCallBatch.
+static void sim_kcall_batch(sim_kext *k, const kcall_request *reqs,
+                            uint32_t count, kcall_timed_response *resps) {
+  spin_until(now_ns() + k->latency_ns);
+  k->transitions++;
+  for (uint32_t i = 0; i < count; i++) {
+    kcall_timed_response *resp = &resps[i];
+    memset(resp, 0, sizeof(*resp));
+    uint64_t args[KCALL_MAX_ARGS];
+    resp->status = kcall_chain_resolve(&reqs[i], i, resps, args);
+    if (resp->status != KCALL_STATUS_SUCCESS) {
+      continue;
+    }
+    uint64_t start = now_ns();
+    resp->ret0 = sim_call(k, reqs[i].fn, args);
+    resp->elapsed = now_ns() - start;
+  }
+}
+
+static uint64_t key_for(uint32_t seq) {
+  return ((uint64_t)seq * 2654435761u) % OBJECT_COUNT;
+}
+
+static void run_loop(sim_kext *k, uint32_t sequences, uint64_t *values) {
+  for (uint32_t s = 0; s < sequences; s++) {
+    kcall_request req = {.fn = FN_LOOKUP, .argCount = 1};
+    req.args[0] = key_for(s);
+    uint64_t obj = sim_kcall(k, &req);
+    if (!obj) {
+      values[s] = 0;
+      continue;
+    }
+    req = (kcall_request){.fn = FN_LOCK, .argCount = 1, .args = {obj}};
+    sim_kcall(k, &req);
+    req = (kcall_request){.fn = FN_READ,
+                          .argCount = 1,
+                          .args = {obj + offsetof(sim_object, value)}};
+    values[s] = sim_kcall(k, &req);
+    req = (kcall_request){.fn = FN_UNLOCK, .argCount = 1, .args = {obj}};
+    sim_kcall(k, &req);
+  }
+}
+
+static void run_batch(sim_kext *k, uint32_t sequences, uint64_t *values) {
+  kcall_request reqs[KCALL_BATCH_MAX];
+  kcall_timed_response resps[KCALL_BATCH_MAX];
+  const uint32_t per_batch = KCALL_BATCH_MAX / CALLS_PER_SEQUENCE;
+
+  for (uint32_t first = 0; first < sequences; first += per_batch) {
+    uint32_t n = sequences - first;
+    if (n > per_batch) {
+      n = per_batch;
+    }
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < n; s++) {
+      uint32_t lookup = count;
+      reqs[count++] = (kcall_request){
+          .fn = FN_LOOKUP, .argCount = 1, .args = {key_for(first + s)}};
+      reqs[count++] = (kcall_request){.fn = FN_LOCK,
+                                      .argCount = 1,
+                                      .chainMask = 1,
+                                      .args = {KCALL_CHAIN(lookup, 0)}};
+      reqs[count++] = (kcall_request){
+          .fn = FN_READ,
+          .argCount = 1,
+          .chainMask = 1,
+          .args = {KCALL_CHAIN(lookup, offsetof(sim_object, value))}};
+      reqs[count++] = (kcall_request){.fn = FN_UNLOCK,
+                                      .argCount = 1,
+                                      .chainMask = 1,
+                                      .args = {KCALL_CHAIN(lookup, 0)}};
+    }
+    sim_kcall_batch(k, reqs, count, resps);
+    for (uint32_t s = 0; s < n; s++) {
+      const kcall_timed_response *read = &resps[s * CALLS_PER_SEQUENCE + 2];
+      values[first + s] =
+          read->status == KCALL_STATUS_SUCCESS ? read->ret0 : 0;
+    }
+  }
+}
+
+static void chaining_checks(sim_kext *k) {
+  kcall_request reqs[3] = {
+      {.fn = FN_LOOKUP, .argCount = 1, .args = {OBJECT_COUNT}}, // -> NULL
+      {.fn = FN_READ,
+       .argCount = 1,
+       .chainMask = 1,
+       .args = {KCALL_CHAIN(0, 8)}},
+      {.fn = FN_READ,
+       .argCount = 1,
+       .chainMask = 1,
+       .args = {KCALL_CHAIN(2, 0)}},
+  };
+  kcall_timed_response resps[3];
+  sim_kcall_batch(k, reqs, 3, resps);
+  CHECK_EQ(resps[0].status, KCALL_STATUS_SUCCESS);
+  CHECK_EQ(resps[0].ret0, 0);
+  CHECK_EQ(resps[1].status, KCALL_STATUS_ABORTED);      // NULL source
+  CHECK_EQ(resps[2].status, KCALL_STATUS_BAD_ARGUMENT); // refers to itself
+
+  kcall_request stray = {.fn = FN_READ, .argCount = 1, .chainMask = 2};
+  sim_kcall_batch(k, &stray, 1, resps);
+  // A chain bit past argCount.
+  CHECK_EQ(resps[0].status, KCALL_STATUS_BAD_ARGUMENT);
+}
+
+int main(int argc, char **argv) {
+  uint32_t sequences = 4000;
+  uint64_t latency_us = 20;
+  uint64_t service_us = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      sequences = 256;
+    } else if (!strcmp(argv[i], "--sequences") && i + 1 < argc) {
+      sequences = (uint32_t)strtoul(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--latency-us") && i + 1 < argc) {
+      latency_us = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--service-us") && i + 1 < argc) {
+      service_us = strtoull(argv[++i], NULL, 0);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--quick] [--sequences N] [--latency-us N] "
+              "[--service-us N]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  static sim_kext k;
+  for (uint32_t i = 0; i < OBJECT_COUNT; i++) {
+    k.objects[i].value = (uint64_t)i * 0x9E3779B97F4A7C15ull;
+  }
+  k.latency_ns = latency_us * 1000;
+  k.service_ns = service_us * 1000;
+
+  chaining_checks(&k);
+
+  uint64_t *loop_values = calloc(sequences, sizeof(uint64_t));
+  uint64_t *batch_values = calloc(sequences, sizeof(uint64_t));
+  if (!loop_values || !batch_values) {
+    fprintf(stderr, "allocation failed\n");
+    return 1;
+  }
+
+  printf("%u lookup/lock/read/unlock sequences, latency %llu us, "
+         "service %llu us\n",
+         sequences, (unsigned long long)latency_us,
+         (unsigned long long)service_us);
+  printf("%6s %12s %12s %8s\n", "mode", "transitions", "calls/s", "speedup");
+
+  k.transitions = 0;
+  uint64_t start = now_ns();
+  run_loop(&k, sequences, loop_values);
+  uint64_t loop_ns = now_ns() - start;
+  uint64_t loop_transitions = k.transitions;
+
+  k.transitions = 0;
+  start = now_ns();
+  run_batch(&k, sequences, batch_values);
+  uint64_t batch_ns = now_ns() - start;
+  uint64_t batch_transitions = k.transitions;
+
+  double calls = (double)sequences * CALLS_PER_SEQUENCE;
+  double loop_rate = calls * 1e9 / (double)(loop_ns ? loop_ns : 1);
+  double batch_rate = calls * 1e9 / (double)(batch_ns ? batch_ns : 1);
+  printf("%6s %12llu %12.0f %7.2fx\n", "loop",
+         (unsigned long long)loop_transitions, loop_rate, 1.0);
+  printf("%6s %12llu %12.0f %7.2fx\n", "batch",
+         (unsigned long long)batch_transitions, batch_rate,
+         batch_rate / loop_rate);
+
+  CHECK(memcmp(loop_values, batch_values, sequences * sizeof(uint64_t)) == 0);
+  CHECK_EQ(loop_transitions, (uint64_t)sequences * CALLS_PER_SEQUENCE);
+  CHECK_EQ(batch_transitions,
+           (sequences + KCALL_BATCH_MAX / CALLS_PER_SEQUENCE - 1) /
+               (KCALL_BATCH_MAX / CALLS_PER_SEQUENCE));
+  for (uint32_t i = 0; i < OBJECT_COUNT; i++) {
+    CHECK_EQ(k.objects[i].lock, 0);
+  }
+
+  free(loop_values);
+  free(batch_values);
+  return test_failures("kcall_batch_bench");
+}
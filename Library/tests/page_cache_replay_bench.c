@@ -0,0 +1,344 @@
+// Replays a kernel read trace through page_cache.c and reports how many
+// transport calls and bytes it cost compared with reading straight through,
+// plus a modelled transport time (per-call cost + bandwidth). Fills are served
+// from a synthetic kernel and every read is checked.
+//
+//   page_cache_replay_bench [--quick] [--pages N] [--call-ns N] [trace]
+//
+// Trace lines (numbers in C syntax, '#' starts a comment):
+//   c <start> <len> immutable|epoch|ttl <ttl_ms>   register a cached range
+//   r <addr> <len>                                  read
+//   w <addr> <len>                                  write (invalidates)
+//   e                                               bump the epoch
+// Without a trace, a synthetic one mixes symbol-style lookups in kernel text,
+// multi-megabyte text diffs and polling of a few hot __DATA words.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "kernel/page_cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE 0x4000ull
+#define TEXT 0xfffffe0007004000ull
+#define TEXT_SIZE (32ull * 1024 * 1024)
+#define DATA 0xfffffe0009800000ull
+#define DATA_SIZE (4ull * 1024 * 1024)
+#define MAX_READ (8u * 1024 * 1024)
+
+typedef enum { OP_RANGE, OP_READ, OP_WRITE, OP_EPOCH } op_kind;
+
+typedef struct {
+  op_kind kind;
+  uint64_t addr;
+  uint64_t len;
+  page_cache_policy policy;
+  uint64_t ttl_ms;
+} trace_op;
+
+typedef struct {
+  trace_op *ops;
+  size_t count;
+  size_t capacity;
+} trace;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t bytes;
+} transport;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint8_t byte_at(uint64_t addr) {
+  return (uint8_t)((addr >> 2) ^ (addr >> 13));
+}
+
+static int transport_fill(void *ctx, uint64_t addr, void *buf, size_t len) {
+  transport *t = ctx;
+  t->calls++;
+  t->bytes += len;
+  uint8_t *out = buf;
+  for (size_t i = 0; i < len; i++) {
+    out[i] = byte_at(addr + i);
+  }
+  return 0;
+}
+
+static int trace_push(trace *t, trace_op op) {
+  if (t->count == t->capacity) {
+    size_t cap = t->capacity ? t->capacity * 2 : 1024;
+    trace_op *grown = realloc(t->ops, cap * sizeof(*grown));
+    if (!grown) {
+      return -1;
+    }
+    t->ops = grown;
+    t->capacity = cap;
+  }
+  t->ops[t->count++] = op;
+  return 0;
+}
+
+static int trace_load(trace *t, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+
+  char line[256];
+  unsigned lineno = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    char kind[16] = {0}, policy[16] = {0};
+    unsigned long long a = 0, b = 0, ttl = 0;
+    int n = sscanf(line, "%15s %lli %lli %15s %lli", kind, (long long *)&a,
+                   (long long *)&b, policy, (long long *)&ttl);
+    if (n <= 0) {
+      continue;
+    }
+
+    trace_op op = {.addr = a, .len = b};
+    bool ok = true;
+    if (!strcmp(kind, "r") && n == 3) {
+      op.kind = OP_READ;
+      ok = b > 0 && b <= MAX_READ;
+    } else if (!strcmp(kind, "w") && n == 3) {
+      op.kind = OP_WRITE;
+    } else if (!strcmp(kind, "e")) {
+      op.kind = OP_EPOCH;
+    } else if (!strcmp(kind, "c") && n >= 4) {
+      op.kind = OP_RANGE;
+      op.ttl_ms = ttl;
+      if (!strcmp(policy, "immutable")) {
+        op.policy = PAGE_CACHE_POLICY_IMMUTABLE;
+      } else if (!strcmp(policy, "epoch")) {
+        op.policy = PAGE_CACHE_POLICY_EPOCH;
+      } else if (!strcmp(policy, "ttl") && n == 5) {
+        op.policy = PAGE_CACHE_POLICY_TTL;
+      } else {
+        ok = false;
+      }
+    } else {
+      ok = false;
+    }
+
+    if (!ok || trace_push(t, op) != 0) {
+      fprintf(stderr, "%s:%u: bad trace line\n", path, lineno);
+      fclose(f);
+      return -1;
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+static uint64_t rng_next(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static int trace_synthesize(trace *t, size_t rounds) {
+  trace_op text = {OP_RANGE, TEXT, TEXT_SIZE, PAGE_CACHE_POLICY_IMMUTABLE, 0};
+  trace_op data = {OP_RANGE, DATA, DATA_SIZE, PAGE_CACHE_POLICY_TTL, 50};
+  if (trace_push(t, text) || trace_push(t, data)) {
+    return -1;
+  }
+
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  for (size_t round = 0; round < rounds; round++) {
+    // Symbol and xref style lookups, mostly in a hot eighth of the text.
+    for (int i = 0; i < 200; i++) {
+      uint64_t r = rng_next(&rng);
+      uint64_t span = (r & 7) ? TEXT_SIZE / 8 : TEXT_SIZE;
+      trace_op op = {OP_READ, TEXT + (r >> 8) % (span - 64),
+                     8 + (r & 0x38), 0, 0};
+      if (trace_push(t, op)) {
+        return -1;
+      }
+    }
+    // Function-sized reads that straddle a few pages.
+    for (int i = 0; i < 20; i++) {
+      uint64_t r = rng_next(&rng);
+      trace_op op = {OP_READ, TEXT + (r >> 8) % (TEXT_SIZE / 8),
+                     PAGE * (1 + (r & 3)), 0, 0};
+      if (trace_push(t, op)) {
+        return -1;
+      }
+    }
+    // A memdiff refresh of several megabytes of text.
+    if (round % 4 == 0) {
+      uint64_t r = rng_next(&rng);
+      trace_op op = {OP_READ, TEXT + ((r >> 8) % 16) * PAGE * 64,
+                     4ull * 1024 * 1024, 0, 0};
+      if (trace_push(t, op)) {
+        return -1;
+      }
+    }
+    // Polling a handful of hot data words, with the odd write.
+    for (int i = 0; i < 50; i++) {
+      uint64_t r = rng_next(&rng);
+      trace_op op = {OP_READ, DATA + (r % 16) * 0x1008, 8, 0, 0};
+      if (trace_push(t, op)) {
+        return -1;
+      }
+    }
+    trace_op w = {OP_WRITE, DATA + (rng_next(&rng) % 16) * 0x1008, 8, 0, 0};
+    if (trace_push(t, w)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+typedef struct {
+  transport t;
+  uint64_t reads;
+  uint64_t wall_ns;
+  page_cache_stats stats;
+} replay_result;
+
+// Replays `tr`, through a cache of `pages` pages or straight to the transport
+// when `pages` is 0. Returns -1 if a read returned the wrong bytes.
+static int replay(const trace *tr, size_t pages, uint8_t *buf,
+                  replay_result *res) {
+  memset(res, 0, sizeof(*res));
+  page_cache *pc = NULL;
+  if (pages) {
+    pc = page_cache_create(pages, PAGE, transport_fill, &res->t);
+    if (!pc) {
+      return -1;
+    }
+  }
+
+  int rc = 0;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < tr->count && rc == 0; i++) {
+    const trace_op *op = &tr->ops[i];
+    switch (op->kind) {
+    case OP_RANGE:
+      if (pc) {
+        page_cache_add_range(pc, op->addr, op->len, op->policy, op->ttl_ms);
+      }
+      break;
+    case OP_READ:
+      res->reads++;
+      if (pc) {
+        rc = page_cache_read(pc, op->addr, buf, op->len);
+      } else {
+        rc = transport_fill(&res->t, op->addr, buf, op->len);
+      }
+      if (rc == 0 && (buf[0] != byte_at(op->addr) ||
+                      buf[op->len - 1] != byte_at(op->addr + op->len - 1) ||
+                      buf[op->len / 2] != byte_at(op->addr + op->len / 2))) {
+        fprintf(stderr, "op %zu: read of 0x%llx returned wrong data\n", i,
+                (unsigned long long)op->addr);
+        rc = -1;
+      }
+      break;
+    case OP_WRITE:
+      if (pc) {
+        page_cache_invalidate(pc, op->addr, op->len);
+      }
+      break;
+    case OP_EPOCH:
+      if (pc) {
+        page_cache_bump_epoch(pc);
+      }
+      break;
+    }
+  }
+  res->wall_ns = now_ns() - start;
+
+  if (pc) {
+    page_cache_get_stats(pc, &res->stats);
+    page_cache_destroy(pc);
+  }
+  return rc;
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 200;
+  size_t pages = 1024;
+  uint64_t call_ns = 5000;      // user/kernel round trip
+  double bytes_per_ns = 4.0;    // ~4 GB/s through the bounce/window paths
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      rounds = 20;
+    } else if (!strcmp(argv[i], "--pages") && i + 1 < argc) {
+      pages = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--call-ns") && i + 1 < argc) {
+      call_ns = strtoull(argv[++i], NULL, 0);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--quick] [--pages N] [--call-ns N] [trace]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  trace tr = {0};
+  if (path ? trace_load(&tr, path) : trace_synthesize(&tr, rounds)) {
+    return 1;
+  }
+
+  uint8_t *buf = malloc(MAX_READ);
+  if (!buf) {
+    return 1;
+  }
+
+  replay_result direct, cached;
+  if (replay(&tr, 0, buf, &direct) || replay(&tr, pages, buf, &cached)) {
+    free(buf);
+    free(tr.ops);
+    return 1;
+  }
+
+  printf("%zu ops, %llu reads, cache %zu pages of 16 KB\n", tr.count,
+         (unsigned long long)direct.reads, pages);
+  printf("%8s %10s %12s %12s %10s\n", "", "calls", "MB fetched",
+         "model ms", "wall ms");
+  const replay_result *rows[] = {&direct, &cached};
+  const char *names[] = {"direct", "cached"};
+  for (int i = 0; i < 2; i++) {
+    double model_ms =
+        ((double)rows[i]->t.calls * (double)call_ns +
+         (double)rows[i]->t.bytes / bytes_per_ns) /
+        1e6;
+    printf("%8s %10llu %12.1f %12.1f %10.1f\n", names[i],
+           (unsigned long long)rows[i]->t.calls,
+           (double)rows[i]->t.bytes / (1024 * 1024), model_ms,
+           (double)rows[i]->wall_ns / 1e6);
+  }
+
+  const page_cache_stats *st = &cached.stats;
+  printf("cache: %llu hits, %llu misses (%llu expired) in %llu fills, "
+         "%llu evictions, %llu bypass reads (%llu large)\n",
+         (unsigned long long)st->hits, (unsigned long long)st->misses,
+         (unsigned long long)st->expired, (unsigned long long)st->fills,
+         (unsigned long long)st->evictions,
+         (unsigned long long)st->bypass_reads,
+         (unsigned long long)st->large_reads);
+
+  free(buf);
+  free(tr.ops);
+  return 0;
+}
@@ -0,0 +1,227 @@
+// page_cache.c against a synthetic kernel whose byte at `addr` is a function
+// of the address, so every read can be checked and every fill counted.
+
+#include "kernel/page_cache.h"
+#include "test_util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE 0x4000ull
+#define TEXT 0xfffffe0007004000ull
+#define DATA 0xfffffe0009000000ull
+#define OTHER 0xfffffe0010000000ull
+
+typedef struct {
+  uint32_t calls;
+  uint64_t bytes;
+  uint64_t last_len;
+  uint8_t salt;       // changes "kernel memory" when bumped
+  uint64_t bad_start; // fills overlapping [bad_start, bad_end) fail
+  uint64_t bad_end;
+} fake_kernel;
+
+static uint8_t byte_at(const fake_kernel *k, uint64_t addr) {
+  return (uint8_t)((addr >> 3) ^ (addr >> 14) ^ k->salt);
+}
+
+static int fake_fill(void *ctx, uint64_t addr, void *buf, size_t len) {
+  fake_kernel *k = ctx;
+  k->calls++;
+  k->bytes += len;
+  k->last_len = len;
+  if (addr < k->bad_end && addr + len > k->bad_start) {
+    return 5;
+  }
+  for (size_t i = 0; i < len; i++) {
+    ((uint8_t *)buf)[i] = byte_at(k, addr + i);
+  }
+  return 0;
+}
+
+static bool matches(const fake_kernel *k, uint64_t addr, const uint8_t *buf,
+                    size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (buf[i] != byte_at(k, addr + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint8_t g_buf[8 * 1024 * 1024];
+
+static void test_run_coalescing(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(256, PAGE, fake_fill, &k);
+  CHECK(pc != NULL);
+  CHECK_EQ(page_cache_add_range(pc, TEXT, 64 * PAGE,
+                                PAGE_CACHE_POLICY_IMMUTABLE, 0),
+           0);
+
+  // Ten pages starting mid-page: one fill of eleven whole pages.
+  uint64_t addr = TEXT + 0x123;
+  size_t len = 10 * PAGE;
+  CHECK_EQ(page_cache_read(pc, addr, g_buf, len), 0);
+  CHECK(matches(&k, addr, g_buf, len));
+  CHECK_EQ(k.calls, 1);
+  CHECK_EQ(k.last_len, 11 * PAGE);
+
+  // Same span again is served from memory.
+  memset(g_buf, 0, len);
+  CHECK_EQ(page_cache_read(pc, addr, g_buf, len), 0);
+  CHECK(matches(&k, addr, g_buf, len));
+  CHECK_EQ(k.calls, 1);
+
+  // Two separate holes are two runs; the pages between them are hits.
+  page_cache_invalidate(pc, TEXT + 4 * PAGE, PAGE);
+  page_cache_invalidate(pc, TEXT + 7 * PAGE, PAGE);
+  CHECK_EQ(page_cache_read(pc, TEXT + 3 * PAGE, g_buf, 6 * PAGE), 0);
+  CHECK(matches(&k, TEXT + 3 * PAGE, g_buf, 6 * PAGE));
+  CHECK_EQ(k.calls, 3);
+
+  page_cache_stats st;
+  page_cache_get_stats(pc, &st);
+  CHECK_EQ(st.fills, 3);
+  CHECK_EQ(st.hits, 11 + 4);
+  page_cache_destroy(pc);
+}
+
+static void test_large_reads_bypass(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(1024, PAGE, fake_fill, &k);
+  CHECK_EQ(page_cache_add_range(pc, TEXT, 512 * PAGE,
+                                PAGE_CACHE_POLICY_IMMUTABLE, 0),
+           0);
+
+  size_t len = (PAGE_CACHE_MAX_RUN + 1) * PAGE;
+  CHECK(len <= sizeof(g_buf));
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, len), 0);
+  CHECK(matches(&k, TEXT, g_buf, len));
+  CHECK_EQ(k.calls, 1);
+  CHECK_EQ(k.last_len, len);
+
+  page_cache_stats st;
+  page_cache_get_stats(pc, &st);
+  CHECK_EQ(st.large_reads, 1);
+  CHECK_EQ(st.misses, 0); // nothing was cached
+
+  // A read of exactly one run is still cached.
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, PAGE_CACHE_MAX_RUN * PAGE), 0);
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, PAGE_CACHE_MAX_RUN * PAGE), 0);
+  CHECK_EQ(k.calls, 2);
+  page_cache_destroy(pc);
+}
+
+static void test_mixed_bypass_and_cached(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(64, PAGE, fake_fill, &k);
+  CHECK_EQ(page_cache_add_range(pc, TEXT + 4 * PAGE, 4 * PAGE,
+                                PAGE_CACHE_POLICY_IMMUTABLE, 0),
+           0);
+
+  // 2 uncached pages, 4 cached, 2 uncached: three fills.
+  CHECK_EQ(page_cache_read(pc, TEXT + 2 * PAGE, g_buf, 8 * PAGE), 0);
+  CHECK(matches(&k, TEXT + 2 * PAGE, g_buf, 8 * PAGE));
+  CHECK_EQ(k.calls, 3);
+
+  page_cache_stats st;
+  page_cache_get_stats(pc, &st);
+  CHECK_EQ(st.bypass_reads, 2);
+  CHECK_EQ(st.fills, 1);
+  CHECK_EQ(st.misses, 4);
+  page_cache_destroy(pc);
+}
+
+static void test_failed_run_falls_back(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(64, PAGE, fake_fill, &k);
+  CHECK_EQ(page_cache_add_range(pc, TEXT, 16 * PAGE,
+                                PAGE_CACHE_POLICY_IMMUTABLE, 0),
+           0);
+
+  // The run fill fails because of one bad page; the others still get cached.
+  k.bad_start = TEXT + 3 * PAGE;
+  k.bad_end = TEXT + 4 * PAGE;
+  CHECK(page_cache_read(pc, TEXT, g_buf, 6 * PAGE) != 0);
+
+  k.bad_start = k.bad_end = 0;
+  uint32_t before = k.calls;
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, 3 * PAGE), 0);
+  CHECK(matches(&k, TEXT, g_buf, 3 * PAGE));
+  CHECK_EQ(k.calls, before);
+  page_cache_destroy(pc);
+}
+
+static void test_data_policies(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(64, PAGE, fake_fill, &k);
+  CHECK_EQ(page_cache_add_range(pc, DATA, 8 * PAGE, PAGE_CACHE_POLICY_TTL, 20),
+           0);
+  CHECK_EQ(page_cache_add_range(pc, OTHER, 8 * PAGE, PAGE_CACHE_POLICY_EPOCH,
+                                0),
+           0);
+
+  CHECK_EQ(page_cache_read(pc, DATA, g_buf, 64), 0);
+  CHECK_EQ(page_cache_read(pc, OTHER, g_buf, 64), 0);
+  CHECK_EQ(k.calls, 2);
+
+  // Kernel memory changes; both copies are still considered fresh.
+  k.salt = 0x5a;
+  CHECK_EQ(page_cache_read(pc, DATA, g_buf, 64), 0);
+  CHECK_EQ(page_cache_read(pc, OTHER, g_buf, 64), 0);
+  CHECK_EQ(k.calls, 2);
+
+  page_cache_bump_epoch(pc);
+  CHECK_EQ(page_cache_read(pc, OTHER, g_buf, 64), 0);
+  CHECK(matches(&k, OTHER, g_buf, 64));
+  CHECK_EQ(k.calls, 3);
+
+  struct timespec ts = {0, 30 * 1000000};
+  nanosleep(&ts, NULL);
+  CHECK_EQ(page_cache_read(pc, DATA, g_buf, 64), 0);
+  CHECK(matches(&k, DATA, g_buf, 64));
+  CHECK_EQ(k.calls, 4);
+
+  page_cache_stats st;
+  page_cache_get_stats(pc, &st);
+  CHECK_EQ(st.expired, 2);
+  page_cache_destroy(pc);
+}
+
+static void test_eviction(void) {
+  fake_kernel k = {0};
+  page_cache *pc = page_cache_create(8, PAGE, fake_fill, &k);
+  CHECK_EQ(page_cache_add_range(pc, TEXT, 64 * PAGE,
+                                PAGE_CACHE_POLICY_IMMUTABLE, 0),
+           0);
+
+  // The run length is capped at the capacity.
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, 8 * PAGE), 0);
+  CHECK_EQ(page_cache_read(pc, TEXT + 8 * PAGE, g_buf, 4 * PAGE), 0);
+  CHECK(matches(&k, TEXT + 8 * PAGE, g_buf, 4 * PAGE));
+  CHECK_EQ(k.calls, 2);
+
+  page_cache_stats st;
+  page_cache_get_stats(pc, &st);
+  CHECK_EQ(st.evictions, 4);
+
+  // The most recent pages survived, the oldest did not.
+  CHECK_EQ(page_cache_read(pc, TEXT + 4 * PAGE, g_buf, 8 * PAGE), 0);
+  CHECK_EQ(k.calls, 2);
+  CHECK_EQ(page_cache_read(pc, TEXT, g_buf, PAGE), 0);
+  CHECK_EQ(k.calls, 3);
+  page_cache_destroy(pc);
+}
+
+int main(void) {
+  test_run_coalescing();
+  test_large_reads_bypass();
+  test_mixed_bypass_and_cached();
+  test_failed_run_falls_back();
+  test_data_policies();
+  test_eviction();
+  return test_failures("page_cache_test");
+}
@@ -0,0 +1,269 @@
+// Tests for kernel/phys_scan.c and calypso/phys_ranges.h: the safe-range
+// arithmetic the kext uses to carve SEP/TZ regions out of DRAM, and the
+// parallel sweep over those ranges. The sweep must find exactly the matches
+// a brute-force search finds (including ones straddling chunk boundaries),
+// in order and without duplicates, with any number of workers, and must
+// never read a carved-out byte.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "calypso/phys_ranges.h"
+#include "kernel/phys_scan.h"
+#include "test_util.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DRAM_BASE 0x800000000ull
+#define DRAM_SIZE (4u * 1024 * 1024)
+#define PAGE 0x4000u
+
+static void test_subtract(void) {
+  phys_range r[4] = {{0x1000, 0x9000}};
+  uint32_t n = 1;
+
+  // Hole in the middle splits the range.
+  n = phys_ranges_subtract(r, n, 4, 0x3000, 0x1000);
+  CHECK_EQ(n, 2);
+  CHECK_EQ(r[0].base, 0x1000);
+  CHECK_EQ(r[0].size, 0x2000);
+  CHECK_EQ(r[1].base, 0x4000);
+  CHECK_EQ(r[1].size, 0x6000);
+
+  // Prefix and suffix trims.
+  n = phys_ranges_subtract(r, n, 4, 0x0, 0x1800);
+  n = phys_ranges_subtract(r, n, 4, 0x9000, 0x8000);
+  CHECK_EQ(n, 2);
+  CHECK_EQ(r[0].base, 0x1800);
+  CHECK_EQ(r[0].size, 0x1800);
+  CHECK_EQ(r[1].base, 0x4000);
+  CHECK_EQ(r[1].size, 0x5000);
+
+  // A hole spanning the gap trims both neighbours.
+  n = phys_ranges_subtract(r, n, 4, 0x2800, 0x2000);
+  CHECK_EQ(n, 2);
+  CHECK_EQ(r[0].size, 0x1000);
+  CHECK_EQ(r[1].base, 0x4800);
+
+  // Non-overlapping and empty holes change nothing.
+  n = phys_ranges_subtract(r, n, 4, 0x20000, 0x1000);
+  n = phys_ranges_subtract(r, n, 4, 0x1800, 0);
+  CHECK_EQ(n, 2);
+
+  // Covering a whole range removes it.
+  n = phys_ranges_subtract(r, n, 4, 0x1800, 0x1000);
+  CHECK_EQ(n, 1);
+  CHECK_EQ(r[0].base, 0x4800);
+
+  // At capacity a split keeps only the low piece: the list never grows
+  // past `cap` and never gains memory.
+  n = phys_ranges_subtract(r, n, 1, 0x5000, 0x1000);
+  CHECK_EQ(n, 1);
+  CHECK_EQ(r[0].base, 0x4800);
+  CHECK_EQ(r[0].size, 0x800);
+
+  // A hole whose end would overflow is clamped to the top.
+  phys_range top[1] = {{UINT64_MAX - 0x1000, 0x1000}};
+  CHECK_EQ(phys_ranges_subtract(top, 1, 1, UINT64_MAX - 0x800, UINT64_MAX), 1);
+  CHECK_EQ(top[0].size, 0x800);
+
+  phys_range c[2] = {{0x1000, 0x1000}, {0x3000, 0x1000}};
+  CHECK(phys_ranges_contains(c, 2, 0x1000, 0x1000));
+  CHECK(phys_ranges_contains(c, 2, 0x3800, 0x800));
+  CHECK(!phys_ranges_contains(c, 2, 0x1800, 0x1000)); // runs into the gap
+  CHECK(!phys_ranges_contains(c, 2, 0x1800, 0x2000)); // spans two ranges
+  CHECK(!phys_ranges_contains(c, 2, 0x3800, UINT64_MAX));
+  CHECK(!phys_ranges_contains(c, 2, 0x0, 0x10));
+}
+
+typedef struct {
+  const uint8_t *image;       // backs [DRAM_BASE, DRAM_BASE + DRAM_SIZE)
+  const phys_range *carveouts; // must never be read
+  uint32_t carveout_count;
+  uint64_t fail_start, fail_end; // reads touching this fail
+  _Atomic uint32_t carveout_reads;
+} sim_dram;
+
+static int sim_read(void *ctx, uint64_t paddr, void *buf, size_t len) {
+  sim_dram *d = ctx;
+  if (paddr < DRAM_BASE || paddr - DRAM_BASE > DRAM_SIZE ||
+      len > DRAM_SIZE - (paddr - DRAM_BASE)) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < d->carveout_count; i++) {
+    const phys_range *c = &d->carveouts[i];
+    if (paddr < c->base + c->size && paddr + len > c->base) {
+      atomic_fetch_add(&d->carveout_reads, 1);
+      return -1;
+    }
+  }
+  if (paddr < d->fail_end && paddr + len > d->fail_start) {
+    return -1;
+  }
+  memcpy(buf, d->image + (paddr - DRAM_BASE), len);
+  return 0;
+}
+
+// Brute-force reference: every stride-aligned offset from each range start
+// where the whole pattern fits in the range and matches.
+static uint32_t reference_scan(const uint8_t *image, const phys_range *r,
+                               uint32_t count, const uint8_t *pattern,
+                               size_t len, size_t stride, uint64_t *out,
+                               uint32_t max) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint64_t off = 0; off + len <= r[i].size; off += stride) {
+      uint64_t pa = r[i].base + off;
+      if (!memcmp(image + (pa - DRAM_BASE), pattern, len) && n < max) {
+        out[n++] = pa;
+      }
+    }
+  }
+  return n;
+}
+
+static void plant(uint8_t *image, uint64_t pa, const uint8_t *p, size_t len) {
+  memcpy(image + (pa - DRAM_BASE), p, len);
+}
+
+static void test_scan(void) {
+  uint8_t *image = malloc(DRAM_SIZE);
+  if (!image) {
+    CHECK(image != NULL);
+    return;
+  }
+  uint64_t x = 0x243F6A8885A308D3ull;
+  for (size_t i = 0; i < DRAM_SIZE; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    image[i] = (uint8_t)(x >> 32);
+  }
+
+  static const uint8_t magic[8] = {0xcf, 0xfa, 0xed, 0xfe, 0x0c, 0x00, 0x00, 0x01};
+  const size_t chunk = 64 * 1024;
+
+  // Two carve-outs, like SEP near the top and a TZ region in the middle.
+  phys_range carveouts[2] = {
+      {DRAM_BASE + 0x130000, 0x28000},
+      {DRAM_BASE + DRAM_SIZE - 0x80000, 0x80000},
+  };
+  phys_range safe[8] = {{DRAM_BASE, DRAM_SIZE}};
+  uint32_t safe_count = 1;
+  for (int i = 0; i < 2; i++) {
+    safe_count = phys_ranges_subtract(safe, safe_count, 8, carveouts[i].base,
+                                      carveouts[i].size);
+  }
+  CHECK_EQ(safe_count, 2);
+
+  // Matches on pages, inside carve-outs (must not be found), straddling
+  // chunk boundaries (unaligned stride) and at the very end of a range.
+  for (uint64_t pa = DRAM_BASE; pa < DRAM_BASE + DRAM_SIZE; pa += 7 * PAGE) {
+    plant(image, pa, magic, sizeof(magic));
+  }
+  plant(image, carveouts[0].base + PAGE, magic, sizeof(magic));
+  plant(image, carveouts[1].base + 2 * PAGE, magic, sizeof(magic));
+  plant(image, DRAM_BASE + chunk - 4, magic, sizeof(magic));
+  plant(image, DRAM_BASE + 3 * chunk - 2, magic, sizeof(magic));
+  plant(image, safe[0].base + safe[0].size - sizeof(magic), magic,
+        sizeof(magic));
+
+  static uint64_t expected[4096];
+  static uint64_t found[4096];
+  static const size_t kStrides[] = {PAGE, 2, 1};
+  static const uint32_t kThreads[] = {1, 3, 8, 33};
+  for (size_t s = 0; s < sizeof(kStrides) / sizeof(kStrides[0]); s++) {
+    uint32_t want = reference_scan(image, safe, safe_count, magic,
+                                   sizeof(magic), kStrides[s], expected,
+                                   4096);
+    CHECK(want > 0);
+    for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); t++) {
+      sim_dram d = {.image = image, .carveouts = carveouts,
+                    .carveout_count = 2};
+      phys_scan_params params = {
+          .read = sim_read, .ctx = &d, .ranges = safe,
+          .range_count = safe_count, .pattern = magic, .mask = "xxxxxxxx",
+          .stride = kStrides[s], .chunk_size = chunk, .threads = kThreads[t]};
+      phys_scan_result res = {.results = found, .max_results = 4096};
+      CHECK_EQ(phys_scan(&params, &res), 0);
+      CHECK_EQ(res.count, want);
+      CHECK(!res.truncated);
+      CHECK(memcmp(found, expected, want * sizeof(uint64_t)) == 0);
+      CHECK_EQ(res.unreadable_bytes, 0);
+      CHECK(res.bytes_scanned >= safe[0].size + safe[1].size);
+      CHECK_EQ(atomic_load(&d.carveout_reads), 0);
+    }
+  }
+
+  // The whole DRAM window, as pd_phys_scan() used to sweep it: carve-out
+  // reads fail and are accounted as unreadable, never as matches.
+  {
+    sim_dram d = {.image = image, .carveouts = carveouts, .carveout_count = 2};
+    phys_range dram = {DRAM_BASE, DRAM_SIZE};
+    phys_scan_params params = {
+        .read = sim_read, .ctx = &d, .ranges = &dram, .range_count = 1,
+        .pattern = magic, .mask = "xxxxxxxx", .stride = PAGE,
+        .chunk_size = chunk, .threads = 4};
+    phys_scan_result res = {.results = found, .max_results = 4096};
+    CHECK_EQ(phys_scan(&params, &res), 0);
+    CHECK(atomic_load(&d.carveout_reads) > 0);
+    CHECK(res.unreadable_bytes >= carveouts[0].size + carveouts[1].size);
+    for (uint32_t i = 0; i < res.count; i++) {
+      CHECK(phys_ranges_contains(safe, safe_count, found[i], sizeof(magic)));
+    }
+  }
+
+  // A failing stretch inside a safe range is skipped and counted.
+  {
+    sim_dram d = {.image = image, .carveouts = carveouts, .carveout_count = 2,
+                  .fail_start = DRAM_BASE + 5 * chunk,
+                  .fail_end = DRAM_BASE + 5 * chunk + 1};
+    phys_scan_params params = {
+        .read = sim_read, .ctx = &d, .ranges = safe,
+        .range_count = safe_count, .pattern = magic, .mask = "xxxxxxxx",
+        .stride = PAGE, .chunk_size = chunk, .threads = 4};
+    phys_scan_result res = {.results = found, .max_results = 4096};
+    CHECK_EQ(phys_scan(&params, &res), 0);
+    CHECK(res.unreadable_bytes > 0);
+    uint32_t all = reference_scan(image, safe, safe_count, magic,
+                                  sizeof(magic), PAGE, expected, 4096);
+    CHECK(res.count < all);
+    for (uint32_t i = 1; i < res.count; i++) {
+      CHECK(found[i - 1] < found[i]);
+    }
+  }
+
+  // Truncation: exactly max_results, sorted, each a real match.
+  {
+    sim_dram d = {.image = image, .carveouts = carveouts, .carveout_count = 2};
+    uint32_t all = reference_scan(image, safe, safe_count, magic,
+                                  sizeof(magic), PAGE, expected, 4096);
+    phys_scan_params params = {
+        .read = sim_read, .ctx = &d, .ranges = safe,
+        .range_count = safe_count, .pattern = magic, .mask = "xxxxxxxx",
+        .stride = PAGE, .chunk_size = chunk, .threads = 8};
+    phys_scan_result res = {.results = found, .max_results = 5};
+    CHECK_EQ(phys_scan(&params, &res), 0);
+    CHECK(all > 5);
+    CHECK(res.truncated);
+    CHECK_EQ(res.count, 5);
+    for (uint32_t i = 0; i < res.count; i++) {
+      CHECK(i == 0 || found[i - 1] < found[i]);
+      bool known = false;
+      for (uint32_t j = 0; j < all; j++) {
+        known |= expected[j] == found[i];
+      }
+      CHECK(known);
+    }
+  }
+
+  free(image);
+}
+
+int main(void) {
+  test_subtract();
+  test_scan();
+  return test_failures("phys_scan_test");
+}
@@ -0,0 +1,223 @@
+// pt_walk.c against a synthetic TTBR1 page-table image: 16 KB granule and
+// T1SZ = 25, the layout XNU uses on Apple silicon. That gives 39-bit kernel
+// VAs and a three-level walk starting at level 1, which has 8 entries; level
+// 2 maps 32 MB blocks and level 3 maps 16 KB pages.
+
+#include "kernel/pt_walk.h"
+#include "test_util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GRANULE 0x4000ull
+#define ENTRIES (GRANULE / 8) // 2048 descriptors per table
+#define L1_SHIFT 36
+#define L2_SHIFT 25
+#define L3_SHIFT 14
+#define SPACE_START 0xffffff8000000000ull // ~0 << 39
+
+#define TCR_T1SZ(x) ((uint64_t)(x) << 16)
+#define TCR_EPD1 (1ull << 23)
+#define TCR_TG1_16K (1ull << 30)
+#define TCR_HPD1 (1ull << 42)
+
+#define DESC_VALID (1ull << 0)
+#define DESC_TABLE (3ull)
+#define DESC_AF (1ull << 10)
+#define DESC_AP_EL0 (1ull << 6)
+#define DESC_AP_RO (1ull << 7)
+#define DESC_NG (1ull << 11)
+#define DESC_PXN (1ull << 53)
+#define DESC_UXN (1ull << 54)
+#define DESC_PXN_TABLE (1ull << 59)
+#define DESC_AP_TABLE_NO_EL0 (1ull << 61)
+#define DESC_AP_TABLE_RO (1ull << 62)
+#define ATTR(idx, sh) (((uint64_t)(idx) << 2) | ((uint64_t)(sh) << 8))
+
+#define L1_PA 0x100000000ull
+#define L2A_PA 0x100004000ull
+#define L3_PA 0x100008000ull
+#define L2B_PA 0x10000c000ull
+#define MISSING_PA 0x1fff00000ull // a table that cannot be read
+
+typedef struct {
+  uint64_t pa;
+  uint64_t desc[ENTRIES];
+} fixture_table;
+
+static fixture_table g_tables[4];
+static uint32_t g_reads;
+
+static int fixture_read(void *ctx, uint64_t paddr, void *buf, size_t len) {
+  (void)ctx;
+  g_reads++;
+  for (size_t i = 0; i < sizeof(g_tables) / sizeof(g_tables[0]); i++) {
+    if (g_tables[i].pa == paddr && len <= sizeof(g_tables[i].desc)) {
+      memcpy(buf, g_tables[i].desc, len);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static uint64_t va_of(uint64_t l1, uint64_t l2, uint64_t l3) {
+  return SPACE_START + (l1 << L1_SHIFT) + (l2 << L2_SHIFT) + (l3 << L3_SHIFT);
+}
+
+static void build_fixture(void) {
+  memset(g_tables, 0, sizeof(g_tables));
+  fixture_table *l1 = &g_tables[0];
+  fixture_table *l2a = &g_tables[1];
+  fixture_table *l3 = &g_tables[2];
+  fixture_table *l2b = &g_tables[3];
+  l1->pa = L1_PA;
+  l2a->pa = L2A_PA;
+  l3->pa = L3_PA;
+  l2b->pa = L2B_PA;
+
+  l1->desc[0] = L2A_PA | DESC_TABLE;
+  // 16 KB granule has no level 1 blocks: this must be ignored.
+  l1->desc[1] = 0x2000000000ull | DESC_VALID | DESC_AF;
+  l1->desc[2] = L2B_PA | DESC_TABLE | DESC_AP_TABLE_RO | DESC_PXN_TABLE |
+                DESC_AP_TABLE_NO_EL0;
+  l1->desc[7] = MISSING_PA | DESC_TABLE;
+
+  // Two physically contiguous 32 MB blocks with equal attributes merge;
+  // the third continues them physically but differs in PXN.
+  l2a->desc[0] = 0x800000000ull | DESC_VALID | DESC_AF | ATTR(2, 3);
+  l2a->desc[1] = 0x802000000ull | DESC_VALID | DESC_AF | ATTR(2, 3);
+  l2a->desc[2] = 0x804000000ull | DESC_VALID | DESC_AF | ATTR(2, 3) | DESC_PXN;
+  l2a->desc[3] = L3_PA | DESC_TABLE;
+  l2a->desc[5] = 0x806000000ull; // invalid
+
+  // Four contiguous pages, a hole, then two pages that differ in flags.
+  for (uint64_t i = 0; i < 4; i++) {
+    l3->desc[i] = (0x900000000ull + i * GRANULE) | DESC_TABLE | DESC_AF |
+                  ATTR(0, 3);
+  }
+  l3->desc[5] = (0x900000000ull + 5 * GRANULE) | DESC_TABLE | DESC_AF |
+                ATTR(0, 3) | DESC_AP_RO | DESC_UXN | DESC_NG;
+  l3->desc[6] = (0x900000000ull + 6 * GRANULE) | DESC_TABLE | DESC_AF |
+                ATTR(0, 3) | DESC_AP_EL0;
+  // A block descriptor at level 3 is reserved and must be ignored.
+  l3->desc[9] = (0x900000000ull + 9 * GRANULE) | DESC_VALID | DESC_AF;
+
+  l2b->desc[0] = 0xa00000000ull | DESC_VALID | DESC_AF | ATTR(1, 2) |
+                 DESC_AP_EL0;
+}
+
+static void check_region(const pt_region *r, uint64_t vaddr, uint64_t paddr,
+                         uint64_t size, uint32_t flags, uint8_t attr,
+                         uint8_t sh) {
+  CHECK_EQ(r->vaddr, vaddr);
+  CHECK_EQ(r->paddr, paddr);
+  CHECK_EQ(r->size, size);
+  CHECK_EQ(r->flags, flags);
+  CHECK_EQ(r->attr_index, attr);
+  CHECK_EQ(r->shareability, sh);
+}
+
+static const uint64_t kTcr = TCR_T1SZ(25) | TCR_TG1_16K;
+
+static void test_full_walk(void) {
+  pt_walk_params params = {
+      .read = fixture_read,
+      .ttbr1 = L1_PA | 1, // CnP must be masked off
+      .tcr = kTcr,
+  };
+  pt_map map;
+  g_reads = 0;
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), 0);
+  CHECK_EQ(map.table_reads, 4);
+  CHECK_EQ(map.table_faults, 1);
+  CHECK_EQ(g_reads, 5);
+
+  CHECK_EQ(map.count, 6);
+  if (map.count == 6) {
+    check_region(&map.regions[0], va_of(0, 0, 0), 0x800000000ull,
+                 2ull << L2_SHIFT, 0, 2, 3);
+    check_region(&map.regions[1], va_of(0, 2, 0), 0x804000000ull,
+                 1ull << L2_SHIFT, PT_REGION_PXN, 2, 3);
+    check_region(&map.regions[2], va_of(0, 3, 0), 0x900000000ull,
+                 4 * GRANULE, 0, 0, 3);
+    check_region(&map.regions[3], va_of(0, 3, 5), 0x900000000ull + 5 * GRANULE,
+                 GRANULE, PT_REGION_READ_ONLY | PT_REGION_UXN | PT_REGION_NG,
+                 0, 3);
+    check_region(&map.regions[4], va_of(0, 3, 6), 0x900000000ull + 6 * GRANULE,
+                 GRANULE, PT_REGION_EL0, 0, 3);
+    // APTable/PXNTable apply; APTable[0] hides the EL0 bit.
+    check_region(&map.regions[5], va_of(2, 0, 0), 0xa00000000ull,
+                 1ull << L2_SHIFT, PT_REGION_READ_ONLY | PT_REGION_PXN, 1, 2);
+  }
+
+  // Lookups.
+  const pt_region *r = pt_map_find(&map, va_of(0, 1, 0) + 0x1234);
+  CHECK(r == &map.regions[0]);
+  CHECK(pt_map_find(&map, va_of(0, 3, 4)) == NULL); // the hole
+  CHECK(pt_map_find(&map, va_of(1, 0, 0)) == NULL); // ignored L1 block
+  CHECK(pt_map_find(&map, SPACE_START - 1) == NULL);
+  uint64_t next = 0;
+  CHECK(pt_map_next_mapped(&map, va_of(0, 3, 4), &next));
+  CHECK_EQ(next, va_of(0, 3, 5));
+  CHECK(pt_map_next_mapped(&map, va_of(0, 3, 5) + 8, &next));
+  CHECK_EQ(next, va_of(0, 3, 5) + 8);
+  CHECK(pt_map_next_mapped(&map, va_of(0, 4, 0), &next));
+  CHECK_EQ(next, va_of(2, 0, 0));
+  CHECK(!pt_map_next_mapped(&map, va_of(2, 1, 0), &next));
+  pt_map_free(&map);
+}
+
+static void test_hpd_and_window(void) {
+  // With hierarchical permissions disabled, table attributes are ignored.
+  pt_walk_params params = {
+      .read = fixture_read, .ttbr1 = L1_PA, .tcr = kTcr | TCR_HPD1};
+  pt_map map;
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), 0);
+  const pt_region *r = pt_map_find(&map, va_of(2, 0, 0));
+  CHECK(r != NULL);
+  if (r) {
+    CHECK_EQ(r->flags, PT_REGION_EL0);
+  }
+  pt_map_free(&map);
+
+  // A window covering only part of the level 3 table: untouched tables are
+  // not read, and edge regions are kept whole.
+  params.tcr = kTcr;
+  params.va_start = va_of(0, 3, 2);
+  params.va_end = va_of(0, 3, 6);
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), 0);
+  CHECK_EQ(map.table_reads, 3); // L1, L2A, L3
+  CHECK_EQ(map.table_faults, 0);
+  CHECK_EQ(map.count, 2);
+  if (map.count == 2) {
+    check_region(&map.regions[0], va_of(0, 3, 2), 0x900000000ull + 2 * GRANULE,
+                 2 * GRANULE, 0, 0, 3);
+    CHECK_EQ(map.regions[1].vaddr, va_of(0, 3, 5));
+  }
+  pt_map_free(&map);
+}
+
+static void test_tcr_handling(void) {
+  pt_map map;
+  pt_walk_params params = {.read = fixture_read, .ttbr1 = L1_PA};
+
+  params.tcr = kTcr | TCR_EPD1; // TTBR1 walks disabled
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), 0);
+  CHECK_EQ(map.count, 0);
+  pt_map_free(&map);
+
+  params.tcr = TCR_T1SZ(25); // TG1 = 0 is reserved
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), -1);
+  params.tcr = TCR_T1SZ(10) | TCR_TG1_16K; // 54-bit VAs are out of range
+  CHECK_EQ(pt_walk_ttbr1(&params, &map), -1);
+  CHECK_EQ(pt_walk_ttbr1(NULL, &map), -1);
+}
+
+int main(void) {
+  build_fixture();
+  test_full_walk();
+  test_hpd_and_window();
+  test_tcr_handling();
+  return test_failures("pt_walk_test");
+}
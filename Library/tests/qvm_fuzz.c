@@ -0,0 +1,274 @@
+// Fuzz target for calypso/query_vm.h. Each input is split into a header
+// (limits and initial registers) and a program; the program is verified and,
+// if accepted, run against a simulated memory image. The read callback checks
+// every access against the image, and the run must respect the caller's step,
+// read-byte and output limits whatever the program does.
+//
+// With clang and -DPANDORA_LIBFUZZER=ON this builds as a libFuzzer target:
+//   qvm_fuzz [corpus dir] [libFuzzer flags]
+// Otherwise it links its own driver, which replays files given on the
+// command line or runs seeded random inputs:
+//   qvm_fuzz [--quick] [--iterations N] [--seed N] [files...]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "calypso/query_vm.h"
+#include "test_util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_BASE 0xfffffe0007000000ull
+#define IMAGE_SIZE (64 * 1024)
+#define OUT_CAP 8192
+#define MAX_STEPS_CAP 100000
+#define MAX_READ_CAP (1024 * 1024)
+
+typedef struct {
+  const uint8_t *image;
+  uint64_t reads;
+} sim_memory;
+
+static uint8_t g_image[IMAGE_SIZE];
+
+static bool sim_read(void *ctx, uint64_t addr, void *out, size_t len) {
+  sim_memory *mem = ctx;
+  if (addr < IMAGE_BASE || addr - IMAGE_BASE > IMAGE_SIZE ||
+      len > IMAGE_SIZE - (addr - IMAGE_BASE)) {
+    return false;
+  }
+  memcpy(out, mem->image + (addr - IMAGE_BASE), len);
+  mem->reads++;
+  return true;
+}
+
+// The image is a web of kernel-looking pointers (some PAC-signed) back into
+// itself, so random programs can chase several hops before faulting.
+static void build_image(void) {
+  uint64_t x = 0x9E3779B97F4A7C15ull;
+  for (size_t off = 0; off < IMAGE_SIZE; off += 8) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t word = x;
+    if ((x & 3) != 0) {
+      word = IMAGE_BASE + ((x >> 8) % IMAGE_SIZE & ~7ull);
+      if ((x & 3) == 1) {
+        word = (word & 0x007fffffffffffffull) | (x & 0xff00000000000000ull) |
+               (1ull << 55); // signed but still a kernel pointer
+      }
+    }
+    memcpy(g_image + off, &word, sizeof(word));
+  }
+}
+
+static uint64_t take_u64(const uint8_t **data, size_t *size) {
+  uint64_t v = 0;
+  size_t n = *size < sizeof(v) ? *size : sizeof(v);
+  memcpy(&v, *data, n);
+  *data += n;
+  *size -= n;
+  return v;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static bool built;
+  if (!built) {
+    build_image();
+    built = true;
+  }
+
+  uint64_t limits = take_u64(&data, &size);
+  qvm_state st;
+  memset(&st, 0, sizeof(st));
+  sim_memory mem = {.image = g_image};
+  uint8_t out[OUT_CAP + 16];
+  memset(out + OUT_CAP, 0xA5, 16);
+
+  st.read = sim_read;
+  st.ctx = &mem;
+  st.out = out;
+  st.out_cap = (size_t)(limits & 0x1fff) % (OUT_CAP + 1);
+  st.max_steps = ((limits >> 16) & 0xffff) * 2 % MAX_STEPS_CAP;
+  st.max_read_bytes = ((limits >> 32) & 0xfffff) % MAX_READ_CAP;
+  for (int i = 0; i < 2; i++) {
+    // Inputs usually point into the image; the fuzzer can still pick any value.
+    uint64_t v = take_u64(&data, &size);
+    st.regs[i] = (v & 1) ? IMAGE_BASE + (v >> 1) % IMAGE_SIZE : v;
+  }
+
+  qvm_insn prog[QVM_MAX_INSNS + 1];
+  uint32_t count = 0;
+  while (size >= sizeof(qvm_insn) && count < QVM_MAX_INSNS + 1) {
+    memcpy(&prog[count], data, sizeof(qvm_insn));
+    // Keep the opcode mostly in range so verification is not the only thing
+    // exercised; out-of-range values still come through.
+    if (prog[count].op >= 2 * QVM_OP_COUNT) {
+      prog[count].op %= QVM_OP_COUNT;
+    }
+    if (prog[count].target > QVM_MAX_INSNS + 1) {
+      prog[count].target %= QVM_MAX_INSNS + 2;
+    }
+    data += sizeof(qvm_insn);
+    size -= sizeof(qvm_insn);
+    count++;
+  }
+
+  qvm_status verified = qvm_verify(prog, count);
+  qvm_status status = qvm_run(prog, count, &st);
+  if (verified != QVM_OK) {
+    CHECK_EQ(status, QVM_ERR_INVALID);
+    CHECK_EQ(st.steps, 0);
+  }
+  CHECK(status <= QVM_ERR_OUTPUT_FULL);
+  CHECK(st.steps <= st.max_steps);
+  CHECK(st.read_bytes <= st.max_read_bytes);
+  CHECK(st.out_len <= st.out_cap);
+  CHECK(st.pc <= count);
+  for (int i = 0; i < 16; i++) {
+    CHECK_EQ(out[OUT_CAP + i], 0xA5);
+  }
+  if (g_test_failures) {
+    abort(); // let the fuzzer record the input
+  }
+  return 0;
+}
+
+#ifndef PANDORA_LIBFUZZER
+
+// Chases IMAGE_BASE -> [+0x10] -> strip -> [+0] and emits both hops; a
+// known-good program so the driver also checks results, not only limits.
+static void check_pointer_chase(void) {
+  build_image();
+  uint64_t first = 0;
+  memcpy(&first, g_image + 0x10, sizeof(first));
+  first = qvm_strip(first, 39);
+
+  const qvm_insn prog[] = {
+      {.op = QVM_OP_LOAD, .dst = 1, .src = 0, .size = 8, .imm = 0x10},
+      {.op = QVM_OP_STRIP, .dst = 1, .src = 1, .imm = 39},
+      {.op = QVM_OP_EMIT, .src = 1, .size = 8},
+      {.op = QVM_OP_JEQI, .dst = 1, .imm = 0, .target = 6},
+      {.op = QVM_OP_LOAD, .dst = 2, .src = 1, .size = 8, .imm = 0},
+      {.op = QVM_OP_EMIT, .src = 2, .size = 8},
+  };
+  uint8_t out[16];
+  sim_memory mem = {.image = g_image};
+  qvm_state st = {.read = sim_read,
+                  .ctx = &mem,
+                  .out = out,
+                  .out_cap = sizeof(out),
+                  .max_steps = 64,
+                  .max_read_bytes = 64,
+                  .regs = {IMAGE_BASE}};
+  qvm_status status = qvm_run(prog, 6, &st);
+
+  uint64_t emitted[2];
+  memcpy(emitted, out, sizeof(emitted));
+  if (first >= IMAGE_BASE && first - IMAGE_BASE <= IMAGE_SIZE - 8) {
+    uint64_t second = 0;
+    memcpy(&second, g_image + (first - IMAGE_BASE), sizeof(second));
+    CHECK_EQ(status, QVM_OK);
+    CHECK_EQ(st.out_len, 16);
+    CHECK_EQ(emitted[0], first);
+    CHECK_EQ(emitted[1], second);
+  } else {
+    CHECK_EQ(status, QVM_ERR_FAULT);
+    CHECK_EQ(emitted[0], first);
+  }
+}
+
+static int run_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  static uint8_t buf[64 * 1024];
+  size_t n = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+  return LLVMFuzzerTestOneInput(buf, n);
+}
+
+int main(int argc, char **argv) {
+  uint64_t iterations = 200000;
+  uint64_t seed = 1;
+  int files = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      iterations = 20000;
+    } else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = strtoull(argv[++i], NULL, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr,
+              "usage: %s [--quick] [--iterations N] [--seed N] [files...]\n",
+              argv[0]);
+      return 2;
+    } else {
+      if (run_file(argv[i]) != 0) {
+        return 1;
+      }
+      files++;
+    }
+  }
+
+  check_pointer_chase();
+  if (files) {
+    return test_failures("qvm_fuzz");
+  }
+
+  // Random programs: a header plus 1..32 instructions. Opcodes, registers and
+  // targets are drawn from small ranges so most programs verify and run.
+  uint64_t x = seed ? seed : 1;
+  uint64_t verified = 0;
+  uint8_t input[24 + 32 * sizeof(qvm_insn)];
+  for (uint64_t it = 0; it < iterations; it++) {
+    for (size_t i = 0; i < sizeof(input); i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      input[i] = (uint8_t)(x >> 24);
+    }
+    uint32_t count = 1 + (uint32_t)(x % 32);
+    qvm_insn *prog = (qvm_insn *)(input + 24);
+    for (uint32_t pc = 0; pc < count; pc++) {
+      qvm_insn in;
+      memcpy(&in, &prog[pc], sizeof(in));
+      in.op %= QVM_OP_COUNT;
+      in.dst %= QVM_NUM_REGS;
+      in.src %= QVM_NUM_REGS;
+      in.size = (uint8_t)(1u << (in.size % 4));
+      // Forward branches (backward for the loop) in 7 of 8 programs.
+      if ((x & 7) != 0 && qvm_is_branch(in.op)) {
+        in.target = in.op == QVM_OP_LOOP ? in.target % (pc + 1)
+                                         : pc + 1 + in.target % (count - pc);
+      } else {
+        in.target %= count + 1;
+      }
+      if (in.op == QVM_OP_EMITMEM || in.op == QVM_OP_STRIP) {
+        in.imm = 1 + in.imm % 55;
+      } else if (in.op == QVM_OP_LOAD || in.op == QVM_OP_ADDI) {
+        in.imm %= 0x100;
+      }
+      memcpy(&prog[pc], &in, sizeof(in));
+    }
+    qvm_insn copy[32];
+    memcpy(copy, prog, count * sizeof(qvm_insn));
+    verified += qvm_verify(copy, count) == QVM_OK;
+    LLVMFuzzerTestOneInput(input, 24 + count * sizeof(qvm_insn));
+  }
+  printf("%llu random programs, %llu verified\n",
+         (unsigned long long)iterations, (unsigned long long)verified);
+  CHECK(verified > 0);
+  return test_failures("qvm_fuzz");
+}
+
+#endif // PANDORA_LIBFUZZER
@@ -0,0 +1,136 @@
+// Exercises read_window_run() against an in-process kext that fills a fake
+// shared window from a fake kernel image, the way the kread_window selector
+// fills the mapped window for pandora_read_direct().
+
+#include "kernel/read_window.h"
+#include "test_util.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FAKE_BASE 0xfffffe0007000000ull
+#define FAKE_SIZE (4 * 1024 * 1024)
+#define MAX_WINDOW (1024 * 1024)
+
+typedef struct {
+  uint8_t *image;
+  uint8_t window[MAX_WINDOW];
+  size_t window_size;
+  uint32_t calls;
+  uint32_t fail_on_call; // 1-based; 0 never fails
+  uint64_t last_kaddr;
+} fake_kext;
+
+static int fake_fill(void *ctx, uint64_t kaddr, size_t len) {
+  fake_kext *k = ctx;
+  k->calls++;
+  // Chunks never exceed the window and walk the range in order.
+  CHECK(len > 0 && len <= k->window_size);
+  CHECK(k->calls == 1 || kaddr > k->last_kaddr);
+  k->last_kaddr = kaddr;
+  if (k->fail_on_call && k->calls == k->fail_on_call) {
+    return 0x10000003; // any nonzero error is passed back as is
+  }
+  if (kaddr < FAKE_BASE || kaddr - FAKE_BASE > FAKE_SIZE ||
+      len > FAKE_SIZE - (kaddr - FAKE_BASE)) {
+    return 1;
+  }
+  memcpy(k->window, k->image + (kaddr - FAKE_BASE), len);
+  return 0;
+}
+
+static void reset(fake_kext *k, size_t window_size) {
+  k->window_size = window_size;
+  k->calls = 0;
+  k->fail_on_call = 0;
+  k->last_kaddr = 0;
+  memset(k->window, 0xEE, sizeof(k->window));
+}
+
+static void test_chunking(fake_kext *k, uint8_t *out) {
+  static const struct {
+    size_t window;
+    uint64_t offset;
+    size_t len;
+    uint32_t calls;
+  } kCases[] = {
+      {MAX_WINDOW, 0, READ_WINDOW_THRESHOLD, 1},
+      {MAX_WINDOW, 0x123, MAX_WINDOW, 1},
+      {MAX_WINDOW, 0x4000, MAX_WINDOW + 1, 2},
+      {MAX_WINDOW, 7, 2 * MAX_WINDOW + MAX_WINDOW / 2, 3},
+      {48 * 1024, 0x10, 100 * 1024, 3}, // a window that is not a power of 2
+      {16 * 1024, 0, 16 * 1024 * 3, 3},
+  };
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+    reset(k, kCases[i].window);
+    memset(out, 0, kCases[i].len + 16);
+    CHECK_EQ(read_window_run(fake_fill, k, k->window, k->window_size,
+                             FAKE_BASE + kCases[i].offset, out, kCases[i].len),
+             0);
+    CHECK_EQ(k->calls, kCases[i].calls);
+    CHECK(memcmp(out, k->image + kCases[i].offset, kCases[i].len) == 0);
+    CHECK_EQ(out[kCases[i].len], 0); // nothing written past the end
+  }
+
+  // An empty read makes no calls.
+  reset(k, MAX_WINDOW);
+  CHECK_EQ(read_window_run(fake_fill, k, k->window, k->window_size, FAKE_BASE,
+                           out, 0),
+           0);
+  CHECK_EQ(k->calls, 0);
+}
+
+static void test_failure(fake_kext *k, uint8_t *out) {
+  // The second chunk fails: its error comes back, the first chunk is in
+  // place and nothing more is requested.
+  reset(k, 64 * 1024);
+  k->fail_on_call = 2;
+  memset(out, 0, 256 * 1024);
+  CHECK_EQ(read_window_run(fake_fill, k, k->window, k->window_size, FAKE_BASE,
+                           out, 256 * 1024),
+           0x10000003);
+  CHECK_EQ(k->calls, 2);
+  CHECK(memcmp(out, k->image, 64 * 1024) == 0);
+  CHECK_EQ(out[64 * 1024], 0);
+
+  // Running off the end of the image fails on the chunk that does.
+  reset(k, MAX_WINDOW);
+  CHECK(read_window_run(fake_fill, k, k->window, k->window_size,
+                        FAKE_BASE + FAKE_SIZE - MAX_WINDOW, out,
+                        MAX_WINDOW + 1) != 0);
+  CHECK_EQ(k->calls, 2);
+
+  CHECK_EQ(read_window_run(NULL, k, k->window, MAX_WINDOW, FAKE_BASE, out, 1),
+           -1);
+  CHECK_EQ(read_window_run(fake_fill, k, k->window, 0, FAKE_BASE, out, 1), -1);
+  CHECK_EQ(read_window_run(fake_fill, k, NULL, MAX_WINDOW, FAKE_BASE, out, 1),
+           -1);
+}
+
+static void test_routing(void) {
+  CHECK(!read_window_wanted(0, 16 * 1024 * 1024)); // no window mapped
+  CHECK(!read_window_wanted(MAX_WINDOW, READ_WINDOW_THRESHOLD - 1));
+  CHECK(read_window_wanted(MAX_WINDOW, READ_WINDOW_THRESHOLD));
+  CHECK(read_window_wanted(16 * 1024, 16 * 1024 * 1024));
+}
+
+int main(void) {
+  static fake_kext k;
+  k.image = malloc(FAKE_SIZE);
+  uint8_t *out = malloc(FAKE_SIZE + 16);
+  if (!k.image || !out) {
+    return 1;
+  }
+  for (size_t i = 0; i < FAKE_SIZE; i++) {
+    k.image[i] = (uint8_t)(i * 131 + (i >> 12));
+  }
+
+  test_routing();
+  test_chunking(&k, out);
+  test_failure(&k, out);
+
+  free(k.image);
+  free(out);
+  return test_failures("read_window_test");
+}
@@ -0,0 +1,193 @@
+// Exercises readv_run() against an in-process transport that serves reads
+// from a fake kernel image, the same way the kext serves a kreadv batch.
+
+#include "kernel/readv.h"
+#include "test_util.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define FAKE_BASE 0xfffffe0007000000ull
+#define FAKE_SIZE (64 * 1024)
+// Reads touching this page fail, like an unmapped kernel page.
+#define FAKE_HOLE (FAKE_BASE + 0x4000)
+#define FAKE_HOLE_SIZE 0x4000
+
+typedef struct {
+  uint8_t image[FAKE_SIZE];
+  uint32_t calls;
+  uint32_t max_batch;
+  uint32_t fail_on_call; // 1-based; 0 never fails
+} fake_kernel;
+
+static int fake_transport(void *ctx, const readv_desc *descs, uint32_t count,
+                          void *buf, size_t buf_len, int32_t *statuses) {
+  fake_kernel *k = ctx;
+  k->calls++;
+  if (count > k->max_batch) {
+    k->max_batch = count;
+  }
+  if (k->fail_on_call && k->calls == k->fail_on_call) {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const readv_desc *d = &descs[i];
+    // readv_run only forwards validated descriptors.
+    CHECK_EQ(readv_check_desc(d, buf_len), READV_STATUS_SUCCESS);
+
+    if (d->kaddr < FAKE_BASE || d->kaddr - FAKE_BASE > FAKE_SIZE ||
+        d->len > FAKE_SIZE - (d->kaddr - FAKE_BASE) ||
+        (d->kaddr < FAKE_HOLE + FAKE_HOLE_SIZE &&
+         d->kaddr + d->len > FAKE_HOLE)) {
+      statuses[i] = (int32_t)0xe00002c0; // kIOReturnVMError
+      continue;
+    }
+    memcpy((uint8_t *)buf + d->offset, k->image + (d->kaddr - FAKE_BASE),
+           d->len);
+    statuses[i] = READV_STATUS_SUCCESS;
+  }
+  return 0;
+}
+
+static void fake_init(fake_kernel *k) {
+  memset(k, 0, sizeof(*k));
+  for (size_t i = 0; i < FAKE_SIZE; i++) {
+    k->image[i] = (uint8_t)(i * 7 + (i >> 8));
+  }
+}
+
+static void test_gather(fake_kernel *k) {
+  uint8_t buf[256] = {0};
+  readv_desc descs[] = {
+      {FAKE_BASE + 0x10, 16, 0},
+      {FAKE_BASE + 0x8000, 32, 16},
+      {FAKE_BASE + 0xfff0, 16, 48},
+  };
+  int32_t statuses[3];
+  size_t failed = 99;
+
+  CHECK_EQ(readv_run(fake_transport, k, descs, 3, buf, sizeof(buf), statuses,
+                     &failed),
+           0);
+  CHECK_EQ(failed, 0);
+  CHECK_EQ(k->calls, 1);
+  for (int i = 0; i < 3; i++) {
+    CHECK_EQ(statuses[i], READV_STATUS_SUCCESS);
+    CHECK(memcmp(buf + descs[i].offset,
+                 k->image + (descs[i].kaddr - FAKE_BASE), descs[i].len) == 0);
+  }
+}
+
+static void test_invalid_answered_locally(fake_kernel *k) {
+  uint8_t buf[64];
+  readv_desc descs[] = {
+      {0, 8, 0},                    // null address
+      {FAKE_BASE, 0, 0},            // empty
+      {FAKE_BASE, 8, 60},           // runs past the buffer
+      {FAKE_BASE, 8, UINT32_MAX},   // offset past the buffer
+      {FAKE_BASE + 0x100, 8, 8},    // valid
+      {FAKE_HOLE + 0x10, 8, 16},    // valid, faults in the transport
+  };
+  int32_t statuses[6];
+  size_t failed = 0;
+
+  CHECK_EQ(readv_run(fake_transport, k, descs, 6, buf, sizeof(buf), statuses,
+                     &failed),
+           0);
+  CHECK_EQ(k->calls, 1);
+  CHECK_EQ(k->max_batch, 2); // only the two valid descriptors were sent
+  for (int i = 0; i < 4; i++) {
+    CHECK_EQ(statuses[i], READV_STATUS_BAD_ARGUMENT);
+  }
+  CHECK_EQ(statuses[4], READV_STATUS_SUCCESS);
+  CHECK(statuses[5] != READV_STATUS_SUCCESS);
+  CHECK_EQ(failed, 5);
+  CHECK(memcmp(buf + 8, k->image + 0x100, 8) == 0);
+}
+
+static void test_batching(fake_kernel *k) {
+  enum { kCount = READV_MAX_BATCH * 2 + 17 };
+  static readv_desc descs[kCount];
+  static int32_t statuses[kCount];
+  static uint8_t buf[kCount * 4];
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    descs[i].kaddr = FAKE_BASE + 0x8000 + i * 4;
+    descs[i].len = 4;
+    descs[i].offset = i * 4;
+  }
+  // One bad descriptor per batch must not shift the others' statuses.
+  descs[3].kaddr = 0;
+  descs[READV_MAX_BATCH + 5].len = 0;
+
+  size_t failed = 0;
+  CHECK_EQ(readv_run(fake_transport, k, descs, kCount, buf, sizeof(buf),
+                     statuses, &failed),
+           0);
+  CHECK_EQ(failed, 2);
+  CHECK_EQ(k->calls, 3);
+  CHECK_EQ(k->max_batch, READV_MAX_BATCH);
+  for (uint32_t i = 0; i < kCount; i++) {
+    if (i == 3 || i == READV_MAX_BATCH + 5) {
+      CHECK_EQ(statuses[i], READV_STATUS_BAD_ARGUMENT);
+      continue;
+    }
+    CHECK_EQ(statuses[i], READV_STATUS_SUCCESS);
+    CHECK(memcmp(buf + i * 4, k->image + 0x8000 + i * 4, 4) == 0);
+  }
+}
+
+static void test_transport_error_aborts_rest(fake_kernel *k) {
+  enum { kCount = READV_MAX_BATCH * 3 };
+  static readv_desc descs[kCount];
+  static int32_t statuses[kCount];
+  static uint8_t buf[kCount];
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    descs[i].kaddr = FAKE_BASE + i;
+    descs[i].len = 1;
+    descs[i].offset = i;
+  }
+  k->fail_on_call = 2;
+
+  size_t failed = 0;
+  CHECK_EQ(readv_run(fake_transport, k, descs, kCount, buf, sizeof(buf),
+                     statuses, &failed),
+           -1);
+  // The failing batch and everything after it is aborted without another
+  // transport call.
+  CHECK_EQ(k->calls, 2);
+  CHECK_EQ(failed, kCount - READV_MAX_BATCH);
+  CHECK_EQ(statuses[0], READV_STATUS_SUCCESS);
+  CHECK_EQ(statuses[READV_MAX_BATCH - 1], READV_STATUS_SUCCESS);
+  CHECK_EQ(statuses[READV_MAX_BATCH], READV_STATUS_ABORTED);
+  CHECK_EQ(statuses[kCount - 1], READV_STATUS_ABORTED);
+}
+
+static void test_bad_arguments(fake_kernel *k) {
+  uint8_t buf[8];
+  readv_desc d = {FAKE_BASE, 8, 0};
+  int32_t status;
+  CHECK_EQ(readv_run(NULL, k, &d, 1, buf, sizeof(buf), &status, NULL), -1);
+  CHECK_EQ(readv_run(fake_transport, k, NULL, 1, buf, sizeof(buf), &status,
+                     NULL),
+           -1);
+  CHECK_EQ(readv_run(fake_transport, k, &d, 0, buf, sizeof(buf), &status,
+                     NULL),
+           -1);
+  CHECK_EQ(k->calls, 0);
+}
+
+int main(void) {
+  static fake_kernel k;
+  void (*tests[])(fake_kernel *) = {
+      test_gather,  test_invalid_answered_locally, test_batching,
+      test_transport_error_aborts_rest, test_bad_arguments,
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    fake_init(&k);
+    tests[i](&k);
+  }
+  return test_failures("readv_test");
+}
@@ -0,0 +1,41 @@
+#ifndef PANDORA_TEST_UTIL_H
+#define PANDORA_TEST_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Minimal assertion helpers for the host tests. A failed CHECK reports the
+// location and bumps the failure count; tests return test_failures() from
+// main so ctest sees a nonzero exit.
+
+static int g_test_failures;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      g_test_failures++;                                                       \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do {                                                                         \
+    unsigned long long check_a_ = (unsigned long long)(a);                     \
+    unsigned long long check_b_ = (unsigned long long)(b);                     \
+    if (check_a_ != check_b_) {                                                \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (0x%llx != 0x%llx)\n", \
+              __FILE__, __LINE__, #a, #b, check_a_, check_b_);                 \
+      g_test_failures++;                                                       \
+    }                                                                          \
+  } while (0)
+
+static inline int test_failures(const char *name) {
+  if (g_test_failures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, g_test_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,203 @@
+// xlate_cache.c against a synthetic page table: VA page i of the test region
+// maps to a PA chosen by fake_pa(), with physically contiguous stretches,
+// breaks and unmapped holes, so every run can be checked and every fill
+// counted.
+
+#include "kernel/xlate_cache.h"
+#include "test_util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PAGE 0x4000ull
+#define BASE 0xfffffe0010000000ull
+#define PHYS 0x800000000ull
+
+typedef struct {
+  uint32_t calls;
+  uint64_t pages;
+  bool scattered;     // every page in its own physical run
+  uint64_t hole;      // page index reported unmapped (0 = none)
+  uint64_t fail_from; // fills asking for this page index or above fail
+  uint8_t attr;       // bumped to change every translation
+} fake_mmu;
+
+static uint64_t page_index(uint64_t va) { return (va - BASE) / PAGE; }
+
+// Contiguous in blocks of 8 pages unless `scattered`; blocks are placed in
+// reverse physical order so neighbours never join across a block boundary.
+static uint64_t fake_pa(const fake_mmu *m, uint64_t i) {
+  if (m->scattered) {
+    return PHYS + (i * 2 + 1) * PAGE;
+  }
+  return PHYS + ((1000 - i / 8) * 8 + i % 8) * PAGE;
+}
+
+static int fake_fill(void *ctx, const uint64_t *vaddrs, uint32_t count,
+                     xlate_page *out) {
+  fake_mmu *m = ctx;
+  m->calls++;
+  m->pages += count;
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t idx = page_index(vaddrs[i]);
+    if (m->fail_from && idx >= m->fail_from) {
+      return -1;
+    }
+    memset(&out[i], 0, sizeof(out[i]));
+    if (m->hole && idx == m->hole) {
+      continue;
+    }
+    out[i].paddr = fake_pa(m, idx) | 0x123; // low bits must be dropped
+    out[i].flags = XLATE_VALID | XLATE_WRITABLE;
+    out[i].attr = m->attr;
+  }
+  return 0;
+}
+
+// Checks that `runs` describe [vaddr, vaddr + covered) exactly, page by page,
+// and that adjacent runs could not have been merged.
+static void check_runs(const fake_mmu *m, uint64_t vaddr, size_t covered,
+                       const xlate_run *runs, uint32_t count) {
+  uint64_t va = vaddr;
+  for (uint32_t r = 0; r < count; r++) {
+    CHECK_EQ(runs[r].vaddr, va);
+    CHECK_EQ(runs[r].attr, m->attr);
+    for (uint64_t off = 0; off < runs[r].len;) {
+      uint64_t cur = runs[r].vaddr + off;
+      uint64_t want = fake_pa(m, page_index(cur)) + (cur & (PAGE - 1));
+      CHECK_EQ(runs[r].paddr + off, want);
+      off += PAGE - (cur & (PAGE - 1));
+    }
+    if (r > 0) {
+      CHECK(runs[r - 1].paddr + runs[r - 1].len != runs[r].paddr);
+    }
+    va += runs[r].len;
+  }
+  CHECK_EQ(va - vaddr, covered);
+}
+
+static void test_basic(void) {
+  fake_mmu m = {0};
+  xlate_cache *xc = xlate_cache_create(64, PAGE, 16, fake_fill, &m);
+  CHECK(xc != NULL);
+
+  xlate_run runs[16];
+  uint32_t n = 0;
+  // Unaligned start and end, spanning several 8-page blocks.
+  uint64_t va = BASE + 3 * PAGE + 0x10;
+  size_t len = 20 * PAGE;
+  CHECK_EQ(xlate_cache_map(xc, va, len, runs, 16, &n), len);
+  check_runs(&m, va, len, runs, n);
+  CHECK_EQ(n, 3); // pages 3-7, 8-15, 16-23
+  CHECK_EQ(m.calls, 2); // two 16-page batches
+
+  // Everything is cached now.
+  uint32_t calls = m.calls;
+  CHECK_EQ(xlate_cache_map(xc, va, len, runs, 16, &n), len);
+  check_runs(&m, va, len, runs, n);
+  CHECK_EQ(m.calls, calls);
+
+  xlate_cache_stats st;
+  xlate_cache_get_stats(xc, &st);
+  CHECK_EQ(st.misses, 2);
+  CHECK(st.hits >= 4);
+  CHECK_EQ(st.unmapped_pages, 0);
+
+  // max_runs bounds the result.
+  CHECK_EQ(xlate_cache_map(xc, va, len, runs, 2, &n),
+           (8 - 3) * PAGE - 0x10 + 8 * PAGE);
+  CHECK_EQ(n, 2);
+
+  // Stale translations are dropped by invalidate and refetched.
+  m.attr = 7;
+  xlate_cache_invalidate(xc, BASE + 8 * PAGE, PAGE);
+  CHECK_EQ(xlate_cache_map(xc, BASE + 8 * PAGE, 8 * PAGE, runs, 16, &n),
+           8 * PAGE);
+  check_runs(&m, BASE + 8 * PAGE, 8 * PAGE, runs, n);
+  xlate_cache_flush(xc);
+  CHECK_EQ(xlate_cache_map(xc, va, len, runs, 16, &n), len);
+  check_runs(&m, va, len, runs, n);
+
+  xlate_cache_destroy(xc);
+}
+
+static void test_unmapped_and_failure(void) {
+  fake_mmu m = {.hole = 10};
+  xlate_cache *xc = xlate_cache_create(64, PAGE, 32, fake_fill, &m);
+  xlate_run runs[8];
+  uint32_t n = 0;
+
+  // Stops at the hole and does not cache it.
+  CHECK_EQ(xlate_cache_map(xc, BASE, 16 * PAGE, runs, 8, &n), 10 * PAGE);
+  check_runs(&m, BASE, 10 * PAGE, runs, n);
+  CHECK_EQ(xlate_cache_map(xc, BASE + 10 * PAGE, PAGE, runs, 8, &n), 0);
+  CHECK_EQ(n, 0);
+  // Pages past the hole were translated in the same batch and are cached.
+  uint32_t calls = m.calls;
+  CHECK_EQ(xlate_cache_map(xc, BASE + 11 * PAGE, 5 * PAGE, runs, 8, &n),
+           5 * PAGE);
+  CHECK_EQ(m.calls, calls);
+
+  // A failing fill returns what was covered before it: nothing when the
+  // first batch already fails, the earlier batches otherwise.
+  m.fail_from = 40;
+  CHECK_EQ(xlate_cache_map(xc, BASE + 32 * PAGE, 16 * PAGE, runs, 8, &n),
+           0);
+  m.hole = 0;
+  xlate_cache *small = xlate_cache_create(64, PAGE, 4, fake_fill, &m);
+  CHECK_EQ(xlate_cache_map(small, BASE + 32 * PAGE, 16 * PAGE, runs, 8, &n),
+           8 * PAGE);
+  check_runs(&m, BASE + 32 * PAGE, 8 * PAGE, runs, n);
+
+  xlate_cache_destroy(small);
+  xlate_cache_destroy(xc);
+}
+
+// Regression: with fewer cache slots than pages in a batch, inserting the
+// batch evicted the run that was just filled for `va`, and the lookup after
+// the fill came back empty. Misses are now served from the fill reply.
+static void test_fill_survives_eviction(void) {
+  fake_mmu m = {.scattered = true};
+  xlate_run runs[64];
+  uint32_t n = 0;
+
+  static const uint32_t kCapacity[] = {1, 2, 3, 15};
+  for (size_t c = 0; c < sizeof(kCapacity) / sizeof(kCapacity[0]); c++) {
+    m.calls = 0;
+    xlate_cache *xc = xlate_cache_create(kCapacity[c], PAGE, 16, fake_fill, &m);
+    CHECK(xc != NULL);
+
+    CHECK_EQ(xlate_cache_map(xc, BASE, 48 * PAGE, runs, 64, &n), 48 * PAGE);
+    CHECK_EQ(n, 48);
+    check_runs(&m, BASE, 48 * PAGE, runs, n);
+    // One batch per 16 pages, however few runs stay cached.
+    CHECK_EQ(m.calls, 48 / 16);
+
+    xlate_cache_stats st;
+    xlate_cache_get_stats(xc, &st);
+    CHECK(st.evictions > 0);
+
+    // Whatever survived in the cache is still correct.
+    CHECK_EQ(xlate_cache_map(xc, BASE + 47 * PAGE, PAGE, runs, 64, &n), PAGE);
+    check_runs(&m, BASE + 47 * PAGE, PAGE, runs, n);
+    xlate_cache_destroy(xc);
+  }
+
+  // Contiguous pages filled in one batch still come back as one run.
+  fake_mmu flat = {0};
+  xlate_cache *xc = xlate_cache_create(1, PAGE, 8, fake_fill, &flat);
+  CHECK_EQ(xlate_cache_map(xc, BASE, 8 * PAGE, runs, 64, &n), 8 * PAGE);
+  CHECK_EQ(n, 1);
+  CHECK_EQ(flat.calls, 1);
+  xlate_cache_destroy(xc);
+}
+
+int main(void) {
+  CHECK(xlate_cache_create(4, 3000, 4, fake_fill, NULL) == NULL);
+  CHECK(xlate_cache_create(0, PAGE, 4, fake_fill, NULL) == NULL);
+  test_basic();
+  test_unmapped_and_failure();
+  test_fill_survives_eviction();
+  return test_failures("xlate_cache_test");
+}